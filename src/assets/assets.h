@@ -18,6 +18,8 @@
 #include "kangaroo_twelve.h"
 #include "four_q.h"
 #include "common_buffers.h"
+#include "digest_tree.h"
+#include "snapshot_delta.h"
 
 
 // CAUTION: Currently, there is no locking of universeLock if contracts use the QPI asset iteration classes directly.
@@ -33,7 +35,18 @@ GLOBAL_VAR_DECL volatile char universeLock GLOBAL_VAR_INIT(0);
 GLOBAL_VAR_DECL AssetRecord* assets GLOBAL_VAR_INIT(nullptr);
 GLOBAL_VAR_DECL m256i* assetDigests GLOBAL_VAR_INIT(nullptr);
 static constexpr unsigned long long assetDigestsSizeInBytes = (ASSETS_CAPACITY * 2 - 1) * 32ULL;
+// Change tracking for incremental update of assetDigests (see getUniverseDigest()). One flag bit per record that has
+// been changed since the last digest update. During the update, the same bits are used for flagging changed nodes of
+// each level of the digest tree.
 GLOBAL_VAR_DECL unsigned long long* assetChangeFlags GLOBAL_VAR_INIT(nullptr);
+// Indices of records changed since last digest update (without duplicates). If more records are changed than fit
+// into the list, assetChangeListOverflow is set and the update falls back to scanning assetChangeFlags.
+static constexpr unsigned int ASSETS_CHANGE_LIST_CAPACITY = 65536;
+GLOBAL_VAR_DECL unsigned int assetChangeList[ASSETS_CHANGE_LIST_CAPACITY];
+GLOBAL_VAR_DECL unsigned int assetChangeListSize GLOBAL_VAR_INIT(0);
+GLOBAL_VAR_DECL bool assetChangeListOverflow GLOBAL_VAR_INIT(false);
+// Records changed since the last base snapshot of the node states, updated together with assetDigests
+GLOBAL_VAR_DECL SnapshotDeltaTracker universeSnapshotDelta;
 static constexpr char CONTRACT_ASSET_UNIT_OF_MEASUREMENT[7] = { 0, 0, 0, 0, 0, 0, 0 };
 
 static constexpr unsigned int NO_ASSET_INDEX = 0xffffffff;
@@ -56,6 +69,7 @@ public: // TODO: make protected
     // - all issuances,
     // - all ownerships belonging to each issuance
     // - all possessions belonging to each ownership
+    // and hash index of all ownerships and possessions by (issuance / ownership index, public key, managing contract)
     struct IndexLists
     {
         unsigned int issuancesFirstIdx;
@@ -63,6 +77,89 @@ public: // TODO: make protected
 
         unsigned int nextIdx[ASSETS_CAPACITY];
 
+        // Open addressing hash table with load factor <= 0.75 (reached if the universe is full). Each slot contains the
+        // index of an ownership or possession record in the lower 24 bits and 8 bits of its hash in the upper bits, so
+        // most records that don't match are skipped without reading them. The capacity is not a power of 2 in order to
+        // limit the memory cost to 4/3 * ASSETS_CAPACITY * 4 bytes (about 85 MB with ASSETS_DEPTH 24, instead of 128 MB
+        // with the next power of 2).
+        static constexpr unsigned int hashIdxCapacity = ASSETS_CAPACITY / 3 * 4;
+        static constexpr unsigned int EMPTY_HASH_SLOT = 0xffffffff;
+        static_assert(ASSETS_CAPACITY <= (1 << 24), "Hash index slots store record indices with 24 bits");
+        unsigned int ownershipsPossessionsHashIdx[hashIdxCapacity];
+
+        static unsigned long long recordHash(unsigned int parentIdx, const m256i& publicKey, unsigned short managingContractIndex)
+        {
+            return (publicKey.m256i_u64[0] ^ (publicKey.m256i_u64[1] * 0xC2B2AE3D27D4EB4FULL) ^ ((unsigned long long)parentIdx << 16) ^ managingContractIndex) * 0x9E3779B97F4A7C15ULL;
+        }
+
+        // Map upper 32 bits of hash to [0, hashIdxCapacity) with a multiplication instead of a division
+        static unsigned int hashSlot(unsigned long long hash)
+        {
+            return (unsigned int)(((hash >> 32) * hashIdxCapacity) >> 32);
+        }
+
+        static unsigned int nextHashSlot(unsigned int slot)
+        {
+            return (slot + 1 < hashIdxCapacity) ? slot + 1 : 0;
+        }
+
+        static unsigned int hashTag(unsigned long long hash)
+        {
+            // 0xff is reserved for EMPTY_HASH_SLOT
+            const unsigned int tag = (unsigned int)(hash >> 24) & 0xff;
+            return ((tag == 0xff) ? 0xfe : tag) << 24;
+        }
+
+        // Add ownership or possession record to the hash index
+        void addToHashIndex(unsigned int recordIdx)
+        {
+            ASSERT(recordIdx < ASSETS_CAPACITY);
+            const auto& record = assets[recordIdx].varStruct;
+            ASSERT(record.ownership.type == OWNERSHIP || record.possession.type == POSSESSION);
+            const unsigned int parentIdx = (record.ownership.type == OWNERSHIP) ? record.ownership.issuanceIndex : record.possession.ownershipIndex;
+            const unsigned long long hash = recordHash(parentIdx, record.ownership.publicKey, record.ownership.managingContractIndex);
+            unsigned int slot = hashSlot(hash);
+            while (ownershipsPossessionsHashIdx[slot] != EMPTY_HASH_SLOT)
+            {
+                slot = nextHashSlot(slot);
+            }
+            ownershipsPossessionsHashIdx[slot] = hashTag(hash) | recordIdx;
+        }
+
+        // Return index of ownership or possession record (given by type) with parent record parentIdx, publicKey, and
+        // managingContractIndex, or NO_ASSET_INDEX if not found.
+        unsigned int findRecord(unsigned char type, unsigned int parentIdx, const m256i& publicKey, unsigned short managingContractIndex) const
+        {
+            const unsigned long long hash = recordHash(parentIdx, publicKey, managingContractIndex);
+            const unsigned int tag = hashTag(hash);
+            for (unsigned int slot = hashSlot(hash); ownershipsPossessionsHashIdx[slot] != EMPTY_HASH_SLOT; slot = nextHashSlot(slot))
+            {
+                if ((ownershipsPossessionsHashIdx[slot] & 0xff000000) == tag)
+                {
+                    const unsigned int recordIdx = ownershipsPossessionsHashIdx[slot] & 0xffffff;
+                    const auto& record = assets[recordIdx].varStruct;
+                    if (record.ownership.type == type
+                        && ((type == OWNERSHIP) ? record.ownership.issuanceIndex : record.possession.ownershipIndex) == parentIdx
+                        && record.ownership.managingContractIndex == managingContractIndex
+                        && record.ownership.publicKey == publicKey)
+                    {
+                        return recordIdx;
+                    }
+                }
+            }
+            return NO_ASSET_INDEX;
+        }
+
+        unsigned int findOwnership(unsigned int issuanceIdx, const m256i& owner, unsigned short managingContractIndex) const
+        {
+            return findRecord(OWNERSHIP, issuanceIdx, owner, managingContractIndex);
+        }
+
+        unsigned int findPossession(unsigned int ownershipIdx, const m256i& possessor, unsigned short managingContractIndex) const
+        {
+            return findRecord(POSSESSION, ownershipIdx, possessor, managingContractIndex);
+        }
+
         void addIssuance(unsigned int newIssuanceIdx)
         {
             // add as first element in linked list of all issuances
@@ -83,6 +180,7 @@ public: // TODO: make protected
             ASSERT(ownershipsPossessionsFirstIdx[issuanceIdx] == NO_ASSET_INDEX || assets[ownershipsPossessionsFirstIdx[issuanceIdx]].varStruct.issuance.type == OWNERSHIP);
             nextIdx[newOwnershipIdx] = ownershipsPossessionsFirstIdx[issuanceIdx];
             ownershipsPossessionsFirstIdx[issuanceIdx] = newOwnershipIdx;
+            addToHashIndex(newOwnershipIdx);
         }
 
         // Add newPossessionIdx as first element in linked list of all possessions of ownershipIdx
@@ -95,18 +193,21 @@ public: // TODO: make protected
             ASSERT(ownershipsPossessionsFirstIdx[ownershipIdx] == NO_ASSET_INDEX || assets[ownershipsPossessionsFirstIdx[ownershipIdx]].varStruct.possession.type == POSSESSION);
             nextIdx[newPossessionIdx] = ownershipsPossessionsFirstIdx[ownershipIdx];
             ownershipsPossessionsFirstIdx[ownershipIdx] = newPossessionIdx;
+            addToHashIndex(newPossessionIdx);
         }
 
-        // Reset lists to empty
+        // Reset lists and hash index to empty
         void reset()
         {
             issuancesFirstIdx = NO_ASSET_INDEX;
             static_assert(NO_ASSET_INDEX == 0xffffffff, "Following setMem() expects NO_ASSET_INDEX == 0xffffffff");
             setMem(ownershipsPossessionsFirstIdx, sizeof(ownershipsPossessionsFirstIdx), 0xff);
             setMem(nextIdx, sizeof(nextIdx), 0xff);
+            static_assert(EMPTY_HASH_SLOT == 0xffffffff, "Following setMem() expects EMPTY_HASH_SLOT == 0xffffffff");
+            setMem(ownershipsPossessionsHashIdx, sizeof(ownershipsPossessionsHashIdx), 0xff);
         }
 
-        // Rebuild lists from assets array (includes reset)
+        // Rebuild lists and hash index from assets array (includes reset)
         void rebuild()
         {
             PROFILE_SCOPE();
@@ -159,10 +260,84 @@ static unsigned int issuanceIndex(const m256i& issuer, unsigned long long assetN
     return NO_ASSET_INDEX;
 }
 
+// Return index of first empty slot in the probe sequence of publicKey.
+static unsigned int emptyAssetSlot(const m256i& publicKey)
+{
+    unsigned int idx = publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
+    while (assets[idx].varStruct.issuance.type != EMPTY)
+    {
+        idx = (idx + 1) & (ASSETS_CAPACITY - 1);
+    }
+    return idx;
+}
+
+// Return index of ownership record (issuanceIdx, owner, managingContractIndex) or, if there is none, of the empty slot
+// to insert it at. This is the slot at which probing from the start index of owner would stop, because records are
+// only removed when rebuilding the universe, so there is no empty slot in the probe sequence before an existing record.
+static unsigned int ownershipSlot(unsigned int issuanceIdx, const m256i& owner, unsigned short managingContractIndex)
+{
+    const unsigned int idx = as.indexLists.findOwnership(issuanceIdx, owner, managingContractIndex);
+    return (idx != NO_ASSET_INDEX) ? idx : emptyAssetSlot(owner);
+}
+
+// Return index of possession record (ownershipIdx, possessor, managingContractIndex) or, if there is none, of the
+// empty slot to insert it at (see ownershipSlot()).
+static unsigned int possessionSlot(unsigned int ownershipIdx, const m256i& possessor, unsigned short managingContractIndex)
+{
+    const unsigned int idx = as.indexLists.findPossession(ownershipIdx, possessor, managingContractIndex);
+    return (idx != NO_ASSET_INDEX) ? idx : emptyAssetSlot(possessor);
+}
+
 
 
 
 
+// Mark record as changed, so its digest is updated by next call of getUniverseDigest(). Caller must hold universeLock
+// or be the only processor writing the universe.
+static void markUniverseRecordChanged(unsigned int index)
+{
+    unsigned long long& flags = assetChangeFlags[index >> 6];
+    const unsigned long long flag = 1ULL << (index & 63);
+    if (!(flags & flag))
+    {
+        flags |= flag;
+        if (assetChangeListSize < ASSETS_CHANGE_LIST_CAPACITY)
+        {
+            assetChangeList[assetChangeListSize++] = index;
+        }
+        else
+        {
+            assetChangeListOverflow = true;
+        }
+    }
+}
+
+// Mark all records as changed, for example after the universe has been replaced as a whole.
+static void markAllUniverseRecordsChanged()
+{
+    setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0xFF);
+    assetChangeListSize = 0;
+    assetChangeListOverflow = true;
+}
+
+// Forget all tracked changes, for example because the digests have been loaded together with the universe.
+static void clearUniverseChanges()
+{
+    if (assetChangeListOverflow)
+    {
+        setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0);
+    }
+    else
+    {
+        for (unsigned int i = 0; i < assetChangeListSize; i++)
+        {
+            assetChangeFlags[assetChangeList[i] >> 6] = 0;
+        }
+    }
+    assetChangeListSize = 0;
+    assetChangeListOverflow = false;
+}
+
 static bool initAssets()
 {
     if (!allocPoolWithErrorLog(L"assets", ASSETS_CAPACITY * sizeof(AssetRecord), (void**)&assets, __LINE__)
@@ -171,12 +346,13 @@ static bool initAssets()
     {
         return false;
     }
-    setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0xFF);
-    return true;
+    markAllUniverseRecordsChanged();
+    return universeSnapshotDelta.init(universeSizeInBytes, sizeof(AssetRecord));
 }
 
 static void deinitAssets()
 {
+    universeSnapshotDelta.deinit();
     if (assetChangeFlags)
     {
         freePool(assetChangeFlags);
@@ -232,9 +408,9 @@ iteration:
                 assets[*possessionIndex].varStruct.possession.ownershipIndex = *ownershipIndex;
                 assets[*possessionIndex].varStruct.possession.numberOfShares = numberOfShares;
 
-                assetChangeFlags[*issuanceIndex >> 6] |= (1ULL << (*issuanceIndex & 63));
-                assetChangeFlags[*ownershipIndex >> 6] |= (1ULL << (*ownershipIndex & 63));
-                assetChangeFlags[*possessionIndex >> 6] |= (1ULL << (*possessionIndex & 63));
+                markUniverseRecordChanged(*issuanceIndex);
+                markUniverseRecordChanged(*ownershipIndex);
+                markUniverseRecordChanged(*possessionIndex);
 
                 as.indexLists.addIssuance(*issuanceIndex);
                 as.indexLists.addOwnership(*issuanceIndex, *ownershipIndex);
@@ -351,105 +527,75 @@ static bool transferShareManagementRights(int sourceOwnershipIndex, int sourcePo
     const m256i& possessionPublicKey = assets[sourcePossessionIndex].varStruct.possession.publicKey;
     const int issuanceIndex = assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex;
 
-    int destinationOwnershipIndex = ownershipPublicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-iteration:
-    if (assets[destinationOwnershipIndex].varStruct.ownership.type == EMPTY
-        || (assets[destinationOwnershipIndex].varStruct.ownership.type == OWNERSHIP
-            && assets[destinationOwnershipIndex].varStruct.ownership.managingContractIndex == destinationOwnershipManagingContractIndex
-            && assets[destinationOwnershipIndex].varStruct.ownership.issuanceIndex == issuanceIndex
-            && assets[destinationOwnershipIndex].varStruct.ownership.publicKey == ownershipPublicKey))
-    {
-        // found empty slot for ownership record or existing record to update
-        assets[sourceOwnershipIndex].varStruct.ownership.numberOfShares -= numberOfShares;
-
-        if (assets[destinationOwnershipIndex].varStruct.ownership.type == EMPTY)
-        {
-            assets[destinationOwnershipIndex].varStruct.ownership.publicKey = ownershipPublicKey;
-            assets[destinationOwnershipIndex].varStruct.ownership.type = OWNERSHIP;
-            assets[destinationOwnershipIndex].varStruct.ownership.managingContractIndex = destinationOwnershipManagingContractIndex;
-            assets[destinationOwnershipIndex].varStruct.ownership.issuanceIndex = issuanceIndex;
-
-            as.indexLists.addOwnership(issuanceIndex, destinationOwnershipIndex);
-        }
-        assets[destinationOwnershipIndex].varStruct.ownership.numberOfShares += numberOfShares;
+    // Find existing ownership record to update or empty slot for new record
+    const int destinationOwnershipIndex = ownershipSlot(issuanceIndex, ownershipPublicKey, destinationOwnershipManagingContractIndex);
+    assets[sourceOwnershipIndex].varStruct.ownership.numberOfShares -= numberOfShares;
 
-        int destinationPossessionIndex = possessionPublicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-    iteration2:
-        if (assets[destinationPossessionIndex].varStruct.possession.type == EMPTY
-            || (assets[destinationPossessionIndex].varStruct.possession.type == POSSESSION
-                && assets[destinationPossessionIndex].varStruct.possession.managingContractIndex == destinationPossessionManagingContractIndex
-                && assets[destinationPossessionIndex].varStruct.possession.ownershipIndex == destinationOwnershipIndex
-                && assets[destinationPossessionIndex].varStruct.possession.publicKey == possessionPublicKey))
-        {
-            // found empty slot for poss possession or existing record to update
-            assets[sourcePossessionIndex].varStruct.possession.numberOfShares -= numberOfShares;
+    if (assets[destinationOwnershipIndex].varStruct.ownership.type == EMPTY)
+    {
+        assets[destinationOwnershipIndex].varStruct.ownership.publicKey = ownershipPublicKey;
+        assets[destinationOwnershipIndex].varStruct.ownership.type = OWNERSHIP;
+        assets[destinationOwnershipIndex].varStruct.ownership.managingContractIndex = destinationOwnershipManagingContractIndex;
+        assets[destinationOwnershipIndex].varStruct.ownership.issuanceIndex = issuanceIndex;
 
-            if (assets[destinationPossessionIndex].varStruct.possession.type == EMPTY)
-            {
-                assets[destinationPossessionIndex].varStruct.possession.publicKey = possessionPublicKey;
-                assets[destinationPossessionIndex].varStruct.possession.type = POSSESSION;
-                assets[destinationPossessionIndex].varStruct.possession.managingContractIndex = destinationPossessionManagingContractIndex;
-                assets[destinationPossessionIndex].varStruct.possession.ownershipIndex = destinationOwnershipIndex;
+        as.indexLists.addOwnership(issuanceIndex, destinationOwnershipIndex);
+    }
+    assets[destinationOwnershipIndex].varStruct.ownership.numberOfShares += numberOfShares;
 
-                as.indexLists.addPossession(destinationOwnershipIndex, destinationPossessionIndex);
-            }
-            assets[destinationPossessionIndex].varStruct.possession.numberOfShares += numberOfShares;
+    // Find existing possession record to update or empty slot for new record
+    const int destinationPossessionIndex = possessionSlot(destinationOwnershipIndex, possessionPublicKey, destinationPossessionManagingContractIndex);
+    assets[sourcePossessionIndex].varStruct.possession.numberOfShares -= numberOfShares;
 
-            assetChangeFlags[sourceOwnershipIndex >> 6] |= (1ULL << (sourceOwnershipIndex & 63));
-            assetChangeFlags[sourcePossessionIndex >> 6] |= (1ULL << (sourcePossessionIndex & 63));
-            assetChangeFlags[destinationOwnershipIndex >> 6] |= (1ULL << (destinationOwnershipIndex & 63));
-            assetChangeFlags[destinationPossessionIndex >> 6] |= (1ULL << (destinationPossessionIndex & 63));
+    if (assets[destinationPossessionIndex].varStruct.possession.type == EMPTY)
+    {
+        assets[destinationPossessionIndex].varStruct.possession.publicKey = possessionPublicKey;
+        assets[destinationPossessionIndex].varStruct.possession.type = POSSESSION;
+        assets[destinationPossessionIndex].varStruct.possession.managingContractIndex = destinationPossessionManagingContractIndex;
+        assets[destinationPossessionIndex].varStruct.possession.ownershipIndex = destinationOwnershipIndex;
 
-            if (lock)
-            {
-                RELEASE(universeLock);
-            }
+        as.indexLists.addPossession(destinationOwnershipIndex, destinationPossessionIndex);
+    }
+    assets[destinationPossessionIndex].varStruct.possession.numberOfShares += numberOfShares;
 
-            AssetOwnershipManagingContractChange logOM;
-            logOM.ownershipPublicKey = ownershipPublicKey;
-            logOM.issuerPublicKey = assets[issuanceIndex].varStruct.issuance.publicKey;
-            logOM.sourceContractIndex = assets[sourceOwnershipIndex].varStruct.ownership.managingContractIndex;
-            logOM.destinationContractIndex = destinationOwnershipManagingContractIndex;
-            logOM.numberOfShares = numberOfShares;
-            *((unsigned long long*) & logOM.assetName) = *((unsigned long long*) & assets[issuanceIndex].varStruct.issuance.name); // possible with 7 byte array, because it is followed by memory reserved for terminator byte
-            logger.logAssetOwnershipManagingContractChange(logOM);
-
-            AssetPossessionManagingContractChange logPM;
-            logPM.possessionPublicKey = possessionPublicKey;
-            logPM.ownershipPublicKey = ownershipPublicKey;
-            logPM.issuerPublicKey = assets[issuanceIndex].varStruct.issuance.publicKey;
-            logPM.sourceContractIndex = assets[sourcePossessionIndex].varStruct.ownership.managingContractIndex;
-            logPM.destinationContractIndex = destinationPossessionManagingContractIndex;
-            logPM.numberOfShares = numberOfShares;
-            *((unsigned long long*) & logPM.assetName) = *((unsigned long long*) & assets[assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex].varStruct.issuance.name);  // possible with 7 byte array, because it is followed by memory reserved for terminator byte
-            logger.logAssetPossessionManagingContractChange(logPM);
-
-            if (destinationOwnershipIndexPtr)
-            {
-                *destinationOwnershipIndexPtr = destinationOwnershipIndex;
-            }
-            if (destinationPossessionIndexPtr)
-            {
-                *destinationPossessionIndexPtr = destinationPossessionIndex;
-            }
+    markUniverseRecordChanged(sourceOwnershipIndex);
+    markUniverseRecordChanged(sourcePossessionIndex);
+    markUniverseRecordChanged(destinationOwnershipIndex);
+    markUniverseRecordChanged(destinationPossessionIndex);
 
-            return true;
-        }
-        else
-        {
-            // try next slot for finding new possession record
-            destinationPossessionIndex = (destinationPossessionIndex + 1) & (ASSETS_CAPACITY - 1);
+    if (lock)
+    {
+        RELEASE(universeLock);
+    }
 
-            goto iteration2;
-        }
+    AssetOwnershipManagingContractChange logOM;
+    logOM.ownershipPublicKey = ownershipPublicKey;
+    logOM.issuerPublicKey = assets[issuanceIndex].varStruct.issuance.publicKey;
+    logOM.sourceContractIndex = assets[sourceOwnershipIndex].varStruct.ownership.managingContractIndex;
+    logOM.destinationContractIndex = destinationOwnershipManagingContractIndex;
+    logOM.numberOfShares = numberOfShares;
+    *((unsigned long long*) & logOM.assetName) = *((unsigned long long*) & assets[issuanceIndex].varStruct.issuance.name); // possible with 7 byte array, because it is followed by memory reserved for terminator byte
+    logger.logAssetOwnershipManagingContractChange(logOM);
+
+    AssetPossessionManagingContractChange logPM;
+    logPM.possessionPublicKey = possessionPublicKey;
+    logPM.ownershipPublicKey = ownershipPublicKey;
+    logPM.issuerPublicKey = assets[issuanceIndex].varStruct.issuance.publicKey;
+    logPM.sourceContractIndex = assets[sourcePossessionIndex].varStruct.ownership.managingContractIndex;
+    logPM.destinationContractIndex = destinationPossessionManagingContractIndex;
+    logPM.numberOfShares = numberOfShares;
+    *((unsigned long long*) & logPM.assetName) = *((unsigned long long*) & assets[assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex].varStruct.issuance.name);  // possible with 7 byte array, because it is followed by memory reserved for terminator byte
+    logger.logAssetPossessionManagingContractChange(logPM);
+
+    if (destinationOwnershipIndexPtr)
+    {
+        *destinationOwnershipIndexPtr = destinationOwnershipIndex;
     }
-    else
+    if (destinationPossessionIndexPtr)
     {
-        // try next slot for finding new ownership record
-        destinationOwnershipIndex = (destinationOwnershipIndex + 1) & (ASSETS_CAPACITY - 1);
-
-        goto iteration;
+        *destinationPossessionIndexPtr = destinationPossessionIndex;
     }
+
+    return true;
 }
 
 static bool transferShareOwnershipAndPossession(int sourceOwnershipIndex, int sourcePossessionIndex, const m256i& destinationPublicKey, long long numberOfShares,
@@ -503,8 +649,8 @@ static bool transferShareOwnershipAndPossession(int sourceOwnershipIndex, int so
         // Burn by subtracting shares from source records
         assets[sourceOwnershipIndex].varStruct.ownership.numberOfShares -= numberOfShares;
         assets[sourcePossessionIndex].varStruct.possession.numberOfShares -= numberOfShares;
-        assetChangeFlags[sourceOwnershipIndex >> 6] |= (1ULL << (sourceOwnershipIndex & 63));
-        assetChangeFlags[sourcePossessionIndex >> 6] |= (1ULL << (sourcePossessionIndex & 63));
+        markUniverseRecordChanged(sourceOwnershipIndex);
+        markUniverseRecordChanged(sourcePossessionIndex);
 
         if (lock)
         {
@@ -539,95 +685,69 @@ static bool transferShareOwnershipAndPossession(int sourceOwnershipIndex, int so
     // Default case: transfer shares to destinationPublicKey
     ASSERT(destinationOwnershipIndex != nullptr);
     ASSERT(destinationPossessionIndex != nullptr);
-    *destinationOwnershipIndex = destinationPublicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-iteration:
-    if (assets[*destinationOwnershipIndex].varStruct.ownership.type == EMPTY
-        || (assets[*destinationOwnershipIndex].varStruct.ownership.type == OWNERSHIP
-            && assets[*destinationOwnershipIndex].varStruct.ownership.managingContractIndex == assets[sourceOwnershipIndex].varStruct.ownership.managingContractIndex
-            && assets[*destinationOwnershipIndex].varStruct.ownership.issuanceIndex == assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex
-            && assets[*destinationOwnershipIndex].varStruct.ownership.publicKey == destinationPublicKey))
-    {
-        assets[sourceOwnershipIndex].varStruct.ownership.numberOfShares -= numberOfShares;
-
-        if (assets[*destinationOwnershipIndex].varStruct.ownership.type == EMPTY)
-        {
-            assets[*destinationOwnershipIndex].varStruct.ownership.publicKey = destinationPublicKey;
-            assets[*destinationOwnershipIndex].varStruct.ownership.type = OWNERSHIP;
-            assets[*destinationOwnershipIndex].varStruct.ownership.managingContractIndex = assets[sourceOwnershipIndex].varStruct.ownership.managingContractIndex;
-            assets[*destinationOwnershipIndex].varStruct.ownership.issuanceIndex = assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex;
-
-            as.indexLists.addOwnership(assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex, *destinationOwnershipIndex);
-        }
-        assets[*destinationOwnershipIndex].varStruct.ownership.numberOfShares += numberOfShares;
+    // Find existing ownership record to update or empty slot for new record
+    *destinationOwnershipIndex = ownershipSlot(assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex, destinationPublicKey, assets[sourceOwnershipIndex].varStruct.ownership.managingContractIndex);
+    assets[sourceOwnershipIndex].varStruct.ownership.numberOfShares -= numberOfShares;
 
-        *destinationPossessionIndex = destinationPublicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-    iteration2:
-        if (assets[*destinationPossessionIndex].varStruct.possession.type == EMPTY
-            || (assets[*destinationPossessionIndex].varStruct.possession.type == POSSESSION
-                && assets[*destinationPossessionIndex].varStruct.possession.managingContractIndex == assets[sourcePossessionIndex].varStruct.possession.managingContractIndex
-                && assets[*destinationPossessionIndex].varStruct.possession.ownershipIndex == *destinationOwnershipIndex
-                && assets[*destinationPossessionIndex].varStruct.possession.publicKey == destinationPublicKey))
-        {
-            assets[sourcePossessionIndex].varStruct.possession.numberOfShares -= numberOfShares;
+    if (assets[*destinationOwnershipIndex].varStruct.ownership.type == EMPTY)
+    {
+        assets[*destinationOwnershipIndex].varStruct.ownership.publicKey = destinationPublicKey;
+        assets[*destinationOwnershipIndex].varStruct.ownership.type = OWNERSHIP;
+        assets[*destinationOwnershipIndex].varStruct.ownership.managingContractIndex = assets[sourceOwnershipIndex].varStruct.ownership.managingContractIndex;
+        assets[*destinationOwnershipIndex].varStruct.ownership.issuanceIndex = assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex;
 
-            if (assets[*destinationPossessionIndex].varStruct.possession.type == EMPTY)
-            {
-                assets[*destinationPossessionIndex].varStruct.possession.publicKey = destinationPublicKey;
-                assets[*destinationPossessionIndex].varStruct.possession.type = POSSESSION;
-                assets[*destinationPossessionIndex].varStruct.possession.managingContractIndex = assets[sourcePossessionIndex].varStruct.possession.managingContractIndex;
-                assets[*destinationPossessionIndex].varStruct.possession.ownershipIndex = *destinationOwnershipIndex;
+        as.indexLists.addOwnership(assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex, *destinationOwnershipIndex);
+    }
+    assets[*destinationOwnershipIndex].varStruct.ownership.numberOfShares += numberOfShares;
 
-                as.indexLists.addPossession(*destinationOwnershipIndex, *destinationPossessionIndex);
-            }
-            assets[*destinationPossessionIndex].varStruct.possession.numberOfShares += numberOfShares;
+    // Find existing possession record to update or empty slot for new record
+    *destinationPossessionIndex = possessionSlot(*destinationOwnershipIndex, destinationPublicKey, assets[sourcePossessionIndex].varStruct.possession.managingContractIndex);
+    assets[sourcePossessionIndex].varStruct.possession.numberOfShares -= numberOfShares;
 
-            assetChangeFlags[sourceOwnershipIndex >> 6] |= (1ULL << (sourceOwnershipIndex & 63));
-            assetChangeFlags[sourcePossessionIndex >> 6] |= (1ULL << (sourcePossessionIndex & 63));
-            assetChangeFlags[*destinationOwnershipIndex >> 6] |= (1ULL << (*destinationOwnershipIndex & 63));
-            assetChangeFlags[*destinationPossessionIndex >> 6] |= (1ULL << (*destinationPossessionIndex & 63));
+    if (assets[*destinationPossessionIndex].varStruct.possession.type == EMPTY)
+    {
+        assets[*destinationPossessionIndex].varStruct.possession.publicKey = destinationPublicKey;
+        assets[*destinationPossessionIndex].varStruct.possession.type = POSSESSION;
+        assets[*destinationPossessionIndex].varStruct.possession.managingContractIndex = assets[sourcePossessionIndex].varStruct.possession.managingContractIndex;
+        assets[*destinationPossessionIndex].varStruct.possession.ownershipIndex = *destinationOwnershipIndex;
 
-            if (lock)
-            {
-                RELEASE(universeLock);
-            }
+        as.indexLists.addPossession(*destinationOwnershipIndex, *destinationPossessionIndex);
+    }
+    assets[*destinationPossessionIndex].varStruct.possession.numberOfShares += numberOfShares;
 
-            AssetOwnershipChange assetOwnershipChange;
-            assetOwnershipChange.sourcePublicKey = assets[sourceOwnershipIndex].varStruct.ownership.publicKey;
-            assetOwnershipChange.destinationPublicKey = destinationPublicKey;
-            assetOwnershipChange.issuerPublicKey = assets[assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex].varStruct.issuance.publicKey;
-            assetOwnershipChange.numberOfShares = numberOfShares;
-            assetOwnershipChange.managingContractIndex = assets[sourceOwnershipIndex].varStruct.ownership.managingContractIndex;
-            *((unsigned long long*) & assetOwnershipChange.name) = *((unsigned long long*) & assets[assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex].varStruct.issuance.name); // Order must be preserved!
-            assetOwnershipChange.numberOfDecimalPlaces = assets[assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex].varStruct.issuance.numberOfDecimalPlaces; // Order must be preserved!
-            *((unsigned long long*) & assetOwnershipChange.unitOfMeasurement) = *((unsigned long long*) & assets[assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex].varStruct.issuance.unitOfMeasurement); // Order must be preserved!
-            logger.logAssetOwnershipChange(assetOwnershipChange);
-
-            AssetPossessionChange assetPossessionChange;
-            assetPossessionChange.sourcePublicKey = assets[sourcePossessionIndex].varStruct.possession.publicKey;
-            assetPossessionChange.destinationPublicKey = destinationPublicKey;
-            assetPossessionChange.issuerPublicKey = assets[assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex].varStruct.issuance.publicKey;
-            assetPossessionChange.numberOfShares = numberOfShares;
-            assetPossessionChange.managingContractIndex = assets[sourcePossessionIndex].varStruct.possession.managingContractIndex;
-            *((unsigned long long*) & assetPossessionChange.name) = *((unsigned long long*) & assets[assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex].varStruct.issuance.name); // Order must be preserved!
-            assetPossessionChange.numberOfDecimalPlaces = assets[assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex].varStruct.issuance.numberOfDecimalPlaces; // Order must be preserved!
-            *((unsigned long long*) & assetPossessionChange.unitOfMeasurement) = *((unsigned long long*) & assets[assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex].varStruct.issuance.unitOfMeasurement); // Order must be preserved!
-            logger.logAssetPossessionChange(assetPossessionChange);
-
-            return true;
-        }
-        else
-        {
-            *destinationPossessionIndex = (*destinationPossessionIndex + 1) & (ASSETS_CAPACITY - 1);
+    markUniverseRecordChanged(sourceOwnershipIndex);
+    markUniverseRecordChanged(sourcePossessionIndex);
+    markUniverseRecordChanged(*destinationOwnershipIndex);
+    markUniverseRecordChanged(*destinationPossessionIndex);
 
-            goto iteration2;
-        }
-    }
-    else
+    if (lock)
     {
-        *destinationOwnershipIndex = (*destinationOwnershipIndex + 1) & (ASSETS_CAPACITY - 1);
-
-        goto iteration;
+        RELEASE(universeLock);
     }
+
+    AssetOwnershipChange assetOwnershipChange;
+    assetOwnershipChange.sourcePublicKey = assets[sourceOwnershipIndex].varStruct.ownership.publicKey;
+    assetOwnershipChange.destinationPublicKey = destinationPublicKey;
+    assetOwnershipChange.issuerPublicKey = assets[assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex].varStruct.issuance.publicKey;
+    assetOwnershipChange.numberOfShares = numberOfShares;
+    assetOwnershipChange.managingContractIndex = assets[sourceOwnershipIndex].varStruct.ownership.managingContractIndex;
+    *((unsigned long long*) & assetOwnershipChange.name) = *((unsigned long long*) & assets[assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex].varStruct.issuance.name); // Order must be preserved!
+    assetOwnershipChange.numberOfDecimalPlaces = assets[assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex].varStruct.issuance.numberOfDecimalPlaces; // Order must be preserved!
+    *((unsigned long long*) & assetOwnershipChange.unitOfMeasurement) = *((unsigned long long*) & assets[assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex].varStruct.issuance.unitOfMeasurement); // Order must be preserved!
+    logger.logAssetOwnershipChange(assetOwnershipChange);
+
+    AssetPossessionChange assetPossessionChange;
+    assetPossessionChange.sourcePublicKey = assets[sourcePossessionIndex].varStruct.possession.publicKey;
+    assetPossessionChange.destinationPublicKey = destinationPublicKey;
+    assetPossessionChange.issuerPublicKey = assets[assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex].varStruct.issuance.publicKey;
+    assetPossessionChange.numberOfShares = numberOfShares;
+    assetPossessionChange.managingContractIndex = assets[sourcePossessionIndex].varStruct.possession.managingContractIndex;
+    *((unsigned long long*) & assetPossessionChange.name) = *((unsigned long long*) & assets[assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex].varStruct.issuance.name); // Order must be preserved!
+    assetPossessionChange.numberOfDecimalPlaces = assets[assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex].varStruct.issuance.numberOfDecimalPlaces; // Order must be preserved!
+    *((unsigned long long*) & assetPossessionChange.unitOfMeasurement) = *((unsigned long long*) & assets[assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex].varStruct.issuance.unitOfMeasurement); // Order must be preserved!
+    logger.logAssetPossessionChange(assetPossessionChange);
+
+    return true;
 }
 
 static long long numberOfPossessedShares(unsigned long long assetName, const m256i& issuer, const m256i& owner, const m256i& possessor, unsigned short ownershipManagingContractIndex, unsigned short possessionManagingContractIndex)
@@ -636,79 +756,24 @@ static long long numberOfPossessedShares(unsigned long long assetName, const m25
 
     ACQUIRE(universeLock);
 
-    int issuanceIndex = issuer.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-iteration:
-    if (assets[issuanceIndex].varStruct.issuance.type == EMPTY)
-    {
-        RELEASE(universeLock);
-
-        return 0;
-    }
-    else
+    long long numberOfPossessedShares = 0;
+    const unsigned int issuanceIdx = issuanceIndex(issuer, assetName);
+    if (issuanceIdx != NO_ASSET_INDEX)
     {
-        if (assets[issuanceIndex].varStruct.issuance.type == ISSUANCE
-            && ((*((unsigned long long*)assets[issuanceIndex].varStruct.issuance.name)) & 0xFFFFFFFFFFFFFF) == assetName
-            && assets[issuanceIndex].varStruct.issuance.publicKey == issuer)
+        const unsigned int ownershipIdx = as.indexLists.findOwnership(issuanceIdx, owner, ownershipManagingContractIndex);
+        if (ownershipIdx != NO_ASSET_INDEX)
         {
-            int ownershipIndex = owner.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-        iteration2:
-            if (assets[ownershipIndex].varStruct.ownership.type == EMPTY)
+            const unsigned int possessionIdx = as.indexLists.findPossession(ownershipIdx, possessor, possessionManagingContractIndex);
+            if (possessionIdx != NO_ASSET_INDEX)
             {
-                RELEASE(universeLock);
-
-                return 0;
+                numberOfPossessedShares = assets[possessionIdx].varStruct.possession.numberOfShares;
             }
-            else
-            {
-                if (assets[ownershipIndex].varStruct.ownership.type == OWNERSHIP
-                    && assets[ownershipIndex].varStruct.ownership.issuanceIndex == issuanceIndex
-                    && assets[ownershipIndex].varStruct.ownership.publicKey == owner
-                    && assets[ownershipIndex].varStruct.ownership.managingContractIndex == ownershipManagingContractIndex)
-                {
-                    int possessionIndex = possessor.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-                iteration3:
-                    if (assets[possessionIndex].varStruct.possession.type == EMPTY)
-                    {
-                        RELEASE(universeLock);
-
-                        return 0;
-                    }
-                    else
-                    {
-                        if (assets[possessionIndex].varStruct.possession.type == POSSESSION
-                            && assets[possessionIndex].varStruct.possession.ownershipIndex == ownershipIndex
-                            && assets[possessionIndex].varStruct.possession.publicKey == possessor
-                            && assets[possessionIndex].varStruct.possession.managingContractIndex == possessionManagingContractIndex)
-                        {
-                            const long long numberOfPossessedShares = assets[possessionIndex].varStruct.possession.numberOfShares;
-
-                            RELEASE(universeLock);
-
-                            return numberOfPossessedShares;
-                        }
-                        else
-                        {
-                            possessionIndex = (possessionIndex + 1) & (ASSETS_CAPACITY - 1);
-
-                            goto iteration3;
-                        }
-                    }
-                }
-                else
-                {
-                    ownershipIndex = (ownershipIndex + 1) & (ASSETS_CAPACITY - 1);
-
-                    goto iteration2;
-                }
-            }
-        }
-        else
-        {
-            issuanceIndex = (issuanceIndex + 1) & (ASSETS_CAPACITY - 1);
-
-            goto iteration;
         }
     }
+
+    RELEASE(universeLock);
+
+    return numberOfPossessedShares;
 }
 
 // Should only be called from tick processor to avoid concurrent asset state changes, which may cause race conditions
@@ -716,32 +781,30 @@ static void getUniverseDigest(m256i& digest)
 {
     PROFILE_SCOPE();
 
-    unsigned int digestIndex;
-    for (digestIndex = 0; digestIndex < ASSETS_CAPACITY; digestIndex++)
+    auto hashAsset = [](unsigned int index)
     {
-        if (assetChangeFlags[digestIndex >> 6] & (1ULL << (digestIndex & 63)))
+        KangarooTwelve(&assets[index], sizeof(AssetRecord), &assetDigests[index], 32);
+    };
+    if (!assetChangeListOverflow)
+    {
+        // Regular case: only rehash the listed records and walk up the tree from them, so quiet ticks cost
+        // (almost) nothing
+        for (unsigned int i = 0; i < assetChangeListSize; i++)
         {
-            KangarooTwelve(&assets[digestIndex], sizeof(AssetRecord), &assetDigests[digestIndex], 32);
+            hashAsset(assetChangeList[i]);
+            universeSnapshotDelta.markChanged(assetChangeList[i]);
         }
+        DigestTreeBuilder::updateAncestors(assetDigests, ASSETS_CAPACITY, assetChangeList, assetChangeListSize, assetChangeFlags);
     }
-    unsigned int previousLevelBeginning = 0;
-    unsigned int numberOfLeafs = ASSETS_CAPACITY;
-    while (numberOfLeafs > 1)
+    else
     {
-        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-        {
-            if (assetChangeFlags[i >> 6] & (3ULL << (i & 63)))
-            {
-                KangarooTwelve64To32(&assetDigests[previousLevelBeginning + i], &assetDigests[digestIndex]);
-                assetChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
-                assetChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
-            }
-            digestIndex++;
-        }
-        previousLevelBeginning += numberOfLeafs;
-        numberOfLeafs >>= 1;
+        // Too many changes for the list: scan flags, skipping 64 unchanged nodes at once and distributing
+        // the hashing to the processors helping digestTreeBuilder
+        universeSnapshotDelta.markChanged(assetChangeFlags);
+        digestTreeBuilder.updateTree(assetDigests, ASSETS_CAPACITY, assetChangeFlags, hashAsset);
     }
-    assetChangeFlags[0] = 0;
+    assetChangeListSize = 0;
+    assetChangeListOverflow = false;
 
     digest = assetDigests[(ASSETS_CAPACITY * 2 - 1) - 1];
 }
@@ -756,7 +819,7 @@ static bool saveUniverse(const CHAR16* fileName = UNIVERSE_FILE_NAME, const CHAR
     const unsigned long long beginningTick = __rdtsc();
 
     ACQUIRE(universeLock);
-    long long savedSize = save(fileName, ASSETS_CAPACITY * sizeof(AssetRecord), (unsigned char*)assets, directory);
+    long long savedSize = saveStateFile(fileName, ASSETS_CAPACITY * sizeof(AssetRecord), (unsigned char*)assets, directory);
     RELEASE(universeLock);
 
     if (savedSize == ASSETS_CAPACITY * sizeof(AssetRecord))
@@ -775,13 +838,14 @@ static bool loadUniverse(const CHAR16* fileName = UNIVERSE_FILE_NAME, CHAR16* di
 {
     PROFILE_SCOPE();
 
-    long long loadedSize = load(fileName, ASSETS_CAPACITY * sizeof(AssetRecord), (unsigned char*)assets, directory);
+    long long loadedSize = loadParallel(fileName, ASSETS_CAPACITY * sizeof(AssetRecord), (unsigned char*)assets, directory);
     if (loadedSize != ASSETS_CAPACITY * sizeof(AssetRecord))
     {
         logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() reads invalid number of bytes", loadedSize, __LINE__);
 
         return false;
     }
+    markAllUniverseRecordsChanged();
     as.indexLists.rebuild();
     return true;
 }
@@ -875,7 +939,7 @@ static void assetsEndEpoch()
     }
     copyMem(assets, reorgAssets, ASSETS_CAPACITY * sizeof(AssetRecord));
 
-    setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0xFF);
+    markAllUniverseRecordsChanged();
 
     as.indexLists.rebuild();
 
@@ -0,0 +1,216 @@
+#pragma once
+
+#include "platform/m256.h"
+#include "platform/concurrency.h"
+#include "platform/memory_util.h"
+#include "platform/assert.h"
+
+#include "kangaroo_twelve.h"
+#include "digest_tree.h"
+
+
+// Digest of a contract state that is split into chunks of chunkSize bytes (CONTRACT_STATE_DIGEST_VERSION 2).
+// Each chunk is hashed with K12 (the last chunk may be shorter). The chunk digests are the leafs of a digest tree
+// (see DigestTreeBuilder) padded with zero digests to the next power of 2, and the root is the digest of the state.
+// A state that fits into a single chunk has the same digest as with version 1 (K12 of the whole state).
+//
+// Only chunks flagged as changed are hashed again. Changes are either flagged explicitly with markAllChanged() or,
+// if a protect function is given in init(), by write tracking: all unchanged chunks are read-only, so the first
+// write to a chunk causes a write fault. The fault handler has to call onWriteFault(), which flags the chunk and
+// makes it writable again. With write tracking, the state buffer must be aligned to the page size and its allocated
+// size must be a multiple of chunkSize (which is a multiple of the page size).
+class ChunkedStateDigest
+{
+public:
+    // Change protection of memory: writable == false makes it read-only. Returns true on success.
+    typedef bool (*ProtectFunction)(void* address, unsigned long long size, bool writable);
+
+    bool init(unsigned char* state, unsigned long long stateSize, unsigned long long chunkSize, ProtectFunction protect = nullptr)
+    {
+        ASSERT(chunkSize && !(chunkSize & (chunkSize - 1)));
+        this->state = state;
+        this->stateSize = stateSize;
+        this->chunkSize = chunkSize;
+        this->protect = protect;
+        numberOfChunks = (unsigned int)((stateSize + chunkSize - 1) / chunkSize);
+        numberOfLeafs = 1;
+        while (numberOfLeafs < numberOfChunks)
+        {
+            numberOfLeafs <<= 1;
+        }
+        changeListSize = 0;
+        if (!numberOfChunks)
+        {
+            return true;
+        }
+
+        if (!allocPoolWithErrorLog(L"chunkedStateDigests", (numberOfLeafs * 2ULL - 1) * sizeof(m256i), (void**)&digests, __LINE__)
+            || !allocPoolWithErrorLog(L"chunkedStateChangeFlags", ((numberOfLeafs + 63) / 64) * 8ULL, (void**)&changeFlags, __LINE__)
+            || !allocPoolWithErrorLog(L"chunkedStateChangeList", numberOfLeafs * sizeof(unsigned int), (void**)&changeList, __LINE__))
+        {
+            return false;
+        }
+        // Padding leafs are zero and never change. Compute the tree once, so the digests above the padding are valid
+        // without hashing them in each update.
+        setMem(digests, numberOfLeafs * sizeof(m256i), 0);
+        unsigned long long levelBeginning = 0;
+        for (unsigned int levelSize = numberOfLeafs; levelSize > 1; levelSize >>= 1)
+        {
+            KangarooTwelve64To32Batch(&digests[levelBeginning], &digests[levelBeginning + levelSize], levelSize >> 1);
+            levelBeginning += levelSize;
+        }
+        markAllChanged();
+        return true;
+    }
+
+    void deinit()
+    {
+        if (digests)
+        {
+            freePool(digests);
+            digests = nullptr;
+        }
+        if (changeFlags)
+        {
+            freePool(changeFlags);
+            changeFlags = nullptr;
+        }
+        if (changeList)
+        {
+            freePool(changeList);
+            changeList = nullptr;
+        }
+        numberOfChunks = 0;
+    }
+
+    bool isWriteTracking() const
+    {
+        return protect != nullptr;
+    }
+
+    // Flag all chunks as changed and make them writable. Has to be called before the state is written by other
+    // means than instructions of this process (such as reading a file into the state), because these do not cause
+    // write faults.
+    void markAllChanged()
+    {
+        if (!numberOfChunks)
+        {
+            return;
+        }
+        for (unsigned int wordIndex = 0; wordIndex < numberOfChunks / 64; wordIndex++)
+        {
+            changeFlags[wordIndex] = 0xFFFFFFFFFFFFFFFFULL;
+        }
+        if (numberOfChunks & 63)
+        {
+            changeFlags[numberOfChunks / 64] = (1ULL << (numberOfChunks & 63)) - 1;
+        }
+        if (protect)
+        {
+            protect(state, numberOfChunks * chunkSize, true);
+        }
+    }
+
+    // Called by the write fault handler. Returns false if the address is not in an unchanged chunk of this
+    // state (the fault has another cause). Otherwise, the chunk is flagged and made writable.
+    bool onWriteFault(const void* address)
+    {
+        if (!protect || (const unsigned char*)address < state || (const unsigned char*)address >= state + numberOfChunks * chunkSize)
+        {
+            return false;
+        }
+        const unsigned int chunkIndex = (unsigned int)(((const unsigned char*)address - state) / chunkSize);
+        volatile long long* word = (volatile long long*)&changeFlags[chunkIndex >> 6];
+        const long long bit = 1LL << (chunkIndex & 63);
+        while (true)
+        {
+            const long long flags = *word;
+            if (flags & bit)
+            {
+                // Already flagged by another processor, which may still be changing the protection
+                break;
+            }
+            if (_InterlockedCompareExchange64(word, flags | bit, flags) == flags)
+            {
+                break;
+            }
+        }
+        return protect(state + chunkIndex * chunkSize, chunkSize, true);
+    }
+
+    // Collect the changed chunks for hashChangedChunks() and return their number.
+    unsigned int collectChangedChunks()
+    {
+        changeListSize = 0;
+        for (unsigned int wordIndex = 0; wordIndex < (numberOfChunks + 63) / 64; wordIndex++)
+        {
+            unsigned long long flags = changeFlags[wordIndex];
+            while (flags)
+            {
+                changeList[changeListSize++] = (wordIndex << 6) + (unsigned int)_tzcnt_u64(flags);
+                flags &= flags - 1;
+            }
+        }
+        return changeListSize;
+    }
+
+    // Flags of the chunks changed since the last updateRoot(), one bit per chunk
+    const unsigned long long* getChangeFlags() const
+    {
+        return changeFlags;
+    }
+
+    // Index of the i-th chunk collected by collectChangedChunks()
+    unsigned int getChangedChunk(unsigned int i) const
+    {
+        ASSERT(i < changeListSize);
+        return changeList[i];
+    }
+
+    // Hash the collected chunks begin to begin + count - 1 (indices into the list of collected chunks). Different
+    // ranges may be hashed by different processors in parallel. With write tracking, the chunks are made
+    // read-only before hashing, so the state must not be written concurrently.
+    void hashChangedChunks(unsigned int begin, unsigned int count)
+    {
+        const unsigned int end = (begin + count < changeListSize) ? begin + count : changeListSize;
+        for (unsigned int i = begin; i < end; i++)
+        {
+            const unsigned int chunkIndex = changeList[i];
+            const unsigned long long offset = chunkIndex * chunkSize;
+            if (protect)
+            {
+                protect(state + offset, chunkSize, false);
+            }
+            const unsigned long long size = (stateSize - offset < chunkSize) ? stateSize - offset : chunkSize;
+            KangarooTwelve(state + offset, (unsigned int)size, &digests[chunkIndex], sizeof(m256i));
+        }
+    }
+
+    // Update the digest tree after all collected chunks have been hashed and return the digest of the state.
+    // Clears the change flags.
+    m256i updateRoot()
+    {
+        if (!numberOfChunks)
+        {
+            return m256i::zero();
+        }
+        if (changeListSize)
+        {
+            DigestTreeBuilder::updateAncestors(digests, numberOfLeafs, changeList, changeListSize, changeFlags);
+            changeListSize = 0;
+        }
+        return digests[numberOfLeafs * 2 - 2];
+    }
+
+private:
+    unsigned char* state = nullptr;
+    unsigned long long stateSize = 0;
+    unsigned long long chunkSize = 0;
+    ProtectFunction protect = nullptr;
+    unsigned int numberOfChunks = 0;
+    unsigned int numberOfLeafs = 0;
+    m256i* digests = nullptr;
+    unsigned long long* changeFlags = nullptr;
+    unsigned int* changeList = nullptr;
+    unsigned int changeListSize = 0;
+};
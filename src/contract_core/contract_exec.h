@@ -65,6 +65,16 @@ GLOBAL_VAR_DECL unsigned int contractError[contractCount];
 // access to contractStateChangeFlags thread-safe
 GLOBAL_VAR_DECL unsigned long long* contractStateChangeFlags GLOBAL_VAR_INIT(nullptr);
 
+// Incremented each time the state of a contract may have changed, used for invalidating cached function results
+GLOBAL_VAR_DECL volatile long long contractStateVersions[contractCount];
+
+// Flag the state of the contract as changed (for the digest) and increment its state version
+static void setContractStateChanged(unsigned int contractIndex)
+{
+    contractStateChangeFlags[contractIndex >> 6] |= (1ULL << (contractIndex & 63));
+    _InterlockedIncrement64(&contractStateVersions[contractIndex]);
+}
+
 
 // Contract system procedures that serve as callbacks, such as PRE_ACQUIRE_SHARES,
 // break the rule that contracts can only call other contracts with lower index.
@@ -169,6 +179,7 @@ static bool initContractExec()
 
     setMem((void*)contractTotalExecutionTicks, sizeof(contractTotalExecutionTicks), 0);
     setMem((void*)contractError, sizeof(contractError), 0);
+    setMem((void*)contractStateVersions, sizeof(contractStateVersions), 0);
     setMem((void*)contractExecutionErrorData, sizeof(contractExecutionErrorData), 0);
     for (int i = 0; i < contractCount; ++i)
     {
@@ -622,7 +633,7 @@ void QPI::QpiContextProcedureCall::__qpiReleaseStateForWriting(unsigned int cont
             contractStateLock[contractIndex].releaseWrite();
         }
     }
-    contractStateChangeFlags[_currentContractIndex >> 6] |= (1ULL << (_currentContractIndex & 63));
+    setContractStateChanged(_currentContractIndex);
 }
 
 // Used to run a special system procedure from within a contract for example in asset management rights transfer
@@ -955,7 +966,7 @@ private:
 
         // release lock of contract state and set state to changed
         contractStateLock[_currentContractIndex].releaseWrite();
-        contractStateChangeFlags[_currentContractIndex >> 6] |= (1ULL << (_currentContractIndex & 63));
+        setContractStateChanged(_currentContractIndex);
 
         // release stack
         releaseContractLocalsStack(_stackIndex);
@@ -1057,7 +1068,7 @@ struct QpiContextUserProcedureCall : public QPI::QpiContextProcedureCall
 
         // release lock of contract state and set state to changed
         contractStateLock[_currentContractIndex].releaseWrite();
-        contractStateChangeFlags[_currentContractIndex >> 6] |= (1ULL << (_currentContractIndex & 63));
+        setContractStateChanged(_currentContractIndex);
     }
 
     // free buffer after output has been copied (or isn't needed anymore)
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "platform/global_var.h"
+#include "platform/m256.h"
+#include "platform/concurrency.h"
+#include "platform/memory_util.h"
+#include "platform/debugging.h"
+
+#include "public_settings.h"
+
+#include "kangaroo_twelve.h"
+
+
+// Cache of contract user function results for answering repeated RequestContractFunction queries without
+// running the function again.
+//
+// Entries are keyed by (contractIndex, inputType, K12(input)) and tagged with the tick and the state version of
+// the contract at the time the function was called. An entry is only used if both still match, that is, if no
+// procedure of the contract has changed the state since then (see contractStateVersions) and the node is still
+// in the same tick (functions may depend on tick, time, spectrum, universe, and other contracts).
+//
+// The cache is direct-mapped. Each entry is protected by a sequence lock, so readers never block, and writers
+// skip the entry if another writer is updating it.
+class ContractFunctionResultCache
+{
+public:
+    // Power of 2
+    static constexpr unsigned int numberOfEntries = 1024;
+
+    // Results with larger output are not cached
+    static constexpr unsigned int maxOutputSize = 4096;
+
+    bool init()
+    {
+        entries = nullptr;
+        outputBuffers = nullptr;
+        hits = 0;
+        misses = 0;
+        return allocPoolWithErrorLog(L"contractFunctionResultCache", numberOfEntries * sizeof(Entry), (void**)&entries, __LINE__)
+            && allocPoolWithErrorLog(L"contractFunctionResultCacheOutputBuffers", MAX_NUMBER_OF_PROCESSORS * maxOutputSize, (void**)&outputBuffers, __LINE__);
+    }
+
+    void deinit()
+    {
+        if (entries)
+        {
+            freePool(entries);
+            entries = nullptr;
+        }
+        if (outputBuffers)
+        {
+            freePool(outputBuffers);
+            outputBuffers = nullptr;
+        }
+    }
+
+    static m256i computeInputDigest(const void* input, unsigned int inputSize)
+    {
+        m256i digest;
+        KangarooTwelve(input, inputSize, &digest, sizeof(digest));
+        return digest;
+    }
+
+    // Look up the result of a function call. If found, the output is copied to a buffer of the calling
+    // processor, which is returned and valid until the next call of tryGet() by this processor.
+    // Returns nullptr if there is no valid entry.
+    const void* tryGet(unsigned long long processorNumber, unsigned int contractIndex, unsigned int inputType, const m256i& inputDigest,
+        unsigned int tick, unsigned long long stateVersion, unsigned int& outputSize)
+    {
+        ASSERT(processorNumber < MAX_NUMBER_OF_PROCESSORS);
+        const Entry& entry = entries[entryIndex(contractIndex, inputType, inputDigest)];
+        unsigned char* outputBuffer = outputBuffers + processorNumber * maxOutputSize;
+
+        const long long sequence = entry.sequence;
+        COMPILER_BARRIER();
+        const unsigned int entryOutputSize = entry.outputSize;
+        bool found = !(sequence & 1)
+            && entry.contractIndex == contractIndex && entry.inputType == inputType && entry.inputDigest == inputDigest
+            && entry.tick == tick && entry.stateVersion == stateVersion && entryOutputSize <= maxOutputSize;
+        if (found)
+        {
+            outputSize = entryOutputSize;
+            copyMem(outputBuffer, entry.output, outputSize);
+            COMPILER_BARRIER();
+
+            // Entry has been overwritten while copying?
+            found = (entry.sequence == sequence);
+        }
+
+        if (!found)
+        {
+            _InterlockedIncrement64(&misses);
+            return nullptr;
+        }
+        _InterlockedIncrement64(&hits);
+        return outputBuffer;
+    }
+
+    // Store the result of a function call that has been started with the given tick and state version.
+    void put(unsigned int contractIndex, unsigned int inputType, const m256i& inputDigest,
+        unsigned int tick, unsigned long long stateVersion, const void* output, unsigned int outputSize)
+    {
+        if (outputSize > maxOutputSize)
+        {
+            return;
+        }
+
+        Entry& entry = entries[entryIndex(contractIndex, inputType, inputDigest)];
+        const long long sequence = entry.sequence;
+        if ((sequence & 1) || _InterlockedCompareExchange64(&entry.sequence, sequence + 1, sequence) != sequence)
+        {
+            // Another processor is writing this entry
+            return;
+        }
+
+        entry.contractIndex = contractIndex;
+        entry.inputType = inputType;
+        entry.inputDigest = inputDigest;
+        entry.tick = tick;
+        entry.stateVersion = stateVersion;
+        entry.outputSize = outputSize;
+        copyMem(entry.output, output, outputSize);
+        COMPILER_BARRIER();
+
+        entry.sequence = sequence + 2;
+    }
+
+    unsigned long long getHits() const
+    {
+        return hits;
+    }
+
+    unsigned long long getMisses() const
+    {
+        return misses;
+    }
+
+private:
+    struct Entry
+    {
+        // Odd while the entry is being written
+        volatile long long sequence;
+        m256i inputDigest;
+        unsigned long long stateVersion;
+        unsigned int tick;
+        unsigned short contractIndex;
+        unsigned short inputType;
+        unsigned int outputSize;
+        unsigned char output[maxOutputSize];
+    };
+
+    Entry* entries = nullptr;
+    unsigned char* outputBuffers = nullptr;
+    volatile long long hits = 0;
+    volatile long long misses = 0;
+
+    static unsigned int entryIndex(unsigned int contractIndex, unsigned int inputType, const m256i& inputDigest)
+    {
+        return (inputDigest.m256i_u32[0] ^ (contractIndex * 0x9E3779B9) ^ (inputType * 0x85EBCA6B)) & (numberOfEntries - 1);
+    }
+};
+
+GLOBAL_VAR_DECL ContractFunctionResultCache contractFunctionResultCache;
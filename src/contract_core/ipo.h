@@ -99,7 +99,7 @@ static long long bidInContractIPO(long long price, unsigned short quantity, cons
                         ipo->prices[j--] = tmpPrice;
                     }
 
-                    contractStateChangeFlags[contractIndex >> 6] |= (1ULL << (contractIndex & 63));
+                    setContractStateChanged(contractIndex);
                     ++registeredBids;
                 }
             }
@@ -44,21 +44,21 @@ static long long getContractFeeReserve(unsigned int contractIndex)
 }
 
 // Set the amount in the fee reserve of the specified contract to a new value (data stored in state of contract 0).
-// This also sets the contractStateChangeFlag of contract 0.
+// This also sets the contractStateChangeFlag and increments the state version of contract 0.
 static void setContractFeeReserve(unsigned int contractIndex, long long newValue)
 {
     contractStateLock[0].acquireWrite();
-    contractStateChangeFlags[0] |= 1ULL;
+    setContractStateChanged(0);
     ((Contract0State*)contractStates[0])->contractFeeReserves[contractIndex] = newValue;
     contractStateLock[0].releaseWrite();
 }
 
 // Add the given amount to the amount in the fee reserve of the specified contract (data stored in state of contract 0).
-// This also sets the contractStateChangeFlag of contract 0.
+// This also sets the contractStateChangeFlag and increments the state version of contract 0.
 static void addToContractFeeReserve(unsigned int contractIndex, long long addAmount)
 {
     contractStateLock[0].acquireWrite();
-    contractStateChangeFlags[0] |= 1ULL;
+    setContractStateChanged(0);
     ((Contract0State*)contractStates[0])->contractFeeReserves[contractIndex] += addAmount;
     contractStateLock[0].releaseWrite();
 }
@@ -3,7 +3,13 @@ using namespace QPI;
 constexpr uint32 ROUND_DURATION = 20;
 constexpr uint64 MIN_BET = 1000000;
 constexpr uint64 MAX_BET = 1000000000;
-constexpr uint32 MAX_BETS_PER_ROUND = 128;
+constexpr uint32 MAX_BETS_PER_ROUND = 4096;
+constexpr uint32 BET_HISTORY_SIZE = 8192;
+// Bettors with bets in betHistory or unclaimed winnings. Bettors without either are removed when the map is full
+// and at the end of the epoch. If all entries are in use, bets of new bettors are refunded.
+constexpr uint32 MAX_BETTORS = 8192;
+constexpr uint32 MAX_USER_BETS_RETURNED = 128;
+constexpr uint32 AUTO_PAYOUT_BETS_PER_TICK = 64;
 constexpr uint32 HISTORY_SIZE = 8;
 constexpr uint32 HOUSE_FEE_BPS = 200;
 constexpr uint32 BASIS_POINTS = 10000;
@@ -50,6 +56,27 @@ struct BetRecord
     uint32 timestamp;
 };
 
+// Result of a resolved round, applied to its bets lazily (when claiming, paying out automatically, or when the
+// bet leaves the bet history). The payout of a winning bet is amount * poolAfterFee / winningPool, in case of a
+// draw it is the amount.
+struct RoundSettlement
+{
+    uint32 roundId;
+    uint8 winningDirection;
+    uint64 poolAfterFee;
+    uint64 winningPool;
+};
+
+// Bets are referenced by their sequence number, which is stable while the bet is in the ring buffer betHistory.
+// Bet reference 0 means no bet, otherwise the reference is sequence number + 1.
+// claimable and unclaimedBets only cover bets that have left betHistory before being claimed.
+struct BettorInfo
+{
+    uint64 lastBetRef;
+    uint64 claimable;
+    uint32 unclaimedBets;
+};
+
 struct TickDerivState
 {
     Round currentRound;
@@ -58,14 +85,39 @@ struct TickDerivState
     uint32 totalRoundsCount;
     uint64 totalVolumeAllTime;
     uint64 totalPayoutsAllTime;
-    Array<BetRecord, MAX_BETS_PER_ROUND> currentBets;
     uint32 currentBetCount;
-    Array<BetRecord, 1024> allBets;
-    uint32 allBetsCount;
+
+    // The bets of the current round are the sequence numbers currentRoundFirstBet to betHistoryCount - 1
+    uint64 currentRoundFirstBet;
+
+    // Ring buffer of the latest BET_HISTORY_SIZE bets, bet with sequence number n is in slot n & (BET_HISTORY_SIZE - 1)
+    Array<BetRecord, BET_HISTORY_SIZE> betHistory;
+    // Reference of the previous bet of the same bettor for each slot of betHistory
+    Array<uint64, BET_HISTORY_SIZE> previousBetOfBettor;
+    // Index of the settlement of the bet's round in roundSettlements for each slot of betHistory
+    Array<uint64, BET_HISTORY_SIZE> betRoundSettlement;
+    uint64 betHistoryCount;
+
+    // Ring buffer of settlements of rounds with bets, settlement with index n is in slot n & (BET_HISTORY_SIZE - 1).
+    // Each of these rounds has at least one bet, so the settlements of all bets in betHistory are available.
+    Array<RoundSettlement, BET_HISTORY_SIZE> roundSettlements;
+    uint64 roundSettlementCount;
+
+    // Sequence number of the next bet to check for automatic payout
+    uint64 autoPayoutNextBet;
+    // Winnings are paid out automatically in BEGIN_TICK if set (switched by the owner with SetAutoPayout), otherwise
+    // they have to be claimed with ClaimWinnings
+    bit autoPayoutEnabled;
+
+    // Newest bet and unclaimed winnings of each bettor (unclaimed winnings are kept after bets leave betHistory)
+    HashMap<id, BettorInfo, MAX_BETTORS> bettors;
+
     id owner;
     uint64 collectedFees;
 };
 
+static_assert(MAX_BETS_PER_ROUND <= BET_HISTORY_SIZE, "Bets of the current round must fit into bet history");
+
 struct TickDerivState2
 {
 };
@@ -108,6 +160,27 @@ public:
             return;
         }
 
+        BettorInfo bettorInfo;
+        if (!state.bettors.get(qpi.invocator(), bettorInfo))
+        {
+            if (state.bettors.population() >= MAX_BETTORS)
+            {
+                removeInactiveBettors(state);
+            }
+            bettorInfo.lastBetRef = 0;
+            bettorInfo.claimable = 0;
+            bettorInfo.unclaimedBets = 0;
+        }
+
+        uint64 betSequenceNumber = state.betHistoryCount;
+        uint64 previousBetRef = bettorInfo.lastBetRef;
+        bettorInfo.lastBetRef = betSequenceNumber + 1;
+        if (state.bettors.set(qpi.invocator(), bettorInfo) == NULL_INDEX)
+        {
+            qpi.transfer(qpi.invocator(), betAmount);
+            return;
+        }
+
         BetRecord bet;
         bet.bettor = qpi.invocator();
         bet.roundId = state.currentRound.id;
@@ -118,16 +191,41 @@ public:
         bet.payout = 0;
         bet.timestamp = qpi.tick();
 
-        state.currentBets.set(state.currentBetCount, bet);
-        state.currentBetCount++;
-        state.currentRound.betCount++;
-
-        if (state.allBetsCount < 1024)
+        uint32 betSlot = (uint32)(betSequenceNumber & (BET_HISTORY_SIZE - 1));
+        if (betSequenceNumber >= BET_HISTORY_SIZE)
         {
-            state.allBets.set(state.allBetsCount, bet);
-            state.allBetsCount++;
+            // Keep unclaimed winnings of the bet leaving the bet history (its round has been resolved)
+            BetRecord oldBet = state.betHistory.get(betSlot);
+            if (isUnsettled(oldBet))
+            {
+                settleBet(state, betSlot, oldBet);
+            }
+            if (oldBet.won && !oldBet.claimed)
+            {
+                BettorInfo oldBettorInfo;
+                if (!state.bettors.get(oldBet.bettor, oldBettorInfo))
+                {
+                    oldBettorInfo.lastBetRef = 0;
+                    oldBettorInfo.claimable = 0;
+                    oldBettorInfo.unclaimedBets = 0;
+                }
+                oldBettorInfo.claimable = oldBettorInfo.claimable + oldBet.payout;
+                oldBettorInfo.unclaimedBets++;
+                if (state.bettors.set(oldBet.bettor, oldBettorInfo) == NULL_INDEX)
+                {
+                    // No entry left to keep the winnings, pay them out directly
+                    qpi.transfer(oldBet.bettor, oldBet.payout);
+                }
+            }
         }
 
+        state.betHistory.set(betSlot, bet);
+        state.previousBetOfBettor.set(betSlot, previousBetRef);
+        state.betRoundSettlement.set(betSlot, state.roundSettlementCount);
+        state.betHistoryCount++;
+        state.currentBetCount++;
+        state.currentRound.betCount++;
+
         if (input.direction == Direction::UP)
         {
             state.currentRound.poolUp = state.currentRound.poolUp + betAmount;
@@ -194,77 +292,7 @@ public:
 
         output.winningDirection = state.currentRound.winningDirection;
 
-        uint64 totalPool = state.currentRound.poolUp + state.currentRound.poolDown;
-
-        if (state.currentRound.winningDirection == 2)
-        {
-            for (uint32 i = 0; i < state.currentBetCount; ++i)
-            {
-                BetRecord bet = state.currentBets.get(i);
-                output.totalPayout = output.totalPayout + bet.amount;
-
-                bet.payout = bet.amount;
-                bet.claimed = false;
-                bet.won = true;
-                state.currentBets.set(i, bet);
-
-                for (uint32 j = 0; j < state.allBetsCount; ++j)
-                {
-                    BetRecord storedBet = state.allBets.get(j);
-                    if (storedBet.bettor == bet.bettor && storedBet.roundId == bet.roundId && storedBet.timestamp == bet.timestamp)
-                    {
-                        state.allBets.set(j, bet);
-                        break;
-                    }
-                }
-            }
-        }
-        else
-        {
-            uint64 houseFee = (totalPool * HOUSE_FEE_BPS) / BASIS_POINTS;
-            uint64 poolAfterFee = totalPool - houseFee;
-            state.collectedFees = state.collectedFees + houseFee;
-
-            uint64 winningPool = (state.currentRound.winningDirection == Direction::UP)
-                ? state.currentRound.poolUp
-                : state.currentRound.poolDown;
-
-            for (uint32 i = 0; i < state.currentBetCount; ++i)
-            {
-                BetRecord bet = state.currentBets.get(i);
-
-                if (bet.direction == state.currentRound.winningDirection)
-                {
-                    if (winningPool > 0)
-                    {
-                        uint64 payout = (poolAfterFee * bet.amount) / winningPool;
-                        output.totalPayout = output.totalPayout + payout;
-
-                        bet.payout = payout;
-                        bet.claimed = false;
-                        bet.won = true;
-                    }
-                }
-                else
-                {
-                    bet.won = false;
-                    bet.payout = 0;
-                    bet.claimed = true;
-                }
-
-                state.currentBets.set(i, bet);
-
-                for (uint32 j = 0; j < state.allBetsCount; ++j)
-                {
-                    BetRecord storedBet = state.allBets.get(j);
-                    if (storedBet.bettor == bet.bettor && storedBet.roundId == bet.roundId && storedBet.timestamp == bet.timestamp)
-                    {
-                        state.allBets.set(j, bet);
-                        break;
-                    }
-                }
-            }
-        }
+        output.totalPayout = recordRoundSettlement(state);
 
         state.currentRound.state = RoundState::COMPLETED;
         state.currentRound.totalPayout = output.totalPayout;
@@ -297,6 +325,7 @@ public:
         state.currentRound.winningDirection = 2;
         state.currentRound.betCount = 0;
         state.currentBetCount = 0;
+        state.currentRoundFirstBet = state.betHistoryCount;
     }
 
     typedef NoData GetCurrentRound_input;
@@ -340,22 +369,33 @@ public:
 
     struct GetUserBets_output
     {
-        Array<BetRecord, MAX_BETS_PER_ROUND> bets;
+        Array<BetRecord, MAX_USER_BETS_RETURNED> bets;
         uint32 betCount;
     };
 
+    // Returns the newest bets of the user that are still in the bet history, newest first
     PUBLIC_FUNCTION(GetUserBets)
     {
         output.betCount = 0;
 
-        for (uint32 i = 0; i < state.allBetsCount && output.betCount < MAX_BETS_PER_ROUND; ++i)
+        BettorInfo bettorInfo;
+        if (!state.bettors.get(input.userAddress, bettorInfo))
         {
-            BetRecord bet = state.allBets.get(i);
-            if (bet.bettor == input.userAddress)
+            return;
+        }
+
+        uint64 betRef = bettorInfo.lastBetRef;
+        while (betRef && betRef + BET_HISTORY_SIZE > state.betHistoryCount && output.betCount < MAX_USER_BETS_RETURNED)
+        {
+            uint32 betSlot = (uint32)((betRef - 1) & (BET_HISTORY_SIZE - 1));
+            BetRecord bet = state.betHistory.get(betSlot);
+            if (betRef <= state.currentRoundFirstBet && isUnsettled(bet))
             {
-                output.bets.set(output.betCount, bet);
-                output.betCount++;
+                settleBet(state, betSlot, bet);
             }
+            output.bets.set(output.betCount, bet);
+            output.betCount++;
+            betRef = state.previousBetOfBettor.get(betSlot);
         }
     }
 
@@ -408,6 +448,29 @@ public:
         }
     }
 
+    struct SetAutoPayout_input
+    {
+        bit enabled;
+    };
+
+    struct SetAutoPayout_output
+    {
+        bit success;
+    };
+
+    PUBLIC_PROCEDURE(SetAutoPayout)
+    {
+        output.success = false;
+
+        if (qpi.invocator() != state.owner)
+        {
+            return;
+        }
+
+        state.autoPayoutEnabled = input.enabled;
+        output.success = true;
+    }
+
     typedef NoData ClaimWinnings_input;
 
     struct ClaimWinnings_output
@@ -425,25 +488,55 @@ public:
 
         id claimer = qpi.invocator();
 
-        for (uint32 i = 0; i < state.allBetsCount; ++i)
+        BettorInfo bettorInfo;
+        if (!state.bettors.get(claimer, bettorInfo))
         {
-            BetRecord bet = state.allBets.get(i);
+            return;
+        }
 
-            if (bet.bettor == claimer && !bet.claimed && bet.won && bet.payout > 0)
-            {
-                qpi.transfer(claimer, bet.payout);
-                output.totalClaimed = output.totalClaimed + bet.payout;
-                output.betsClaimed++;
+        output.totalClaimed = bettorInfo.claimable;
+        output.betsClaimed = bettorInfo.unclaimedBets;
 
-                bet.claimed = true;
-                state.allBets.set(i, bet);
+        // Settle and claim the bets of resolved rounds that are still in the bet history
+        uint64 betRef = bettorInfo.lastBetRef;
+        while (betRef && betRef + BET_HISTORY_SIZE > state.betHistoryCount)
+        {
+            uint32 betSlot = (uint32)((betRef - 1) & (BET_HISTORY_SIZE - 1));
+            if (betRef <= state.currentRoundFirstBet)
+            {
+                BetRecord bet = state.betHistory.get(betSlot);
+                if (isUnsettled(bet))
+                {
+                    settleBet(state, betSlot, bet);
+                    state.betHistory.set(betSlot, bet);
+                }
+                if (bet.won && !bet.claimed)
+                {
+                    output.totalClaimed = output.totalClaimed + bet.payout;
+                    output.betsClaimed++;
+                    bet.claimed = true;
+                    state.betHistory.set(betSlot, bet);
+                }
             }
+            betRef = state.previousBetOfBettor.get(betSlot);
         }
 
         if (output.totalClaimed > 0)
         {
+            qpi.transfer(claimer, output.totalClaimed);
             output.success = true;
         }
+
+        bettorInfo.claimable = 0;
+        bettorInfo.unclaimedBets = 0;
+        if (isInactiveBettor(state, bettorInfo))
+        {
+            state.bettors.removeByKey(claimer);
+        }
+        else
+        {
+            state.bettors.replace(claimer, bettorInfo);
+        }
     }
 
     struct GetUserClaimable_input
@@ -462,24 +555,118 @@ public:
         output.totalClaimable = 0;
         output.unclaimedBets = 0;
 
-        for (uint32 i = 0; i < state.allBetsCount; ++i)
+        BettorInfo bettorInfo;
+        if (!state.bettors.get(input.userAddress, bettorInfo))
         {
-            BetRecord bet = state.allBets.get(i);
+            return;
+        }
 
-            if (bet.bettor == input.userAddress && !bet.claimed && bet.won && bet.payout > 0)
+        output.totalClaimable = bettorInfo.claimable;
+        output.unclaimedBets = bettorInfo.unclaimedBets;
+
+        uint64 betRef = bettorInfo.lastBetRef;
+        while (betRef && betRef + BET_HISTORY_SIZE > state.betHistoryCount)
+        {
+            uint32 betSlot = (uint32)((betRef - 1) & (BET_HISTORY_SIZE - 1));
+            if (betRef <= state.currentRoundFirstBet)
             {
-                output.totalClaimable = output.totalClaimable + bet.payout;
-                output.unclaimedBets++;
+                BetRecord bet = state.betHistory.get(betSlot);
+                if (isUnsettled(bet))
+                {
+                    settleBet(state, betSlot, bet);
+                }
+                if (bet.won && !bet.claimed)
+                {
+                    output.totalClaimable = output.totalClaimable + bet.payout;
+                    output.unclaimedBets++;
+                }
             }
+            betRef = state.previousBetOfBettor.get(betSlot);
         }
     }
 
+    // A bet of a resolved round that has neither been won nor lost yet has not been settled
+    inline static bit isUnsettled(const BetRecord& bet)
+    {
+        return !bet.won && !bet.claimed;
+    }
+
+    // Apply the settlement of the bet's round to the bet, which is in betSlot of betHistory
+    inline static void settleBet(const TickDerivState& state, uint32 betSlot, BetRecord& bet)
+    {
+        RoundSettlement settlement = state.roundSettlements.get((uint32)(state.betRoundSettlement.get(betSlot) & (BET_HISTORY_SIZE - 1)));
+        bet.payout = 0;
+        if (settlement.winningDirection == 2)
+        {
+            bet.payout = bet.amount;
+        }
+        else if (bet.direction == settlement.winningDirection && settlement.winningPool > 0)
+        {
+            bet.payout = div(uint128(settlement.poolAfterFee) * uint128(bet.amount), uint128(settlement.winningPool)).low;
+        }
+        bet.won = (bet.payout > 0);
+        bet.claimed = !bet.won;
+    }
+
+    // A bettor without unclaimed winnings whose bets have all left the bet history
+    inline static bit isInactiveBettor(const TickDerivState& state, const BettorInfo& bettorInfo)
+    {
+        return bettorInfo.claimable == 0 && (bettorInfo.lastBetRef == 0 || bettorInfo.lastBetRef + BET_HISTORY_SIZE <= state.betHistoryCount);
+    }
+
+    // Remove all inactive bettors from the bettors map (the slots are reused without cleanup)
+    inline static void removeInactiveBettors(TickDerivState& state)
+    {
+        sint64 elementIndex = state.bettors.nextElementIndex(NULL_INDEX);
+        while (elementIndex != NULL_INDEX)
+        {
+            if (isInactiveBettor(state, state.bettors.value(elementIndex)))
+            {
+                state.bettors.removeByIndex(elementIndex);
+            }
+            elementIndex = state.bettors.nextElementIndex(elementIndex);
+        }
+    }
+
+    // Record the settlement of the current round without touching its bets, return the total payout of the round.
+    // Rounding remainders of the payouts stay in the contract.
+    inline static uint64 recordRoundSettlement(TickDerivState& state)
+    {
+        RoundSettlement settlement;
+        settlement.roundId = state.currentRound.id;
+        settlement.winningDirection = state.currentRound.winningDirection;
+        settlement.poolAfterFee = state.currentRound.poolUp + state.currentRound.poolDown;
+        settlement.winningPool = 0;
+
+        uint64 totalPayout = settlement.poolAfterFee;
+        if (settlement.winningDirection != 2)
+        {
+            uint64 houseFee = (settlement.poolAfterFee * HOUSE_FEE_BPS) / BASIS_POINTS;
+            settlement.poolAfterFee = settlement.poolAfterFee - houseFee;
+            state.collectedFees = state.collectedFees + houseFee;
+
+            settlement.winningPool = (settlement.winningDirection == Direction::UP)
+                ? state.currentRound.poolUp
+                : state.currentRound.poolDown;
+            totalPayout = (settlement.winningPool > 0) ? settlement.poolAfterFee : 0;
+        }
+
+        if (state.currentBetCount > 0)
+        {
+            state.roundSettlements.set((uint32)(state.roundSettlementCount & (BET_HISTORY_SIZE - 1)), settlement);
+            state.roundSettlementCount++;
+        }
+
+        return totalPayout;
+    }
+
     REGISTER_USER_FUNCTIONS_AND_PROCEDURES()
     {
         REGISTER_USER_PROCEDURE(PlaceBet, 1);
         REGISTER_USER_PROCEDURE(ResolveRound, 2);
         REGISTER_USER_PROCEDURE(WithdrawFees, 3);
         REGISTER_USER_PROCEDURE(ClaimWinnings, 4);
+        REGISTER_USER_PROCEDURE(SetAutoPayout, 5);
         REGISTER_USER_FUNCTION(GetCurrentRound, 1);
         REGISTER_USER_FUNCTION(GetRoundHistory, 2);
         REGISTER_USER_FUNCTION(GetUserBets, 3);
@@ -496,7 +683,12 @@ public:
         state.collectedFees = 0;
         state.historyWriteIndex = 0;
         state.currentBetCount = 0;
-        state.allBetsCount = 0;
+        state.currentRoundFirstBet = 0;
+        state.betHistoryCount = 0;
+        state.roundSettlementCount = 0;
+        state.autoPayoutNextBet = 0;
+        state.autoPayoutEnabled = true;
+        state.bettors.reset();
 
         for (uint32 i = 0; i < HISTORY_SIZE; ++i)
         {
@@ -532,10 +724,39 @@ public:
         state.currentBetCount = 0;
     }
 
+    END_EPOCH()
+    {
+        removeInactiveBettors(state);
+        state.bettors.cleanupIfNeeded();
+    }
+
     BEGIN_TICK()
     {
         uint32 currentTick = qpi.tick();
 
+        // If enabled, pay out winnings of resolved rounds automatically, checking at most AUTO_PAYOUT_BETS_PER_TICK bets
+        // per tick. Bets that left the bet history have been credited to the bettor's claimable amount.
+        if (state.autoPayoutNextBet + BET_HISTORY_SIZE < state.betHistoryCount)
+        {
+            state.autoPayoutNextBet = state.betHistoryCount - BET_HISTORY_SIZE;
+        }
+        for (uint32 i = 0; state.autoPayoutEnabled && i < AUTO_PAYOUT_BETS_PER_TICK && state.autoPayoutNextBet < state.currentRoundFirstBet; ++i)
+        {
+            uint32 betSlot = (uint32)(state.autoPayoutNextBet & (BET_HISTORY_SIZE - 1));
+            BetRecord bet = state.betHistory.get(betSlot);
+            if (isUnsettled(bet))
+            {
+                settleBet(state, betSlot, bet);
+            }
+            if (bet.won && !bet.claimed)
+            {
+                qpi.transfer(bet.bettor, bet.payout);
+                bet.claimed = true;
+            }
+            state.betHistory.set(betSlot, bet);
+            state.autoPayoutNextBet++;
+        }
+
         if (state.currentRound.state == RoundState::ACTIVE)
         {
             if (currentTick >= state.currentRound.endTick)
@@ -574,76 +795,7 @@ public:
                         state.currentRound.winningDirection = 2;
                     }
 
-                    uint64 totalPool = state.currentRound.poolUp + state.currentRound.poolDown;
-                    uint64 totalPayout = 0;
-
-                    if (state.currentRound.winningDirection == 2)
-                    {
-                        for (uint32 i = 0; i < state.currentBetCount; ++i)
-                        {
-                            BetRecord bet = state.currentBets.get(i);
-                            totalPayout = totalPayout + bet.amount;
-                            bet.payout = bet.amount;
-                            bet.claimed = false;
-                            bet.won = true;
-                            state.currentBets.set(i, bet);
-
-                            for (uint32 j = 0; j < state.allBetsCount; ++j)
-                            {
-                                BetRecord storedBet = state.allBets.get(j);
-                                if (storedBet.bettor == bet.bettor && storedBet.roundId == bet.roundId && storedBet.timestamp == bet.timestamp)
-                                {
-                                    state.allBets.set(j, bet);
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    else
-                    {
-                        uint64 houseFee = (totalPool * HOUSE_FEE_BPS) / BASIS_POINTS;
-                        uint64 poolAfterFee = totalPool - houseFee;
-                        state.collectedFees = state.collectedFees + houseFee;
-
-                        uint64 winningPool = (state.currentRound.winningDirection == Direction::UP)
-                            ? state.currentRound.poolUp
-                            : state.currentRound.poolDown;
-
-                        for (uint32 i = 0; i < state.currentBetCount; ++i)
-                        {
-                            BetRecord bet = state.currentBets.get(i);
-
-                            if (bet.direction == state.currentRound.winningDirection)
-                            {
-                                if (winningPool > 0)
-                                {
-                                    uint64 payout = (poolAfterFee * bet.amount) / winningPool;
-                                    totalPayout = totalPayout + payout;
-                                    bet.payout = payout;
-                                    bet.claimed = false;
-                                    bet.won = true;
-                                }
-                            }
-                            else
-                            {
-                                bet.won = false;
-                                bet.payout = 0;
-                                bet.claimed = true;
-                            }
-
-                            state.currentBets.set(i, bet);
-
-                            for (uint32 j = 0; j < state.allBetsCount; ++j)
-                            {
-                                BetRecord storedBet = state.allBets.get(j);
-                                if (storedBet.bettor == bet.bettor && storedBet.roundId == bet.roundId && storedBet.timestamp == bet.timestamp)
-                                {
-                                    state.allBets.set(j, bet);
-                                    break;
-                                }
-                            }
-                        }
-                    }
+                    uint64 totalPayout = recordRoundSettlement(state);
 
                     state.currentRound.state = RoundState::COMPLETED;
                     state.currentRound.totalPayout = totalPayout;
@@ -675,6 +827,7 @@ public:
                     state.currentRound.winningDirection = 2;
                     state.currentRound.betCount = 0;
                     state.currentBetCount = 0;
+                    state.currentRoundFirstBet = state.betHistoryCount;
                 }
             }
         }
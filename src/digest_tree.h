@@ -0,0 +1,305 @@
+#pragma once
+
+#include "platform/global_var.h"
+#include "platform/m256.h"
+#include "platform/concurrency.h"
+
+#include "kangaroo_twelve.h"
+
+
+// Parallel computation of the K12 digest trees of spectrum, universe, and contract states.
+// The digests array of a tree holds the digests of all leafs, followed by the digests of each higher level,
+// ending with the root digest. The number of leafs must be a power of 2.
+//
+// The processor calling buildTree() or updateTree() (usually the tick processor) splits the work into
+// independent tasks and processes them together with all helper processors calling tryHelp() while they
+// are idle (request processors and solution processors). Each digest only depends on the digests of its
+// children, so the result does not depend on which processor computes which task. Within a task, sibling
+// pairs are hashed K12_64TO32_LANES at a time.
+class DigestTreeBuilder
+{
+public:
+    typedef void (*TaskFunction)(void* context, unsigned int taskIndex);
+
+    // Number of leafs per task in buildTree(). Each task hashes its leafs and computes their full subtree.
+    static constexpr unsigned int leafsPerBuildTask = 4096;
+
+    // Number of nodes per task in updateTree(). Levels with fewer nodes are updated by the calling processor.
+    static constexpr unsigned int nodesPerUpdateTask = 4096;
+
+    // Process tasks of the currently running job if there is one. Called by helper processors.
+    void tryHelp()
+    {
+        if (!jobActive)
+        {
+            return;
+        }
+        _InterlockedIncrement(&activeHelpers);
+        if (jobActive)
+        {
+            processTasks();
+        }
+        _InterlockedDecrement(&activeHelpers);
+    }
+
+    // Call taskFunction(context, taskIndex) for each taskIndex < numberOfTasks on the calling processor and
+    // all helpers. Returns after all tasks are finished.
+    void runTasks(unsigned int numberOfTasks, TaskFunction taskFunction, void* context)
+    {
+        if (numberOfTasks <= 1)
+        {
+            if (numberOfTasks)
+            {
+                taskFunction(context, 0);
+            }
+            return;
+        }
+
+        ACQUIRE(jobLock);
+
+        this->taskFunction = taskFunction;
+        this->taskContext = context;
+        this->numberOfTasks = numberOfTasks;
+        nextTask = 0;
+        finishedTasks = 0;
+        ATOMIC_STORE8(jobActive, 1);
+
+        processTasks();
+        WAIT_WHILE(finishedTasks < (long)numberOfTasks);
+
+        // Make sure no helper is left that may pick up a task of the next job before it is set up
+        ATOMIC_STORE8(jobActive, 0);
+        WAIT_WHILE(activeHelpers != 0);
+
+        RELEASE(jobLock);
+    }
+
+    // Call func(taskIndex) for each taskIndex < numberOfTasks in parallel (see runTasks()).
+    template <typename Func>
+    void run(unsigned int numberOfTasks, Func& func)
+    {
+        runTasks(numberOfTasks, callFunc<Func>, &func);
+    }
+
+    // Compute all digests of the tree from scratch. hashLeafs(begin, count) has to write the digests of the
+    // leafs begin to begin + count - 1 to digests[begin] to digests[begin + count - 1].
+    template <typename LeafHashFunc>
+    void buildTree(m256i* digests, unsigned int numberOfLeafs, LeafHashFunc& hashLeafs)
+    {
+        const unsigned int leafsPerTask = (numberOfLeafs < leafsPerBuildTask) ? numberOfLeafs : leafsPerBuildTask;
+        auto buildSubtree = [&](unsigned int taskIndex)
+        {
+            unsigned int begin = taskIndex * leafsPerTask;
+            hashLeafs(begin, leafsPerTask);
+            unsigned long long levelBeginning = 0;
+            unsigned int levelSize = numberOfLeafs;
+            unsigned int count = leafsPerTask;
+            while (count > 1)
+            {
+                KangarooTwelve64To32Batch(&digests[levelBeginning + begin], &digests[levelBeginning + levelSize + (begin >> 1)], count >> 1);
+                levelBeginning += levelSize;
+                levelSize >>= 1;
+                begin >>= 1;
+                count >>= 1;
+            }
+        };
+        const unsigned int numberOfSubtrees = numberOfLeafs / leafsPerTask;
+        run(numberOfSubtrees, buildSubtree);
+
+        // The levels above the subtree roots are small, so compute them in this processor
+        unsigned long long levelBeginning = 0;
+        unsigned int levelSize = numberOfLeafs;
+        while (levelSize > numberOfSubtrees)
+        {
+            levelBeginning += levelSize;
+            levelSize >>= 1;
+        }
+        while (levelSize > 1)
+        {
+            KangarooTwelve64To32Batch(&digests[levelBeginning], &digests[levelBeginning + levelSize], levelSize >> 1);
+            levelBeginning += levelSize;
+            levelSize >>= 1;
+        }
+    }
+
+    // Update digests of all leafs flagged in changeFlags (one bit per leaf) and of their ancestors.
+    // hashLeaf(index) has to write the digest of leaf index to digests[index]. Leafs are hashed in tasks of
+    // leafsPerTask leafs (power of 2), use small values if hashing a leaf is expensive. While updating,
+    // changeFlags is used for flagging the changed nodes of each level. It is all zero when returning.
+    template <typename LeafHashFunc>
+    void updateTree(m256i* digests, unsigned int numberOfLeafs, unsigned long long* changeFlags, LeafHashFunc& hashLeaf, unsigned int leafsPerTask = nodesPerUpdateTask)
+    {
+        if (leafsPerTask > numberOfLeafs)
+        {
+            leafsPerTask = numberOfLeafs;
+        }
+        auto hashChangedLeafs = [&](unsigned int taskIndex)
+        {
+            const unsigned int begin = taskIndex * leafsPerTask;
+            if (leafsPerTask >= 64)
+            {
+                // Skip 64 unchanged leafs at once
+                for (unsigned int wordIndex = begin >> 6; wordIndex < (begin + leafsPerTask) >> 6; wordIndex++)
+                {
+                    unsigned long long flags = changeFlags[wordIndex];
+                    while (flags)
+                    {
+                        hashLeaf((wordIndex << 6) + (unsigned int)_tzcnt_u64(flags));
+                        flags &= flags - 1;
+                    }
+                }
+            }
+            else
+            {
+                for (unsigned int i = begin; i < begin + leafsPerTask; i++)
+                {
+                    if (changeFlags[i >> 6] & (1ULL << (i & 63)))
+                    {
+                        hashLeaf(i);
+                    }
+                }
+            }
+        };
+        run(numberOfLeafs / leafsPerTask, hashChangedLeafs);
+
+        unsigned long long levelBeginning = 0;
+        unsigned int levelSize = numberOfLeafs;
+        while (levelSize > 1)
+        {
+            const unsigned int numberOfWords = (levelSize + 63) >> 6;
+            if (levelSize > nodesPerUpdateTask)
+            {
+                // Hash flagged pairs in parallel without modifying flags ...
+                auto hashChangedPairs = [&](unsigned int taskIndex)
+                {
+                    const unsigned int beginWord = taskIndex * (nodesPerUpdateTask >> 6);
+                    KangarooTwelve64To32Queue queue;
+                    for (unsigned int wordIndex = beginWord; wordIndex < beginWord + (nodesPerUpdateTask >> 6); wordIndex++)
+                    {
+                        unsigned long long flags = changeFlags[wordIndex];
+                        while (flags)
+                        {
+                            const unsigned int i = ((wordIndex << 6) + (unsigned int)_tzcnt_u64(flags)) & ~1U;
+                            queue.push(&digests[levelBeginning + i], &digests[levelBeginning + levelSize + (i >> 1)]);
+                            flags &= ~(3ULL << (i & 63));
+                        }
+                    }
+                    queue.flush();
+                };
+                run(levelSize / nodesPerUpdateTask, hashChangedPairs);
+
+                // ... and propagate flags to parent level afterwards
+                propagateChangeFlags(changeFlags, numberOfWords, nullptr, 0, 0);
+            }
+            else
+            {
+                propagateChangeFlags(changeFlags, numberOfWords, digests, levelBeginning, levelSize);
+            }
+            levelBeginning += levelSize;
+            levelSize >>= 1;
+        }
+
+        // Only the root flag is left
+        changeFlags[0] = 0;
+    }
+
+    // Update the digests of all ancestors of the leafs in changeList in the calling processor. This is cheaper than
+    // updateTree() if only few leafs have changed, because the cost does not depend on numberOfLeafs. The digests
+    // of the listed leafs must be up to date already. The list must not contain duplicates and changeFlags must have
+    // exactly the bits of the listed leafs set. changeList is overwritten and changeFlags is all zero when returning.
+    static void updateAncestors(m256i* digests, unsigned int numberOfLeafs, unsigned int* changeList, unsigned int listSize, unsigned long long* changeFlags)
+    {
+        KangarooTwelve64To32Queue queue;
+        unsigned long long levelBeginning = 0;
+        unsigned int levelSize = numberOfLeafs;
+        while (levelSize > 1)
+        {
+            // Clear flags of current level before reusing them for deduplicating parent nodes
+            for (unsigned int i = 0; i < listSize; i++)
+            {
+                changeFlags[changeList[i] >> 6] &= ~(1ULL << (changeList[i] & 63));
+            }
+            unsigned int parentListSize = 0;
+            for (unsigned int i = 0; i < listSize; i++)
+            {
+                const unsigned int parent = changeList[i] >> 1;
+                if (!(changeFlags[parent >> 6] & (1ULL << (parent & 63))))
+                {
+                    changeFlags[parent >> 6] |= (1ULL << (parent & 63));
+                    changeList[parentListSize++] = parent;
+                }
+            }
+            for (unsigned int i = 0; i < parentListSize; i++)
+            {
+                const unsigned int parent = changeList[i];
+                queue.push(&digests[levelBeginning + (parent << 1)], &digests[levelBeginning + levelSize + parent]);
+            }
+            queue.flush();
+            listSize = parentListSize;
+            levelBeginning += levelSize;
+            levelSize >>= 1;
+        }
+
+        // Only the root flag is left
+        changeFlags[0] = 0;
+    }
+
+private:
+    volatile char jobLock = 0;
+    volatile char jobActive = 0;
+    volatile long activeHelpers = 0;
+    volatile long nextTask = 0;
+    volatile long finishedTasks = 0;
+    long numberOfTasks = 0;
+    TaskFunction taskFunction = nullptr;
+    void* taskContext = nullptr;
+
+    template <typename Func>
+    static void callFunc(void* func, unsigned int taskIndex)
+    {
+        (*(Func*)func)(taskIndex);
+    }
+
+    void processTasks()
+    {
+        while (true)
+        {
+            const long taskIndex = _InterlockedIncrement(&nextTask) - 1;
+            if (taskIndex >= numberOfTasks)
+            {
+                break;
+            }
+            taskFunction(taskContext, (unsigned int)taskIndex);
+            _InterlockedIncrement(&finishedTasks);
+        }
+    }
+
+    // Replace flags of one level by flags of the parent level, hashing the flagged pairs if digests is given.
+    // Parent flags of word N are written to word N / 2, which has been processed before (or is N == 0).
+    static void propagateChangeFlags(unsigned long long* changeFlags, unsigned int numberOfWords, m256i* digests, unsigned long long levelBeginning, unsigned int levelSize)
+    {
+        KangarooTwelve64To32Queue queue;
+        for (unsigned int wordIndex = 0; wordIndex < numberOfWords; wordIndex++)
+        {
+            unsigned long long flags = changeFlags[wordIndex];
+            if (!flags)
+            {
+                continue;
+            }
+            changeFlags[wordIndex] = 0;
+            while (flags)
+            {
+                const unsigned int i = ((wordIndex << 6) + (unsigned int)_tzcnt_u64(flags)) & ~1U;
+                if (digests)
+                {
+                    queue.push(&digests[levelBeginning + i], &digests[levelBeginning + levelSize + (i >> 1)]);
+                }
+                flags &= ~(3ULL << (i & 63));
+                changeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
+            }
+        }
+        queue.flush();
+    }
+};
+
+GLOBAL_VAR_DECL DigestTreeBuilder digestTreeBuilder;
@@ -73,4 +73,13 @@ static unsigned long long logReaderPasscodes[4] = {
 // Perform state persisting when your node is misaligned will also make your node misaligned after resuming.
 // Thus, picking various TICK_STORAGE_AUTOSAVE_TICK_PERIOD numbers across AUX nodes is recommended.
 // some suggested prime numbers you can try: 971 977 983 991 997
-#define TICK_STORAGE_AUTOSAVE_TICK_PERIOD 1337
\ No newline at end of file
+#define TICK_STORAGE_AUTOSAVE_TICK_PERIOD 1337
+// Auto save writes full (base) files of spectrum, universe, and contract states only if more than
+// 1 / TICK_STORAGE_AUTOSAVE_DELTA_FRACTION of the spectrum or universe records have changed since the last base snapshot.
+// Otherwise, it only writes the changed records to delta files (see snapshot_delta.h). 0 disables delta snapshots.
+#define TICK_STORAGE_AUTOSAVE_DELTA_FRACTION 8
+// Save spectrum, universe, and digest tree files of snapshots in a chunked zlib format that is decompressed in
+// parallel on load (see platform/compressed_file.h). Files in both formats are loaded, so this can be changed between
+// restarts. The HTTP state downloads serve the compressed chunks as zip archives, but other tools reading the
+// snapshot files directly need to support the format. Linux only.
+#define NODE_STATE_COMPRESSION 0
\ No newline at end of file
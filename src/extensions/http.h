@@ -6,6 +6,7 @@ static unsigned long long httpPasscodes[4] = {};
 
 #include <drogon/drogon.h>
 #include "ticking/tick_storage.h"
+#include "state_export.h"
 
 using namespace drogon;
 
@@ -43,6 +44,86 @@ class QubicHttpServer
 {
 private:
     static inline std::string hiddenFolder = ".qubic-tmp";
+    static inline StateExportCache stateExports{hiddenFolder};
+
+    // Send a file or the part requested by the Range header, so interrupted downloads can be resumed
+    static void sendFile(const HttpRequestPtr &req,
+                         const std::function<void(const HttpResponsePtr &)> &callback,
+                         const std::string &path, unsigned long long fileSize,
+                         const std::string &fileName, const std::string &etag)
+    {
+        unsigned long long offset, length;
+        ByteRangeType rangeType = parseByteRange(req->getHeader("Range"), fileSize, offset, length);
+        const std::string &ifRange = req->getHeader("If-Range");
+        if (!ifRange.empty() && ifRange != etag)
+        {
+            // The file has changed since the first part was downloaded
+            rangeType = ByteRangeFull;
+        }
+
+        HttpResponsePtr resp;
+        if (rangeType == ByteRangeUnsatisfiable)
+        {
+            resp = HttpResponse::newHttpResponse();
+            resp->setStatusCode(k416RequestedRangeNotSatisfiable);
+            resp->addHeader("Content-Range", "bytes */" + std::to_string(fileSize));
+        }
+        else if (rangeType == ByteRangePartial)
+        {
+            resp = HttpResponse::newFileResponse(path, offset, length, true);
+        }
+        else
+        {
+            resp = HttpResponse::newFileResponse(path);
+        }
+        resp->addHeader("Accept-Ranges", "bytes");
+        resp->addHeader("ETag", etag);
+        resp->addHeader("Content-Disposition", "attachment; filename=\"" + fileName + "\"");
+        callback(resp);
+    }
+
+    // Send the state file of the current epoch (such as spectrum.123), or with zip=true its zip archive. The archive
+    // is built once per epoch in the background, requests wait for it without blocking a handler thread.
+    static void exportState(const std::string &stateName,
+                            const HttpRequestPtr &req,
+                            std::function<void(const HttpResponsePtr &)> &&callback)
+    {
+        const std::string fileName = stateName + "." + std::to_string(system.epoch);
+        if (req->getParameter("zip") != "true")
+        {
+            struct stat fileStat;
+            if (stat(fileName.c_str(), &fileStat) != 0)
+            {
+                auto resp = HttpResponse::newHttpResponse();
+                resp->setStatusCode(k404NotFound);
+                resp->setBody("File not found");
+                callback(resp);
+                return;
+            }
+            char etag[64];
+            snprintf(etag, sizeof(etag), "\"%llx-%llx\"", (unsigned long long)fileStat.st_size,
+                     (unsigned long long)fileStat.st_mtim.tv_sec * 1000000000ULL + fileStat.st_mtim.tv_nsec);
+            sendFile(req, callback, fileName, fileStat.st_size, fileName, etag);
+            return;
+        }
+
+        stateExports.get(fileName,
+            [req, callback = std::move(callback), stateName, fileName](const StateExport &stateExport)
+            {
+                if (stateExport.path.empty())
+                {
+                    auto resp = HttpResponse::newHttpResponse();
+                    resp->setStatusCode(k500InternalServerError);
+                    resp->setBody("Failed to create zip file: " + stateExport.error);
+                    callback(resp);
+                    return;
+                }
+                char crcHex[9];
+                snprintf(crcHex, sizeof(crcHex), "%08x", stateExport.crc32);
+                sendFile(req, callback, stateExport.path, stateExport.size, stateName + ".zip",
+                         "\"" + fileName + "-" + crcHex + "\"");
+            });
+    }
 
     static void __http_thread(int port)
     {
@@ -166,10 +247,12 @@ private:
                 unsigned int tick = std::stoul(tickStr);
                 TickData localTickData;
                 TickStorage::tickData.acquireLock();
-                TickData* tickData = TickStorage::tickData.getByTickIfNotEmpty(tick);
+                unsigned int tickDataIndex;
+                TickData* tickData = TickStorage::tickData.pinByTickIfNotEmpty(tick, tickDataIndex);
                 if (tickData)
                 {
                     copyMem(&localTickData, tickData, sizeof(TickData));
+                    TickStorage::tickData.unpinByIndex(tickDataIndex);
                 }
                 TickStorage::tickData.releaseLock();
                 if (!tickData)
@@ -221,13 +304,17 @@ private:
                 unsigned int tick = std::stoul(tickStr);
                 Tick localTicks[NUMBER_OF_COMPUTORS];
                 setMem(localTicks, sizeof(localTicks), 0);
-                for (int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+                if (TickStorage::tickInCurrentEpochStorage(tick))
                 {
-                    TickStorage::ticks.acquireLock(i);
-                    Tick* tickVote = TickStorage::ticks.getByTickInCurrentEpoch(tick) + i;
-                    if (tickVote)
-                        copyMem(&localTicks[i], tickVote, sizeof(Tick));
-                    TickStorage::ticks.releaseLock(i);
+                    const unsigned int tickIndex = TickStorage::tickToIndexCurrentEpoch(tick);
+                    const Tick* tickVotes = TickStorage::ticks.pinByTickIndex(tickIndex);
+                    for (int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+                    {
+                        TickStorage::ticks.acquireLock(i);
+                        copyMem(&localTicks[i], tickVotes + i, sizeof(Tick));
+                        TickStorage::ticks.releaseLock(i);
+                    }
+                    TickStorage::ticks.unpinByTickIndex(tickIndex);
                 }
                 Json::Value json(Json::arrayValue);
                 for (int i = 0; i < NUMBER_OF_COMPUTORS; i++)
@@ -324,42 +411,7 @@ private:
             [](const HttpRequestPtr &req,
                std::function<void(const HttpResponsePtr &)> &&callback)
             {
-                bool isZip = req->getParameter("zip") == "true";
-                std::string path;
-                if (isZip)
-                {
-                    path = hiddenFolder + "/" + "spectrum.zip";
-                }
-                else
-                {
-                    path = "spectrum." + std::to_string(system.epoch);
-                }
-
-                // create zip if not exists in .qubic-tmp/
-                if (isZip && !std::filesystem::exists(path))
-                {
-                    // check if hidden folder exists
-                    if (!std::filesystem::exists(hiddenFolder + "/"))
-                    {
-                        std::filesystem::create_directory(hiddenFolder);
-                    }
-
-                    std::string inputFile = "spectrum." + std::to_string(system.epoch);
-                    std::string command = "zip -j " + path + " " + inputFile;
-                    if (exec(command.c_str()) != 0)
-                    {
-                        auto resp = HttpResponse::newHttpResponse();
-                        resp->setStatusCode(k500InternalServerError);
-                        resp->setBody("Failed to create zip file");
-                        callback(resp);
-                        return;
-                    }
-                }
-
-                auto resp = HttpResponse::newFileResponse(path);
-                std::string fileName = isZip ? "spectrum.zip" : ("spectrum." + std::to_string(system.epoch));
-                resp->addHeader("Content-Disposition", "attachment; filename=\"" + fileName + "\"");
-                callback(resp);
+                exportState("spectrum", req, std::move(callback));
             }, {drogon::Get, "MiddleWare::PasscodeVerifier"});
 
         app.registerHandler(
@@ -367,41 +419,7 @@ private:
             [](const HttpRequestPtr &req,
                std::function<void(const HttpResponsePtr &)> &&callback)
             {
-                bool isZip = req->getParameter("zip") == "true";
-                std::string path;
-                if (isZip)
-                {
-                    path = hiddenFolder + "/" + "universe.zip";
-                }
-                else
-                {
-                    path = "universe." + std::to_string(system.epoch);
-                }
-
-                // create zip if not exists in .qubic-tmp/
-                if (isZip && !std::filesystem::exists(path))
-                {
-                    // check if hidden folder exists
-                    if (!std::filesystem::exists(hiddenFolder + "/"))
-                    {
-                        std::filesystem::create_directory(hiddenFolder);
-                    }
-                    std::string inputFile = "universe." + std::to_string(system.epoch);
-                    std::string command = "zip -j " + path + " " + inputFile;
-                    if (exec(command.c_str()) != 0)
-                    {
-                        Json::Value json;
-                        json["error"] = "Failed to create zip file";
-                        auto resp = HttpResponse::newHttpJsonResponse(json);
-                        callback(resp);
-                        return;
-                    }
-                }
-
-                auto resp = HttpResponse::newFileResponse(path);
-                std::string fileName = isZip ? "universe.zip" : ("universe." + std::to_string(system.epoch));
-                resp->addHeader("Content-Disposition", "attachment; filename=\"" + fileName + "\"");
-                callback(resp);
+                exportState("universe", req, std::move(callback));
             }, {drogon::Get, "MiddleWare::PasscodeVerifier"});
 
         app.registerHandler(
@@ -24,10 +24,12 @@
 #include <netinet/in.h>
 #include <poll.h>
 #include <sys/mman.h>
+#include <signal.h>
 #include <cstddef>
 #include <mutex>
 #include <condition_variable>
 #include <queue>
+#include "extensions/socket_reactor.h"
 #endif
 
 #define ACQUIRE_NO_SPINNING(lock) while (_InterlockedCompareExchange8(&lock, 1, 0)) std::this_thread::sleep_for(std::chrono::milliseconds(1));
@@ -154,6 +156,38 @@ inline bool qVirtualFreeAndRecommit(void* address, const unsigned long long size
 	}
     return VirtualAlloc(address, (SIZE_T)size, MEM_COMMIT, PAGE_READWRITE) != address;
 }
+
+inline void qVirtualFree(void* address, const unsigned long long size) {
+    commitMemMap.erase((unsigned long long)address);
+    VirtualFree(address, 0, MEM_RELEASE);
+}
+
+inline bool qVirtualProtect(void* address, const unsigned long long size, bool writable) {
+    DWORD oldProtect;
+    return VirtualProtect(address, (SIZE_T)size, writable ? PAGE_READWRITE : PAGE_READONLY, &oldProtect) != 0;
+}
+
+// Handler for writes to read-only memory: returns true if it has made the memory writable, so the write can be retried
+typedef bool (*WriteFaultHandler)(void* address);
+inline WriteFaultHandler writeFaultHandler = nullptr;
+
+inline LONG CALLBACK writeFaultExceptionHandler(PEXCEPTION_POINTERS exceptionInfo) {
+    const EXCEPTION_RECORD* record = exceptionInfo->ExceptionRecord;
+    if (record->ExceptionCode == EXCEPTION_ACCESS_VIOLATION && record->NumberParameters >= 2
+        && record->ExceptionInformation[0] == 1 && writeFaultHandler && writeFaultHandler((void*)record->ExceptionInformation[1]))
+    {
+        return EXCEPTION_CONTINUE_EXECUTION;
+    }
+    return EXCEPTION_CONTINUE_SEARCH;
+}
+
+inline void qSetWriteFaultHandler(WriteFaultHandler handler) {
+    if (!writeFaultHandler)
+    {
+        AddVectoredExceptionHandler(1, writeFaultExceptionHandler);
+    }
+    writeFaultHandler = handler;
+}
 #else
 inline void* qVirtualAlloc(const unsigned long long size, bool commitMem = false) {
     int prot = commitMem ? (PROT_READ | PROT_WRITE) : PROT_NONE;
@@ -189,6 +223,42 @@ inline bool qVirtualFreeAndRecommit(void* address, const unsigned long long size
     return mmap(address, size, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == address;
 }
 
+inline void qVirtualFree(void* address, const unsigned long long size) {
+    commitMemMap.erase((unsigned long long)address);
+    munmap(address, size);
+}
+
+inline bool qVirtualProtect(void* address, const unsigned long long size, bool writable) {
+    return mprotect(address, size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ) == 0;
+}
+
+// Handler for writes to read-only memory: returns true if it has made the memory writable, so the write can be retried
+typedef bool (*WriteFaultHandler)(void* address);
+inline WriteFaultHandler writeFaultHandler = nullptr;
+inline struct sigaction previousSegvAction;
+
+inline void writeFaultSignalHandler(int signal, siginfo_t* info, void* context) {
+    if (writeFaultHandler && writeFaultHandler(info->si_addr))
+    {
+        return;
+    }
+    // Not caused by write tracking: restore previous handling, so the retried instruction faults again and crashes
+    sigaction(SIGSEGV, &previousSegvAction, nullptr);
+}
+
+inline void qSetWriteFaultHandler(WriteFaultHandler handler) {
+    if (!writeFaultHandler)
+    {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = writeFaultSignalHandler;
+        action.sa_flags = SA_SIGINFO | SA_NODEFER;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, &previousSegvAction);
+    }
+    writeFaultHandler = handler;
+}
+
 #endif
 
 void updateTime() {
@@ -290,6 +360,8 @@ struct Overload {
         volatile char receiveLock;
         volatile char sendLock;
         ConnectStatus connectStatus;
+        // ID of socket in socketReactor (Linux only, 0 if socket is not registered)
+        unsigned long long reactorSocketId;
     };
 
     struct EventData {
@@ -312,12 +384,18 @@ struct Overload {
 
     inline static std::vector<std::thread> threads;
     inline static std::map<unsigned long long, SOCKET> incomingSocketMap;
+    inline static std::mutex incomingSocketMapLock;
     inline static std::map<unsigned long long, TcpData> tcpDataMap;
     inline static std::map<unsigned long long, EventData> eventDataMap;
     inline static std::map<unsigned long long, bool> isReceiveThreadSetupMap;
     inline static std::map<unsigned long long, bool> isSendThreadSetupMap;
     inline static EventQueue<TransmitRequest> transmitQueue;
     inline static EventQueue<ReceiveRequest> receiveQueue;
+#ifdef __linux__
+    // Number of threads handling the socket events, see SocketReactor
+    static constexpr unsigned int NUMBER_OF_NETWORK_IO_THREADS = 2;
+    inline static SocketReactor socketReactor;
+#endif
 
     // Directly call the setup function without using custom stack.
     static void startThread(EFI_AP_PROCEDURE procedure, void* data, unsigned long long ProcessorNumber, EFI_EVENT WaitEvent, unsigned long long TimeoutInMicroseconds) {
@@ -454,12 +532,20 @@ struct Overload {
         if (memcmp(Protocol, &tcp4ProtocolGuid, sizeof(EFI_GUID)) == 0) {
             *Interface = new EFI_TCP4_PROTOCOL;
             // Check if this is a incomming socket and set socket instance if it is
+            std::unique_lock<std::mutex> incomingSocketMapGuard(incomingSocketMapLock);
             if (incomingSocketMap.contains((unsigned long long)Handle)) {
                 TcpData& tcpData = tcpDataMap[(unsigned long long) * Interface];
                 tcpData.socket = incomingSocketMap[(unsigned long long)Handle];
+#ifdef __linux__
+                tcpData.reactorSocketId = socketReactor.add(tcpData.socket, false);
+                if (!tcpData.reactorSocketId) {
+                    tcpData.socket = INVALID_SOCKET;
+                }
+#endif
 
                 incomingSocketMap.erase((unsigned long long)Handle);
             }
+            incomingSocketMapGuard.unlock();
 
             // Map handle to the tcp4Protocol so we can get tcp4Protocol from the handle
             *(unsigned long long*)Handle = (unsigned long long) * Interface;
@@ -648,6 +734,14 @@ struct Overload {
         unsigned long long key = *(unsigned long long*)ChildHandle;
 		if (tcpDataMap.contains(key)) {
 			TcpData& tcpData = tcpDataMap[key];
+#ifdef __linux__
+			if (tcpData.reactorSocketId) {
+				// Closes the socket
+				socketReactor.remove(tcpData.reactorSocketId);
+				tcpData.reactorSocketId = 0;
+				tcpData.socket = INVALID_SOCKET;
+			}
+#endif
 			if (tcpData.socket != INVALID_SOCKET) {
 				closesocket(tcpData.socket);
 				tcpData.socket = INVALID_SOCKET;
@@ -704,7 +798,11 @@ struct Overload {
             return EFI_ABORTED;
         }
 
+#ifdef __linux__
+        return socketReactor.transmit(tcpData->reactorSocketId, Token);
+#else
         transmitQueue.push({ tcpData->socket, Token});
+#endif
 
         return EFI_SUCCESS;
     }
@@ -733,7 +831,11 @@ struct Overload {
             return EFI_ABORTED;
         }
 
+#ifdef __linux__
+        return socketReactor.receive(tcpData->reactorSocketId, Token);
+#else
         receiveQueue.push({ tcpData->socket, Token});
+#endif
 
         return EFI_SUCCESS;
     }
@@ -801,6 +903,13 @@ struct Overload {
     static EFI_STATUS Configure(IN void* This, IN EFI_TCP4_CONFIG_DATA* TcpConfigData OPTIONAL) {
         static bool isGlobalSocketInitialized = false;
         if (!TcpConfigData) {
+#ifdef __linux__
+            // Reset instance: abort pending operations like the UEFI implementation does, so the peer can be closed
+            auto it = tcpDataMap.find((unsigned long long)This);
+            if (it != tcpDataMap.end() && it->second.reactorSocketId) {
+                socketReactor.abort(it->second.reactorSocketId);
+            }
+#endif
             return EFI_SUCCESS;
         }
 
@@ -811,6 +920,7 @@ struct Overload {
         data.receiveLock = 0;
         data.sendLock = 0;
         data.connectStatus = ConnectStatus::Disconnected;
+        data.reactorSocketId = 0;
         // Global set up for accepting new connections
         if ((unsigned long long)This == (unsigned long long)peerTcp4Protocol && !isGlobalSocketInitialized) {
             #ifdef _MSC_VER
@@ -851,6 +961,14 @@ struct Overload {
 
             logToConsole(L"Socket binded");
             data.socket = sock;
+#ifdef __linux__
+            fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+            data.reactorSocketId = socketReactor.add(sock, true);
+            if (!data.reactorSocketId) {
+                logToConsole(L"Failed to register listening socket!");
+                return EFI_ABORTED;
+            }
+#endif
 			isGlobalSocketInitialized = true;
         }
 
@@ -871,6 +989,9 @@ struct Overload {
             return EFI_UNSUPPORTED;
         }
 
+#ifdef __linux__
+        return socketReactor.accept(tcpData->reactorSocketId, ListenToken);
+#else
         // accept in a thread
         std::thread acceptThread([tcpData, ListenToken]() {
             sockaddr_in addr{};
@@ -895,15 +1016,21 @@ struct Overload {
             ioctlsocket(clientSocket, FIONBIO, &mode);
 #endif
 
-            CreateChild(NULL, &ListenToken->NewChildHandle);
-            // At this point we dont know the tcp4Protocol for this peer (tcp4Protocol will be inititialzed in peerConnectionNewlyEstablished())
-            // so we map the clientSocket to the handle to process it later in peerConnectionNewlyEstablished()
-            incomingSocketMap[(unsigned long long)ListenToken->NewChildHandle] = clientSocket;
+            registerIncomingSocket(ListenToken, clientSocket);
             ListenToken->CompletionToken.Status = EFI_SUCCESS;
             tcpData->connectStatus = ConnectStatus::Connected;
             });
         acceptThread.detach();
         return EFI_SUCCESS;
+#endif
+    }
+
+    static void registerIncomingSocket(EFI_TCP4_LISTEN_TOKEN* ListenToken, SOCKET clientSocket) {
+        CreateChild(NULL, &ListenToken->NewChildHandle);
+        // At this point we dont know the tcp4Protocol for this peer (tcp4Protocol will be inititialzed in peerConnectionNewlyEstablished())
+        // so we map the clientSocket to the handle to process it later in peerConnectionNewlyEstablished()
+        std::lock_guard<std::mutex> incomingSocketMapGuard(incomingSocketMapLock);
+        incomingSocketMap[(unsigned long long)ListenToken->NewChildHandle] = clientSocket;
     }
 
     static EFI_STATUS Connect(IN void* This, IN EFI_TCP4_CONNECTION_TOKEN* ConnectionToken) {
@@ -917,7 +1044,11 @@ struct Overload {
             logToConsole(L"No Tcp Data For This Connect!");
             return EFI_UNSUPPORTED;
         }
+#ifdef __linux__
+        SOCKET sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+#else
         SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+#endif
         if (sock == INVALID_SOCKET) {
             logToConsole(L"Socket creation failed!!");
 
@@ -935,6 +1066,21 @@ struct Overload {
         #endif
 
         unsigned int ipInNumber = *(unsigned int*)tcpData->configData.AccessPoint.RemoteAddress.Addr;
+#ifdef __linux__
+        // Delay reconnecting to the same IP like below, but without blocking a thread
+        auto now = std::chrono::system_clock::now();
+        long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+        unsigned long long delayMilliseconds = (ms - latestConnectTimestampMap[ipInNumber] < 2'000) ? 5'000 : 0;
+        latestConnectTimestampMap[ipInNumber] = ms + delayMilliseconds;
+
+        tcpData->reactorSocketId = socketReactor.add(sock, false);
+        if (!tcpData->reactorSocketId) {
+            tcpData->socket = INVALID_SOCKET;
+            return EFI_ABORTED;
+        }
+        tcpData->connectStatus = ConnectStatus::Connecting;
+        return socketReactor.connect(tcpData->reactorSocketId, serverAddr, ConnectionToken, delayMilliseconds);
+#else
         // connect in a thread
         std::thread connectThread([tcpData, serverAddr, ConnectionToken, ipInNumber]() {
             auto now = std::chrono::system_clock::now();
@@ -961,6 +1107,7 @@ struct Overload {
         connectThread.detach();
 
         return EFI_SUCCESS;
+#endif
     }
 
     static void transmitProcessor()
@@ -1117,11 +1264,18 @@ struct Overload {
         st->ConOut->ClearScreen = Overload::ClearScreen;
         st->ConIn->ReadKeyStroke = Overload::ReadKeyStroke;
 
+#ifdef __linux__
+        // Start threads handling the socket events
+        if (!socketReactor.start(NUMBER_OF_NETWORK_IO_THREADS, registerIncomingSocket)) {
+            logToConsole(L"Failed to start socket reactor!");
+        }
+#else
         // Open transmit and receive processor threads
         std::thread transmitProcessorThread(transmitProcessor);
         transmitProcessorThread.detach();
         std::thread receiveProcessorThread(receiveProcessor);
         receiveProcessorThread.detach();
+#endif
     }
 };
 
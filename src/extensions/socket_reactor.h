@@ -0,0 +1,593 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "lib/platform_efi/uefi.h"
+
+// Event-driven backend of the EFI_TCP4_PROTOCOL emulation in the Linux build (see Overload).
+//
+// Each socket is registered edge-triggered with the epoll instance of one of the I/O threads. An operation requested
+// by the main loop (Connect, Accept, Receive, Transmit) is tried right away on the calling thread, because usually
+// data or buffer space is available. Only if the socket would block, the token is parked in the socket state and
+// completed by the I/O thread as soon as epoll reports the socket ready. Trying the operation and parking the token
+// happen while holding the socket lock, so no readiness edge is lost in between.
+//
+// Tokens are completed by setting CompletionToken.Status, which the main loop polls (see peers.h). After abort() or
+// remove() returned, no pending token of the socket is touched anymore.
+class SocketReactor
+{
+public:
+    // Called for each accepted connection (with the lock of the listening socket held). Has to set
+    // token->NewChildHandle, so the main loop can open the protocol of the new connection.
+    typedef void (*AcceptHandler)(EFI_TCP4_LISTEN_TOKEN* token, int socket);
+
+    static constexpr unsigned int maxNumberOfThreads = 8;
+
+    // Tokens with more fragments are completed with EFI_INVALID_PARAMETER
+    static constexpr unsigned int maxNumberOfFragments = 16;
+
+    // Transmissions not finished within this time are completed with EFI_TIMEOUT
+    static constexpr long long transmitTimeoutMilliseconds = 1000;
+
+    // Interval of checking transmit timeouts and delayed connects
+    static constexpr int timerIntervalMilliseconds = 50;
+
+    bool start(unsigned int numberOfThreads, AcceptHandler acceptHandler)
+    {
+        if (numberOfThreads < 1)
+        {
+            numberOfThreads = 1;
+        }
+        if (numberOfThreads > maxNumberOfThreads)
+        {
+            numberOfThreads = maxNumberOfThreads;
+        }
+        this->acceptHandler = acceptHandler;
+        for (unsigned int i = 0; i < numberOfThreads; i++)
+        {
+            epollFds[i] = epoll_create1(EPOLL_CLOEXEC);
+            if (epollFds[i] < 0)
+            {
+                return false;
+            }
+        }
+        this->numberOfThreads = numberOfThreads;
+        for (unsigned int i = 0; i < numberOfThreads; i++)
+        {
+            std::thread ioThread(&SocketReactor::runLoop, this, i);
+            ioThread.detach();
+        }
+        return true;
+    }
+
+    // Register a non-blocking socket, which is owned by the reactor from now on. Returns the ID used in all other
+    // calls or 0 on error (the socket is closed in this case).
+    unsigned long long add(int socket, bool listening)
+    {
+        std::shared_ptr<Socket> s = std::make_shared<Socket>();
+        s->fd = socket;
+        s->listening = listening;
+        if (!listening)
+        {
+            // Nagle's algorithm would delay small messages such as tick votes (peers coalesce their messages anyway)
+            int opt = 1;
+            setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        }
+
+        std::lock_guard<std::mutex> registryGuard(registryLock);
+        const unsigned long long id = nextId++;
+        s->loopIndex = (unsigned int)(id % numberOfThreads);
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.u64 = id;
+        if (epoll_ctl(epollFds[s->loopIndex], EPOLL_CTL_ADD, socket, &event) < 0)
+        {
+            close(socket);
+            return 0;
+        }
+        sockets.emplace(id, s);
+        return id;
+    }
+
+    // Complete all pending tokens with EFI_ABORTED and shut down the connection. Further operations fail.
+    void abort(unsigned long long id)
+    {
+        std::shared_ptr<Socket> s = find(id);
+        if (s)
+        {
+            std::lock_guard<std::mutex> socketGuard(s->lock);
+            if (!s->closed)
+            {
+                s->closed = true;
+                abortPendingTokens(*s);
+                if (!s->listening)
+                {
+                    shutdown(s->fd, SHUT_RDWR);
+                }
+            }
+        }
+    }
+
+    // Abort and close the socket and forget the ID.
+    void remove(unsigned long long id)
+    {
+        std::shared_ptr<Socket> s;
+        {
+            std::lock_guard<std::mutex> registryGuard(registryLock);
+            auto it = sockets.find(id);
+            if (it == sockets.end())
+            {
+                return;
+            }
+            s = it->second;
+            sockets.erase(it);
+        }
+
+        std::lock_guard<std::mutex> socketGuard(s->lock);
+        s->closed = true;
+        abortPendingTokens(*s);
+        epoll_ctl(epollFds[s->loopIndex], EPOLL_CTL_DEL, s->fd, nullptr);
+        close(s->fd);
+        s->fd = -1;
+    }
+
+    // Start connecting to address after delayMilliseconds.
+    EFI_STATUS connect(unsigned long long id, const sockaddr_in& address, EFI_TCP4_CONNECTION_TOKEN* token, unsigned long long delayMilliseconds)
+    {
+        std::shared_ptr<Socket> s = find(id);
+        if (!s)
+        {
+            return EFI_ABORTED;
+        }
+        std::lock_guard<std::mutex> socketGuard(s->lock);
+        if (s->closed || s->connectToken)
+        {
+            return EFI_ACCESS_DENIED;
+        }
+        s->connectToken = token;
+        s->connectAddress = address;
+        s->connectStarted = false;
+        if (delayMilliseconds)
+        {
+            s->connectNotBefore = milliseconds() + delayMilliseconds;
+            s->hasTimer = true;
+        }
+        else
+        {
+            startConnect(*s);
+        }
+        return EFI_SUCCESS;
+    }
+
+    EFI_STATUS accept(unsigned long long id, EFI_TCP4_LISTEN_TOKEN* token)
+    {
+        std::shared_ptr<Socket> s = find(id);
+        if (!s)
+        {
+            return EFI_ABORTED;
+        }
+        std::lock_guard<std::mutex> socketGuard(s->lock);
+        if (s->closed || !s->listening)
+        {
+            return EFI_ACCESS_DENIED;
+        }
+        s->acceptTokens.push_back(token);
+        if (s->acceptTokens.size() == 1)
+        {
+            acceptPendingConnections(*s);
+        }
+        return EFI_SUCCESS;
+    }
+
+    EFI_STATUS receive(unsigned long long id, EFI_TCP4_IO_TOKEN* token)
+    {
+        std::shared_ptr<Socket> s = find(id);
+        if (!s)
+        {
+            complete(token->CompletionToken, EFI_ABORTED);
+            return EFI_ABORTED;
+        }
+        std::lock_guard<std::mutex> socketGuard(s->lock);
+        if (s->closed || s->receiveToken)
+        {
+            complete(token->CompletionToken, EFI_ABORTED);
+            return EFI_ABORTED;
+        }
+        s->receiveToken = token;
+        tryReceive(*s);
+        return EFI_SUCCESS;
+    }
+
+    EFI_STATUS transmit(unsigned long long id, EFI_TCP4_IO_TOKEN* token)
+    {
+        std::shared_ptr<Socket> s = find(id);
+        if (!s)
+        {
+            complete(token->CompletionToken, EFI_ABORTED);
+            return EFI_ABORTED;
+        }
+        std::lock_guard<std::mutex> socketGuard(s->lock);
+        if (s->closed || s->transmitToken)
+        {
+            complete(token->CompletionToken, EFI_ABORTED);
+            return EFI_ABORTED;
+        }
+        s->transmitToken = token;
+        s->transmittedSize = 0;
+        s->transmitDeadline = milliseconds() + transmitTimeoutMilliseconds;
+        if (!tryTransmit(*s))
+        {
+            s->hasTimer = true;
+        }
+        return EFI_SUCCESS;
+    }
+
+private:
+    struct Socket
+    {
+        std::mutex lock;
+        int fd = -1;
+        unsigned int loopIndex = 0;
+        bool listening = false;
+        bool closed = false;
+
+        // Set if connect deadline or transmit deadline has to be checked by the I/O thread
+        std::atomic<bool> hasTimer = false;
+
+        EFI_TCP4_CONNECTION_TOKEN* connectToken = nullptr;
+        sockaddr_in connectAddress{};
+        unsigned long long connectNotBefore = 0;
+        bool connectStarted = false;
+
+        std::deque<EFI_TCP4_LISTEN_TOKEN*> acceptTokens;
+
+        EFI_TCP4_IO_TOKEN* receiveToken = nullptr;
+
+        EFI_TCP4_IO_TOKEN* transmitToken = nullptr;
+        unsigned long long transmittedSize = 0;
+        unsigned long long transmitDeadline = 0;
+    };
+
+    AcceptHandler acceptHandler = nullptr;
+    unsigned int numberOfThreads = 1;
+    int epollFds[maxNumberOfThreads] = {};
+
+    std::mutex registryLock;
+    std::unordered_map<unsigned long long, std::shared_ptr<Socket>> sockets;
+    unsigned long long nextId = 1;
+
+    static unsigned long long milliseconds()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Publish the result of an operation to the main loop, which may read the other token fields right afterwards
+    static void complete(EFI_TCP4_COMPLETION_TOKEN& token, EFI_STATUS status)
+    {
+        std::atomic_thread_fence(std::memory_order_release);
+        *((volatile EFI_STATUS*)&token.Status) = status;
+    }
+
+    std::shared_ptr<Socket> find(unsigned long long id)
+    {
+        std::lock_guard<std::mutex> registryGuard(registryLock);
+        auto it = sockets.find(id);
+        return (it == sockets.end()) ? nullptr : it->second;
+    }
+
+    // Set iov to the fragments after the first skipSize bytes (empty fragments are left out). Returns false if there
+    // are more than maxNumberOfFragments fragments.
+    static bool getFragments(const EFI_TCP4_FRAGMENT_DATA* fragmentTable, unsigned int fragmentCount, unsigned long long skipSize, iovec* iov, unsigned int& count)
+    {
+        count = 0;
+        if (fragmentCount > maxNumberOfFragments)
+        {
+            return false;
+        }
+        for (unsigned int i = 0; i < fragmentCount; i++)
+        {
+            const unsigned long long length = fragmentTable[i].FragmentLength;
+            if (skipSize >= length)
+            {
+                skipSize -= length;
+                continue;
+            }
+            iov[count].iov_base = (char*)fragmentTable[i].FragmentBuffer + skipSize;
+            iov[count].iov_len = length - skipSize;
+            skipSize = 0;
+            count++;
+        }
+        return true;
+    }
+
+    // All following functions expect the socket lock to be held
+
+    static void abortPendingTokens(Socket& s)
+    {
+        if (s.connectToken)
+        {
+            complete(s.connectToken->CompletionToken, EFI_ABORTED);
+            s.connectToken = nullptr;
+        }
+        for (EFI_TCP4_LISTEN_TOKEN* token : s.acceptTokens)
+        {
+            complete(token->CompletionToken, EFI_ABORTED);
+        }
+        s.acceptTokens.clear();
+        if (s.receiveToken)
+        {
+            complete(s.receiveToken->CompletionToken, EFI_ABORTED);
+            s.receiveToken = nullptr;
+        }
+        if (s.transmitToken)
+        {
+            complete(s.transmitToken->CompletionToken, EFI_ABORTED);
+            s.transmitToken = nullptr;
+        }
+        s.hasTimer = false;
+    }
+
+    static void startConnect(Socket& s)
+    {
+        s.connectStarted = true;
+        if (::connect(s.fd, (const sockaddr*)&s.connectAddress, sizeof(s.connectAddress)) == 0)
+        {
+            complete(s.connectToken->CompletionToken, EFI_SUCCESS);
+            s.connectToken = nullptr;
+        }
+        else if (errno != EINPROGRESS && errno != EINTR)
+        {
+            complete(s.connectToken->CompletionToken, EFI_ABORTED);
+            s.connectToken = nullptr;
+        }
+    }
+
+    static void finishConnect(Socket& s)
+    {
+        int error = 0;
+        socklen_t errorSize = sizeof(error);
+        if (getsockopt(s.fd, SOL_SOCKET, SO_ERROR, &error, &errorSize) < 0)
+        {
+            error = errno;
+        }
+        if (!error)
+        {
+            // Events from before the connection attempt (such as EPOLLHUP of the unconnected socket) may arrive late
+            sockaddr_in peerAddress;
+            socklen_t peerAddressSize = sizeof(peerAddress);
+            if (getpeername(s.fd, (sockaddr*)&peerAddress, &peerAddressSize) < 0)
+            {
+                if (errno == ENOTCONN)
+                {
+                    return;
+                }
+                error = errno;
+            }
+        }
+        complete(s.connectToken->CompletionToken, error ? EFI_ABORTED : EFI_SUCCESS);
+        s.connectToken = nullptr;
+    }
+
+    void acceptPendingConnections(Socket& s)
+    {
+        while (!s.acceptTokens.empty())
+        {
+            const int clientSocket = accept4(s.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            EFI_TCP4_LISTEN_TOKEN* token = s.acceptTokens.front();
+            if (clientSocket < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    return;
+                }
+                if (errno == EINTR || errno == ECONNABORTED)
+                {
+                    continue;
+                }
+                // For example out of file descriptors, let the main loop retry later
+                complete(token->CompletionToken, EFI_ABORTED);
+            }
+            else
+            {
+                acceptHandler(token, clientSocket);
+                complete(token->CompletionToken, EFI_SUCCESS);
+            }
+            s.acceptTokens.pop_front();
+        }
+    }
+
+    static void tryReceive(Socket& s)
+    {
+        EFI_TCP4_RECEIVE_DATA* rxData = s.receiveToken->Packet.RxData;
+        iovec iov[maxNumberOfFragments];
+        unsigned int iovCount;
+        if (!getFragments(rxData->FragmentTable, rxData->FragmentCount, 0, iov, iovCount) || !iovCount)
+        {
+            // readv() into an empty buffer returns 0 like for a connection closed by remote
+            complete(s.receiveToken->CompletionToken, EFI_INVALID_PARAMETER);
+            s.receiveToken = nullptr;
+            return;
+        }
+        ssize_t n;
+        do
+        {
+            n = readv(s.fd, iov, iovCount);
+        } while (n < 0 && errno == EINTR);
+
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            // Wait for EPOLLIN
+            return;
+        }
+        if (n > 0)
+        {
+            rxData->DataLength = (unsigned int)n;
+            complete(s.receiveToken->CompletionToken, EFI_SUCCESS);
+        }
+        else
+        {
+            // Connection closed by remote or error
+            complete(s.receiveToken->CompletionToken, EFI_ABORTED);
+        }
+        s.receiveToken = nullptr;
+    }
+
+    // Send as much as possible of the pending transmission. Returns true if the token has been completed.
+    static bool tryTransmit(Socket& s)
+    {
+        EFI_TCP4_TRANSMIT_DATA* txData = s.transmitToken->Packet.TxData;
+        if (txData->FragmentCount > maxNumberOfFragments)
+        {
+            complete(s.transmitToken->CompletionToken, EFI_INVALID_PARAMETER);
+            s.transmitToken = nullptr;
+            return true;
+        }
+        unsigned long long totalSize = 0;
+        for (unsigned int i = 0; i < txData->FragmentCount; i++)
+        {
+            totalSize += txData->FragmentTable[i].FragmentLength;
+        }
+
+        while (s.transmittedSize < totalSize)
+        {
+            // Gather all fragments into one system call
+            iovec iov[maxNumberOfFragments];
+            unsigned int iovCount;
+            getFragments(txData->FragmentTable, txData->FragmentCount, s.transmittedSize, iov, iovCount);
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = iovCount;
+            const ssize_t n = sendmsg(s.fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (n > 0)
+            {
+                s.transmittedSize += n;
+            }
+            else if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                // Wait for EPOLLOUT
+                return false;
+            }
+            else
+            {
+                complete(s.transmitToken->CompletionToken, EFI_ABORTED);
+                s.transmitToken = nullptr;
+                return true;
+            }
+        }
+
+        complete(s.transmitToken->CompletionToken, EFI_SUCCESS);
+        s.transmitToken = nullptr;
+        return true;
+    }
+
+    void handleEvents(Socket& s)
+    {
+        if (s.closed)
+        {
+            return;
+        }
+        if (s.listening)
+        {
+            acceptPendingConnections(s);
+            return;
+        }
+
+        // Just retry all pending operations, they return quickly if the socket is not ready
+        if (s.connectToken && s.connectStarted)
+        {
+            finishConnect(s);
+        }
+        if (s.receiveToken)
+        {
+            tryReceive(s);
+        }
+        if (s.transmitToken)
+        {
+            tryTransmit(s);
+        }
+    }
+
+    void checkTimers(unsigned int loopIndex)
+    {
+        std::vector<std::shared_ptr<Socket>> timedSockets;
+        {
+            std::lock_guard<std::mutex> registryGuard(registryLock);
+            for (const auto& entry : sockets)
+            {
+                if (entry.second->loopIndex == loopIndex && entry.second->hasTimer)
+                {
+                    timedSockets.push_back(entry.second);
+                }
+            }
+        }
+
+        const unsigned long long now = milliseconds();
+        for (const auto& s : timedSockets)
+        {
+            std::lock_guard<std::mutex> socketGuard(s->lock);
+            if (s->closed)
+            {
+                continue;
+            }
+            if (s->connectToken && !s->connectStarted && now >= s->connectNotBefore)
+            {
+                startConnect(*s);
+            }
+            if (s->transmitToken && now >= s->transmitDeadline)
+            {
+                complete(s->transmitToken->CompletionToken, EFI_TIMEOUT);
+                s->transmitToken = nullptr;
+            }
+            s->hasTimer = (s->connectToken && !s->connectStarted) || s->transmitToken;
+        }
+    }
+
+    void runLoop(unsigned int loopIndex)
+    {
+        epoll_event events[64];
+        unsigned long long nextTimerCheck = milliseconds() + timerIntervalMilliseconds;
+        while (true)
+        {
+            const int numberOfEvents = epoll_wait(epollFds[loopIndex], events, 64, timerIntervalMilliseconds);
+            for (int i = 0; i < numberOfEvents; i++)
+            {
+                std::shared_ptr<Socket> s = find(events[i].data.u64);
+                if (s)
+                {
+                    std::lock_guard<std::mutex> socketGuard(s->lock);
+                    handleEvents(*s);
+                }
+            }
+
+            const unsigned long long now = milliseconds();
+            if (now >= nextTimerCheck)
+            {
+                checkTimers(loopIndex);
+                nextTimerCheck = now + timerIntervalMilliseconds;
+            }
+        }
+    }
+};
+
+#endif
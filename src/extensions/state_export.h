@@ -0,0 +1,572 @@
+#pragma once
+
+// Compressed exports of the per-epoch state files (spectrum.<epoch>, universe.<epoch>) for the HTTP server.
+// The zip archive is created in-process with zlib instead of running "zip -j" for each request: the file is
+// read and deflated in blocks by several threads (independent deflate blocks concatenated with sync flushes,
+// like pigz), so the whole file is never held in memory. The archive is cached per state file (the name contains
+// the epoch) and is rebuilt only if the state file changes. All requests that arrive while an archive is built
+// wait for the same build without blocking their thread. State files saved in the compressed format (see
+// NODE_STATE_COMPRESSION) already consist of such blocks, which are copied into the archive without recompression.
+
+#ifdef __linux__
+
+#include <zlib.h>
+
+#include "platform/compressed_file.h"
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static constexpr unsigned long long STATE_EXPORT_BLOCK_SIZE = 16ULL * 1024 * 1024;
+static constexpr unsigned int STATE_EXPORT_THREADS = 4;
+static constexpr unsigned int STATE_EXPORT_REMOVAL_DELAY_SECONDS = 600;
+
+struct StateExport
+{
+    std::string path;       // archive, empty on error
+    std::string error;
+    unsigned long long size = 0;
+    unsigned int crc32 = 0; // CRC-32 of the state file, used to name the archive and as ETag
+};
+
+static void putZip16(std::vector<unsigned char>& buffer, unsigned int value)
+{
+    buffer.push_back((unsigned char)value);
+    buffer.push_back((unsigned char)(value >> 8));
+}
+
+static void putZip32(std::vector<unsigned char>& buffer, unsigned int value)
+{
+    putZip16(buffer, value & 0xFFFF);
+    putZip16(buffer, value >> 16);
+}
+
+// Header of the single archive entry. The local header (central == false) is written with zero sizes and patched
+// after the data has been compressed.
+static std::vector<unsigned char> zipEntryHeader(bool central, const std::string& entryName, time_t modificationTime,
+    unsigned int crc, unsigned long long compressedSize, unsigned long long uncompressedSize)
+{
+    tm localTime;
+    localtime_r(&modificationTime, &localTime);
+    const unsigned int dosTime = (localTime.tm_hour << 11) | (localTime.tm_min << 5) | (localTime.tm_sec >> 1);
+    const unsigned int dosDate = ((localTime.tm_year < 80 ? 0 : localTime.tm_year - 80) << 9) | ((localTime.tm_mon + 1) << 5) | localTime.tm_mday;
+
+    std::vector<unsigned char> header;
+    putZip32(header, central ? 0x02014b50 : 0x04034b50);
+    if (central)
+    {
+        putZip16(header, (3 << 8) | 20); // made by Unix, zip 2.0
+    }
+    putZip16(header, 20); // version needed: deflate
+    putZip16(header, 0); // flags
+    putZip16(header, 8); // method: deflate
+    putZip16(header, dosTime);
+    putZip16(header, dosDate);
+    putZip32(header, crc);
+    putZip32(header, (unsigned int)compressedSize);
+    putZip32(header, (unsigned int)uncompressedSize);
+    putZip16(header, (unsigned int)entryName.size());
+    putZip16(header, 0); // extra field length
+    if (central)
+    {
+        putZip16(header, 0); // comment length
+        putZip16(header, 0); // disk number
+        putZip16(header, 0); // internal attributes
+        putZip32(header, 0100644u << 16); // external attributes: regular file, rw-r--r--
+        putZip32(header, 0); // offset of local header
+    }
+    header.insert(header.end(), entryName.begin(), entryName.end());
+    return header;
+}
+
+// Copy the chunks of a state file in the compressed format (see compressed_file.h) to the archive. They already
+// form a single raw deflate stream, so the data is not decompressed and compressed again.
+static bool copyCompressedFileChunks(FILE* source, FILE* archive, const CompressedFileHeader& header,
+    const std::vector<CompressedFileChunk>& chunks, unsigned int& crc, unsigned long long& compressedSize)
+{
+    if (chunks.empty())
+    {
+        // Empty final block of a stream without data
+        static const unsigned char emptyStream[2] = { 0x03, 0x00 };
+        compressedSize = sizeof(emptyStream);
+        return fwrite(emptyStream, 1, sizeof(emptyStream), archive) == sizeof(emptyStream);
+    }
+    std::vector<unsigned char> buffer(STATE_EXPORT_BLOCK_SIZE);
+    if (fseeko(source, compressedFileDataOffset(header), SEEK_SET) != 0)
+    {
+        return false;
+    }
+    for (unsigned long long i = 0; i < chunks.size(); i++)
+    {
+        const unsigned long long dataSize = std::min(header.chunkSize, header.totalSize - i * header.chunkSize);
+        crc = (unsigned int)crc32_combine(crc, chunks[i].crc32, (z_off_t)dataSize);
+        for (unsigned long long copied = 0; copied < chunks[i].compressedSize; )
+        {
+            const unsigned long long size = std::min<unsigned long long>(buffer.size(), chunks[i].compressedSize - copied);
+            if (fread(buffer.data(), 1, size, source) != size || fwrite(buffer.data(), 1, size, archive) != size)
+            {
+                return false;
+            }
+            copied += size;
+        }
+        compressedSize += chunks[i].compressedSize;
+    }
+    return true;
+}
+
+// Write a zip archive with the file at sourcePath as its only entry (named entryName) to archivePath, like
+// "zip -j". Returns false and sets error on failure. Files of 4 GB or more are not supported (no zip64).
+static bool writeZipArchive(const std::string& sourcePath, const std::string& entryName, const std::string& archivePath,
+    unsigned int& crc, std::string& error, unsigned int numberOfThreads = STATE_EXPORT_THREADS,
+    unsigned long long blockSize = STATE_EXPORT_BLOCK_SIZE, int level = Z_BEST_SPEED)
+{
+    struct stat sourceStat;
+    if (stat(sourcePath.c_str(), &sourceStat) != 0)
+    {
+        error = "Cannot access " + sourcePath;
+        return false;
+    }
+    if (!numberOfThreads)
+    {
+        numberOfThreads = 1;
+    }
+
+    FILE* source = fopen(sourcePath.c_str(), "rb");
+    if (!source)
+    {
+        error = "Cannot open " + sourcePath;
+        return false;
+    }
+    CompressedFileHeader compressedHeader;
+    std::vector<CompressedFileChunk> compressedChunks;
+    const int compressedSource = readCompressedFileTable(fileno(source), compressedHeader, compressedChunks);
+    if (compressedSource < 0)
+    {
+        fclose(source);
+        error = "Invalid compressed file " + sourcePath;
+        return false;
+    }
+    const unsigned long long sourceSize = compressedSource ? compressedHeader.totalSize : sourceStat.st_size;
+    if (sourceSize >= 0xFFFFFFFFULL)
+    {
+        fclose(source);
+        error = sourcePath + " is too large for a zip archive";
+        return false;
+    }
+    FILE* archive = fopen(archivePath.c_str(), "wb");
+    if (!archive)
+    {
+        fclose(source);
+        error = "Cannot create " + archivePath;
+        return false;
+    }
+
+    const std::vector<unsigned char> localHeader = zipEntryHeader(false, entryName, sourceStat.st_mtime, 0, 0, 0);
+    bool ok = fwrite(localHeader.data(), 1, localHeader.size(), archive) == localHeader.size();
+
+    crc = (unsigned int)crc32(0, Z_NULL, 0);
+    unsigned long long compressedSize = 0;
+    if (ok && compressedSource)
+    {
+        ok = copyCompressedFileChunks(source, archive, compressedHeader, compressedChunks, crc, compressedSize);
+        if (!ok)
+        {
+            error = "Cannot copy " + sourcePath;
+        }
+    }
+
+    // Otherwise, each round reads numberOfThreads blocks and deflates them in parallel. Every block except the last
+    // one ends with a sync flush (byte-aligned, not final), so the concatenated outputs form a single deflate stream.
+    std::vector<unsigned char> input(compressedSource ? 0 : (sourceSize < numberOfThreads * blockSize) ? sourceSize + 1 : numberOfThreads * blockSize);
+    std::vector<std::vector<unsigned char>> outputs(numberOfThreads);
+    std::vector<unsigned long long> outputSizes(numberOfThreads);
+    std::vector<unsigned int> blockCrcs(numberOfThreads);
+    std::vector<int> results(numberOfThreads);
+    for (unsigned long long offset = 0; ok && !compressedSource && (offset < sourceSize || (offset == 0 && sourceSize == 0)); offset += numberOfThreads * blockSize)
+    {
+        const unsigned long long roundSize = (sourceSize - offset < numberOfThreads * blockSize) ? sourceSize - offset : numberOfThreads * blockSize;
+        if (fread(input.data(), 1, roundSize, source) != roundSize)
+        {
+            error = "Cannot read " + sourcePath;
+            ok = false;
+            break;
+        }
+        const unsigned int numberOfBlocks = roundSize ? (unsigned int)((roundSize + blockSize - 1) / blockSize) : 1;
+        const bool lastRound = (offset + roundSize == sourceSize);
+        auto deflateBlock = [&](unsigned int i)
+        {
+            const unsigned long long blockOffset = i * blockSize;
+            const unsigned long long size = (roundSize - blockOffset < blockSize) ? roundSize - blockOffset : blockSize;
+            z_stream stream = {};
+            results[i] = deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+            if (results[i] != Z_OK)
+            {
+                return;
+            }
+            outputs[i].resize(deflateBound(&stream, (uLong)size) + 16);
+            stream.next_in = input.data() + blockOffset;
+            stream.avail_in = (uInt)size;
+            stream.next_out = outputs[i].data();
+            stream.avail_out = (uInt)outputs[i].size();
+            const bool lastBlock = lastRound && i == numberOfBlocks - 1;
+            results[i] = deflate(&stream, lastBlock ? Z_FINISH : Z_SYNC_FLUSH);
+            results[i] = (results[i] == (lastBlock ? Z_STREAM_END : Z_OK) && !stream.avail_in) ? Z_OK : Z_BUF_ERROR;
+            outputSizes[i] = stream.total_out;
+            deflateEnd(&stream);
+            blockCrcs[i] = (unsigned int)crc32(0, input.data() + blockOffset, (uInt)size);
+        };
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < numberOfBlocks; i++)
+        {
+            threads.emplace_back(deflateBlock, i);
+        }
+        deflateBlock(0);
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        for (unsigned int i = 0; ok && i < numberOfBlocks; i++)
+        {
+            const unsigned long long size = (roundSize - i * blockSize < blockSize) ? roundSize - i * blockSize : blockSize;
+            if (results[i] != Z_OK)
+            {
+                error = "Compression failed";
+                ok = false;
+            }
+            else if (fwrite(outputs[i].data(), 1, outputSizes[i], archive) != outputSizes[i])
+            {
+                error = "Cannot write " + archivePath;
+                ok = false;
+            }
+            crc = (unsigned int)crc32_combine(crc, blockCrcs[i], (z_off_t)size);
+            compressedSize += outputSizes[i];
+        }
+        if (!roundSize)
+        {
+            break;
+        }
+    }
+    fclose(source);
+
+    if (ok && compressedSize >= 0xFFFFFFFFULL)
+    {
+        error = archivePath + " is too large for a zip archive";
+        ok = false;
+    }
+    if (ok)
+    {
+        const std::vector<unsigned char> centralHeader = zipEntryHeader(true, entryName, sourceStat.st_mtime, crc, compressedSize, sourceSize);
+        const unsigned long long centralOffset = localHeader.size() + compressedSize;
+        std::vector<unsigned char> end;
+        putZip32(end, 0x06054b50);
+        putZip16(end, 0); // disk number
+        putZip16(end, 0); // disk with central directory
+        putZip16(end, 1); // entries on this disk
+        putZip16(end, 1); // entries
+        putZip32(end, (unsigned int)centralHeader.size());
+        putZip32(end, (unsigned int)centralOffset);
+        putZip16(end, 0); // comment length
+
+        // Patch CRC and sizes of the local header
+        const std::vector<unsigned char> patchedHeader = zipEntryHeader(false, entryName, sourceStat.st_mtime, crc, compressedSize, sourceSize);
+        ok = fwrite(centralHeader.data(), 1, centralHeader.size(), archive) == centralHeader.size()
+            && fwrite(end.data(), 1, end.size(), archive) == end.size()
+            && fseek(archive, 0, SEEK_SET) == 0
+            && fwrite(patchedHeader.data(), 1, patchedHeader.size(), archive) == patchedHeader.size();
+        if (!ok)
+        {
+            error = "Cannot write " + archivePath;
+        }
+    }
+    if (fclose(archive) != 0 && ok)
+    {
+        error = "Cannot write " + archivePath;
+        ok = false;
+    }
+    return ok;
+}
+
+// Zip archives of state files, built in the background and cached in directory (one archive per state name, the
+// archive of the previous epoch is deleted). Thread-safe.
+//
+// Outdated archives are deleted removalDelaySeconds after they have been replaced, not immediately. A response for
+// an outdated archive may have been created but not be sent yet, because the HTTP server only opens the file when it
+// starts sending. Once the file is open, deleting it does not affect the transfer.
+class StateExportCache
+{
+public:
+    typedef std::function<void(const StateExport&)> Callback;
+
+    StateExportCache(const std::string& directory, unsigned int numberOfThreads = STATE_EXPORT_THREADS,
+        unsigned int removalDelaySeconds = STATE_EXPORT_REMOVAL_DELAY_SECONDS)
+        : directory(directory), numberOfThreads(numberOfThreads), removalDelay(std::chrono::seconds(removalDelaySeconds))
+    {
+    }
+
+    ~StateExportCache()
+    {
+        std::vector<std::thread> runningBuilds;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            runningBuilds.swap(builds);
+        }
+        for (auto& build : runningBuilds)
+        {
+            build.join();
+        }
+    }
+
+    // Call callback with the archive of the state file sourcePath (such as "spectrum.123"), either immediately if
+    // the cached archive is up to date, or from the build thread when it has been built.
+    void get(const std::string& sourcePath, Callback&& callback)
+    {
+        struct stat sourceStat;
+        if (stat(sourcePath.c_str(), &sourceStat) != 0)
+        {
+            StateExport failed;
+            failed.error = "Cannot access " + sourcePath;
+            callback(failed);
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        joinFinishedBuilds();
+        removeOutdatedArchives();
+        Entry& entry = entries[sourcePath];
+        if (!entry.building && !entry.result.path.empty() && entry.sourceSize == sourceStat.st_size
+            && entry.sourceModificationTime == sourceStat.st_mtim.tv_sec * 1000000000LL + sourceStat.st_mtim.tv_nsec
+            && std::filesystem::exists(entry.result.path))
+        {
+            const StateExport result = entry.result;
+            lock.unlock();
+            callback(result);
+            return;
+        }
+        entry.waiters.push_back(std::move(callback));
+        if (!entry.building)
+        {
+            entry.building = true;
+            entry.sourceSize = sourceStat.st_size;
+            entry.sourceModificationTime = sourceStat.st_mtim.tv_sec * 1000000000LL + sourceStat.st_mtim.tv_nsec;
+            builds.emplace_back(&StateExportCache::build, this, sourcePath);
+        }
+    }
+
+private:
+    struct Entry
+    {
+        bool building = false;
+        long long sourceSize = -1;
+        long long sourceModificationTime = -1;
+        StateExport result;
+        std::vector<Callback> waiters;
+    };
+
+    void build(std::string sourcePath)
+    {
+        const std::string entryName = std::filesystem::path(sourcePath).filename().string();
+        const std::string stateName = entryName.substr(0, entryName.rfind('.'));
+        const std::string temporaryPath = directory + "/" + entryName + ".zip.tmp";
+        StateExport result;
+        std::error_code errorCode;
+        std::filesystem::create_directories(directory, errorCode);
+        if (writeZipArchive(sourcePath, entryName, temporaryPath, result.crc32, result.error, numberOfThreads))
+        {
+            char crcHex[9];
+            snprintf(crcHex, sizeof(crcHex), "%08x", result.crc32);
+            result.path = directory + "/" + entryName + "-" + crcHex + ".zip";
+            std::filesystem::rename(temporaryPath, result.path, errorCode);
+            if (errorCode)
+            {
+                result.error = "Cannot rename " + temporaryPath;
+                result.path.clear();
+            }
+            else
+            {
+                result.size = std::filesystem::file_size(result.path, errorCode);
+            }
+        }
+        std::vector<std::string> outdatedPaths;
+        if (result.path.empty())
+        {
+            std::filesystem::remove(temporaryPath, errorCode);
+        }
+        else
+        {
+            // Outdated archives of the same state (previous epochs or previous content)
+            for (const auto& file : std::filesystem::directory_iterator(directory, errorCode))
+            {
+                const std::string fileName = file.path().filename().string();
+                if (fileName.rfind(stateName + ".", 0) == 0 && fileName.size() > 4 && fileName.compare(fileName.size() - 4, 4, ".zip") == 0
+                    && file.path().string() != result.path)
+                {
+                    outdatedPaths.push_back(file.path().string());
+                }
+            }
+        }
+
+        std::vector<Callback> waiters;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const auto now = std::chrono::steady_clock::now();
+            for (const auto& path : outdatedPaths)
+            {
+                // Keeps the time of an archive that is already outdated
+                outdatedArchives.emplace(path, now);
+            }
+            outdatedArchives.erase(result.path);
+            removeOutdatedArchives();
+
+            for (auto it = entries.begin(); it != entries.end();)
+            {
+                // Archives of other epochs are outdated
+                const std::string otherEntryName = std::filesystem::path(it->first).filename().string();
+                if (it->first != sourcePath && !it->second.building && otherEntryName.substr(0, otherEntryName.rfind('.')) == stateName)
+                {
+                    it = entries.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+            Entry& entry = entries[sourcePath];
+            entry.building = false;
+            entry.result = result;
+            waiters.swap(entry.waiters);
+        }
+        for (auto& waiter : waiters)
+        {
+            waiter(result);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        finishedBuilds.push_back(std::this_thread::get_id());
+    }
+
+    // Delete the outdated archives that have been replaced at least removalDelay ago. Must be called with mutex locked.
+    void removeOutdatedArchives()
+    {
+        const auto now = std::chrono::steady_clock::now();
+        for (auto it = outdatedArchives.begin(); it != outdatedArchives.end();)
+        {
+            if (now - it->second >= removalDelay)
+            {
+                std::error_code errorCode;
+                std::filesystem::remove(it->first, errorCode);
+                it = outdatedArchives.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    // Join the build threads that have finished, so builds does not grow with each export. Must be called with
+    // mutex locked.
+    void joinFinishedBuilds()
+    {
+        for (auto it = builds.begin(); it != builds.end();)
+        {
+            if (std::find(finishedBuilds.begin(), finishedBuilds.end(), it->get_id()) != finishedBuilds.end())
+            {
+                it->join();
+                it = builds.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        finishedBuilds.clear();
+    }
+
+    std::string directory;
+    unsigned int numberOfThreads;
+    std::chrono::steady_clock::duration removalDelay;
+    std::mutex mutex;
+    std::map<std::string, Entry> entries;
+    std::map<std::string, std::chrono::steady_clock::time_point> outdatedArchives;
+    std::vector<std::thread> builds;
+    std::vector<std::thread::id> finishedBuilds;
+};
+
+// Result of parseByteRange()
+enum ByteRangeType
+{
+    ByteRangeFull,           // no (supported) range, send the whole file
+    ByteRangePartial,        // send length bytes from offset
+    ByteRangeUnsatisfiable,  // the range is outside the file
+};
+
+// Parse the value of a Range header ("bytes=first-last", "bytes=first-" or "bytes=-suffixLength") for a file of
+// fileSize bytes. Multiple ranges are not supported and the whole file is sent instead, which is allowed by HTTP.
+static ByteRangeType parseByteRange(const std::string& range, unsigned long long fileSize, unsigned long long& offset, unsigned long long& length)
+{
+    offset = 0;
+    length = fileSize;
+    if (range.rfind("bytes=", 0) != 0 || range.find(',') != std::string::npos)
+    {
+        return ByteRangeFull;
+    }
+    const std::string spec = range.substr(6);
+    const size_t dash = spec.find('-');
+    if (dash == std::string::npos || spec.find_first_not_of("0123456789-") != std::string::npos || spec.find('-', dash + 1) != std::string::npos)
+    {
+        return ByteRangeFull;
+    }
+    const std::string firstText = spec.substr(0, dash), lastText = spec.substr(dash + 1);
+    // Values with more than 18 significant digits are larger than any state file and saturate, so they are handled
+    // like other values beyond the end of the file (the last position is clamped to the file size)
+    auto parseValue = [](const std::string& text)
+        {
+            const size_t begin = text.find_first_not_of('0');
+            if (begin == std::string::npos)
+            {
+                return 0ULL;
+            }
+            return (text.size() - begin > 18) ? ~0ULL : std::stoull(text.substr(begin));
+        };
+    if (firstText.empty())
+    {
+        if (lastText.empty())
+        {
+            return ByteRangeFull;
+        }
+        const unsigned long long suffixLength = parseValue(lastText);
+        if (!suffixLength || !fileSize)
+        {
+            return ByteRangeUnsatisfiable;
+        }
+        length = (suffixLength < fileSize) ? suffixLength : fileSize;
+        offset = fileSize - length;
+        return ByteRangePartial;
+    }
+    const unsigned long long first = parseValue(firstText);
+    unsigned long long last = lastText.empty() ? fileSize - 1 : parseValue(lastText);
+    if (first >= fileSize || last < first)
+    {
+        return ByteRangeUnsatisfiable;
+    }
+    if (last >= fileSize)
+    {
+        last = fileSize - 1;
+    }
+    offset = first;
+    length = last - first + 1;
+    return ByteRangePartial;
+}
+
+#endif
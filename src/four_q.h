@@ -1355,16 +1355,10 @@ static void ecc_precomp_double(point_extproj_t P, point_extproj_precomp_t* Table
     R1_to_R2(Q, Table[3]);                  // Converting from (X,Y,Z,Ta,Tb) to (X+Y,Y-X,2Z,2dT)
 }
 
-static bool ecc_mul_double(unsigned long long* k, unsigned long long* l, point_t Q)
-{ // Double scalar multiplication R = k*G + l*Q, where the G is the generator
-  // Uses DOUBLE_SCALAR_TABLE, which contains multiples of G, Phi(G), Psi(G) and Phi(Psi(G))
-  // The function uses wNAF with interleaving.
-    char digits_k1[65], digits_k2[65], digits_k3[65], digits_k4[65];
-    char digits_l1[65], digits_l2[65], digits_l3[65], digits_l4[65];
-    point_precomp_t V;
-    point_extproj_t Q1, Q2, Q3, Q4, T;
-    point_extproj_precomp_t U, Q_table1[4], Q_table2[4], Q_table3[4], Q_table4[4];
-    unsigned long long k_scalars[4], l_scalars[4];
+static bool ecc_precomp_double_endo(point_t Q, point_extproj_precomp_t* Q_table)
+{ // Generation of the precomputation tables of Q, Phi(Q), Psi(Q) and Psi(Phi(Q)) used by ecc_mul_double_precomp()
+  // Q_table has 16 entries, 4 for each of the points. Returns false if Q does not lie on the curve.
+    point_extproj_t Q1, Q2, Q3, Q4;
 
     point_setup(Q, Q1);                                             // Convert to representation (X,Y,1,Ta,Tb)
 
@@ -1393,6 +1387,25 @@ static bool ecc_mul_double(unsigned long long* k, unsigned long long* l, point_t
     *((m256i*) & Q4->tb) = *((m256i*) & Q2->tb);
     ecc_psi(Q4);
 
+    ecc_precomp_double(Q1, Q_table);
+    ecc_precomp_double(Q2, Q_table + 4);
+    ecc_precomp_double(Q3, Q_table + 8);
+    ecc_precomp_double(Q4, Q_table + 12);
+
+    return true;
+}
+
+static void ecc_mul_double_precomp(unsigned long long* k, unsigned long long* l, point_extproj_precomp_t* Q_table, point_t Q)
+{ // Double scalar multiplication Q = k*G + l*P, where the G is the generator and Q_table is the output of ecc_precomp_double_endo(P)
+  // Uses DOUBLE_SCALAR_TABLE, which contains multiples of G, Phi(G), Psi(G) and Phi(Psi(G))
+  // The function uses wNAF with interleaving.
+    char digits_k1[65], digits_k2[65], digits_k3[65], digits_k4[65];
+    char digits_l1[65], digits_l2[65], digits_l3[65], digits_l4[65];
+    point_precomp_t V;
+    point_extproj_t T;
+    point_extproj_precomp_t U;
+    unsigned long long k_scalars[4], l_scalars[4];
+
     decompose((unsigned long long*)k, k_scalars);                   // Scalar decomposition
     decompose((unsigned long long*)l, l_scalars);
     wNAF_recode(k_scalars[0], 8, digits_k1);                        // Scalar recoding
@@ -1403,10 +1416,6 @@ static bool ecc_mul_double(unsigned long long* k, unsigned long long* l, point_t
     wNAF_recode(l_scalars[1], 4, digits_l2);
     wNAF_recode(l_scalars[2], 4, digits_l3);
     wNAF_recode(l_scalars[3], 4, digits_l4);
-    ecc_precomp_double(Q1, Q_table1);
-    ecc_precomp_double(Q2, Q_table2);
-    ecc_precomp_double(Q3, Q_table3);
-    ecc_precomp_double(Q4, Q_table4);
 
     T->x[0][0] = 0; T->x[0][1] = 0; T->x[1][0] = 0; T->x[1][1] = 0; // Initialize T as the neutral point (0:1:1)
     T->y[0][0] = 1; T->y[0][1] = 0; T->y[1][0] = 0; T->y[1][1] = 0;
@@ -1418,42 +1427,42 @@ static bool ecc_mul_double(unsigned long long* k, unsigned long long* l, point_t
 
         if (digits_l1[i] < 0)
         {
-            eccneg_extproj_precomp(Q_table1[(-digits_l1[i]) >> 1], U);
+            eccneg_extproj_precomp(Q_table[(-digits_l1[i]) >> 1], U);
             eccadd(U, T);
         }
         else if (digits_l1[i] > 0)
         {
-            eccadd(Q_table1[(digits_l1[i]) >> 1], T);
+            eccadd(Q_table[(digits_l1[i]) >> 1], T);
         }
 
         if (digits_l2[i] < 0)
         {
-            eccneg_extproj_precomp(Q_table2[(-digits_l2[i]) >> 1], U);
+            eccneg_extproj_precomp(Q_table[4 + ((-digits_l2[i]) >> 1)], U);
             eccadd(U, T);
         }
         else if (digits_l2[i] > 0)
         {
-            eccadd(Q_table2[(digits_l2[i]) >> 1], T);
+            eccadd(Q_table[4 + ((digits_l2[i]) >> 1)], T);
         }
 
         if (digits_l3[i] < 0)
         {
-            eccneg_extproj_precomp(Q_table3[(-digits_l3[i]) >> 1], U);
+            eccneg_extproj_precomp(Q_table[8 + ((-digits_l3[i]) >> 1)], U);
             eccadd(U, T);
         }
         else if (digits_l3[i] > 0)
         {
-            eccadd(Q_table3[(digits_l3[i]) >> 1], T);
+            eccadd(Q_table[8 + ((digits_l3[i]) >> 1)], T);
         }
 
         if (digits_l4[i] < 0)
         {
-            eccneg_extproj_precomp(Q_table4[(-digits_l4[i]) >> 1], U);
+            eccneg_extproj_precomp(Q_table[12 + ((-digits_l4[i]) >> 1)], U);
             eccadd(U, T);
         }
         else if (digits_l4[i] > 0)
         {
-            eccadd(Q_table4[(digits_l4[i]) >> 1], T);
+            eccadd(Q_table[12 + ((digits_l4[i]) >> 1)], T);
         }
 
         if (digits_k1[i] < 0)
@@ -1498,6 +1507,17 @@ static bool ecc_mul_double(unsigned long long* k, unsigned long long* l, point_t
     }
 
     eccnorm(T, Q);
+}
+
+static bool ecc_mul_double(unsigned long long* k, unsigned long long* l, point_t Q)
+{ // Double scalar multiplication R = k*G + l*Q, where the G is the generator
+    point_extproj_precomp_t Q_table[16];
+
+    if (!ecc_precomp_double_endo(Q, Q_table))
+    {
+        return false;
+    }
+    ecc_mul_double_precomp(k, l, Q_table, Q);
 
     return true;
 }
@@ -1912,16 +1932,21 @@ static void signWithRandomK(const unsigned char* subseed, const unsigned char* p
     }
 }
 
-static bool verify(const unsigned char* publicKey, const unsigned char* messageDigest, const unsigned char* signature)
-{ // SchnorrQ signature verification
-  // It verifies the signature Signature of a message MessageDigest of size 32 in bytes
-  // Inputs: 32-byte PublicKey, 64-byte Signature, and MessageDigest of size 32 in bytes
-  // Output: TRUE (valid signature) or FALSE (invalid signature)
+// Public key with the precomputed tables of the double scalar multiplication, for verifying several signatures
+// of the same signer without decoding the key and computing its endomorphisms each time
+struct VerificationKey
+{
+    m256i publicKey;
+    point_extproj_precomp_t table[16];
+};
+
+static bool prepareVerificationKey(const unsigned char* publicKey, VerificationKey& key)
+{ // Decodes the 32-byte PublicKey and precomputes the tables used by verifyWithKey()
+  // Output: TRUE (valid key) or FALSE (invalid key, signatures of which never verify)
     point_t A;
-    unsigned char temp[32 + 64], h[64];
 
-    if ((publicKey[15] & 0x80) || (signature[15] & 0x80) || (signature[62] & 0xC0) || signature[63])
-    {  // Are bit128(PublicKey) = bit128(Signature) = 0 and Signature+32 < 2^246?
+    if (publicKey[15] & 0x80)
+    {  // Is bit128(PublicKey) = 0?
         return false;
     }
 
@@ -1930,17 +1955,46 @@ static bool verify(const unsigned char* publicKey, const unsigned char* messageD
         return false;
     }
 
+    key.publicKey = *((m256i*)publicKey);
+
+    return ecc_precomp_double_endo(A, key.table);
+}
+
+static bool verifyWithKey(const VerificationKey& key, const unsigned char* messageDigest, const unsigned char* signature)
+{ // SchnorrQ signature verification with a key prepared by prepareVerificationKey()
+  // Inputs: prepared key, 64-byte Signature, and MessageDigest of size 32 in bytes
+  // Output: TRUE (valid signature) or FALSE (invalid signature)
+    point_t A;
+    unsigned char temp[32 + 64], h[64];
+
+    if ((signature[15] & 0x80) || (signature[62] & 0xC0) || signature[63])
+    {  // Are bit128(Signature) = 0 and Signature+32 < 2^246?
+        return false;
+    }
+
     *((m256i*)temp) = *((m256i*)signature);
-    *((m256i*)(temp + 32)) = *((m256i*)publicKey);
+    *((m256i*)(temp + 32)) = key.publicKey;
     *((m256i*)(temp + 64)) = *((m256i*)messageDigest);
 
     KangarooTwelve(temp, 32 + 64, h, 64);
 
-    if (!ecc_mul_double((unsigned long long*)(signature + 32), (unsigned long long*)h, A))
-    {
-        return false;
-    }
+    ecc_mul_double_precomp((unsigned long long*)(signature + 32), (unsigned long long*)h, (point_extproj_precomp_t*)key.table, A);
 
     encode(A, (unsigned char*)A);
     return *(const m256i*)A == *(const m256i*)signature;
 }
+
+static bool verify(const unsigned char* publicKey, const unsigned char* messageDigest, const unsigned char* signature)
+{ // SchnorrQ signature verification
+  // It verifies the signature Signature of a message MessageDigest of size 32 in bytes
+  // Inputs: 32-byte PublicKey, 64-byte Signature, and MessageDigest of size 32 in bytes
+  // Output: TRUE (valid signature) or FALSE (invalid signature)
+    VerificationKey key;
+
+    if ((publicKey[15] & 0x80) || (signature[15] & 0x80) || (signature[62] & 0xC0) || signature[63])
+    {  // Are bit128(PublicKey) = bit128(Signature) = 0 and Signature+32 < 2^246?
+        return false;
+    }
+
+    return prepareVerificationKey(publicKey, key) && verifyWithKey(key, messageDigest, signature);
+}
@@ -2495,6 +2495,184 @@ static void KangarooTwelve64To32(const void* input, void* output)
     KangarooTwelve64To32((const unsigned char*)input, (unsigned char*)output);
 }
 
+////////// Multi-lane KangarooTwelve64To32 \\\\\\\\\\
+
+// Hashing K12_64TO32_LANES independent 64-byte inputs at once. The Keccak state of input n is kept in lane n of
+// 25 vector registers, so each instruction of the permutation processes all inputs.
+#if defined (__AVX512F__)
+#define K12_64TO32_LANES 8
+typedef __m512i K12Lanes;
+#define K12LanesLoad(p) _mm512_loadu_si512(p)
+#define K12LanesStore(p, a) _mm512_storeu_si512(p, a)
+#define K12LanesSet1(x) _mm512_set1_epi64(x)
+#define K12LanesXor(a, b) _mm512_xor_si512(a, b)
+#define K12LanesXor5(a, b, c, d, e) _mm512_ternarylogic_epi64(_mm512_ternarylogic_epi64(a, b, c, 0x96), d, e, 0x96)
+#define K12LanesRol(a, offset) _mm512_rol_epi64(a, offset)
+#define K12LanesChi(a, b, c) _mm512_ternarylogic_epi64(a, b, c, 0xD2)
+#elif defined (__AVX2__)
+#define K12_64TO32_LANES 4
+typedef __m256i K12Lanes;
+#define K12LanesLoad(p) _mm256_loadu_si256((const __m256i*)(p))
+#define K12LanesStore(p, a) _mm256_storeu_si256((__m256i*)(p), a)
+#define K12LanesSet1(x) _mm256_set1_epi64x(x)
+#define K12LanesXor(a, b) _mm256_xor_si256(a, b)
+#define K12LanesXor5(a, b, c, d, e) _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(c, d)), e)
+#define K12LanesRol(a, offset) _mm256_or_si256(_mm256_slli_epi64(a, offset), _mm256_srli_epi64(a, 64 - (offset)))
+#define K12LanesChi(a, b, c) _mm256_xor_si256(a, _mm256_andnot_si256(b, c))
+#else
+#define K12_64TO32_LANES 1
+#endif
+
+#if K12_64TO32_LANES > 1
+// Rho and pi of one row of the output: B[x] = ROL(A[src[x]] ^ D[src[x] % 5], rho[x]), then chi and writing to row y of E
+#define K12LanesRhoPiChi(A, E, y, s0, r0, s1, r1, s2, r2, s3, r3, s4, r4) \
+    B0 = K12LanesRol(K12LanesXor(A[s0], D[s0 % 5]), r0); \
+    B1 = K12LanesRol(K12LanesXor(A[s1], D[s1 % 5]), r1); \
+    B2 = K12LanesRol(K12LanesXor(A[s2], D[s2 % 5]), r2); \
+    B3 = K12LanesRol(K12LanesXor(A[s3], D[s3 % 5]), r3); \
+    B4 = K12LanesRol(K12LanesXor(A[s4], D[s4 % 5]), r4); \
+    E[5 * y + 0] = K12LanesChi(B0, B1, B2); \
+    E[5 * y + 1] = K12LanesChi(B1, B2, B3); \
+    E[5 * y + 2] = K12LanesChi(B2, B3, B4); \
+    E[5 * y + 3] = K12LanesChi(B3, B4, B0); \
+    E[5 * y + 4] = K12LanesChi(B4, B0, B1);
+
+// One round of Keccak-p reading state A and writing state E
+#define K12LanesRound(A, E, i) \
+    for (unsigned int x = 0; x < 5; x++) \
+    { \
+        C[x] = K12LanesXor5(A[x], A[x + 5], A[x + 10], A[x + 15], A[x + 20]); \
+    } \
+    for (unsigned int x = 0; x < 5; x++) \
+    { \
+        D[x] = K12LanesXor(C[(x + 4) % 5], K12LanesRol(C[(x + 1) % 5], 1)); \
+    } \
+    K12LanesRhoPiChi(A, E, 0, 0, 0, 6, 44, 12, 43, 18, 21, 24, 14) \
+    K12LanesRhoPiChi(A, E, 1, 3, 28, 9, 20, 10, 3, 16, 45, 22, 61) \
+    K12LanesRhoPiChi(A, E, 2, 1, 1, 7, 6, 13, 25, 19, 8, 20, 18) \
+    K12LanesRhoPiChi(A, E, 3, 4, 27, 5, 36, 11, 10, 17, 15, 23, 56) \
+    K12LanesRhoPiChi(A, E, 4, 2, 62, 8, 55, 14, 39, 15, 41, 21, 2) \
+    E[0] = K12LanesXor(E[0], K12LanesSet1(roundConstants[i]));
+
+static void KeccakP1600_Permute_12rounds_Lanes(K12Lanes* A)
+{
+    static constexpr unsigned long long roundConstants[12] = {
+        KeccakF1600RoundConstant0, KeccakF1600RoundConstant1, KeccakF1600RoundConstant2, KeccakF1600RoundConstant3,
+        KeccakF1600RoundConstant4, KeccakF1600RoundConstant5, KeccakF1600RoundConstant6, KeccakF1600RoundConstant7,
+        KeccakF1600RoundConstant8, KeccakF1600RoundConstant9, KeccakF1600RoundConstant10, 0x8000000080008008ULL };
+
+    K12Lanes E[25];
+    K12Lanes C[5], D[5];
+    K12Lanes B0, B1, B2, B3, B4;
+    for (unsigned int round = 0; round < 12; round += 2)
+    {
+        K12LanesRound(A, E, round)
+        K12LanesRound(E, A, round + 1)
+    }
+}
+
+#undef K12LanesRound
+#undef K12LanesRhoPiChi
+#endif
+
+// Compute KangarooTwelve64To32(inputs[n], outputs[n]) for all n < K12_64TO32_LANES.
+static void KangarooTwelve64To32Lanes(const void* const* inputs, void* const* outputs)
+{
+#if K12_64TO32_LANES > 1
+    // Transpose inputs, so that word w of all inputs is in one vector
+    unsigned long long words[8][K12_64TO32_LANES];
+    for (unsigned int n = 0; n < K12_64TO32_LANES; n++)
+    {
+        for (unsigned int w = 0; w < 8; w++)
+        {
+            words[w][n] = ((const unsigned long long*)inputs[n])[w];
+        }
+    }
+
+    // Absorb the single block: 64 byte input, empty customization string, suffix, and padding
+    K12Lanes A[25];
+    for (unsigned int w = 0; w < 8; w++)
+    {
+        A[w] = K12LanesLoad(words[w]);
+    }
+    A[8] = K12LanesSet1(0x0700);
+    for (unsigned int w = 9; w < 25; w++)
+    {
+        A[w] = K12LanesSet1(0);
+    }
+    A[20] = K12LanesSet1(0x8000000000000000);
+
+    KeccakP1600_Permute_12rounds_Lanes(A);
+
+    for (unsigned int w = 0; w < 4; w++)
+    {
+        K12LanesStore(words[w], A[w]);
+    }
+    for (unsigned int n = 0; n < K12_64TO32_LANES; n++)
+    {
+        for (unsigned int w = 0; w < 4; w++)
+        {
+            ((unsigned long long*)outputs[n])[w] = words[w][n];
+        }
+    }
+#else
+    KangarooTwelve64To32(inputs[0], outputs[0]);
+#endif
+}
+
+// Compute KangarooTwelve64To32() of count consecutive 64-byte inputs, writing count consecutive 32-byte outputs.
+// This is the layout of the nodes of one level in a digest tree and their parents.
+static void KangarooTwelve64To32Batch(const void* input, void* output, unsigned long long count)
+{
+    const void* inputs[K12_64TO32_LANES];
+    void* outputs[K12_64TO32_LANES];
+    while (count >= K12_64TO32_LANES)
+    {
+        for (unsigned int n = 0; n < K12_64TO32_LANES; n++)
+        {
+            inputs[n] = (const unsigned char*)input + n * 64;
+            outputs[n] = (unsigned char*)output + n * 32;
+        }
+        KangarooTwelve64To32Lanes(inputs, outputs);
+        input = (const unsigned char*)input + K12_64TO32_LANES * 64;
+        output = (unsigned char*)output + K12_64TO32_LANES * 32;
+        count -= K12_64TO32_LANES;
+    }
+    for (unsigned long long i = 0; i < count; i++)
+    {
+        KangarooTwelve64To32((const unsigned char*)input + i * 64, (unsigned char*)output + i * 32);
+    }
+}
+
+// Collects KangarooTwelve64To32() calls with scattered inputs and outputs, computing K12_64TO32_LANES of them at once.
+// Outputs are only valid after calling flush().
+struct KangarooTwelve64To32Queue
+{
+    const void* inputs[K12_64TO32_LANES];
+    void* outputs[K12_64TO32_LANES];
+    unsigned int size = 0;
+
+    void push(const void* input, void* output)
+    {
+        inputs[size] = input;
+        outputs[size] = output;
+        if (++size == K12_64TO32_LANES)
+        {
+            KangarooTwelve64To32Lanes(inputs, outputs);
+            size = 0;
+        }
+    }
+
+    void flush()
+    {
+        for (unsigned int i = 0; i < size; i++)
+        {
+            KangarooTwelve64To32(inputs[i], outputs[i]);
+        }
+        size = 0;
+    }
+};
+
 static void random(const unsigned char* publicKey, const unsigned char* nonce, unsigned char* output, unsigned long long outputSize)
 {
     unsigned char state[200];
@@ -268,10 +268,23 @@ private:
     inline static VirtualMemory<TickBlobInfo, TEXT_IMAP_AS_NUMBER, TEXT_LOGS_AS_NUMBER, IMAP_LOG_PAGE_SIZE, VM_NUM_CACHE_PAGE> mapTxToLogId;
     inline static TickBlobInfo currentTickTxToId;
     inline static char responseBuffers[MAX_NUMBER_OF_PROCESSORS][RequestResponseHeader::max_size];
-    inline static std::map<unsigned long long, BlobInfo> blobInfoTmp;
-    inline static std::map<unsigned long long, char*> tmpLogBuffer;
-    inline static std::map<unsigned long long, unsigned long long> tmpLogSize;
-    inline static std::map<unsigned long long, unsigned int> logIdToTxIdMap;
+
+    // Logs of the current tick are staged in an arena and committed to logBuffer at the end of the tick, because logs
+    // of invalid solution transactions may be removed until then. Entry i stores the log with ID stagedLogsFirstId + i.
+    struct StagedLog
+    {
+        unsigned long long arenaOffset;
+        unsigned int size;
+        unsigned int txId; // LOG_TX_PER_TICK if log isn't assigned to a transaction
+        bool removed;
+    };
+    static constexpr unsigned long long stagedLogArenaInitialSize = 16 * 1024 * 1024;
+    static constexpr unsigned long long stagedLogsInitialCapacity = 128 * 1024;
+    inline static std::vector<char> stagedLogArena;
+    inline static unsigned long long stagedLogArenaSize;
+    inline static std::vector<StagedLog> stagedLogs;
+    inline static std::vector<BlobInfo> stagedBlobInfos; // used in commit only
+    inline static unsigned long long stagedLogsFirstId;
 
 #if LOG_STATE_DIGEST
     // Digests of log data:
@@ -335,9 +348,23 @@ private:
     {
 #if ENABLED_LOGGING
         if (isPausing) return;
-        char buffer[LOG_HEADER_SIZE];
+
+        // reserve space in arena (only grows on exceptionally busy ticks, never shrinks)
+        const unsigned long long logSize = LOG_HEADER_SIZE + messageSize;
+        if (stagedLogArenaSize + logSize > stagedLogArena.size())
+        {
+            stagedLogArena.resize(max(2 * (unsigned long long)stagedLogArena.size(), stagedLogArenaSize + logSize));
+        }
+        if (stagedLogs.empty())
+        {
+            stagedLogsFirstId = logId;
+        }
+        ASSERT(logId == stagedLogsFirstId + stagedLogs.size());
+        stagedLogs.push_back({ stagedLogArenaSize, (unsigned int)logSize, LOG_TX_PER_TICK, false });
+        char* buffer = stagedLogArena.data() + stagedLogArenaSize;
+        stagedLogArenaSize += logSize;
+
         tx.addLogId();
-        logBuf.set(logId, logBufferTail, LOG_HEADER_SIZE + messageSize);
         *((unsigned short*)(buffer)) = system.epoch;
         *((unsigned int*)(buffer + 2)) = system.tick;
         *((unsigned int*)(buffer + 6)) = messageSize | (messageType << 24);
@@ -345,15 +372,8 @@ private:
         unsigned long long logDigest = 0;
         KangarooTwelve(message, messageSize, &logDigest, 8);
         *((unsigned long long*)(buffer + 18)) = logDigest;
-        logBufferTail += LOG_HEADER_SIZE + messageSize;
-        // logBuffer.appendMany(buffer, LOG_HEADER_SIZE);
-        // logBuffer.appendMany((char*)message, messageSize);
-        char* tmpLog = new char[LOG_HEADER_SIZE + messageSize];
-        setMem(tmpLog, LOG_HEADER_SIZE + messageSize, 0);
-        copyMem(tmpLog, buffer, LOG_HEADER_SIZE);
-        copyMem(tmpLog + LOG_HEADER_SIZE, (char*)message, messageSize);
-        tmpLogBuffer[logId - 1] = tmpLog;
-        tmpLogSize[logId - 1] = LOG_HEADER_SIZE + messageSize;
+        logBufferTail += logSize;
+        copyMem(buffer + LOG_HEADER_SIZE, message, messageSize);
 #if LOG_STATE_DIGEST
         if (messageType == QU_TRANSFER || messageType == ASSET_ISSUANCE || messageType == ASSET_OWNERSHIP_CHANGE || messageType == ASSET_POSSESSION_CHANGE ||
             messageType == BURNING || messageType == DUST_BURNING || messageType == SPECTRUM_STATS || messageType == ASSET_OWNERSHIP_MANAGING_CONTRACT_CHANGE ||
@@ -419,16 +439,6 @@ public:
             return BlobInfo{ -1,-1 };
         }
 
-        static void set(unsigned long long logId, long long index, long long length)
-        {
-            //ASSERT(logId == mapLogIdToBufferIndex.size());
-            BlobInfo res;
-            res.startIndex = index;
-            res.length = length;
-            //mapLogIdToBufferIndex.append(res);
-            blobInfoTmp[logId] = res;
-        }
-
         static void get(char* dst, unsigned long long logId)
         {
             BlobInfo bi = logBuf.getBlobInfo(logId);
@@ -445,12 +455,24 @@ public:
     {
         static bool init()
         {
+            if (stagedLogArena.size() < stagedLogArenaInitialSize)
+            {
+                stagedLogArena.resize(stagedLogArenaInitialSize);
+                stagedLogs.reserve(stagedLogsInitialCapacity);
+                stagedBlobInfos.reserve(stagedLogsInitialCapacity);
+            }
+            stagedLogArenaSize = 0;
+            stagedLogs.clear();
             return mapTxToLogId.init();
         }
 
         static void deinit()
         {
             mapTxToLogId.deinit();
+            std::vector<char>().swap(stagedLogArena);
+            std::vector<StagedLog>().swap(stagedLogs);
+            std::vector<BlobInfo>().swap(stagedBlobInfos);
+            stagedLogArenaSize = 0;
         }
 
         // return the logID ranges of a tx hash
@@ -512,8 +534,8 @@ public:
             if (offsetTick < MAX_NUMBER_OF_TICKS_PER_EPOCH && currentTxId < LOG_TX_PER_TICK)
             {
                 auto& startIndex = currentTickTxToId.fromLogId[currentTxId];
-                auto& length = currentTickTxToId.length[currentTxId];\
-                logIdToTxIdMap[logId] = currentTxId;
+                auto& length = currentTickTxToId.length[currentTxId];
+                stagedLogs.back().txId = currentTxId;
                 if (startIndex == -1)
                 {
                     startIndex = logId;
@@ -538,8 +560,13 @@ public:
                 {
                     length--;
 
-                    // Remove the BlobInfo of this logId
-                    blobInfoTmp.erase(startIndex + 1);
+                    // Mark log as removed, it is skipped in commit
+                    const unsigned long long stagedIndex = startIndex + 1 - stagedLogsFirstId;
+                    ASSERT(stagedIndex < stagedLogs.size());
+                    if (stagedIndex < stagedLogs.size())
+                    {
+                        stagedLogs[stagedIndex].removed = true;
+                    }
                 } else
                 {
                     logToConsole(L"Warning: cannot remove return deposit log of solution transaction, invalid length");
@@ -560,42 +587,62 @@ public:
         // 1. The deleted log id must be a log of invalid solution tx
         static void _commit()
         {
-            // commit the tmp blob info and logBuffer to the VM
+            // Compact staged logs of current tick in arena, removing the deleted logs and adjusting log IDs, so that
+            // they can be appended to the VMs at once
             unsigned long long currentDeletedLogs = 0;
             unsigned long long totalBytesOfLogsDeleted = 0;
+            unsigned long long compactedSize = 0;
+            unsigned long long tickArenaBegin = 0;
+            char* arena = stagedLogArena.data();
+            stagedBlobInfos.clear();
             for (unsigned long long i = currentTickStartLogId; i < logId; i++)
             {
-                auto it = blobInfoTmp.find(i);
-                if (it == blobInfoTmp.end())
+                const unsigned long long stagedIndex = i - stagedLogsFirstId;
+                ASSERT(i >= stagedLogsFirstId && stagedIndex < stagedLogs.size());
+                if (i < stagedLogsFirstId || stagedIndex >= stagedLogs.size())
+                {
+                    continue;
+                }
+                const StagedLog& stagedLog = stagedLogs[stagedIndex];
+                if (i == currentTickStartLogId)
+                {
+                    tickArenaBegin = stagedLog.arenaOffset;
+                    compactedSize = tickArenaBegin;
+                }
+                if (stagedLog.removed)
                 {
-                    // this log id is deleted
                     currentDeletedLogs++;
-                    unsigned long long deletedBytes = tmpLogSize[i];
-                    totalBytesOfLogsDeleted += deletedBytes;
-                } else
+                    totalBytesOfLogsDeleted += stagedLog.size;
+                    continue;
+                }
+
+                // adjust the txInfoBlob (once per tx, when processing its first log)
+                if (stagedLog.txId < LOG_TX_PER_TICK && currentTickTxToId.fromLogId[stagedLog.txId] == (long long)i)
+                {
+                    currentTickTxToId.fromLogId[stagedLog.txId] -= currentDeletedLogs;
+                }
+
+                char* log = arena + compactedSize;
+                if (compactedSize != stagedLog.arenaOffset)
                 {
-                    BlobInfo& blobInfo = blobInfoTmp[i];
-                    blobInfo.startIndex -= totalBytesOfLogsDeleted;
-                    mapLogIdToBufferIndex.append(blobInfo);
-                    char * tmpLog = tmpLogBuffer[i];
-                    // change the log id in the log header
-                    *((unsigned long long*)(tmpLog + 10)) = i - currentDeletedLogs;
-                    // append the log to the log buffer
-                    logBuffer.appendMany(tmpLog, blobInfo.length);
-                    // adjust the txInfoBlob
-                    unsigned int txId = logIdToTxIdMap[i];
-                    currentTickTxToId.fromLogId[txId] -= currentDeletedLogs;
+                    copyMem(log, arena + stagedLog.arenaOffset, stagedLog.size);
                 }
+                // change the log id in the log header
+                *((unsigned long long*)(log + 10)) = i - currentDeletedLogs;
+                // logBufferTail includes all staged logs
+                stagedBlobInfos.push_back({ (long long)(logBufferTail - stagedLogArenaSize + compactedSize), (long long)stagedLog.size });
+                compactedSize += stagedLog.size;
             }
-            // Reset the tmp buffer
-            blobInfoTmp.clear();
-            for (auto& it : tmpLogBuffer)
+            if (!stagedBlobInfos.empty())
             {
-                delete[] it.second;
+                mapLogIdToBufferIndex.appendMany(stagedBlobInfos.data(), stagedBlobInfos.size());
+                logBuffer.appendMany(arena + tickArenaBegin, compactedSize - tickArenaBegin);
             }
-            tmpLogBuffer.clear();
-            tmpLogSize.clear();
-            logIdToTxIdMap.clear();
+
+            // Reset the arena
+            stagedLogs.clear();
+            stagedLogArenaSize = 0;
+
             // Adjust the logId and logBufferTail
             logId -= currentDeletedLogs;
             logBufferTail -= totalBytesOfLogsDeleted;
@@ -682,6 +729,18 @@ public:
         isPausing = false;
 #endif
     }
+
+    // Log page cache counters of the log storages, which help to choose VM_NUM_CACHE_PAGE
+    static void logCacheStatistics()
+    {
+#if ENABLED_LOGGING
+        setText(message, L"Log cache hits/misses/prefetch hits: ");
+        appendCacheStatistics(message, L"buffer ", logBuffer.getCacheStatistics());
+        appendCacheStatistics(message, L" | log id map ", mapLogIdToBufferIndex.getCacheStatistics());
+        appendCacheStatistics(message, L" | tx map ", mapTxToLogId.getCacheStatistics());
+        logToConsole(message);
+#endif
+    }
     
 #if defined(NO_UEFI) && !defined(REAL_NODE)
 #else
@@ -689,6 +748,15 @@ public:
     // This function is part of save/load feature and can only be called from main thread
     bool saveCurrentLoggingStates(CHAR16* dir)
     {
+        return saveDumpedLoggingStates(dir, dumpCurrentLoggingStates());
+    }
+
+    // Copy the current logging states to the scratchpad and return their size. Part of the save/load feature and
+    // can only be called from main thread. The states can be saved later with saveDumpedLoggingStates(), as long
+    // as the scratchpad is not used in between (or is inherited by a snapshot process, see startNodeStateSnapshot()).
+    unsigned long long dumpCurrentLoggingStates()
+    {
+        unsigned long long writeSz = 0;
 #if ENABLED_LOGGING
         unsigned char* buffer = (unsigned char*)__scratchpad();        
         static_assert(reorgBufferSize >= LOG_BUFFER_PAGE_SIZE + PMAP_LOG_PAGE_SIZE * sizeof(BlobInfo) + IMAP_LOG_PAGE_SIZE * sizeof(TickBlobInfo)
@@ -727,8 +795,16 @@ public:
         *((unsigned int*)buffer) = currentTxId; buffer += 4;
         *((unsigned int*)buffer) = currentTick; buffer += 4;
         writeSz += 8 + 8 + 4 + 4 + 4 + 4;
-        buffer = (unsigned char*)__scratchpad(); // reset back to original pos
-        sz = save(L"logEventState.db", writeSz, buffer, dir);
+#endif
+        return writeSz;
+    }
+
+    // Save logging states dumped to the scratchpad by dumpCurrentLoggingStates()
+    bool saveDumpedLoggingStates(CHAR16* dir, unsigned long long writeSz)
+    {
+#if ENABLED_LOGGING
+        unsigned char* buffer = (unsigned char*)__scratchpad();
+        unsigned long long sz = save(L"logEventState.db", writeSz, buffer, dir);
         if (sz != writeSz)
         {
             logToConsole(L"Failed to save logging event data!");
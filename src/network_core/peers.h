@@ -160,6 +160,8 @@ static struct Request
 {
     Peer* peer;
     unsigned int offset;
+    unsigned int reservedSize;
+    volatile char released;
 } requestQueueElements[REQUEST_QUEUE_LENGTH];
 
 static struct Response
@@ -172,7 +174,7 @@ static volatile unsigned int requestQueueBufferHead = 0, requestQueueBufferTail
 static volatile unsigned int responseQueueBufferHead = 0, responseQueueBufferTail = 0;
 static volatile unsigned short requestQueueElementHead = 0, requestQueueElementTail = 0;
 static volatile unsigned short responseQueueElementHead = 0, responseQueueElementTail = 0;
-static volatile char requestQueueTailLock = 0;
+static volatile long requestQueueElementNext = 0;
 static volatile char responseQueueHeadLock = 0;
 static volatile unsigned long long queueProcessingNumerator = 0, queueProcessingDenominator = 0;
 static volatile unsigned long long tickerLoopNumerator = 0, tickerLoopDenominator = 0;
@@ -673,6 +675,72 @@ static bool peerConnectionNewlyEstablished(unsigned int i)
     return false;
 }
 
+// Requests are handed to the request processors without copying them out of requestQueueBuffer. The main loop
+// appends requests at the head. A request processor claims the next request by incrementing requestQueueElementNext,
+// processes it in place, and releases it afterwards. Requests may be released out of order, so only the main loop
+// moves the tail, stopping at the oldest request that is still being processed (see reclaimRequestQueueSpace()).
+// requestQueueElementNext is 32-bit to avoid ABA problems with the compare-and-swap when the 16-bit element index
+// wraps around.
+
+// Space reserved for a request in requestQueueBuffer. Messages with fewer payload bytes than expected are padded,
+// so that handlers temporarily modifying the first payload bytes (such as the computor index of a tick) do not
+// touch the next request, which may be processed by another processor at the same time.
+// The reserved space is only reused after all older requests are released, so a single slow request blocks
+// reclaiming the space of the requests received after it, even if they have been processed already. If the
+// main loop receives REQUEST_QUEUE_BUFFER_SIZE bytes (or REQUEST_QUEUE_LENGTH requests) during that time, new
+// requests are answered with TryAgain until the slow request is released. Request handlers must therefore not
+// wait for long-running work, but leave it to the tick processor (as done for the computor verification keys).
+static unsigned int requestQueueReservedSize(unsigned int messageSize)
+{
+    if (messageSize < sizeof(RequestResponseHeader) + 8)
+    {
+        messageSize = sizeof(RequestResponseHeader) + 8;
+    }
+    return (messageSize + 7) & ~7U;
+}
+
+// Claim the next request in the queue. Returns the element index, or -1 if there is no unclaimed request.
+// The request has to be passed to releaseRequest() after processing. Can be called from any thread.
+static int claimRequest()
+{
+    while (true)
+    {
+        const long next = requestQueueElementNext;
+        if ((unsigned short)next == requestQueueElementHead)
+        {
+            return -1;
+        }
+        if (_InterlockedCompareExchange(&requestQueueElementNext, next + 1, next) == next)
+        {
+            return (unsigned short)next;
+        }
+    }
+}
+
+// Release a claimed request, allowing the main loop to reuse its space in requestQueueBuffer.
+static void releaseRequest(int elementIndex)
+{
+    // Make sure all accesses to the request are done before releasing it
+    COMPILER_BARRIER();
+    requestQueueElements[elementIndex].released = 1;
+}
+
+// Move the tail of the request queue over all released requests. Must only be called by the main loop.
+static void reclaimRequestQueueSpace()
+{
+    while (requestQueueElementTail != (unsigned short)requestQueueElementNext && requestQueueElements[requestQueueElementTail].released)
+    {
+        const Request& request = requestQueueElements[requestQueueElementTail];
+        unsigned int newTail = request.offset + request.reservedSize;
+        if (newTail > REQUEST_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
+        {
+            newTail = 0;
+        }
+        requestQueueBufferTail = newTail;
+        requestQueueElementTail++;
+    }
+}
+
 // This function process all data that arrive in FragmentBuffer.
 // based on RequestResponseHeader to determine whether the received packet is completed or not
 // if it receives a completed packet, it will copy the packet to requestQueueElements to process later in requestProcessors
@@ -702,12 +770,15 @@ static void processReceivedData(unsigned int i, unsigned int salt)
                     numberOfReceivedBytes += peers[i].receiveData.DataLength;
                     *((unsigned long long*) & peers[i].receiveData.FragmentTable[0].FragmentBuffer) += peers[i].receiveData.DataLength;
 
-                iteration:
-                    unsigned int receivedDataSize = (unsigned int)(((unsigned long long)peers[i].receiveData.FragmentTable[0].FragmentBuffer) - ((unsigned long long)peers[i].receiveBuffer));
-
-                    if (receivedDataSize >= sizeof(RequestResponseHeader))
+                    // Process all complete messages in the receive buffer, then move the remaining partial message
+                    // (if any) to the beginning of the buffer at once
+                    unsigned char* receiveBuffer = (unsigned char*)peers[i].receiveBuffer;
+                    const unsigned int receivedDataSize = (unsigned int)(((unsigned long long)peers[i].receiveData.FragmentTable[0].FragmentBuffer) - ((unsigned long long)receiveBuffer));
+                    unsigned int processedDataSize = 0;
+                    bool peerClosed = false;
+                    while (receivedDataSize - processedDataSize >= sizeof(RequestResponseHeader))
                     {
-                        RequestResponseHeader* requestResponseHeader = (RequestResponseHeader*)peers[i].receiveBuffer;
+                        RequestResponseHeader* requestResponseHeader = (RequestResponseHeader*)(receiveBuffer + processedDataSize);
                         if (requestResponseHeader->size() < sizeof(RequestResponseHeader))
                         {
                             // protocol violation -> forget peer
@@ -717,72 +788,85 @@ static void processReceivedData(unsigned int i, unsigned int salt)
                             logToConsole(message);
                             forgetPublicPeer(peers[i].address);
                             closePeer(&peers[i]);
+                            peerClosed = true;
+
+                            break;
                         }
-                        else
+                        if (receivedDataSize - processedDataSize < requestResponseHeader->size())
                         {
-                            if (receivedDataSize >= requestResponseHeader->size())
+                            break;
+                        }
+
+                        // Compute saltId of packet with K12 of payload and header (size + type temporarily
+                        // overwritten with salt). This is used recognized and skip packet duplicates with
+                        // dejavu0 (checking/setting flag for received package). After receiving a certain
+                        // number of packages (DEJAVU_SWAP_LIMIT), dejavu0 is moved to dejavu1 for checking
+                        // and dejavu0 is initialized with an empty buffer for checking/setting.
+                        unsigned int saltedId;
+                        const unsigned int header = *((unsigned int*)requestResponseHeader);
+                        *((unsigned int*)requestResponseHeader) = salt;
+                        KangarooTwelve(requestResponseHeader, header & 0xFFFFFF, &saltedId, sizeof(saltedId));
+                        *((unsigned int*)requestResponseHeader) = header;
+
+                        // Initiate transfer of already received packet to processing thread
+                        // (or drop it without processing if Dejavu filter tells to ignore it)
+                        if (!((dejavu0[saltedId >> 6] | dejavu1[saltedId >> 6]) & (1ULL << (saltedId & 63))))
+                        {
+                            reclaimRequestQueueSpace();
+
+                            const unsigned int reservedSize = requestQueueReservedSize(requestResponseHeader->size());
+                            if ((requestQueueBufferHead >= requestQueueBufferTail || requestQueueBufferHead + reservedSize < requestQueueBufferTail)
+                                && (unsigned short)(requestQueueElementHead + 1) != requestQueueElementTail)
                             {
-                                // Compute saltId of packet with K12 of payload and header (size + type temporarily
-                                // overwritten with salt). This is used recognized and skip packet duplicates with
-                                // dejavu0 (checking/setting flag for received package). After receiving a certain
-                                // number of packages (DEJAVU_SWAP_LIMIT), dejavu0 is moved to dejavu1 for checking
-                                // and dejavu0 is initialized with an empty buffer for checking/setting.
-                                unsigned int saltedId;
-                                const unsigned int header = *((unsigned int*)requestResponseHeader);
-                                *((unsigned int*)requestResponseHeader) = salt;
-                                KangarooTwelve(requestResponseHeader, header & 0xFFFFFF, &saltedId, sizeof(saltedId));
-                                *((unsigned int*)requestResponseHeader) = header;
-
-                                // Initiate transfer of already received packet to processing thread
-                                // (or drop it without processing if Dejavu filter tells to ignore it)
-                                if (!((dejavu0[saltedId >> 6] | dejavu1[saltedId >> 6]) & (1ULL << (saltedId & 63))))
+                                dejavu0[saltedId >> 6] |= (1ULL << (saltedId & 63));
+
+                                ASSERT(requestQueueElementHead < REQUEST_QUEUE_LENGTH);
+                                ASSERT(requestQueueBufferHead < REQUEST_QUEUE_BUFFER_SIZE);
+                                ASSERT(requestQueueBufferHead + reservedSize < REQUEST_QUEUE_BUFFER_SIZE);
+
+                                Request& request = requestQueueElements[requestQueueElementHead];
+                                request.offset = requestQueueBufferHead;
+                                request.reservedSize = reservedSize;
+                                request.peer = &peers[i];
+                                request.released = 0;
+                                copyMem(&requestQueueBuffer[requestQueueBufferHead], requestResponseHeader, requestResponseHeader->size());
+                                requestQueueBufferHead += reservedSize;
+                                if (requestQueueBufferHead > REQUEST_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
                                 {
-                                    if ((requestQueueBufferHead >= requestQueueBufferTail || requestQueueBufferHead + requestResponseHeader->size() < requestQueueBufferTail)
-                                        && (unsigned short)(requestQueueElementHead + 1) != requestQueueElementTail)
-                                    {
-                                        dejavu0[saltedId >> 6] |= (1ULL << (saltedId & 63));
-
-                                        ASSERT(requestQueueElementHead < REQUEST_QUEUE_LENGTH);
-                                        ASSERT(requestQueueBufferHead < REQUEST_QUEUE_BUFFER_SIZE);
-                                        ASSERT(requestQueueBufferHead + requestResponseHeader->size() < REQUEST_QUEUE_BUFFER_SIZE);
-
-                                        requestQueueElements[requestQueueElementHead].offset = requestQueueBufferHead;
-                                        copyMem(&requestQueueBuffer[requestQueueBufferHead], peers[i].receiveBuffer, requestResponseHeader->size());
-                                        requestQueueBufferHead += requestResponseHeader->size();
-                                        requestQueueElements[requestQueueElementHead].peer = &peers[i];
-                                        if (requestQueueBufferHead > REQUEST_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
-                                        {
-                                            requestQueueBufferHead = 0;
-                                        }
-                                        // TODO: Place a fence
-                                        requestQueueElementHead++;
-
-                                        if (!(--dejavuSwapCounter))
-                                        {
-                                            unsigned long long* tmp = dejavu1;
-                                            dejavu1 = dejavu0;
-                                            setMem(dejavu0 = tmp, 536870912, 0);
-                                            dejavuSwapCounter = DEJAVU_SWAP_LIMIT;
-                                        }
-                                    }
-                                    else
-                                    {
-                                        _InterlockedIncrement64(&numberOfDiscardedRequests);
-
-                                        enqueueResponse(&peers[i], 0, TryAgain::type, requestResponseHeader->dejavu(), NULL);
-                                    }
+                                    requestQueueBufferHead = 0;
                                 }
-                                else
+
+                                // Make sure the request is complete before the request processors can claim it
+                                COMPILER_BARRIER();
+                                requestQueueElementHead++;
+
+                                if (!(--dejavuSwapCounter))
                                 {
-                                    _InterlockedIncrement64(&numberOfDuplicateRequests);
+                                    unsigned long long* tmp = dejavu1;
+                                    dejavu1 = dejavu0;
+                                    setMem(dejavu0 = tmp, 536870912, 0);
+                                    dejavuSwapCounter = DEJAVU_SWAP_LIMIT;
                                 }
+                            }
+                            else
+                            {
+                                _InterlockedIncrement64(&numberOfDiscardedRequests);
 
-                                copyMem(peers[i].receiveBuffer, ((char*)peers[i].receiveBuffer) + requestResponseHeader->size(), receivedDataSize -= requestResponseHeader->size());
-                                peers[i].receiveData.FragmentTable[0].FragmentBuffer = ((char*)peers[i].receiveBuffer) + receivedDataSize;
-
-                                goto iteration;
+                                enqueueResponse(&peers[i], 0, TryAgain::type, requestResponseHeader->dejavu(), NULL);
                             }
                         }
+                        else
+                        {
+                            _InterlockedIncrement64(&numberOfDuplicateRequests);
+                        }
+
+                        processedDataSize += requestResponseHeader->size();
+                    }
+
+                    if (!peerClosed && processedDataSize)
+                    {
+                        copyMem(receiveBuffer, receiveBuffer + processedDataSize, receivedDataSize - processedDataSize);
+                        peers[i].receiveData.FragmentTable[0].FragmentBuffer = receiveBuffer + (receivedDataSize - processedDataSize);
                     }
                 }
             }
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "platform/file_io.h"
+
+#ifdef __linux__
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <filesystem>
+#include <string>
+
+
+// Executed by the snapshot process (see startNodeStateSnapshot() in qubic.cpp). Writes the node states to
+// stagingDirectory by calling writeStates(stagingDirectory), which returns false on error, and replaces the last
+// snapshot in directory by the new one. Returns the exit code of the snapshot process: 0 on success, 1 if writing
+// the node states failed, and 2 if the directory could not be replaced. On error, directory is left unchanged.
+template <typename WriteStatesFunc>
+static int writeNodeStateSnapshot(CHAR16* directory, CHAR16* stagingDirectory, WriteStatesFunc writeStates)
+{
+    if (!writeStates(stagingDirectory))
+    {
+        return 1;
+    }
+
+    // Replace the last snapshot by the new one. Exchanging the directories is atomic, so there is always a complete
+    // snapshot in the epoch directory.
+    sync();
+    const std::string directoryStr = wchar_to_string(directory);
+    const std::string stagingDirectoryStr = wchar_to_string(stagingDirectory);
+    if (std::filesystem::exists(directoryStr))
+    {
+        if (renameat2(AT_FDCWD, stagingDirectoryStr.c_str(), AT_FDCWD, directoryStr.c_str(), RENAME_EXCHANGE) != 0)
+        {
+            return 2;
+        }
+        std::filesystem::remove_all(stagingDirectoryStr);
+    }
+    else if (rename(stagingDirectoryStr.c_str(), directoryStr.c_str()) != 0)
+    {
+        return 2;
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,245 @@
+#pragma once
+
+// Chunked deflate format of large node state files (spectrum, universe, digest trees). The data is split into
+// chunks that are compressed and decompressed by several threads in parallel. Each chunk except the last one ends
+// with a sync flush (byte-aligned, not final), so the concatenated chunks form a single raw deflate stream of the
+// whole data, which can be copied into a zip archive without recompressing it (see writeZipArchive()).
+//
+// The file starts with CompressedFileHeader, followed by numberOfChunks CompressedFileChunk entries and the
+// compressed chunks in order. All chunks have chunkSize bytes of data except for the last one.
+
+#ifdef __linux__
+
+#include <zlib.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct CompressedFileHeader
+{
+    static constexpr unsigned long long magicValue = 0x3130464443534e51ULL; // "QNSCDF01"
+
+    unsigned long long magic;
+    unsigned long long totalSize;
+    unsigned long long chunkSize;
+    unsigned long long numberOfChunks;
+};
+
+struct CompressedFileChunk
+{
+    unsigned long long compressedSize;
+    unsigned int crc32; // CRC-32 of the uncompressed chunk
+    unsigned int reserved;
+};
+
+static constexpr unsigned long long COMPRESSED_FILE_CHUNK_SIZE = 16ULL * 1024 * 1024;
+
+// Offset of the first compressed chunk in the file
+static unsigned long long compressedFileDataOffset(const CompressedFileHeader& header)
+{
+    return sizeof(CompressedFileHeader) + header.numberOfChunks * sizeof(CompressedFileChunk);
+}
+
+// Read and check the header and chunk table of the compressed file fd. Returns 1 on success, 0 if the file is not
+// in the compressed format, and -1 if it is invalid.
+static int readCompressedFileTable(int fd, CompressedFileHeader& header, std::vector<CompressedFileChunk>& chunks)
+{
+    if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || header.magic != CompressedFileHeader::magicValue)
+    {
+        return 0;
+    }
+    const off_t fileSize = lseek(fd, 0, SEEK_END);
+    if (!header.chunkSize || header.chunkSize > 0xFFFFFFFFULL || header.numberOfChunks != (header.totalSize + header.chunkSize - 1) / header.chunkSize
+        || fileSize < 0 || header.numberOfChunks > (unsigned long long)fileSize / sizeof(CompressedFileChunk))
+    {
+        return -1;
+    }
+    chunks.resize(header.numberOfChunks);
+    const ssize_t tableSize = (ssize_t)(header.numberOfChunks * sizeof(CompressedFileChunk));
+    if (tableSize && pread(fd, chunks.data(), tableSize, sizeof(header)) != tableSize)
+    {
+        return -1;
+    }
+    unsigned long long end = compressedFileDataOffset(header);
+    for (const auto& chunk : chunks)
+    {
+        if (chunk.compressedSize > (unsigned long long)fileSize)
+        {
+            return -1;
+        }
+        end += chunk.compressedSize;
+    }
+    return (end == (unsigned long long)fileSize) ? 1 : -1;
+}
+
+// Write size bytes of data to path in the compressed format. The chunks are compressed by numberOfThreads threads,
+// numberOfThreads chunks at a time. Returns false on error.
+static bool writeCompressedFile(const std::string& path, const unsigned char* data, unsigned long long size,
+    unsigned int numberOfThreads = 8, unsigned long long chunkSize = COMPRESSED_FILE_CHUNK_SIZE, int level = Z_BEST_SPEED)
+{
+    if (!numberOfThreads)
+    {
+        numberOfThreads = 1;
+    }
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    CompressedFileHeader header;
+    header.magic = CompressedFileHeader::magicValue;
+    header.totalSize = size;
+    header.chunkSize = chunkSize;
+    header.numberOfChunks = (size + chunkSize - 1) / chunkSize;
+    std::vector<CompressedFileChunk> chunks(header.numberOfChunks);
+    bool ok = fseeko(file, compressedFileDataOffset(header), SEEK_SET) == 0;
+
+    std::vector<std::vector<unsigned char>> outputs(numberOfThreads);
+    std::vector<bool> results(numberOfThreads);
+    for (unsigned long long firstChunk = 0; ok && firstChunk < header.numberOfChunks; firstChunk += numberOfThreads)
+    {
+        const unsigned int numberOfRoundChunks = (unsigned int)std::min<unsigned long long>(numberOfThreads, header.numberOfChunks - firstChunk);
+        auto deflateChunk = [&](unsigned int i)
+        {
+            const unsigned long long chunkIndex = firstChunk + i;
+            const unsigned long long offset = chunkIndex * chunkSize;
+            const unsigned long long chunkDataSize = std::min(chunkSize, size - offset);
+            const bool lastChunk = chunkIndex == header.numberOfChunks - 1;
+            z_stream stream = {};
+            results[i] = deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+            if (!results[i])
+            {
+                return;
+            }
+            outputs[i].resize(deflateBound(&stream, (uLong)chunkDataSize) + 16);
+            stream.next_in = (unsigned char*)data + offset;
+            stream.avail_in = (uInt)chunkDataSize;
+            stream.next_out = outputs[i].data();
+            stream.avail_out = (uInt)outputs[i].size();
+            results[i] = deflate(&stream, lastChunk ? Z_FINISH : Z_SYNC_FLUSH) == (lastChunk ? Z_STREAM_END : Z_OK) && !stream.avail_in;
+            chunks[chunkIndex].compressedSize = stream.total_out;
+            chunks[chunkIndex].crc32 = (unsigned int)crc32(0, data + offset, (uInt)chunkDataSize);
+            chunks[chunkIndex].reserved = 0;
+            deflateEnd(&stream);
+        };
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < numberOfRoundChunks; i++)
+        {
+            threads.emplace_back(deflateChunk, i);
+        }
+        deflateChunk(0);
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        for (unsigned int i = 0; ok && i < numberOfRoundChunks; i++)
+        {
+            const unsigned long long compressedSize = chunks[firstChunk + i].compressedSize;
+            ok = results[i] && fwrite(outputs[i].data(), 1, compressedSize, file) == compressedSize;
+        }
+    }
+
+    ok = ok && fseeko(file, 0, SEEK_SET) == 0
+        && fwrite(&header, sizeof(header), 1, file) == 1
+        && (chunks.empty() || fwrite(chunks.data(), sizeof(CompressedFileChunk), chunks.size(), file) == chunks.size());
+    return (fclose(file) == 0) && ok;
+}
+
+// Read the compressed file path into data (size bytes), decompressing the chunks with numberOfThreads threads in
+// parallel. Returns 1 on success, 0 if the file cannot be opened or is not in the compressed format (so it can be
+// read as an uncompressed file), and -1 on error (including a different size of the data or a CRC mismatch).
+static int readCompressedFile(const std::string& path, unsigned char* data, unsigned long long size, unsigned int numberOfThreads = 8)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    CompressedFileHeader header;
+    std::vector<CompressedFileChunk> chunks;
+    int result = readCompressedFileTable(fd, header, chunks);
+    if (result <= 0 || header.totalSize != size)
+    {
+        close(fd);
+        return result ? -1 : 0;
+    }
+
+    std::vector<unsigned long long> chunkOffsets(header.numberOfChunks);
+    unsigned long long offset = compressedFileDataOffset(header);
+    for (unsigned long long i = 0; i < header.numberOfChunks; i++)
+    {
+        chunkOffsets[i] = offset;
+        offset += chunks[i].compressedSize;
+    }
+
+    std::atomic<unsigned long long> nextChunk = 0;
+    std::atomic<bool> failed = false;
+    auto inflateChunks = [&]()
+    {
+        std::vector<unsigned char> input;
+        unsigned long long chunkIndex;
+        while ((chunkIndex = nextChunk++) < header.numberOfChunks)
+        {
+            const CompressedFileChunk& chunk = chunks[chunkIndex];
+            const unsigned long long dataOffset = chunkIndex * header.chunkSize;
+            const unsigned long long chunkDataSize = std::min(header.chunkSize, size - dataOffset);
+            const bool lastChunk = chunkIndex == header.numberOfChunks - 1;
+            input.resize(chunk.compressedSize);
+            bool ok = chunk.compressedSize <= 0xFFFFFFFFULL
+                && pread(fd, input.data(), chunk.compressedSize, chunkOffsets[chunkIndex]) == (ssize_t)chunk.compressedSize;
+            z_stream stream = {};
+            if (ok && inflateInit2(&stream, -MAX_WBITS) == Z_OK)
+            {
+                // The sync flush at the end of a chunk may be left in the input when the output is full. It does not
+                // produce output, which is checked with the spare byte.
+                unsigned char spare;
+                stream.next_in = input.data();
+                stream.avail_in = (uInt)chunk.compressedSize;
+                stream.next_out = data + dataOffset;
+                stream.avail_out = (uInt)chunkDataSize;
+                int status = Z_OK;
+                while (status == Z_OK && (stream.avail_in || (lastChunk && stream.avail_out)))
+                {
+                    if (!stream.avail_out)
+                    {
+                        stream.next_out = &spare;
+                        stream.avail_out = 1;
+                    }
+                    status = inflate(&stream, Z_SYNC_FLUSH);
+                }
+                ok = status == (lastChunk ? Z_STREAM_END : Z_OK) && !stream.avail_in && stream.total_out == chunkDataSize
+                    && (unsigned int)crc32(0, data + dataOffset, (uInt)chunkDataSize) == chunk.crc32;
+                inflateEnd(&stream);
+            }
+            else
+            {
+                ok = false;
+            }
+            if (!ok)
+            {
+                failed = true;
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < numberOfThreads && i < header.numberOfChunks; i++)
+    {
+        threads.emplace_back(inflateChunks);
+    }
+    inflateChunks();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    close(fd);
+    return failed ? -1 : 1;
+}
+
+#endif
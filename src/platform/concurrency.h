@@ -126,3 +126,11 @@ static_assert(sizeof(long) == 4, "Size of long for _InterlockedExchange is 4 byt
 #define ATOMIC_LOAD64(target) _InterlockedCompareExchange64(&target, 0, 0)
 #define ATOMIC_ADD64(target, val) _InterlockedExchangeAdd64(&target, val)
 #define ATOMIC_MAX64(target, val) atomicMax64(&target, val)
+
+// Prevent the compiler from moving memory accesses across this point. The CPU does not reorder loads with other
+// loads or stores with other stores on x86, so this is enough for ordering the accesses of seqlock readers.
+#ifdef _MSC_VER
+#define COMPILER_BARRIER() _ReadWriteBarrier()
+#else
+#define COMPILER_BARRIER() __asm__ __volatile__("" ::: "memory")
+#endif
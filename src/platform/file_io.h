@@ -6,6 +6,9 @@
 #include <cstdio>
 #include <filesystem>
 #include <fstream>
+#include <thread>
+#include <vector>
+#include "compressed_file.h"
 #endif
 #include <lib/platform_common/processor.h>
 #include <lib/platform_common/compiler_optimization.h>
@@ -74,7 +77,7 @@ static long long getFileSize(CHAR16* fileName, CHAR16* directory = NULL)
     std::string dirNameStr = wchar_to_string(directory);
     std::string fileNameStr = wchar_to_string(fileName);
     std::filesystem::path filePath;
-    filePath = dirNameStr + "/" + fileNameStr;
+    filePath = dirNameStr.empty() ? fileNameStr : dirNameStr + "/" + fileNameStr;
 
     if (!std::filesystem::exists(filePath))
     {
@@ -301,7 +304,9 @@ static bool removeDir(CHAR16* dirName)
 #endif
 }
 
-static long long load(const CHAR16* fileName, unsigned long long totalSize, unsigned char* buffer, const CHAR16* directory = NULL)
+// Load totalSize bytes of the file into buffer. Returns totalSize on success and -1 on error. Errors are not logged if
+// logErrors is false, because logging is not thread-safe.
+static long long load(const CHAR16* fileName, unsigned long long totalSize, unsigned char* buffer, const CHAR16* directory = NULL, bool logErrors = true)
 {
 #ifdef NO_UEFI
     FILE* file = nullptr;
@@ -311,20 +316,26 @@ static long long load(const CHAR16* fileName, unsigned long long totalSize, unsi
     }
     if (q_wfopen_s(&file, fileName, directory, L"rb") != 0 || !file)
     {
+        if (logErrors)
+        {
 #ifdef _MSC_VER
-        wprintf(L"Error opening file %s!\n", fileName);
+            wprintf(L"Error opening file %s!\n", fileName);
 #else
-        print_wstr(L"Error opening file in load %s!\n", wchar_to_string((fileName)).c_str());
+            print_wstr(L"Error opening file in load %s!\n", wchar_to_string((fileName)).c_str());
 #endif
+        }
         return -1;
     }
     if (fread(buffer, 1, totalSize, file) != totalSize)
     {
+        if (logErrors)
+        {
 #ifdef _MSC_VER
-        wprintf(L"Error reading %llu bytes from %s!\n", totalSize, fileName);
+            wprintf(L"Error reading %llu bytes from %s!\n", totalSize, fileName);
 #else
-        print_wstr(L"Error reading %llu bytes from %s!\n", totalSize, wchar_to_string((fileName)).c_str());
+            print_wstr(L"Error reading %llu bytes from %s!\n", totalSize, wchar_to_string((fileName)).c_str());
 #endif
+        }
         return -1;
     }
     fclose(file);
@@ -340,14 +351,20 @@ static long long load(const CHAR16* fileName, unsigned long long totalSize, unsi
         // Open the directory
         if (status = root->Open(root, (void**)&directoryProtocol, (CHAR16*)directory, EFI_FILE_MODE_READ, 0))
         {
-            logStatusToConsole(L"FileIOLoad:OpenDir EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
+            if (logErrors)
+            {
+                logStatusToConsole(L"FileIOLoad:OpenDir EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
+            }
             return -1;
         }
 
         // Open the file from the directory.
         if (status = directoryProtocol->Open(directoryProtocol, (void**)&file, (CHAR16*)fileName, EFI_FILE_MODE_READ, 0))
         {
-            logStatusToConsole(L"FileIOLoad:OpenDir:OpenFile EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
+            if (logErrors)
+            {
+                logStatusToConsole(L"FileIOLoad:OpenDir:OpenFile EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
+            }
             directoryProtocol->Close(directoryProtocol);
             return -1;
         }
@@ -359,7 +376,10 @@ static long long load(const CHAR16* fileName, unsigned long long totalSize, unsi
     {
         if (status = root->Open(root, (void**)&file, (CHAR16*)fileName, EFI_FILE_MODE_READ, 0))
         {
-            logStatusToConsole(L"FileIOLoad:OpenFile EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
+            if (logErrors)
+            {
+                logStatusToConsole(L"FileIOLoad:OpenFile EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
+            }
             return -1;
         }
     }
@@ -376,7 +396,10 @@ static long long load(const CHAR16* fileName, unsigned long long totalSize, unsi
                 || size != (READING_CHUNK_SIZE <= (totalSize - readSize) ? READING_CHUNK_SIZE : (totalSize - readSize)))
             {
                 // If this error occurs, see the definition of READING_CHUNK_SIZE above.
-                logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() fails", status, __LINE__);
+                if (logErrors)
+                {
+                    logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() fails", status, __LINE__);
+                }
 
                 file->Close(file);
 
@@ -392,6 +415,103 @@ static long long load(const CHAR16* fileName, unsigned long long totalSize, unsi
 #endif
 }
 
+// Minimum number of bytes read by each thread of loadParallel()
+static constexpr unsigned long long PARALLEL_LOAD_MIN_PART_SIZE = 64ULL * 1024 * 1024;
+
+// Same as load(), but reading different parts of a large file by several threads in parallel, which keeps more
+// requests in flight on SSDs. Does not create the directory, so it can be called from any thread.
+static long long loadParallel(const CHAR16* fileName, unsigned long long totalSize, unsigned char* buffer, const CHAR16* directory = NULL, unsigned int numberOfThreads = 8, bool logErrors = true)
+{
+#ifdef NO_UEFI
+#ifdef __linux__
+    // Files saved in the compressed format (see saveStateFile()) are decompressed by the threads instead
+    const std::string path = directory ? wchar_to_string(directory) + "/" + wchar_to_string(fileName) : wchar_to_string(fileName);
+    const int compressed = readCompressedFile(path, buffer, totalSize, numberOfThreads);
+    if (compressed < 0)
+    {
+        if (logErrors)
+        {
+            print_wstr(L"Error decompressing %llu bytes from %s!\n", totalSize, wchar_to_string((fileName)).c_str());
+        }
+        return -1;
+    }
+    if (compressed > 0)
+    {
+        return totalSize;
+    }
+#endif
+    unsigned long long partSize = (totalSize + numberOfThreads - 1) / (numberOfThreads ? numberOfThreads : 1);
+    if (partSize < PARALLEL_LOAD_MIN_PART_SIZE)
+    {
+        partSize = PARALLEL_LOAD_MIN_PART_SIZE;
+    }
+    if (partSize >= totalSize)
+    {
+        FILE* file = nullptr;
+        if (q_wfopen_s(&file, fileName, directory, L"rb") != 0 || !file)
+        {
+            if (logErrors)
+            {
+#ifdef _MSC_VER
+                wprintf(L"Error opening file %s!\n", fileName);
+#else
+                print_wstr(L"Error opening file in loadParallel %s!\n", wchar_to_string((fileName)).c_str());
+#endif
+            }
+            return -1;
+        }
+        const bool ok = fread(buffer, 1, totalSize, file) == totalSize;
+        fclose(file);
+        return ok ? totalSize : -1;
+    }
+
+    std::vector<std::thread> threads;
+    volatile long failedParts = 0;
+    for (unsigned long long offset = 0; offset < totalSize; offset += partSize)
+    {
+        const unsigned long long size = (totalSize - offset < partSize) ? totalSize - offset : partSize;
+        threads.emplace_back([=, &failedParts]()
+            {
+                FILE* file = nullptr;
+                bool ok = q_wfopen_s(&file, fileName, directory, L"rb") == 0 && file;
+#ifdef _MSC_VER
+                ok = ok && _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+                ok = ok && fseeko(file, offset, SEEK_SET) == 0;
+#endif
+                ok = ok && fread(buffer + offset, 1, size, file) == size;
+                if (file)
+                {
+                    fclose(file);
+                }
+                if (!ok)
+                {
+                    _InterlockedIncrement(&failedParts);
+                }
+            });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    if (failedParts)
+    {
+        if (logErrors)
+        {
+#ifdef _MSC_VER
+            wprintf(L"Error reading %llu bytes from %s!\n", totalSize, fileName);
+#else
+            print_wstr(L"Error reading %llu bytes from %s!\n", totalSize, wchar_to_string((fileName)).c_str());
+#endif
+        }
+        return -1;
+    }
+    return totalSize;
+#else
+    return load(fileName, totalSize, buffer, directory, logErrors);
+#endif
+}
+
 static long long save(const CHAR16* fileName, unsigned long long totalSize, const unsigned char* buffer, const CHAR16* directory = NULL)
 {
 #ifdef NO_UEFI
@@ -489,6 +609,27 @@ static long long save(const CHAR16* fileName, unsigned long long totalSize, cons
 #endif
 }
 
+// Save a large node state file that is read with loadParallel(). If NODE_STATE_COMPRESSION is set in
+// private_settings.h, the file is saved in the compressed format (see compressed_file.h), otherwise like save().
+static long long saveStateFile(const CHAR16* fileName, unsigned long long totalSize, const unsigned char* buffer, const CHAR16* directory = NULL)
+{
+#if NODE_STATE_COMPRESSION && defined(NO_UEFI) && defined(__linux__)
+    if (directory != NULL)
+    {
+        createDir(directory);
+    }
+    const std::string path = directory ? wchar_to_string(directory) + "/" + wchar_to_string(fileName) : wchar_to_string(fileName);
+    if (!writeCompressedFile(path, buffer, totalSize))
+    {
+        print_wstr(L"Error writing compressed file %s!\n", wchar_to_string((fileName)).c_str());
+        return -1;
+    }
+    return totalSize;
+#else
+    return save(fileName, totalSize, buffer, directory);
+#endif
+}
+
 OPTIMIZE_OFF()
 
 struct FileItem
@@ -9,6 +9,22 @@
 
 #include "four_q.h"
 #include "kangaroo_twelve.h"
+#include "contracts/math_lib.h"
+
+#if defined(NO_UEFI) && defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(NO_UEFI)
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
 
 template <class T>
 inline constexpr const T& max(const T& left, const T& right)
@@ -22,6 +38,25 @@ inline constexpr const T& min(const T& left, const T& right)
     return (left < right) ? left : right;
 }
 
+// Counters of page lookups in the cache of a VirtualMemory / SwapVirtualMemory, for sizing the number of cache pages
+struct VirtualMemoryCacheStatistics
+{
+    unsigned long long hits;         // requested page was in cache
+    unsigned long long misses;       // requested page had to be loaded (or created)
+    unsigned long long prefetchHits; // misses that were served from a page prefetched in the background
+};
+
+// Append label and statistics formatted as "hits/misses/prefetchHits" to text
+static void appendCacheStatistics(CHAR16* text, const CHAR16* label, const VirtualMemoryCacheStatistics& statistics)
+{
+    appendText(text, label);
+    appendNumber(text, statistics.hits, TRUE);
+    appendText(text, L"/");
+    appendNumber(text, statistics.misses, TRUE);
+    appendText(text, L"/");
+    appendNumber(text, statistics.prefetchHits, TRUE);
+}
+
 // an util to use disk as RAM to reduce hardware requirement for qubic core node
 // this VirtualMemory doesn't (yet) support amend operation. That means data stay persisted once they are written
 // template variables meaning:
@@ -41,12 +76,21 @@ protected:
     CHAR16* pageDir = NULL;
 
     unsigned long long cachePageId[numCachePage + 1];
-    unsigned long long lastAccessedTimestamp[numCachePage + 1]; // in millisecond
+    unsigned long long cachePageReferenced[numCachePage + 1]; // CLOCK reference bit (64 bit to keep layout of VM state)
+    unsigned int cachePagePinCount[numCachePage + 1]; // pinned pages are not evicted
+    unsigned int clockHand;
+
+    // hash table mapping page id to cache slot, entries are slot index + 1 (0 means empty)
+    static constexpr unsigned int pageTableSize = (unsigned int)math_lib::findNextPowerOf2(2 * (numCachePage + 1));
+    static_assert(numCachePage + 1 < 0xffff, "Page table entries are 16 bit");
+    unsigned short pageTable[pageTableSize];
     unsigned long long currentId; // total items in this array, aka: latest item index + 1
     unsigned long long currentPageId; // current page index that's written on
 
     volatile char memLock; // every read/write needs a memory lock, can optimize later
 
+    VirtualMemoryCacheStatistics cacheStatistics;
+
     void generatePageName(CHAR16 pageName[64], unsigned long long page_id)
     {
         setMem(pageName, sizeof(pageName), 0);
@@ -94,31 +138,102 @@ protected:
 #endif
     }
 
-    // return the most outdated cache page
-    int getMostOutdatedCachePage()
+    static unsigned int pageTableHash(unsigned long long pageId)
+    {
+        return (unsigned int)(pageId * 0x9E3779B97F4A7C15ULL >> 40) & (pageTableSize - 1);
+    }
+
+    // return position of pageId in pageTable or of the empty entry where it can be inserted
+    unsigned int findPageTableEntry(unsigned long long pageId)
     {
-        // i = 1 because 0 is used for current page
-        int min_index = 1;
-        for (int i = 1; i <= numCachePage; i++)
+        unsigned int pos = pageTableHash(pageId);
+        while (pageTable[pos] && cachePageId[pageTable[pos] - 1] != pageId)
         {
-            if (lastAccessedTimestamp[i] == 0)
+            pos = (pos + 1) & (pageTableSize - 1);
+        }
+        return pos;
+    }
+
+    void removePageTableEntry(unsigned int pos)
+    {
+        // backward shift deletion: move following entries of the probe sequence into the gap if possible
+        unsigned int next = pos;
+        while (true)
+        {
+            next = (next + 1) & (pageTableSize - 1);
+            if (!pageTable[next])
             {
-                return i;
+                break;
             }
-            if ((lastAccessedTimestamp[i] < lastAccessedTimestamp[min_index]) || (lastAccessedTimestamp[i] == lastAccessedTimestamp[min_index] && cachePageId[i] < cachePageId[min_index]))
+            const unsigned int home = pageTableHash(cachePageId[pageTable[next] - 1]);
+            if (((next - home) & (pageTableSize - 1)) >= ((next - pos) & (pageTableSize - 1)))
             {
-                min_index = i;
+                pageTable[pos] = pageTable[next];
+                pos = next;
             }
         }
-        return min_index;
+        pageTable[pos] = 0;
+    }
+
+    // set page id of cache slot, updating the page table
+    void setCachePageId(int slot, unsigned long long pageId)
+    {
+        unsigned int pos = findPageTableEntry(cachePageId[slot]);
+        if (pageTable[pos] == slot + 1)
+        {
+            removePageTableEntry(pos);
+        }
+        cachePageId[slot] = pageId;
+        cachePagePinCount[slot] = 0;
+        if (pageId != (unsigned long long)-1)
+        {
+            pageTable[findPageTableEntry(pageId)] = slot + 1;
+        }
+    }
+
+    void rebuildPageTable()
+    {
+        setMem(pageTable, sizeof(pageTable), 0);
+        for (int i = 0; i <= numCachePage; i++)
+        {
+            if (cachePageId[i] != (unsigned long long)-1)
+            {
+                pageTable[findPageTableEntry(cachePageId[i])] = i + 1;
+            }
+        }
+    }
+
+    // Return cache slot to replace by a new page with CLOCK policy: take the first slot at the clock hand that
+    // is not pinned and hasn't been referenced since the last pass of the hand. Slot 0 is skipped if skipFirstSlot
+    // is set and the slot of page excludedPageId is always skipped.
+    int getCachePageToEvict(bool skipFirstSlot, unsigned long long excludedPageId = (unsigned long long)-1)
+    {
+        // at most two passes: the first one may only clear reference bits
+        for (unsigned int i = 0; i < 2 * (numCachePage + 1) + 1; i++)
+        {
+            const unsigned int slot = clockHand;
+            clockHand = (clockHand == numCachePage) ? 0 : clockHand + 1;
+            if ((skipFirstSlot && slot == 0) || cachePagePinCount[slot] || (cachePageId[slot] == excludedPageId && excludedPageId != (unsigned long long)-1))
+            {
+                continue;
+            }
+            if (cachePageReferenced[slot] && cachePageId[slot] != (unsigned long long)-1)
+            {
+                cachePageReferenced[slot] = 0;
+                continue;
+            }
+            return slot;
+        }
+        return -1;
     }
 
     void copyCurrentPageToCache()
     {
-        int cache_slot_idx = getMostOutdatedCachePage();
+        int cache_slot_idx = getCachePageToEvict(true);
+        ASSERT(cache_slot_idx > 0);
         copyMem(cache[cache_slot_idx], currentPage, pageSize);
-        lastAccessedTimestamp[cache_slot_idx] = now_ms();
-        cachePageId[cache_slot_idx] = currentPageId;
+        cachePageReferenced[cache_slot_idx] = 1;
+        setCachePageId(cache_slot_idx, currentPageId);
 #ifndef NDEBUG
         {
             CHAR16 debugMsg[128];
@@ -142,19 +257,23 @@ protected:
         setMem(currentPage, pageSize, 0);
     }
 
+    // check if page is in cache without marking it as referenced
+    bool isPageCached(unsigned long long pageId)
+    {
+        return pageTable[findPageTableEntry(pageId)] != 0;
+    }
+
     // return cache id given cache_page_id
     int findCachePage(unsigned long long requested_page_id)
     {
-        // TODO: consider implementing a tree here for faster search
-        for (int i = 0; i <= numCachePage; i++)
+        const unsigned int pos = findPageTableEntry(requested_page_id);
+        if (!pageTable[pos])
         {
-            if (cachePageId[i] == requested_page_id)
-            {
-                lastAccessedTimestamp[i] = now_ms();
-                return i;
-            }
+            return -1;
         }
-        return -1;
+        const int i = pageTable[pos] - 1;
+        cachePageReferenced[i] = 1;
+        return i;
     }
 
     // load a page from disk to cache
@@ -166,14 +285,21 @@ protected:
 
         if (cache_page_id != -1)
         {
+            cacheStatistics.hits++;
             return cache_page_id;
         }
+        cacheStatistics.misses++;
         CHAR16 pageName[64];
         generatePageName(pageName, pageId);
-        cache_page_id = getMostOutdatedCachePage();
+        cache_page_id = getCachePageToEvict(true);
+        if (cache_page_id < 0)
+        {
+            return -1;
+        }
+        // invalidate slot before overwriting its content
+        setCachePageId(cache_page_id, (unsigned long long)-1);
 #if defined(NO_UEFI) && !defined(REAL_NODE)
         auto sz = load(pageName, pageSize, (unsigned char*)cache[cache_page_id], pageDir);
-        lastAccessedTimestamp[cache_page_id] = now_ms();
 #else
 #if !defined(NDEBUG)
         {
@@ -191,9 +317,9 @@ protected:
 #endif
             return -1;
         }
-        lastAccessedTimestamp[cache_page_id] = now_ms();
 #endif
-        cachePageId[cache_page_id] = pageId;
+        cachePageReferenced[cache_page_id] = 1;
+        setCachePageId(cache_page_id, pageId);
 #if !defined(NDEBUG)
         {
             CHAR16 debugMsg[128];
@@ -224,7 +350,7 @@ protected:
             writeCurrentPageToDisk();
             copyCurrentPageToCache();
             cleanCurrentPage();
-            cachePageId[0] = currentId / pageCapacity;
+            setCachePageId(0, currentId / pageCapacity);
             currentPageId++;
         }
     }
@@ -233,8 +359,12 @@ protected:
     {
         setMem(currentPage, pageSize * (numCachePage + 1), 0);
         setMem(cachePageId, sizeof(cachePageId), 0xff);
-        setMem(lastAccessedTimestamp, sizeof(lastAccessedTimestamp), 0);
+        setMem(cachePageReferenced, sizeof(cachePageReferenced), 0);
+        setMem(cachePagePinCount, sizeof(cachePagePinCount), 0);
+        clockHand = 0;
         cachePageId[0] = 0;
+        rebuildPageTable();
+        setMem(&cacheStatistics, sizeof(cacheStatistics), 0);
         currentId = 0;
         currentPageId = 0;
         memLock = 0;
@@ -617,6 +747,11 @@ public:
         return currentPage;
     }
 
+    VirtualMemoryCacheStatistics getCacheStatistics() const
+    {
+        return cacheStatistics;
+    }
+
     unsigned long long dumpVMState(unsigned char* buffer)
     {
         ACQUIRE(memLock);
@@ -652,13 +787,143 @@ public:
         buffer += 8;
         ret += 8;
 
-        cachePageId[0] = currentPageId;
-        lastAccessedTimestamp[0] = now_ms();
+        setCachePageId(0, currentPageId);
+        cachePageReferenced[0] = 1;
         RELEASE(memLock);
         return ret;
     }
 };
 
+// Background threads writing evicted pages of SwapVirtualMemory to disk (write-behind) and loading pages before they
+// are accessed (prefetch). Threads are only available with an OS (NO_UEFI). If the workers are not running, pages are
+// written and loaded synchronously by the processor accessing the SwapVirtualMemory.
+class SwapIOWorkers
+{
+public:
+    typedef void (*JobFunction)(void* context, unsigned long long arg);
+
+    static constexpr unsigned int maxNumberOfWorkers = 16;
+    static constexpr unsigned int jobQueueCapacity = 256;
+
+    static bool start(unsigned int numberOfWorkers)
+    {
+#if defined(NO_UEFI)
+        if (numberOfThreads || !numberOfWorkers)
+        {
+            return false;
+        }
+        if (numberOfWorkers > maxNumberOfWorkers)
+        {
+            numberOfWorkers = maxNumberOfWorkers;
+        }
+        jobBegin = 0;
+        jobCount = 0;
+        stopRequested = false;
+        for (unsigned int i = 0; i < numberOfWorkers; i++)
+        {
+            threads[i] = std::thread(workerLoop);
+        }
+        numberOfThreads = numberOfWorkers;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Finish all queued jobs and stop the threads
+    static void stop()
+    {
+#if defined(NO_UEFI)
+        if (!numberOfThreads)
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopRequested = true;
+        }
+        condition.notify_all();
+        for (unsigned int i = 0; i < numberOfThreads; i++)
+        {
+            threads[i].join();
+        }
+        numberOfThreads = 0;
+#endif
+    }
+
+    static bool isRunning()
+    {
+        return numberOfThreads != 0;
+    }
+
+    // Queue call of func(context, arg) in a worker thread. Returns false if the job cannot be queued.
+    static bool submit(JobFunction func, void* context, unsigned long long arg)
+    {
+#if defined(NO_UEFI)
+        if (!numberOfThreads)
+        {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (jobCount == jobQueueCapacity || stopRequested)
+            {
+                return false;
+            }
+            Job& job = jobs[(jobBegin + jobCount) % jobQueueCapacity];
+            job.func = func;
+            job.context = context;
+            job.arg = arg;
+            jobCount++;
+        }
+        condition.notify_one();
+        return true;
+#else
+        return false;
+#endif
+    }
+
+private:
+    struct Job
+    {
+        JobFunction func;
+        void* context;
+        unsigned long long arg;
+    };
+
+    inline static Job jobs[jobQueueCapacity];
+    inline static unsigned int jobBegin = 0;
+    inline static unsigned int jobCount = 0;
+    inline static unsigned int numberOfThreads = 0;
+    inline static bool stopRequested = false;
+
+#if defined(NO_UEFI)
+    inline static std::thread threads[maxNumberOfWorkers];
+    inline static std::mutex mutex;
+    inline static std::condition_variable condition;
+
+    static void workerLoop()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [] { return jobCount || stopRequested; });
+                if (!jobCount)
+                {
+                    return;
+                }
+                job = jobs[jobBegin];
+                jobBegin = (jobBegin + 1) % jobQueueCapacity;
+                jobCount--;
+            }
+            job.func(job.context, job.arg);
+        }
+    }
+#endif
+};
+
 enum SwapMode
 {
     INDEX_MODE = 0, // for stride access pattern (ideally for TickData, Ticks)
@@ -679,12 +944,17 @@ class SwapVirtualMemory : private VirtualMemory<T, prefixName, pageDirectory, pa
     using VMBase::pageDir;
     using VMBase::cache;
     using VMBase::cachePageId;
-    using VMBase::lastAccessedTimestamp;
+    using VMBase::cachePageReferenced;
+    using VMBase::cachePagePinCount;
     using VMBase::memLock;
     using VMBase::generatePageName;
     using VMBase::findCachePage;
     using VMBase::loadPageToCache;
-    using VMBase::getMostOutdatedCachePage;
+    using VMBase::setCachePageId;
+    using VMBase::rebuildPageTable;
+    using VMBase::getCachePageToEvict;
+    using VMBase::isPageCached;
+    using VMBase::cacheStatistics;
 
     static constexpr unsigned long long MAX_PAGE = 1024 * 1024; // max 1 million pages, can be adjusted later
 
@@ -704,18 +974,229 @@ private:
     static constexpr unsigned long long pageHasExtraBytesBufferSize = sizeof(bool) * MAX_PAGE;
     static constexpr unsigned long long lastestPageExtraBytesOffsetAccessedBufferSize = sizeof(unsigned long long) * MAX_PAGE;
 
-    void writePageToDisk(unsigned long long pageId)
+    // Buffers of background IO, only used if SwapIOWorkers are running when calling init()
+    static constexpr unsigned int numWriteBehindBuffers = 2;
+    static constexpr unsigned int numPrefetchBuffers = 2;
+    static constexpr unsigned long long prefetchDistance = 2; // number of pages loaded ahead of sequential access
+    enum IOBufferState : char
     {
+        IO_BUFFER_FREE = 0,
+        IO_BUFFER_BUSY = 1, // being written (write-behind) or loaded (prefetch) by worker thread
+        IO_BUFFER_READY = 2, // prefetched page ready to be copied into cache
+    };
+    struct IOBuffer
+    {
+        unsigned char* data;
+        volatile unsigned long long pageId;
+        volatile IOBufferState state;
+    };
+    unsigned char* ioBufferMemory = nullptr;
+    IOBuffer writeBehindBuffers[numWriteBehindBuffers];
+    IOBuffer prefetchBuffers[numPrefetchBuffers];
+    unsigned long long lastMissPageId = INVALID_PAGE_ID;
+
+    static void writeBehindJob(void* context, unsigned long long bufferIndex)
+    {
+        SwapVirtualMemory* vm = (SwapVirtualMemory*)context;
+        IOBuffer& buffer = vm->writeBehindBuffers[bufferIndex];
+        vm->writePageBufferToDisk(buffer.pageId, buffer.data);
+        COMPILER_BARRIER();
+        buffer.state = IO_BUFFER_FREE;
+    }
+
+    static void prefetchJob(void* context, unsigned long long bufferIndex)
+    {
+        SwapVirtualMemory* vm = (SwapVirtualMemory*)context;
+        IOBuffer& buffer = vm->prefetchBuffers[bufferIndex];
         CHAR16 pageName[64];
-        generatePageName(pageName, pageId);
+        vm->generatePageName(pageName, buffer.pageId);
+        const long long sz = load(pageName, vm->pageSize, buffer.data, vm->pageDir);
+        COMPILER_BARRIER();
+        buffer.state = (sz == (long long)vm->pageSize) ? IO_BUFFER_READY : IO_BUFFER_FREE;
+    }
 
-        int cache_idx = findCachePage(pageId);
-        if (cache_idx == -1)
+    void waitForWriteBehind(unsigned long long pageId)
+    {
+        for (unsigned int i = 0; i < numWriteBehindBuffers; i++)
         {
-            logToConsole(L"Error in writeCachePageToDisk: page not found on cache");
-            return;
+            while (writeBehindBuffers[i].state == IO_BUFFER_BUSY && writeBehindBuffers[i].pageId == pageId)
+            {
+                _mm_pause();
+            }
+        }
+    }
+
+    // Wait until all background IO is finished and drop prefetched pages
+    void waitForBackgroundIO()
+    {
+        for (unsigned int i = 0; i < numWriteBehindBuffers; i++)
+        {
+            while (writeBehindBuffers[i].state == IO_BUFFER_BUSY)
+            {
+                _mm_pause();
+            }
+        }
+        for (unsigned int i = 0; i < numPrefetchBuffers; i++)
+        {
+            while (prefetchBuffers[i].state == IO_BUFFER_BUSY)
+            {
+                _mm_pause();
+            }
+            prefetchBuffers[i].state = IO_BUFFER_FREE;
+        }
+        lastMissPageId = INVALID_PAGE_ID;
+    }
+
+    // Write cache page to disk, in background if possible. Call before evicting the page from cache.
+    void evictPage(int cacheIndex)
+    {
+        const unsigned long long pageId = cachePageId[cacheIndex];
+
+        // a previous write of the same page has to be finished first to keep the order of writes
+        waitForWriteBehind(pageId);
+
+        if (ioBufferMemory)
+        {
+            for (unsigned int i = 0; i < numWriteBehindBuffers; i++)
+            {
+                IOBuffer& buffer = writeBehindBuffers[i];
+                if (buffer.state == IO_BUFFER_FREE)
+                {
+                    copyMem(buffer.data, cache[cacheIndex], pageSize);
+                    buffer.pageId = pageId;
+                    buffer.state = IO_BUFFER_BUSY;
+                    if (SwapIOWorkers::submit(writeBehindJob, this, i))
+                    {
+                        return;
+                    }
+                    buffer.state = IO_BUFFER_FREE;
+                    break;
+                }
+            }
+        }
+
+        writePageBufferToDisk(pageId, (unsigned char*)cache[cacheIndex]);
+    }
+
+    // Copy page to cache buffer if it is still in a write-behind buffer or has been prefetched.
+    // Returns false if page needs to be loaded from disk.
+    bool copyPageFromIOBuffers(unsigned long long pageId, unsigned char* dst)
+    {
+        if (!ioBufferMemory)
+        {
+            return false;
+        }
+        for (unsigned int i = 0; i < numWriteBehindBuffers; i++)
+        {
+            // worker only reads the buffer and it cannot be reused while memLock is held
+            IOBuffer& buffer = writeBehindBuffers[i];
+            if (buffer.state == IO_BUFFER_BUSY && buffer.pageId == pageId)
+            {
+                copyMem(dst, buffer.data, pageSize);
+                return true;
+            }
+        }
+        for (unsigned int i = 0; i < numPrefetchBuffers; i++)
+        {
+            IOBuffer& buffer = prefetchBuffers[i];
+            if (buffer.state != IO_BUFFER_FREE && buffer.pageId == pageId)
+            {
+                while (buffer.state == IO_BUFFER_BUSY)
+                {
+                    _mm_pause();
+                }
+                if (buffer.state == IO_BUFFER_READY)
+                {
+                    copyMem(dst, buffer.data, pageSize);
+                    buffer.state = IO_BUFFER_FREE;
+                    cacheStatistics.prefetchHits++;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Start loading the pages following pageId in the background if they are on disk only
+    void prefetchFollowingPages(unsigned long long pageId)
+    {
+        for (unsigned long long nextPageId = pageId + 1; nextPageId <= pageId + prefetchDistance && nextPageId < MAX_PAGE; nextPageId++)
+        {
+            if (!isPageWrittenToDisk[nextPageId] || isPageCached(nextPageId))
+            {
+                continue;
+            }
+
+            // skip pages already queued for writing or prefetching and find buffer, reusing the ones of pages skipped
+            // by the sequential access
+            int freeBufferIndex = -1;
+            bool skip = false;
+            for (unsigned int i = 0; i < numWriteBehindBuffers; i++)
+            {
+                if (writeBehindBuffers[i].state == IO_BUFFER_BUSY && writeBehindBuffers[i].pageId == nextPageId)
+                {
+                    skip = true;
+                }
+            }
+            for (unsigned int i = 0; i < numPrefetchBuffers; i++)
+            {
+                const IOBuffer& buffer = prefetchBuffers[i];
+                if (buffer.state != IO_BUFFER_FREE && buffer.pageId == nextPageId)
+                {
+                    skip = true;
+                }
+                else if (buffer.state == IO_BUFFER_FREE || (buffer.state == IO_BUFFER_READY && (buffer.pageId <= pageId || buffer.pageId > pageId + prefetchDistance)))
+                {
+                    freeBufferIndex = i;
+                }
+            }
+            if (skip)
+            {
+                continue;
+            }
+            if (freeBufferIndex < 0)
+            {
+                break;
+            }
+
+            IOBuffer& buffer = prefetchBuffers[freeBufferIndex];
+            buffer.pageId = nextPageId;
+            buffer.state = IO_BUFFER_BUSY;
+            if (!SwapIOWorkers::submit(prefetchJob, this, freeBufferIndex))
+            {
+                buffer.state = IO_BUFFER_FREE;
+                break;
+            }
+        }
+    }
+
+    bool initIOBuffers()
+    {
+        if (!SwapIOWorkers::isRunning() || ioBufferMemory)
+        {
+            return true;
+        }
+        if (!allocPoolWithErrorLog(L"SwapVM.IOBuffers", pageSize * (numWriteBehindBuffers + numPrefetchBuffers), (void**)&ioBufferMemory, __LINE__))
+        {
+            return false;
+        }
+        for (unsigned int i = 0; i < numWriteBehindBuffers; i++)
+        {
+            writeBehindBuffers[i].data = ioBufferMemory + i * pageSize;
+            writeBehindBuffers[i].state = IO_BUFFER_FREE;
+        }
+        for (unsigned int i = 0; i < numPrefetchBuffers; i++)
+        {
+            prefetchBuffers[i].data = ioBufferMemory + (numWriteBehindBuffers + i) * pageSize;
+            prefetchBuffers[i].state = IO_BUFFER_FREE;
         }
-        unsigned char *pageBuffer = (unsigned char*)cache[cache_idx];
+        return true;
+    }
+
+    void writePageBufferToDisk(unsigned long long pageId, const unsigned char* pageBuffer)
+    {
+        CHAR16 pageName[64];
+        generatePageName(pageName, pageId);
 
 #if defined(NO_UEFI) && !defined(REAL_NODE)
         auto sz = save(pageName, pageSize, (unsigned char*)pageBuffer, pageDir);
@@ -738,7 +1219,7 @@ private:
             debugMsg[6] = L' ';
             debugMsg[7] = 0;
             appendText(debugMsg, L"page ");
-            appendNumber(debugMsg, currentPageId, true);
+            appendNumber(debugMsg, pageId, true);
             appendText(debugMsg, L" is written into disk");
             addDebugMessage(debugMsg);
         }
@@ -753,18 +1234,25 @@ private:
 
         if (cache_page_id != -1)
         {
+            cacheStatistics.hits++;
             return cache_page_id;
         }
+        cacheStatistics.misses++;
         CHAR16 pageName[64];
         generatePageName(pageName, pageId);
-        cache_page_id = getMostOutdatedCachePageExceptCurrentPage();
+        cache_page_id = getCachePageToEvict(false, currentPageId);
+        if (cache_page_id == -1)
+        {
+            // all pages are pinned
+            return -1;
+        }
         if (cachePageId[cache_page_id] != INVALID_PAGE_ID)
         {
-            writePageToDisk(cachePageId[cache_page_id]);
+            evictPage(cache_page_id);
+            setCachePageId(cache_page_id, INVALID_PAGE_ID);
         }
 #if false
         auto sz = load(pageName, pageSize, (unsigned char*)cache[cache_page_id], pageDir);
-        lastAccessedTimestamp[cache_page_id] = now_ms();
 #else
 #if !defined(NDEBUG)
         {
@@ -775,7 +1263,11 @@ private:
         }
 #endif
         unsigned long long sz = 0;
-        if (isPageWrittenToDisk[pageId])
+        if (copyPageFromIOBuffers(pageId, (unsigned char*)cache[cache_page_id]))
+        {
+            sz = pageSize;
+        }
+        else if (isPageWrittenToDisk[pageId])
         {
             sz = load(pageName, pageSize, (unsigned char*)cache[cache_page_id], pageDir);
         } else
@@ -790,9 +1282,16 @@ private:
 #endif
             return -1;
         }
-        lastAccessedTimestamp[cache_page_id] = now_ms();
 #endif
-        cachePageId[cache_page_id] = pageId;
+        cachePageReferenced[cache_page_id] = 1;
+        setCachePageId(cache_page_id, pageId);
+
+        // tick processing mostly reads pages in sequence, so load next pages in background
+        if (ioBufferMemory && pageId == lastMissPageId + 1)
+        {
+            prefetchFollowingPages(pageId);
+        }
+        lastMissPageId = pageId;
 #if !defined(NDEBUG)
         {
             CHAR16 debugMsg[128];
@@ -812,33 +1311,16 @@ private:
         return cache_page_id;
     }
 
-    // return the most outdated cache page
-    int getMostOutdatedCachePageExceptCurrentPage()
-    {
-        int min_index = 0;
-        for (int i = 0; i <= numCachePage; i++)
-        {
-            if (lastAccessedTimestamp[i] == 0 && cachePageId[i] != currentPageId)
-            {
-                return i;
-            }
-            if ((lastAccessedTimestamp[i] < lastAccessedTimestamp[min_index]) || (lastAccessedTimestamp[i] == lastAccessedTimestamp[min_index] && cachePageId[i] < cachePageId[min_index]))
-            {
-                if (cachePageId[i] != currentPageId) // skip current page
-                {
-                    min_index = i;
-                }
-            }
-        }
-        return min_index;
-    }
 public:
+    using VMBase::getCacheStatistics;
+
     SwapVirtualMemory()
     {
         VMBase();
     }
 
     void reset() {
+        waitForBackgroundIO();
         VMBase::reset();
         setMem(isPageWrittenToDisk, isPageWrittenToDiskSize, 0);
         if (mode == SwapMode::OFFSET_MODE) {
@@ -865,7 +1347,7 @@ public:
         {
             return false;
         }
-        bool ok = VMBase::init();
+        bool ok = VMBase::init() && initIOBuffers();
         return ok;
     }
 
@@ -877,7 +1359,7 @@ public:
             return false;
         }
 
-        bool ok = VMBase::init();
+        bool ok = VMBase::init() && initIOBuffers();
         return ok;
     }
 
@@ -903,8 +1385,8 @@ public:
         return resultRef;
     }
 
-    // NOTE: if getPtr is used, all other operations need to be SEQUENCE even they are reading operations (get, getMany)
-    // because reading operations may flush the page T* live into disk and change cache page state
+    // NOTE: the pointer returned by getPtr is only valid until the page is evicted by another access. If the pointer
+    // is used while other operations may run concurrently, use pin() / unpin() instead.
     T* getPtr(unsigned long long index)
     requires (mode == SwapMode::INDEX_MODE)
     {
@@ -927,6 +1409,42 @@ public:
         return result;
     }
 
+    // Return pointer to element and pin its page in the cache. The pointer stays valid until unpin(index) is called,
+    // because pinned pages are never evicted. Each pin() needs to be followed by exactly one unpin().
+    T* pin(unsigned long long index)
+    requires (mode == SwapMode::INDEX_MODE)
+    {
+        ACQUIRE(memLock);
+        unsigned long long requested_page_id = index / pageCapacity;
+        currentPageId = requested_page_id > currentPageId ? requested_page_id : currentPageId;
+        int cache_page_idx = loadPageToCacheAndTryToPersist(requested_page_id);
+        if (cache_page_idx == -1)
+        {
+            setText(message, L"Fatal Error: Invalid cache page index | Line ");
+            appendNumber(message, __LINE__, true);
+            logToConsole(message);
+            // Exit program
+            exit(1);
+        }
+        cachePagePinCount[cache_page_idx]++;
+        T* result = &cache[cache_page_idx][index % pageCapacity];
+        RELEASE(memLock);
+        return result;
+    }
+
+    void unpin(unsigned long long index)
+    requires (mode == SwapMode::INDEX_MODE)
+    {
+        ACQUIRE(memLock);
+        int cache_page_idx = findCachePage(index / pageCapacity);
+        ASSERT(cache_page_idx != -1 && cachePagePinCount[cache_page_idx] > 0);
+        if (cache_page_idx != -1 && cachePagePinCount[cache_page_idx] > 0)
+        {
+            cachePagePinCount[cache_page_idx]--;
+        }
+        RELEASE(memLock);
+    }
+
     T* operator[](unsigned long long offset)
     requires (mode == SwapMode::OFFSET_MODE)
     {
@@ -1001,12 +1519,14 @@ public:
         {
             totalOffsetModeExtraSize = pageExtraBytesBufferSize + pageHasExtraBytesBufferSize + lastestPageExtraBytesOffsetAccessedBufferSize;
         }
-        return pageSize * (numCachePage + 1) + isPageWrittenToDiskSize  + sizeof(cachePageId) + sizeof(lastAccessedTimestamp) + 8 + totalOffsetModeExtraSize;
+        return pageSize * (numCachePage + 1) + isPageWrittenToDiskSize  + sizeof(cachePageId) + sizeof(cachePageReferenced) + 8 + totalOffsetModeExtraSize;
     }
 
     unsigned long long dumpVMState(unsigned char* buffer)
     {
         ACQUIRE(memLock);
+        // pages written in background are only flagged in isPageWrittenToDisk after writing has finished
+        waitForBackgroundIO();
         unsigned long long ret = 0;
         for (int i = 0; i <= numCachePage; i++)
         {
@@ -1034,9 +1554,9 @@ public:
             ret += lastestPageExtraBytesOffsetAccessedBufferSize;
         }
 
-        copyMem(buffer, lastAccessedTimestamp, sizeof(lastAccessedTimestamp));
-        buffer += sizeof(lastAccessedTimestamp);
-        ret += sizeof(lastAccessedTimestamp);
+        copyMem(buffer, cachePageReferenced, sizeof(cachePageReferenced));
+        buffer += sizeof(cachePageReferenced);
+        ret += sizeof(cachePageReferenced);
 
         copyMem(buffer, cachePageId, sizeof(cachePageId));
         ret += sizeof(cachePageId);
@@ -1052,6 +1572,7 @@ public:
     unsigned long long loadVMState(unsigned char* buffer)
     {
         ACQUIRE(memLock);
+        waitForBackgroundIO();
         unsigned long long ret = 0;
         for (int i = 0; i <= numCachePage; i++)
         {
@@ -1079,13 +1600,15 @@ public:
             ret += lastestPageExtraBytesOffsetAccessedBufferSize;
         }
 
-        copyMem(lastAccessedTimestamp, buffer, sizeof(lastAccessedTimestamp));
-        buffer += sizeof(lastAccessedTimestamp);
-        ret += sizeof(lastAccessedTimestamp);
+        copyMem(cachePageReferenced, buffer, sizeof(cachePageReferenced));
+        buffer += sizeof(cachePageReferenced);
+        ret += sizeof(cachePageReferenced);
 
         copyMem(cachePageId, buffer, sizeof(cachePageId));
         buffer += sizeof(cachePageId);
         ret += sizeof(cachePageId);
+        rebuildPageTable();
+        setMem(cachePagePinCount, sizeof(cachePagePinCount), 0);
 
         currentPageId = *((unsigned long long*)buffer);
         buffer += 8;
@@ -1123,4 +1646,301 @@ public:
     {
         return currentPage;
     }
-};
\ No newline at end of file
+};
+
+#if defined(NO_UEFI) && defined(__linux__)
+
+// Linux alternative to SwapVirtualMemory with the same access interface (selected with USE_SWAP_MMAP in TickStorage).
+// Instead of loading and saving whole pages into a RAM cache, the whole storage is one sparse file per instance
+// that is memory-mapped, leaving caching and eviction to the kernel page cache. Thus, getRef(), getPtr() and
+// operator[] are a pointer addition without locking, and returned pointers stay valid until deinit().
+// Like in SwapVirtualMemory, data in the file is only used if the page has been written since init() or reset(),
+// or if it is marked as written by loadVMState(). Pages that have not been written read as zeros.
+// dumpVMState() saves a copy of the file next to it ("swap.mmap.snapshot"), which loadVMState() restores.
+// pageCapacity is only used for the granularity of this tracking, numCachePage is unused.
+template <typename T, unsigned long long prefixName, unsigned long long pageDirectory, unsigned long long pageCapacity = 100000, unsigned long long numCachePage = 128, SwapMode mode = INDEX_MODE, long long extraBytesPerElement = 0>
+class MappedSwapVirtualMemory
+{
+    static constexpr unsigned long long maxBytesPerElement = sizeof(T) + extraBytesPerElement;
+    static constexpr unsigned long long pageSize = ((mode == SwapMode::OFFSET_MODE) ? maxBytesPerElement : sizeof(T)) * pageCapacity;
+
+    unsigned char* mappedData = nullptr;
+    unsigned long long mappedSize = 0;
+    int fileDescriptor = -1;
+    std::string fileName;
+
+    // one byte per page, set to 1 after a page has been zeroed or restored (written from the view of the user)
+    volatile unsigned char* pageWritten = nullptr;
+    unsigned long long numberOfPages = 0;
+
+    // only used for initializing pages
+    volatile char pageInitLock = 0;
+
+    // make sure the page is zeroed if it hasn't been written since init() or reset()
+    void preparePage(unsigned long long pageId)
+    {
+        ASSERT(pageId < numberOfPages);
+        if (pageWritten[pageId])
+        {
+            return;
+        }
+        ACQUIRE(pageInitLock);
+        if (!pageWritten[pageId])
+        {
+            const unsigned long long pageEnd = min((pageId + 1) * pageSize, mappedSize);
+            setMem(mappedData + pageId * pageSize, pageEnd - pageId * pageSize, 0);
+            COMPILER_BARRIER();
+            pageWritten[pageId] = 1;
+        }
+        RELEASE(pageInitLock);
+    }
+
+    bool resizeFile()
+    {
+        // shrinking to 0 and growing again drops all data blocks, which keeps the file sparse and reads as zeros
+        return ftruncate(fileDescriptor, 0) == 0 && ftruncate(fileDescriptor, mappedSize) == 0;
+    }
+
+    // Copy size bytes of file srcFd to dstFd. If the file system supports it (btrfs, xfs), the data blocks are shared
+    // copy-on-write, which is fast independent of the size. Otherwise, only the data ranges of the sparse file are
+    // copied, keeping the holes.
+    static bool copyFileData(int srcFd, int dstFd, unsigned long long size)
+    {
+        if (ioctl(dstFd, FICLONE, srcFd) == 0)
+        {
+            return ftruncate(dstFd, size) == 0;
+        }
+        if (ftruncate(dstFd, 0) != 0 || ftruncate(dstFd, size) != 0)
+        {
+            return false;
+        }
+        off_t offset = 0;
+        while (offset < (off_t)size)
+        {
+            off_t dataBegin = lseek(srcFd, offset, SEEK_DATA);
+            if (dataBegin < 0)
+            {
+                // no data after offset
+                return errno == ENXIO;
+            }
+            off_t dataEnd = lseek(srcFd, dataBegin, SEEK_HOLE);
+            if (dataEnd < 0)
+            {
+                return false;
+            }
+            dataEnd = min(dataEnd, (off_t)size);
+            off_t srcOffset = dataBegin, dstOffset = dataBegin;
+            while (srcOffset < dataEnd)
+            {
+                if (copy_file_range(srcFd, &srcOffset, dstFd, &dstOffset, dataEnd - srcOffset, 0) <= 0)
+                {
+                    return false;
+                }
+            }
+            offset = dataEnd;
+        }
+        return true;
+    }
+
+public:
+    // Create or open the file of this instance and map sizeInBytes bytes of it (max element index times sizeof(T)
+    // in INDEX_MODE or max offset in OFFSET_MODE). Set randomAccess to disable kernel read-ahead (for hash maps).
+    bool init(unsigned long long sizeInBytes, bool randomAccess = false)
+    {
+        ASSERT(mappedData == nullptr);
+
+        // same directory naming as VirtualMemory, for example "tx00data.123/"
+        CHAR16 pageDir[16];
+        setMem(pageDir, sizeof(pageDir), 0);
+        unsigned long long tmp = prefixName;
+        copyMem(pageDir, &tmp, 8);
+        tmp = pageDirectory;
+        copyMem(pageDir + 4, &tmp, 8);
+        appendText(pageDir, L".");
+#ifdef REAL_NODE
+        addEpochToFileName(pageDir, 12, max(EPOCH, int(system.epoch)));
+#else
+        addEpochToFileName(pageDir, 12, 0);
+#endif
+        std::string dirName = wchar_to_string(pageDir);
+        std::filesystem::create_directory(dirName);
+        fileName = dirName + "/swap.mmap";
+
+        // an element accessed in OFFSET_MODE may extend beyond the last offset
+        mappedSize = sizeInBytes + maxBytesPerElement;
+        numberOfPages = (mappedSize + pageSize - 1) / pageSize;
+        if (!allocPoolWithErrorLog(L"MappedSwapVM.PageWritten", numberOfPages, (void**)&pageWritten, __LINE__))
+        {
+            return false;
+        }
+
+        fileDescriptor = open(fileName.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fileDescriptor < 0 || ftruncate(fileDescriptor, mappedSize) != 0)
+        {
+            logToConsole(L"MappedSwapVirtualMemory: cannot create swap file");
+            return false;
+        }
+
+        void* mapping = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+        if (mapping == MAP_FAILED)
+        {
+            logToConsole(L"MappedSwapVirtualMemory: cannot map swap file");
+            return false;
+        }
+        mappedData = (unsigned char*)mapping;
+        madvise(mappedData, mappedSize, randomAccess ? MADV_RANDOM : MADV_NORMAL);
+        madvise(mappedData, mappedSize, MADV_DONTDUMP);
+
+        setMem((void*)pageWritten, numberOfPages, 0);
+        pageInitLock = 0;
+        return true;
+    }
+
+    void deinit()
+    {
+        if (mappedData)
+        {
+            munmap(mappedData, mappedSize);
+            mappedData = nullptr;
+        }
+        if (fileDescriptor >= 0)
+        {
+            close(fileDescriptor);
+            fileDescriptor = -1;
+        }
+        if (pageWritten)
+        {
+            freePool((void*)pageWritten);
+            pageWritten = nullptr;
+        }
+    }
+
+    // Discard all data. Must not run concurrently with other operations.
+    void reset()
+    {
+        if (!resizeFile())
+        {
+            // fall back to zeroing pages on first access
+            logToConsole(L"MappedSwapVirtualMemory: cannot truncate swap file");
+        }
+        madvise(mappedData, mappedSize, MADV_DONTNEED);
+        setMem((void*)pageWritten, numberOfPages, 0);
+    }
+
+    T& getRef(unsigned long long index)
+    requires (mode == SwapMode::INDEX_MODE)
+    {
+        return *getPtr(index);
+    }
+
+    T* getPtr(unsigned long long index)
+    requires (mode == SwapMode::INDEX_MODE)
+    {
+        ASSERT((index + 1) * sizeof(T) <= mappedSize);
+        preparePage(index / pageCapacity);
+        return (T*)mappedData + index;
+    }
+
+    // Pages are never evicted from the mapping, so pinning is the same as getPtr()
+    T* pin(unsigned long long index)
+    requires (mode == SwapMode::INDEX_MODE)
+    {
+        return getPtr(index);
+    }
+
+    void unpin(unsigned long long index)
+    requires (mode == SwapMode::INDEX_MODE)
+    {
+    }
+
+    T* operator[](unsigned long long offset)
+    requires (mode == SwapMode::OFFSET_MODE)
+    {
+        ASSERT(offset + maxBytesPerElement <= mappedSize);
+        // element may cross a page boundary
+        preparePage(offset / pageSize);
+        preparePage((offset + maxBytesPerElement - 1) / pageSize);
+        return (T*)(mappedData + offset);
+    }
+
+    T* operator[](unsigned long long index)
+    requires (mode == SwapMode::INDEX_MODE)
+    {
+        return getPtr(index);
+    }
+
+    T& operator()(unsigned long long index)
+    requires (mode == SwapMode::INDEX_MODE)
+    {
+        return getRef(index);
+    }
+
+    // The data is persisted in a copy of the file, so the state only consists of the size and the page flags
+    unsigned long long getVmStateSize()
+    {
+        return 8 + numberOfPages;
+    }
+
+    // Flush data to file, save a copy of the file as of this call, and dump page flags. Must not run concurrently
+    // with writes (TickStorage holds the locks of the storage while saving). The copy replaces the one of the
+    // previous dump only after it has been completed. Returns 0 on error.
+    unsigned long long dumpVMState(unsigned char* buffer)
+    {
+        msync(mappedData, mappedSize, MS_SYNC);
+        const std::string snapshotFileName = fileName + ".snapshot";
+        const std::string tmpFileName = snapshotFileName + ".tmp";
+        const int snapshotFileDescriptor = open(tmpFileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        bool ok = snapshotFileDescriptor >= 0 && copyFileData(fileDescriptor, snapshotFileDescriptor, mappedSize)
+            && fsync(snapshotFileDescriptor) == 0;
+        if (snapshotFileDescriptor >= 0)
+        {
+            close(snapshotFileDescriptor);
+        }
+        if (!ok || rename(tmpFileName.c_str(), snapshotFileName.c_str()) != 0)
+        {
+            logToConsole(L"MappedSwapVirtualMemory: cannot save copy of swap file");
+            unlink(tmpFileName.c_str());
+            return 0;
+        }
+        *((unsigned long long*)buffer) = mappedSize;
+        copyMem(buffer + 8, (void*)pageWritten, numberOfPages);
+        return 8 + numberOfPages;
+    }
+
+    // Restore the data saved by the last dumpVMState() and the page flags after init(). If there is no copy of the
+    // file (state saved by a previous version), the current data of the file is used, which may include data written
+    // after the dump.
+    unsigned long long loadVMState(unsigned char* buffer)
+    {
+        if (*((unsigned long long*)buffer) != mappedSize)
+        {
+            logToConsole(L"MappedSwapVirtualMemory: state does not match size of swap file");
+            return 0;
+        }
+        const int snapshotFileDescriptor = open((fileName + ".snapshot").c_str(), O_RDONLY);
+        if (snapshotFileDescriptor >= 0)
+        {
+            const bool ok = copyFileData(snapshotFileDescriptor, fileDescriptor, mappedSize);
+            close(snapshotFileDescriptor);
+            madvise(mappedData, mappedSize, MADV_DONTNEED);
+            if (!ok)
+            {
+                logToConsole(L"MappedSwapVirtualMemory: cannot restore copy of swap file");
+                return 0;
+            }
+        }
+        else
+        {
+            logToConsole(L"MappedSwapVirtualMemory: no copy of swap file, using current data");
+        }
+        copyMem((void*)pageWritten, buffer + 8, numberOfPages);
+        return 8 + numberOfPages;
+    }
+
+    unsigned long long getPageSize()
+    {
+        return pageSize;
+    }
+};
+
+#endif
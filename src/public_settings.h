@@ -116,6 +116,14 @@ static constexpr unsigned int SOLUTION_THRESHOLD_DEFAULT = 321;
 
 #define SOLUTION_SECURITY_DEPOSIT 1000000
 
+// Format of contract state digests (part of the computer digest, so all computors have to switch in the same epoch):
+// 1 = K12 of the whole state, rehashed whenever a procedure of the contract has been called
+// 2 = root of a digest tree over chunks of CONTRACT_STATE_DIGEST_CHUNK_SIZE bytes, only changed chunks are rehashed
+// States up to CONTRACT_STATE_DIGEST_CHUNK_SIZE bytes have the same digest in both versions. No data migration is
+// needed for switching, because the digests are recomputed from the states after loading.
+#define CONTRACT_STATE_DIGEST_VERSION 1
+#define CONTRACT_STATE_DIGEST_CHUNK_SIZE 65536ULL // power of 2 and multiple of the page size
+
 // Signing difficulty
 #ifdef TESTNET
 #define TARGET_TICK_VOTE_SIGNATURE 0x07FFFFFFU  // around 32 signing operations per ID
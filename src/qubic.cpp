@@ -8,6 +8,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <byteswap.h>
+#include <sys/wait.h>
 #include <codecvt>
 #include <locale>
 #include "extensions/utils.h"
@@ -23,12 +24,21 @@
 // UNCOMMENT this line to enable it
 #define USE_SWAP
 
+// this option stores the swap data (see USE_SWAP) in one memory-mapped file per storage instead of page files,
+// leaving caching to the page cache of the OS kernel (Linux only)
+// UNCOMMENT this line to enable it
+// #define USE_SWAP_MMAP
+
 //////////////////////////////////////////////////////////////
 
 #ifdef CMAKE_NO_USE_SWAP
 #undef USE_SWAP
 #endif
 
+#ifdef CMAKE_USE_SWAP_MMAP
+#define USE_SWAP_MMAP
+#endif
+
 #define REAL_NODE
 #define NO_UEFI
 #define SINGLE_COMPILE_UNIT
@@ -39,6 +49,8 @@
 // contract_def.h needs to be included first to make sure that contracts have minimal access
 #include "contract_core/contract_def.h"
 #include "contract_core/contract_exec.h"
+#include "contract_core/contract_function_cache.h"
+#include "contract_core/chunked_state_digest.h"
 
 #include <lib/platform_common/qintrin.h>
 
@@ -106,6 +118,7 @@
 
 #include "contract_core/qpi_mining_impl.h"
 #include "revenue.h"
+#include "node_state_snapshot.h"
 
 #include <csignal>
 
@@ -154,7 +167,6 @@ struct Processor : public CustomStack
     Type type;
     EFI_EVENT event;
     Peer* peer;
-    void* buffer;
 };
 
 
@@ -169,6 +181,7 @@ static volatile bool forceNextTick = false;
 static volatile bool forceSwitchEpoch = false;
 static volatile char criticalSituation = 0;
 static volatile bool systemMustBeSaved = false, spectrumMustBeSaved = false, universeMustBeSaved = false, computerMustBeSaved = false;
+static volatile bool computorVerificationKeysMustBeUpdated = false;
 
 static int misalignedState = 0;
 
@@ -204,8 +217,6 @@ static unsigned int resourceTestingDigest = 0;
 
 static unsigned int numberOfTransactions = 0;
 
-static unsigned long long spectrumChangeFlags[SPECTRUM_CAPACITY / (sizeof(unsigned long long) * 8)];
-
 static unsigned long long mainLoopNumerator = 0, mainLoopDenominator = 0;
 static unsigned char contractProcessorState = 0;
 static unsigned int contractProcessorPhase;
@@ -215,6 +226,11 @@ static unsigned char contractProcessorPostIncomingTransferType = 0;
 static EFI_EVENT contractProcessorEvent;
 static m256i contractStateDigests[MAX_NUMBER_OF_CONTRACTS * 2 - 1];
 const unsigned long long contractStateDigestsSizeInBytes = sizeof(contractStateDigests);
+#if CONTRACT_STATE_DIGEST_VERSION >= 2
+static ChunkedStateDigest contractStateChunkDigests[contractCount];
+#endif
+// Chunks of the contract states changed since the last base snapshot (whole states with CONTRACT_STATE_DIGEST_VERSION 1)
+static SnapshotDeltaTracker contractStateSnapshotDeltas[contractCount];
 
 // targetNextTickDataDigestIsKnown == true signals that we need to fetch TickData (update the version in this node)
 // targetNextTickDataDigestIsKnown == false means there is no consensus on next tick data yet
@@ -261,8 +277,8 @@ static bool competitorComputorStatuses[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
 static unsigned int minimumComputorScore = 0, minimumCandidateScore = 0;
 static int solutionThreshold[MAX_NUMBER_EPOCH] = { -1 };
 static unsigned long long solutionTotalExecutionTicks = 0;
-static unsigned long long K12MeasurementsCount = 0;
-static unsigned long long K12MeasurementsSum = 0;
+static volatile long long K12MeasurementsCount = 0;
+static volatile long long K12MeasurementsSum = 0;
 static volatile char minerScoreArrayLock = 0;
 static SpecialCommandGetMiningScoreRanking<MAX_NUMBER_OF_MINERS> requestMiningScoreRanking;
 
@@ -292,6 +308,9 @@ struct
 } nodeStateBuffer;
 #endif
 static bool saveComputer(CHAR16* directory = NULL);
+#if TICK_STORAGE_AUTOSAVE_MODE
+static bool saveComputerDelta(CHAR16* directory = NULL);
+#endif
 static bool saveSystem(CHAR16* directory = NULL);
 static bool loadComputer(CHAR16* directory = NULL, bool forceLoadFromFile = false);
 static bool saveRevenueComponents(CHAR16* directory = NULL);
@@ -424,6 +443,55 @@ void logToConsole(const CHAR16* message)
 #endif
 }
 
+// Number of threads reading node state files in parallel at startup
+static constexpr unsigned int STARTUP_LOADER_THREADS = 8;
+
+// Log the duration of a phase of loading the node states at startup
+static void logStartupPhase(const CHAR16* phase, unsigned long long beginningTick)
+{
+    setText(message, L"Startup phase \"");
+    appendText(message, phase);
+    appendText(message, L"\" took ");
+    appendNumber(message, (__rdtsc() - beginningTick) * 1000 / frequency, TRUE);
+    appendText(message, L" milliseconds.");
+    logToConsole(message);
+}
+
+// Threads helping digestTreeBuilder while the node states are loaded at startup, before the request processors
+// that usually help are running
+class StartupDigestHelpers
+{
+public:
+    StartupDigestHelpers()
+    {
+        const unsigned int count = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            threads.emplace_back([this]()
+                {
+                    while (!stop)
+                    {
+                        digestTreeBuilder.tryHelp();
+                        _mm_pause();
+                    }
+                });
+        }
+    }
+
+    ~StartupDigestHelpers()
+    {
+        stop = true;
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+private:
+    volatile bool stop = false;
+    std::vector<std::thread> threads;
+};
+
 static int computorIndex(m256i computor)
 {
     for (int computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex++)
@@ -476,99 +544,136 @@ static void enableAVX()
 }
 
 // Should only be called from tick processor to avoid concurrent state changes, which can cause race conditions as detailed in FIXME below.
-static void getComputerDigest(m256i& digest)
+// The states are hashed in parallel by the processors helping digestTreeBuilder.
+#if CONTRACT_STATE_DIGEST_VERSION >= 2
+// Allocated size of a contract state buffer, which is write-protected in chunks for tracking changes
+static unsigned long long contractStateAllocationSize(unsigned long long stateSize)
 {
-    PROFILE_SCOPE();
+    return (stateSize) ? (stateSize + CONTRACT_STATE_DIGEST_CHUNK_SIZE - 1) & ~(CONTRACT_STATE_DIGEST_CHUNK_SIZE - 1) : CONTRACT_STATE_DIGEST_CHUNK_SIZE;
+}
 
-    unsigned int digestIndex;
-    for (digestIndex = 0; digestIndex < MAX_NUMBER_OF_CONTRACTS; digestIndex++)
+// Called on writes to write-protected memory. Returns true if the address is in an unchanged chunk of a contract state.
+static bool onContractStateWriteFault(void* address)
+{
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
     {
-        if (contractStateChangeFlags[digestIndex >> 6] & (1ULL << (digestIndex & 63)))
+        if (contractStateChunkDigests[contractIndex].onWriteFault(address))
         {
-            const unsigned long long size = digestIndex < contractCount ? contractDescriptions[digestIndex].stateSize : 0;
-            if (!size)
-            {
-                contractStateDigests[digestIndex] = m256i::zero();
-            }
-            else
-            {
-                // FIXME: We may have a race condition here if a digest is computed here by thread A, the state is changed
-                // + contractStateChangeFlags set afterwards by thread B and contractStateChangeFlags cleared below below
-                // by thread A. We then have a changed state but a cleared contractStateChangeFlags flag leading to wrong
-                // digest.
-                // This is currently avoided by calling getComputerDigest() from tick processor only (and in non-concurrent init)
-                contractStateLock[digestIndex].acquireRead();
-
-                const unsigned long long startTick = __rdtsc();
-                KangarooTwelve(contractStates[digestIndex], (unsigned int)size, &contractStateDigests[digestIndex], 32);
-                const unsigned long long executionTicks = __rdtsc() - startTick;
-
-                contractStateLock[digestIndex].releaseRead();
-
-                // K12 of state is included in contract execution time
-                _interlockedadd64(&contractTotalExecutionTicks[digestIndex], executionTicks);
-
-                // Gather data for comparing different versions of K12
-                if (K12MeasurementsCount < 500)
-                {
-                    K12MeasurementsSum += executionTicks;
-                    K12MeasurementsCount++;
-                }
-            }
+            return true;
         }
     }
-    unsigned int previousLevelBeginning = 0;
-    unsigned int numberOfLeafs = MAX_NUMBER_OF_CONTRACTS;
-    while (numberOfLeafs > 1)
+    return false;
+}
+
+// Hash the changed chunks of all contract states in parallel and flag the contracts with changed chunks in
+// contractStateChangeFlags. The chunk trees and the roots are updated in getComputerDigest().
+static void hashChangedContractStateChunks()
+{
+    constexpr unsigned int chunksPerTask = 4;
+    unsigned int firstTask[contractCount + 1];
+    firstTask[0] = 0;
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
     {
-        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+        ChunkedStateDigest& stateDigest = contractStateChunkDigests[contractIndex];
+        const bool procedureCalled = (contractStateChangeFlags[contractIndex >> 6] & (1ULL << (contractIndex & 63))) != 0;
+        if (procedureCalled && !stateDigest.isWriteTracking())
         {
-            if (contractStateChangeFlags[i >> 6] & (3ULL << (i & 63)))
-            {
-                KangarooTwelve64To32(&contractStateDigests[previousLevelBeginning + i], &contractStateDigests[digestIndex]);
-                contractStateChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
-                contractStateChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
-            }
-            digestIndex++;
+            stateDigest.markAllChanged();
+        }
+        const unsigned int changedChunks = stateDigest.collectChangedChunks();
+        if (changedChunks && !procedureCalled)
+        {
+            // Write tracking also catches changes that were not flagged with setContractStateChanged(), so flag them
+            // here for the digest and invalidate cached function results of the contract
+            setContractStateChanged(contractIndex);
+        }
+        for (unsigned int i = 0; i < changedChunks; i++)
+        {
+            contractStateSnapshotDeltas[contractIndex].markChanged(stateDigest.getChangedChunk(i));
         }
-        previousLevelBeginning += numberOfLeafs;
-        numberOfLeafs >>= 1;
+        firstTask[contractIndex + 1] = firstTask[contractIndex] + (changedChunks + chunksPerTask - 1) / chunksPerTask;
     }
-    contractStateChangeFlags[0] = 0;
 
-    digest = contractStateDigests[(MAX_NUMBER_OF_CONTRACTS * 2 - 1) - 1];
+    auto hashChunks = [&](unsigned int taskIndex)
+    {
+        unsigned int contractIndex = 0;
+        while (firstTask[contractIndex + 1] <= taskIndex)
+        {
+            contractIndex++;
+        }
+        contractStateLock[contractIndex].acquireRead();
+
+        const unsigned long long startTick = __rdtsc();
+        contractStateChunkDigests[contractIndex].hashChangedChunks((taskIndex - firstTask[contractIndex]) * chunksPerTask, chunksPerTask);
+        const unsigned long long executionTicks = __rdtsc() - startTick;
+
+        contractStateLock[contractIndex].releaseRead();
+
+        // K12 of state is included in contract execution time
+        _interlockedadd64(&contractTotalExecutionTicks[contractIndex], executionTicks);
+    };
+    digestTreeBuilder.run(firstTask[contractCount], hashChunks);
 }
+#endif
 
-static void getSpectrumDigest(m256i& digest)
+static void getComputerDigest(m256i& digest)
 {
-    unsigned int digestIndex;
-    ACQUIRE(spectrumLock);
-    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
+    PROFILE_SCOPE();
+
+#if CONTRACT_STATE_DIGEST_VERSION >= 2
+    hashChangedContractStateChunks();
+
+    auto hashContractState = [](unsigned int digestIndex)
+    {
+        contractStateDigests[digestIndex] = (digestIndex < contractCount) ? contractStateChunkDigests[digestIndex].updateRoot() : m256i::zero();
+    };
+    digestTreeBuilder.updateTree(contractStateDigests, MAX_NUMBER_OF_CONTRACTS, contractStateChangeFlags, hashContractState);
+#else
+    auto hashContractState = [](unsigned int digestIndex)
     {
-        if (spectrum[digestIndex].latestIncomingTransferTick == system.tick || spectrum[digestIndex].latestOutgoingTransferTick == system.tick)
+        const unsigned long long size = digestIndex < contractCount ? contractDescriptions[digestIndex].stateSize : 0;
+        if (!size)
         {
-            KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-            spectrumChangeFlags[digestIndex >> 6] |= (1ULL << (digestIndex & 63));
+            contractStateDigests[digestIndex] = m256i::zero();
         }
-    }
-    unsigned int previousLevelBeginning = 0;
-    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-    while (numberOfLeafs > 1)
-    {
-        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+        else
         {
-            if (spectrumChangeFlags[i >> 6] & (3ULL << (i & 63)))
+            // FIXME: We may have a race condition here if a digest is computed here by thread A, the state is changed
+            // + contractStateChangeFlags set afterwards by thread B and contractStateChangeFlags cleared in updateTree()
+            // by thread A. We then have a changed state but a cleared contractStateChangeFlags flag leading to wrong
+            // digest.
+            // This is currently avoided by calling getComputerDigest() from tick processor only (and in non-concurrent init)
+            contractStateLock[digestIndex].acquireRead();
+            contractStateSnapshotDeltas[digestIndex].markAllChanged();
+
+            const unsigned long long startTick = __rdtsc();
+            KangarooTwelve(contractStates[digestIndex], (unsigned int)size, &contractStateDigests[digestIndex], 32);
+            const unsigned long long executionTicks = __rdtsc() - startTick;
+
+            contractStateLock[digestIndex].releaseRead();
+
+            // K12 of state is included in contract execution time
+            _interlockedadd64(&contractTotalExecutionTicks[digestIndex], executionTicks);
+
+            // Gather data for comparing different versions of K12
+            if (K12MeasurementsCount < 500)
             {
-                KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex]);
-                spectrumChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
-                spectrumChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
+                ATOMIC_ADD64(K12MeasurementsSum, executionTicks);
+                ATOMIC_INC64(K12MeasurementsCount);
             }
-            digestIndex++;
         }
-        previousLevelBeginning += numberOfLeafs;
-        numberOfLeafs >>= 1;
-    }
-    spectrumChangeFlags[0] = 0;
+    };
+    // Contract states differ a lot in size, so let each task hash a single state
+    digestTreeBuilder.updateTree(contractStateDigests, MAX_NUMBER_OF_CONTRACTS, contractStateChangeFlags, hashContractState, 1);
+#endif
+
+    digest = contractStateDigests[(MAX_NUMBER_OF_CONTRACTS * 2 - 1) - 1];
+}
+
+static void getSpectrumDigest(m256i& digest)
+{
+    ACQUIRE(spectrumLock);
+    updateSpectrumDigests();
     digest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
     RELEASE(spectrumLock);
 }
@@ -874,6 +979,10 @@ static void processBroadcastComputors(Peer* peer, RequestResponseHeader* header)
             // Copy computor list
             copyMem(&broadcastedComputors.computors, &request->computors, sizeof(Computors));
 
+            // Preparing the verification keys runs a job on all processors, so leave it to the tick processor.
+            // Until then verifyComputorSignature() falls back to verify().
+            computorVerificationKeysMustBeUpdated = true;
+
             // Update ownComputorIndices and minerPublicKeys
             if (request->computors.epoch == system.epoch)
             {
@@ -929,8 +1038,9 @@ static void processBroadcastTick(Peer* peer, RequestResponseHeader* header)
         request->tick.computorIndex ^= BroadcastTick::type;
         KangarooTwelve(&request->tick, sizeof(Tick) - SIGNATURE_SIZE, digest, sizeof(digest));
         request->tick.computorIndex ^= BroadcastTick::type;
-        const bool verifyFourQCurve = true;
-        if (verifyTickVoteSignature(broadcastedComputors.computors.publicKeys[request->tick.computorIndex].m256i_u8, digest, request->tick.signature, verifyFourQCurve))
+        // The curve verification uses the prepared verification key of the computor
+        if (verifyTickVoteSignature(broadcastedComputors.computors.publicKeys[request->tick.computorIndex].m256i_u8, digest, request->tick.signature, false)
+            && verifyComputorSignature(request->tick.computorIndex, digest, request->tick.signature))
         {
             if (header->isDejavuZero())
             {
@@ -939,8 +1049,10 @@ static void processBroadcastTick(Peer* peer, RequestResponseHeader* header)
 
             ts.ticks.acquireLock(request->tick.computorIndex);
 
-            // Find element in tick storage and check if contains data (epoch is set to 0 on init)
-            Tick* tsTick = ts.ticks.getByTickInCurrentEpoch(request->tick.tick) + request->tick.computorIndex;
+            // Find element in tick storage and check if contains data (epoch is set to 0 on init). The page is pinned,
+            // so it is not evicted by other threads while the tick is compared or copied.
+            const unsigned int tickIndex = ts.tickToIndexCurrentEpoch(request->tick.tick);
+            Tick* tsTick = ts.ticks.pinByTickIndex(tickIndex) + request->tick.computorIndex;
             if (tsTick->epoch == system.epoch)
             {
                 // Check if the sent tick matches the tick in tick storage
@@ -964,6 +1076,7 @@ static void processBroadcastTick(Peer* peer, RequestResponseHeader* header)
                 copyMem(tsTick, &request->tick, sizeof(Tick));
                 peer->lastActiveTick = max(peer->lastActiveTick, peer->getDejavuTick(header->dejavu()));
             }
+            ts.ticks.unpinByTickIndex(tickIndex);
 
             ts.ticks.releaseLock(request->tick.computorIndex);
         }
@@ -1008,7 +1121,7 @@ static void processBroadcastFutureTickData(Peer* peer, RequestResponseHeader* he
             request->tickData.computorIndex ^= BroadcastFutureTickData::type;
             KangarooTwelve(&request->tickData, sizeof(TickData) - SIGNATURE_SIZE, digest, sizeof(digest));
             request->tickData.computorIndex ^= BroadcastFutureTickData::type;
-            if (verify(broadcastedComputors.computors.publicKeys[request->tickData.computorIndex].m256i_u8, digest, request->tickData.signature))
+            if (verifyComputorSignature(request->tickData.computorIndex, digest, request->tickData.signature))
             {
                 if (header->isDejavuZero())
                 {
@@ -1028,6 +1141,7 @@ static void processBroadcastFutureTickData(Peer* peer, RequestResponseHeader* he
                             if (digest == targetNextTickDataDigest)
                             {
                                 copyMem(&td, &request->tickData, sizeof(TickData));
+                                ts.tickDataDigestIndex.build(td);
                                 peer->lastActiveTick = max(peer->lastActiveTick, peer->getDejavuTick(header->dejavu()));
 
                                 if (memcmp(&td, &request->tickData, sizeof(TickData)) != 0)
@@ -1066,6 +1180,7 @@ static void processBroadcastFutureTickData(Peer* peer, RequestResponseHeader* he
                         else
                         {
                             copyMem(&td, &request->tickData, sizeof(TickData));
+                            ts.tickDataDigestIndex.build(td);
                             peer->lastActiveTick = max(peer->lastActiveTick, peer->getDejavuTick(header->dejavu()));
                         }
                     }
@@ -1094,32 +1209,33 @@ static void processBroadcastTransaction(Peer* peer, RequestResponseHeader* heade
             pendingTxsPool.add(request);
 
             unsigned int tickIndex = ts.tickToIndexCurrentEpoch(request->tick);
+            int transactionSlot = -1;
             ts.tickData.acquireLock();
             if (request->tick == system.tick + 1
                 && ts.tickData[tickIndex].epoch == system.epoch)
             {
                 KangarooTwelve(request, transactionSize, digest, sizeof(digest));
+                transactionSlot = ts.tickDataDigestIndex.findSlot(ts.tickData[tickIndex], digest);
+            }
+            ts.tickData.releaseLock();
+
+            // The tick data may be changed after releasing the lock, but the tick processor checks the digests
+            // of the stored transactions anyway
+            if (transactionSlot >= 0)
+            {
                 auto* tsReqTickTransactionOffsets = ts.tickTransactionOffsets.getByTickIndex(tickIndex);
-                for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+                ts.tickTransactions.acquireLock();
+                if (!tsReqTickTransactionOffsets[transactionSlot])
                 {
-                    if (digest == ts.tickData[tickIndex].transactionDigests[i])
+                    if (ts.nextTickTransactionOffset + transactionSize <= ts.tickTransactions.storageSpaceCurrentEpoch)
                     {
-                        ts.tickTransactions.acquireLock();
-                        if (!tsReqTickTransactionOffsets[i])
-                        {
-                            if (ts.nextTickTransactionOffset + transactionSize <= ts.tickTransactions.storageSpaceCurrentEpoch)
-                            {
-                                tsReqTickTransactionOffsets[i] = ts.nextTickTransactionOffset;
-                                copyMem(ts.tickTransactions(ts.nextTickTransactionOffset), request, transactionSize);
-                                ts.nextTickTransactionOffset += transactionSize;
-                            }
-                        }
-                        ts.tickTransactions.releaseLock();
-                        break;
+                        tsReqTickTransactionOffsets[transactionSlot] = ts.nextTickTransactionOffset;
+                        copyMem(ts.tickTransactions(ts.nextTickTransactionOffset), request, transactionSize);
+                        ts.nextTickTransactionOffset += transactionSize;
                     }
                 }
+                ts.tickTransactions.releaseLock();
             }
-            ts.tickData.releaseLock();
         }
     }
 }
@@ -1145,20 +1261,23 @@ static void processRequestQuorumTick(Peer* peer, RequestResponseHeader* header)
     RequestQuorumTick* request = header->getPayload<RequestQuorumTick>();
 
     unsigned short tickEpoch = 0;
-    const Tick* tsCompTicks;
+    unsigned int tickIndex = 0;
     if (ts.tickInCurrentEpochStorage(request->quorumTick.tick))
     {
         tickEpoch = system.epoch;
-        tsCompTicks = ts.ticks.getByTickInCurrentEpoch(request->quorumTick.tick);
+        tickIndex = ts.tickToIndexCurrentEpoch(request->quorumTick.tick);
     }
     else if (ts.tickInPreviousEpochStorage(request->quorumTick.tick))
     {
         tickEpoch = system.epoch - 1;
-        tsCompTicks = ts.ticks.getByTickInPreviousEpoch(request->quorumTick.tick);
+        tickIndex = ts.tickToIndexPreviousEpoch(request->quorumTick.tick);
     }
 
     if (tickEpoch != 0)
     {
+        // The page stays pinned while the responses are enqueued, so other threads cannot evict it
+        const Tick* tsCompTicks = ts.ticks.pinByTickIndex(tickIndex);
+
         // Send Tick struct data from tick storage as requested by tick and voteFlags in request->quorumTick.
         // The order of the computors is randomized using a Fisher–Yates shuffle
         // Todo: This function may be optimized by moving the checking of voteFlags in the first loop, reducing the number of calls to random().
@@ -1186,6 +1305,7 @@ static void processRequestQuorumTick(Peer* peer, RequestResponseHeader* header)
 
             computorIndices[index] = computorIndices[--numberOfComputorIndices];
         }
+        ts.ticks.unpinByTickIndex(tickIndex);
     }
     enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
 }
@@ -1195,10 +1315,12 @@ static void processRequestTickData(Peer* peer, RequestResponseHeader* header)
     RequestTickData* request = header->getPayload<RequestTickData>();
     // SWAP: we need atomic here to avoid flush the page while another thread is writing to it
     ts.tickData.acquireLock();
-    TickData* td = ts.tickData.getByTickIfNotEmpty(request->requestedTickData.tick);
+    unsigned int tickDataIndex;
+    TickData* td = ts.tickData.pinByTickIfNotEmpty(request->requestedTickData.tick, tickDataIndex);
     if (td)
     {
         enqueueResponse(peer, sizeof(TickData), BroadcastFutureTickData::type, header->dejavu(), td);
+        ts.tickData.unpinByIndex(tickDataIndex);
     }
     else
     {
@@ -1346,9 +1468,7 @@ static void processRequestEntity(Peer* peer, RequestResponseHeader* header)
     else
     {
         copyMem(&respondedEntity.entity, &spectrum[respondedEntity.spectrumIndex], sizeof(EntityRecord));
-        ACQUIRE(spectrumLock);
-        getSiblings<SPECTRUM_DEPTH>(respondedEntity.spectrumIndex, spectrumDigests, respondedEntity.siblings);
-        RELEASE(spectrumLock);
+        getSpectrumSiblings(respondedEntity.spectrumIndex, respondedEntity.siblings);
     }
 
 
@@ -1409,11 +1529,27 @@ static void processRequestContractFunction(Peer* peer, const unsigned long long
     }
     else
     {
+        // Answer repeated queries from the cache if the contract state has not changed in the current tick.
+        // Tick and state version need to be read before calling the function, so that a state change during
+        // the call invalidates the result.
+        const unsigned char* input = ((unsigned char*)request) + sizeof(RequestContractFunction);
+        const m256i inputDigest = ContractFunctionResultCache::computeInputDigest(input, request->inputSize);
+        const unsigned int tick = system.tick;
+        const unsigned long long stateVersion = contractStateVersions[request->contractIndex];
+        unsigned int cachedOutputSize = 0;
+        const void* cachedOutput = contractFunctionResultCache.tryGet(processorNumber, request->contractIndex, request->inputType, inputDigest, tick, stateVersion, cachedOutputSize);
+        if (cachedOutput)
+        {
+            enqueueResponse(peer, cachedOutputSize, RespondContractFunction::type, header->dejavu(), cachedOutput);
+            return;
+        }
+
         QpiContextUserFunctionCall qpiContext(request->contractIndex);
-        auto errorCode = qpiContext.call(request->inputType, (((unsigned char*)request) + sizeof(RequestContractFunction)), request->inputSize);
+        auto errorCode = qpiContext.call(request->inputType, input, request->inputSize);
         if (errorCode == NoContractError)
         {
             // success: respond with function output
+            contractFunctionResultCache.put(request->contractIndex, request->inputType, inputDigest, tick, stateVersion, qpiContext.outputBuffer, qpiContext.outputSize);
             enqueueResponse(peer, qpiContext.outputSize, RespondContractFunction::type, header->dejavu(), qpiContext.outputBuffer);
         }
         else
@@ -2033,8 +2169,6 @@ static void requestProcessor(void* ProcedureArgument, unsigned long long process
 
     //const unsigned long long processorNumber = getRunningProcessorID();
 
-    Processor* processor = (Processor*)ProcedureArgument;
-    RequestResponseHeader* header = (RequestResponseHeader*)processor->buffer;
     while (!shutDownNode)
     {
         checkinTime(processorNumber);
@@ -2046,29 +2180,15 @@ static void requestProcessor(void* ProcedureArgument, unsigned long long process
             {
                 {
                     // to avoid potential overflow: consume the queue without processing requests
-                    ACQUIRE(requestQueueTailLock);
-                    if (requestQueueElementTail == requestQueueElementHead)
-                    {
-                        RELEASE(requestQueueTailLock);
-                    }
-                    else
+                    const int requestIndex = claimRequest();
+                    if (requestIndex >= 0)
                     {
-                        {
-                            RequestResponseHeader* requestHeader = (RequestResponseHeader*)&requestQueueBuffer[requestQueueElements[requestQueueElementTail].offset];
-                            copyMem(header, requestHeader, requestHeader->size());
-                            requestQueueBufferTail += requestHeader->size();
-                        }
-
-                        Peer* peer = requestQueueElements[requestQueueElementTail].peer;
-
-                        if (requestQueueBufferTail > REQUEST_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
-                        {
-                            requestQueueBufferTail = 0;
-                        }
-                        requestQueueElementTail++;
-                        RELEASE(requestQueueTailLock);
+                        releaseRequest(requestIndex);
                     }
                 }
+
+                // help computing digests, for example in reorganizeSpectrum()
+                digestTreeBuilder.tryHelp();
             }
             END_WAIT_WHILE();
             _InterlockedDecrement(&epochTransitionWaitingRequestProcessors);
@@ -2081,234 +2201,220 @@ static void requestProcessor(void* ProcedureArgument, unsigned long long process
             score->tryProcessSolution(processorNumber);
         }
         
-        if (requestQueueElementTail == requestQueueElementHead)
+        const int requestIndex = claimRequest();
+        if (requestIndex < 0)
         {
+            // idle request processors (including solution processors without queued solution) help the tick
+            // processor computing digests
+            digestTreeBuilder.tryHelp();
             _mm_pause();
         }
         else
         {
-            ACQUIRE(requestQueueTailLock);
+            PROFILE_NAMED_SCOPE("requestProcessor(): request processing");
+            const unsigned long long beginningTick = __rdtsc();
+
+            // The request is processed in place in the request queue buffer and released afterwards
+            RequestResponseHeader* header = (RequestResponseHeader*)&requestQueueBuffer[requestQueueElements[requestIndex].offset];
+            Peer* peer = requestQueueElements[requestIndex].peer;
 
-            if (requestQueueElementTail == requestQueueElementHead)
+            switch (header->type())
             {
-                RELEASE(requestQueueTailLock);
-            }
-            else
+            case ExchangePublicPeers::type:
             {
-                PROFILE_NAMED_SCOPE("requestProcessor(): request processing");
-                const unsigned long long beginningTick = __rdtsc();
+                processExchangePublicPeers(peer, header);
+            }
+            break;
 
-                {
-                    RequestResponseHeader* requestHeader = (RequestResponseHeader*)&requestQueueBuffer[requestQueueElements[requestQueueElementTail].offset];
-                    copyMem(header, requestHeader, requestHeader->size());
-                    requestQueueBufferTail += requestHeader->size();
-                }
+            case BroadcastMessage::type:
+            {
+                processBroadcastMessage(processorNumber, header);
+            }
+            break;
 
-                Peer* peer = requestQueueElements[requestQueueElementTail].peer;
+            case BroadcastComputors::type:
+            {
+                processBroadcastComputors(peer, header);
+            }
+            break;
 
-                if (requestQueueBufferTail > REQUEST_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
-                {
-                    requestQueueBufferTail = 0;
-                }
-                requestQueueElementTail++;
+            case BroadcastTick::type:
+            {
+                processBroadcastTick(peer, header);
+            }
+            break;
 
-                RELEASE(requestQueueTailLock);
-                switch (header->type())
-                {
-                case ExchangePublicPeers::type:
-                {
-                    processExchangePublicPeers(peer, header);
-                }
-                break;
+            case BroadcastFutureTickData::type:
+            {
+                processBroadcastFutureTickData(peer, header);
+            }
+            break;
 
-                case BroadcastMessage::type:
-                {
-                    processBroadcastMessage(processorNumber, header);
-                }
-                break;
+            case BROADCAST_TRANSACTION:
+            {
+                processBroadcastTransaction(peer, header);
+            }
+            break;
 
-                case BroadcastComputors::type:
-                {
-                    processBroadcastComputors(peer, header);
-                }
-                break;
+            case RequestComputors::type:
+            {
+                processRequestComputors(peer, header);
+            }
+            break;
 
-                case BroadcastTick::type:
-                {
-                    processBroadcastTick(peer, header);
-                }
-                break;
+            case RequestQuorumTick::type:
+            {
+                processRequestQuorumTick(peer, header);
+            }
+            break;
 
-                case BroadcastFutureTickData::type:
-                {
-                    processBroadcastFutureTickData(peer, header);
-                }
-                break;
+            case RequestTickData::type:
+            {
+                processRequestTickData(peer, header);
+            }
+            break;
 
-                case BROADCAST_TRANSACTION:
-                {
-                    processBroadcastTransaction(peer, header);
-                }
-                break;
+            case REQUEST_TICK_TRANSACTIONS:
+            {
+                processRequestTickTransactions(peer, header);
+            }
+            break;
 
-                case RequestComputors::type:
-                {
-                    processRequestComputors(peer, header);
-                }
-                break;
+            case REQUEST_TRANSACTION_INFO:
+            {
+                processRequestTransactionInfo(peer, header);
+            }
+            break;
 
-                case RequestQuorumTick::type:
-                {
-                    processRequestQuorumTick(peer, header);
-                }
-                break;
+            case REQUEST_CURRENT_TICK_INFO:
+            {
+                processRequestCurrentTickInfo(peer, header);
+            }
+            break;
 
-                case RequestTickData::type:
-                {
-                    processRequestTickData(peer, header);
-                }
-                break;
+            case RESPOND_CURRENT_TICK_INFO:
+            {
+                processResponseCurrentTickInfo(peer, header);
+            }
+            break;
 
-                case REQUEST_TICK_TRANSACTIONS:
-                {
-                    processRequestTickTransactions(peer, header);
-                }
-                break;
+            case REQUEST_ENTITY:
+            {
+                processRequestEntity(peer, header);
+            }
+            break;
 
-                case REQUEST_TRANSACTION_INFO:
-                {
-                    processRequestTransactionInfo(peer, header);
-                }
-                break;
+            case RequestActiveIPOs::type:
+            {
+                processRequestActiveIPOs(peer, header);
+            }
+            break;
 
-                case REQUEST_CURRENT_TICK_INFO:
-                {
-                    processRequestCurrentTickInfo(peer, header);
-                }
-                break;
+            case RequestContractIPO::type:
+            {
+                processRequestContractIPO(peer, header);
+            }
+            break;
 
-                case RESPOND_CURRENT_TICK_INFO:
-                {
-                    processResponseCurrentTickInfo(peer, header);
-                }
-                break;
+            case RequestIssuedAssets::type:
+            {
+                processRequestIssuedAssets(peer, header);
+            }
+            break;
 
-                case REQUEST_ENTITY:
-                {
-                    processRequestEntity(peer, header);
-                }
-                break;
+            case RequestOwnedAssets::type:
+            {
+                processRequestOwnedAssets(peer, header);
+            }
+            break;
 
-                case RequestActiveIPOs::type:
-                {
-                    processRequestActiveIPOs(peer, header);
-                }
-                break;
+            case RequestPossessedAssets::type:
+            {
+                processRequestPossessedAssets(peer, header);
+            }
+            break;
 
-                case RequestContractIPO::type:
-                {
-                    processRequestContractIPO(peer, header);
-                }
-                break;
+            case RequestContractFunction::type:
+            {
+                processRequestContractFunction(peer, processorNumber, header);
+            }
+            break;
 
-                case RequestIssuedAssets::type:
-                {
-                    processRequestIssuedAssets(peer, header);
-                }
-                break;
+            case RequestLog::type:
+            {
+                logger.processRequestLog(processorNumber, peer, header);
+            }
+            break;
 
-                case RequestOwnedAssets::type:
-                {
-                    processRequestOwnedAssets(peer, header);
-                }
-                break;
+            case RequestLogIdRangeFromTx::type:
+            {
+                logger.processRequestTxLogInfo(processorNumber, peer, header);
+            }
+            break;
 
-                case RequestPossessedAssets::type:
-                {
-                    processRequestPossessedAssets(peer, header);
-                }
-                break;
+            case RequestAllLogIdRangesFromTick::type:
+            {
+                logger.processRequestTickTxLogInfo(processorNumber, peer, header);
+            }
+            break;
 
-                case RequestContractFunction::type:
-                {
-                    processRequestContractFunction(peer, processorNumber, header);
-                }
-                break;
-
-                case RequestLog::type:
-                {
-                    logger.processRequestLog(processorNumber, peer, header);
-                }
-                break;
-
-                case RequestLogIdRangeFromTx::type:
-                {
-                    logger.processRequestTxLogInfo(processorNumber, peer, header);
-                }
-                break;
-
-                case RequestAllLogIdRangesFromTick::type:
-                {
-                    logger.processRequestTickTxLogInfo(processorNumber, peer, header);
-                }
-                break;
-
-                case RequestPruningLog::type:
-                {
-                    logger.processRequestPrunePageFile(peer, header);
-                }
-                break;
+            case RequestPruningLog::type:
+            {
+                logger.processRequestPrunePageFile(peer, header);
+            }
+            break;
 
-                case RequestLogStateDigest::type:
-                {
-                    logger.processRequestGetLogDigest(peer, header);
-                }
-                break;
+            case RequestLogStateDigest::type:
+            {
+                logger.processRequestGetLogDigest(peer, header);
+            }
+            break;
 
-                case REQUEST_SYSTEM_INFO:
-                {
-                    processRequestSystemInfo(peer, header);
-                }
-                break;
+            case REQUEST_SYSTEM_INFO:
+            {
+                processRequestSystemInfo(peer, header);
+            }
+            break;
 
-                case RequestAssets::type:
-                {
-                    processRequestAssets(peer, header);
-                }
-                break;
-                case RequestedCustomMiningSolutionVerification::type:
-                {
-                    processRequestedCustomMiningSolutionVerificationRequest(peer, header);
-                }
-                break;
-                case RequestedCustomMiningData::type:
-                {
-                    processCustomMiningDataRequest(peer, processorNumber, header);
-                }
-                break;
+            case RequestAssets::type:
+            {
+                processRequestAssets(peer, header);
+            }
+            break;
+            case RequestedCustomMiningSolutionVerification::type:
+            {
+                processRequestedCustomMiningSolutionVerificationRequest(peer, header);
+            }
+            break;
+            case RequestedCustomMiningData::type:
+            {
+                processCustomMiningDataRequest(peer, processorNumber, header);
+            }
+            break;
 
-                case SpecialCommand::type:
-                {
-                    processSpecialCommand(peer, header);
-                }
-                break;
+            case SpecialCommand::type:
+            {
+                processSpecialCommand(peer, header);
+            }
+            break;
 
 #if ADDON_TX_STATUS_REQUEST
-                /* qli: process RequestTxStatus message */
-                case REQUEST_TX_STATUS:
-                {
-                    processRequestConfirmedTx(processorNumber, peer, header);
-                }
-                break;
+            /* qli: process RequestTxStatus message */
+            case REQUEST_TX_STATUS:
+            {
+                processRequestConfirmedTx(processorNumber, peer, header);
+            }
+            break;
 #endif
 
-                }
+            }
 
-                queueProcessingNumerator += __rdtsc() - beginningTick;
-                queueProcessingDenominator++;
+            releaseRequest(requestIndex);
 
-                _InterlockedIncrement64(&numberOfProcessedRequests);
-            }
+            queueProcessingNumerator += __rdtsc() - beginningTick;
+            queueProcessingDenominator++;
+
+            _InterlockedIncrement64(&numberOfProcessedRequests);
         }
     }
 }
@@ -3243,34 +3349,8 @@ static void processTick(unsigned long long processorNumber)
     PROFILE_SCOPE_END();
 
     PROFILE_NAMED_SCOPE_BEGIN("processTick(): get spectrum digest");
-    unsigned int digestIndex;
     ACQUIRE(spectrumLock);
-    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
-    {
-        if (spectrum[digestIndex].latestIncomingTransferTick == system.tick || spectrum[digestIndex].latestOutgoingTransferTick == system.tick)
-        {
-            KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-            spectrumChangeFlags[digestIndex >> 6] |= (1ULL << (digestIndex & 63));
-        }
-    }
-    unsigned int previousLevelBeginning = 0;
-    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-    while (numberOfLeafs > 1)
-    {
-        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-        {
-            if (spectrumChangeFlags[i >> 6] & (3ULL << (i & 63)))
-            {
-                KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex]);
-                spectrumChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
-                spectrumChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
-            }
-            digestIndex++;
-        }
-        previousLevelBeginning += numberOfLeafs;
-        numberOfLeafs >>= 1;
-    }
-    spectrumChangeFlags[0] = 0;
+    updateSpectrumDigests();
 
     etalonTick.saltedSpectrumDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
     RELEASE(spectrumLock);
@@ -3371,7 +3451,7 @@ static void processTick(unsigned long long processorNumber)
 
                     unsigned int nextTxIndex = 0;
                     unsigned int numPendingTickTxs = pendingTxsPool.getNumberOfPendingTickTxs(system.tick + TICK_TRANSACTIONS_PUBLICATION_OFFSET);
-                    pendingTxsPool.acquireLock();
+                    pendingTxsPool.acquireLock(system.tick + TICK_TRANSACTIONS_PUBLICATION_OFFSET);
                     for (unsigned int tx = 0; tx < numPendingTickTxs; ++tx)
                     {
 #if !defined(NDEBUG) && !defined(NO_UEFI)
@@ -3401,7 +3481,7 @@ static void processTick(unsigned long long processorNumber)
                             break;
                         }
                     }
-                    pendingTxsPool.releaseLock();
+                    pendingTxsPool.releaseLock(system.tick + TICK_TRANSACTIONS_PUBLICATION_OFFSET);
 
                     {
                         // insert & broadcast vote counter tx
@@ -3587,6 +3667,7 @@ static void beginEpoch()
         getPublicKey(privateKey.m256i_u8, publicKey.m256i_u8);
         broadcastedComputors.computors.publicKeys[i] = publicKey;
     }
+    updateComputorVerificationKeys();
 
     ACQUIRE(minerScoreArrayLock);
     numberOfOwnComputorIndices = 0;
@@ -3874,7 +3955,7 @@ static void initializeFirstTick()
             setMem(uniqueVoteCount, sizeof(uniqueVoteCount), 0);
             uniqueCount = 0;
 
-            const Tick* tsCompTicks = ts.ticks.getByTickIndex(firstTickIndex);
+            const Tick* tsCompTicks = ts.ticks.pinByTickIndex(firstTickIndex);
             for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
             {
                 ts.ticks.acquireLock(i);
@@ -3939,9 +4020,11 @@ static void initializeFirstTick()
                     etalonTick.prevSpectrumDigest = unique->prevSpectrumDigest;
                     etalonTick.prevUniverseDigest = unique->prevUniverseDigest;
                     etalonTick.prevTransactionBodyDigest = unique->prevTransactionBodyDigest;
+                    ts.ticks.unpinByTickIndex(firstTickIndex);
                     return;
                 }
             }
+            ts.ticks.unpinByTickIndex(firstTickIndex);
         }
         _mm_pause();
     }
@@ -3956,24 +4039,123 @@ static bool invalidateNodeStates(CHAR16* directory)
     return ts.saveInvalidateData(system.epoch, directory);
 }
 
-// can only called from main thread
-static bool saveAllNodeStates()
+// Base snapshot that spectrumSnapshotDelta, universeSnapshotDelta, and contractStateSnapshotDeltas refer to. If
+// nodeStateDeltaBaseTick is 0, there is none and the next snapshot is saved as a new base (see snapshot_delta.h).
+struct NodeStateDeltaBase
 {
-    PROFILE_SCOPE();
+    unsigned int epoch;
+    unsigned int tick;
+};
+static NodeStateDeltaBase nodeStateDeltaBase = { 0, 0 };
+static CHAR16 NODE_STATE_DELTA_BASE_FILE_NAME[] = L"snapshotDeltaBase";
 
-    CHAR16 directory[16];
-    setText(directory, L"ep");
-    appendNumber(directory, system.epoch, false);
+// Files of a base snapshot, which are kept for delta snapshots. The delta files have the suffix ".delta".
+static bool isNodeStateBaseFile(const std::string& fileName)
+{
+    if (fileName.ends_with(".delta"))
+    {
+        return false;
+    }
+    return fileName.starts_with("spectrum.") || fileName.starts_with("universe.") || fileName.starts_with("contract")
+        || fileName == "snapshotSpectrumDigest" || fileName == "snapshotUniverseDigest" || fileName == "snapshotDeltaBase";
+}
 
-    logToConsole(L"Start saving node states from main thread");
+// Check if the node states can be saved as delta to the base snapshot in directory
+static bool canSaveNodeStateDelta(CHAR16* directory)
+{
+    if (!TICK_STORAGE_AUTOSAVE_DELTA_FRACTION || !nodeStateDeltaBase.tick || nodeStateDeltaBase.epoch != system.epoch)
+    {
+        return false;
+    }
 
-    // First remove old snapshot data
-    if (!removeDir(directory))
+    // Make sure the base has not been replaced, for example by compaction (see compactNodeStateSnapshot())
+    NodeStateDeltaBase base;
+    if (getFileSize(NODE_STATE_DELTA_BASE_FILE_NAME, directory) != sizeof(base)
+        || load(NODE_STATE_DELTA_BASE_FILE_NAME, sizeof(base), (unsigned char*)&base, directory) != sizeof(base)
+        || base.epoch != nodeStateDeltaBase.epoch || base.tick != nodeStateDeltaBase.tick)
     {
-        logToConsole(L"Failed to remove old snapshot data");
         return false;
     }
 
+    // Start a new base if the deltas get large
+    return spectrumSnapshotDelta.countChanged() <= SPECTRUM_CAPACITY / TICK_STORAGE_AUTOSAVE_DELTA_FRACTION
+        && universeSnapshotDelta.countChanged() <= ASSETS_CAPACITY / TICK_STORAGE_AUTOSAVE_DELTA_FRACTION;
+}
+
+// Start tracking changes relative to a base snapshot of the current node states. Can only be called from main thread
+// while the tick processor is waiting.
+static void startNodeStateDeltaBase()
+{
+    nodeStateDeltaBase.epoch = system.epoch;
+    nodeStateDeltaBase.tick = system.tick;
+    ACQUIRE(spectrumLock);
+    spectrumSnapshotDelta.clear();
+    RELEASE(spectrumLock);
+    ACQUIRE(universeLock);
+    universeSnapshotDelta.clear();
+    RELEASE(universeLock);
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
+    {
+        contractStateSnapshotDeltas[contractIndex].clear();
+    }
+}
+
+// Remove old snapshot data in directory and mark the snapshot in it as invalid. For a delta snapshot, the base
+// files in baseDirectory are kept (if baseDirectory is directory) or hard-linked into directory.
+static bool prepareNodeStateDirectory(CHAR16* directory, CHAR16* baseDirectory = NULL)
+{
+    if (baseDirectory == directory)
+    {
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(wchar_to_string(directory), error))
+        {
+            if (!isNodeStateBaseFile(entry.path().filename().string()))
+            {
+                std::filesystem::remove_all(entry.path(), error);
+            }
+            if (error)
+            {
+                break;
+            }
+        }
+        if (error)
+        {
+            logToConsole(L"Failed to remove old snapshot data");
+            return false;
+        }
+    }
+    else
+    {
+        // First remove old snapshot data
+        if (!removeDir(directory))
+        {
+            logToConsole(L"Failed to remove old snapshot data");
+            return false;
+        }
+        if (baseDirectory)
+        {
+            createDir(directory);
+            std::error_code error;
+            const std::filesystem::path path = wchar_to_string(directory);
+            for (const auto& entry : std::filesystem::directory_iterator(wchar_to_string(baseDirectory), error))
+            {
+                if (isNodeStateBaseFile(entry.path().filename().string()))
+                {
+                    std::filesystem::create_hard_link(entry.path(), path / entry.path().filename(), error);
+                }
+                if (error)
+                {
+                    break;
+                }
+            }
+            if (error)
+            {
+                logToConsole(L"Failed to link base snapshot data");
+                return false;
+            }
+        }
+    }
+
     // Mark current snapshot metadata as invalid at the beginning.
     // Any reasons make the valid metadata can not be overwritten at the final step will keep this invalid file
     // and make the loadAllNodeStates see this saving as an invalid save.
@@ -3982,6 +4164,68 @@ static bool saveAllNodeStates()
         logToConsole(L"Failed to init snapshot metadata");
         return false;
     }
+    return true;
+}
+
+// Save a large array of the node states to the base file fileName or, if delta is given, only the records changed
+// since the base snapshot to the delta file
+static bool saveNodeStateArray(CHAR16* fileName, const unsigned char* data, unsigned long long size, const SnapshotDeltaTracker* delta, CHAR16* directory = NULL)
+{
+    if (!delta)
+    {
+        return saveStateFile(fileName, size, data, directory) == (long long)size;
+    }
+    CHAR16 deltaFileName[64];
+    setText(deltaFileName, fileName);
+    appendText(deltaFileName, L".delta");
+    return delta->saveDelta(deltaFileName, data, nodeStateDeltaBase.epoch, nodeStateDeltaBase.tick, directory);
+}
+
+// Save the digest tree of an array (see DigestTreeBuilder) to the base file fileName or, if leafDelta (the tracker
+// of the array) is given, only the digests that depend on records changed since the base snapshot to the delta file
+static bool saveNodeStateDigestTree(CHAR16* fileName, const m256i* digests, unsigned long long size, const SnapshotDeltaTracker* leafDelta, CHAR16* directory)
+{
+    if (!leafDelta)
+    {
+        return saveNodeStateArray(fileName, (const unsigned char*)digests, size, nullptr, directory);
+    }
+    SnapshotDeltaTracker treeDelta;
+    bool saved = treeDelta.init(size, sizeof(m256i));
+    if (saved)
+    {
+        treeDelta.markTreeOfChangedLeafs(*leafDelta);
+        saved = saveNodeStateArray(fileName, (const unsigned char*)digests, size, &treeDelta, directory);
+    }
+    treeDelta.deinit();
+    return saved;
+}
+
+// Save all node states except for spectrum and universe to directory. The tick storage is skipped if saveTickStorage
+// is false. The logging states are expected in the scratchpad (see logger.dumpCurrentLoggingStates()). If delta is
+// true, the large arrays are saved as deltas to the base snapshot.
+static bool saveRemainingNodeStates(CHAR16* directory, bool saveTickStorage, unsigned long long loggingStateSize, bool delta);
+
+// can only called from main thread
+static bool saveAllNodeStates()
+{
+    PROFILE_SCOPE();
+
+    CHAR16 directory[16];
+    setText(directory, L"ep");
+    appendNumber(directory, system.epoch, false);
+
+    const bool delta = canSaveNodeStateDelta(directory);
+    logToConsole(delta ? L"Start saving node state delta from main thread" : L"Start saving node states from main thread");
+
+    if (!prepareNodeStateDirectory(directory, delta ? directory : NULL))
+    {
+        return false;
+    }
+    if (!delta)
+    {
+        // The old base is gone
+        nodeStateDeltaBase.tick = 0;
+    }
 
     SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 4] = L'0';
     SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 3] = L'0';
@@ -3990,7 +4234,7 @@ static bool saveAllNodeStates()
     appendText(message, directory); appendText(message, L"/");
     appendText(message, SPECTRUM_FILE_NAME);
     logToConsole(message);
-    if (!saveSpectrum(SPECTRUM_FILE_NAME, directory))
+    if (delta ? !saveNodeStateArray(SPECTRUM_FILE_NAME, (unsigned char*)spectrum, spectrumSizeInBytes, &spectrumSnapshotDelta, directory) : !saveSpectrum(SPECTRUM_FILE_NAME, directory))
     {
         logToConsole(L"Failed to save spectrum");
         return false;
@@ -4003,114 +4247,544 @@ static bool saveAllNodeStates()
     appendText(message, directory); appendText(message, L"/");
     appendText(message, UNIVERSE_FILE_NAME);
     logToConsole(message);
-    if (!saveUniverse(UNIVERSE_FILE_NAME, directory))
+    if (delta ? !saveNodeStateArray(UNIVERSE_FILE_NAME, (unsigned char*)assets, universeSizeInBytes, &universeSnapshotDelta, directory) : !saveUniverse(UNIVERSE_FILE_NAME, directory))
+    {
+        logToConsole(L"Failed to save universe");
+        return false;
+    }
+
+    if (!saveRemainingNodeStates(directory, true, logger.dumpCurrentLoggingStates(), delta))
+    {
+        return false;
+    }
+    if (!delta)
+    {
+        startNodeStateDeltaBase();
+    }
+    return true;
+}
+
+static bool saveRemainingNodeStates(CHAR16* directory, bool saveTickStorage, unsigned long long loggingStateSize, bool delta)
+{
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 4] = L'0';
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 3] = L'0';
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 2] = L'0';
+    setText(message, L"Saving computer files");
+    logToConsole(message);
+    if (delta ? !saveComputerDelta(directory) : !saveComputer(directory))
+    {
+        logToConsole(L"Failed to save computer");
+        return false;
+    }
+    setText(message, L"Saving system to system.snp");
+    logToConsole(message);
+
+    static wchar_t SYSTEM_SNAPSHOT_FILE_NAME[] = L"system.snp";
+    long long savedSize = save(SYSTEM_SNAPSHOT_FILE_NAME, sizeof(system), (unsigned char*)&system, directory);
+    if (savedSize != sizeof(system))
+    {
+        logToConsole(L"Failed to save system");
+        return false;
+    }
+    
+    score->saveScoreCache(system.epoch, directory);
+    
+    copyMem(&nodeStateBuffer.etalonTick, &etalonTick, sizeof(etalonTick));
+    copyMem(nodeStateBuffer.minerPublicKeys, (void*)minerPublicKeys, sizeof(minerPublicKeys));
+    copyMem(nodeStateBuffer.minerScores, (void*)minerScores, sizeof(minerScores));
+    copyMem(nodeStateBuffer.competitorPublicKeys, (void*)competitorPublicKeys, sizeof(competitorPublicKeys));
+    copyMem(nodeStateBuffer.competitorScores, (void*)competitorScores, sizeof(competitorScores));
+    copyMem(nodeStateBuffer.competitorComputorStatuses, (void*)competitorComputorStatuses, sizeof(competitorComputorStatuses));
+    copyMem(nodeStateBuffer.solutionPublicationTicks, (void*)solutionPublicationTicks, sizeof(solutionPublicationTicks));
+    copyMem(nodeStateBuffer.faultyComputorFlags, (void*)faultyComputorFlags, sizeof(faultyComputorFlags));
+    copyMem(&nodeStateBuffer.broadcastedComputors, (void*)&broadcastedComputors, sizeof(broadcastedComputors));
+    copyMem(&nodeStateBuffer.resourceTestingDigest, &resourceTestingDigest, sizeof(resourceTestingDigest));
+    nodeStateBuffer.currentRandomSeed = score->currentRandomSeed;
+    nodeStateBuffer.numberOfMiners = numberOfMiners;
+    nodeStateBuffer.numberOfTransactions = numberOfTransactions;    
+    voteCounter.saveAllDataToArray(nodeStateBuffer.voteCounterData);
+    gCustomMiningSharesCounter.saveAllDataToArray(nodeStateBuffer.customMiningSharesCounterData);
+
+    CHAR16 NODE_STATE_FILE_NAME[] = L"snapshotNodeMiningState";
+    savedSize = save(NODE_STATE_FILE_NAME, sizeof(nodeStateBuffer), (unsigned char*)&nodeStateBuffer, directory);
+    logToConsole(L"Saving mining states");
+    if (savedSize != sizeof(nodeStateBuffer))
+    {
+        logToConsole(L"Failed to save etalon tick and other states");
+        return false;
+    }
+    
+    CHAR16 SPECTRUM_DIGEST_FILE_NAME[] = L"snapshotSpectrumDigest";
+    logToConsole(L"Saving spectrum digests");
+    if (!saveNodeStateDigestTree(SPECTRUM_DIGEST_FILE_NAME, spectrumDigests, spectrumDigestsSizeInByte, delta ? &spectrumSnapshotDelta : nullptr, directory))
+    {
+        logToConsole(L"Failed to save spectrum digest");
+        return false;
+    }
+
+    CHAR16 UNIVERSE_DIGEST_FILE_NAME[] = L"snapshotUniverseDigest";
+    logToConsole(L"Saving universe digests");
+    if (!saveNodeStateDigestTree(UNIVERSE_DIGEST_FILE_NAME, assetDigests, assetDigestsSizeInBytes, delta ? &universeSnapshotDelta : nullptr, directory))
+    {
+        logToConsole(L"Failed to save universe digest");
+        return false;
+    }
+
+    CHAR16 COMPUTER_DIGEST_FILE_NAME[] = L"snapshotComputerDigest";
+    savedSize = save(COMPUTER_DIGEST_FILE_NAME, contractStateDigestsSizeInBytes, (unsigned char*)contractStateDigests, directory);
+    logToConsole(L"Saving computer digests");
+    if (savedSize != contractStateDigestsSizeInBytes)
+    {
+        logToConsole(L"Failed to save computer digest");
+        return false;
+    }
+
+    CHAR16 MINER_SOL_FLAG_FILE_NAME[] = L"snapshotMinerSolutionFlag";
+    logToConsole(L"Saving miner solution flags");
+    savedSize = save(MINER_SOL_FLAG_FILE_NAME, NUMBER_OF_MINER_SOLUTION_FLAGS / 8, (unsigned char*)minerSolutionFlags, directory);
+    if (savedSize != NUMBER_OF_MINER_SOLUTION_FLAGS / 8)
+    {
+        logToConsole(L"Failed to save miner solution flag");
+        return false;
+    }
+
+    if (saveTickStorage)
+    {
+        setText(message, L"Saving tick storage ");
+        logToConsole(message);
+        if (ts.trySaveToFile(system.epoch, system.tick, directory) != 0)
+        {
+            logToConsole(L"Failed to save tick storage");
+            return false;
+        }
+    }
+
+#if ADDON_TX_STATUS_REQUEST
+    if (!saveStateTxStatus(numberOfTransactions, directory))
+    {
+        logToConsole(L"Failed to save tx status");
+        return false;
+    }
+#endif
+#if ENABLED_LOGGING
+    logger.saveDumpedLoggingStates(directory, loggingStateSize);
+#endif
+
+    if (!delta)
+    {
+        const NodeStateDeltaBase base = { system.epoch, system.tick };
+        if (save(NODE_STATE_DELTA_BASE_FILE_NAME, sizeof(base), (unsigned char*)&base, directory) != sizeof(base))
+        {
+            logToConsole(L"Failed to save snapshot delta base");
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef __linux__
+// Concurrent snapshots: the node states are written by a child process, which gets a copy-on-write image of the
+// memory from fork(). The node only pauses for forking instead of for writing all files, so the peers are kept
+// connected. The snapshot process writes to a staging directory that replaces the epoch directory only after all
+// files have been written and synced, so a failed snapshot never destroys the last complete one.
+static pid_t nodeStateSnapshotPid = 0;
+static unsigned long long nodeStateSnapshotStartTick = 0;
+static bool nodeStateSnapshotIsBase = false;
+
+// Set if saving was requested while the snapshot process was running. The save is requested again when the process
+// has finished (see checkNodeStateSnapshot()).
+static bool nodeStateSnapshotPending = false;
+
+static void getNodeStateSnapshotDirectories(CHAR16* directory, CHAR16* stagingDirectory)
+{
+    setText(directory, L"ep");
+    appendNumber(directory, system.epoch, false);
+    setText(stagingDirectory, directory);
+    appendText(stagingDirectory, L".new");
+}
+
+// Locks held while forking, so the snapshot is consistent and the snapshot process does not inherit locks owned by
+// other processors
+static void acquireNodeStateSnapshotLocks()
+{
+    ACQUIRE(spectrumLock);
+    ACQUIRE(universeLock);
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
+    {
+        contractStateLock[contractIndex].acquireWrite();
+    }
+#if USE_SCORE_CACHE
+    ACQUIRE(score->scoreCacheLock);
+#endif
+#ifndef USE_SWAP
+    ts.tickData.acquireLock();
+    for (unsigned short computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex++)
+    {
+        ts.ticks.acquireLock(computorIndex);
+    }
+    ts.tickTransactions.acquireLock();
+#endif
+}
+
+static void releaseNodeStateSnapshotLocks()
+{
+#ifndef USE_SWAP
+    ts.tickTransactions.releaseLock();
+    for (unsigned short computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex++)
+    {
+        ts.ticks.releaseLock(computorIndex);
+    }
+    ts.tickData.releaseLock();
+#endif
+#if USE_SCORE_CACHE
+    RELEASE(score->scoreCacheLock);
+#endif
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
+    {
+        contractStateLock[contractIndex].releaseWrite();
+    }
+    RELEASE(universeLock);
+    RELEASE(spectrumLock);
+}
+
+// Executed by the snapshot process to write all node states to stagingDirectory (see writeNodeStateSnapshot())
+static bool writeNodeStateFiles(CHAR16* stagingDirectory, unsigned long long loggingStateSize, bool delta)
+{
+    // Spectrum and universe are the largest files, so write them in parallel to the others. The threads pass full
+    // paths to save() to avoid creating the directory concurrently.
+    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 4] = L'0';
+    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 3] = L'0';
+    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 2] = L'0';
+    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 4] = L'0';
+    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 3] = L'0';
+    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 2] = L'0';
+    CHAR16 spectrumPath[64], universePath[64];
+    setText(spectrumPath, stagingDirectory);
+    appendText(spectrumPath, L"/");
+    appendText(spectrumPath, SPECTRUM_FILE_NAME);
+    setText(universePath, stagingDirectory);
+    appendText(universePath, L"/");
+    appendText(universePath, UNIVERSE_FILE_NAME);
+
+    bool spectrumSaved = false, universeSaved = false;
+    std::thread spectrumWriter([&]()
+        {
+            spectrumSaved = saveNodeStateArray(spectrumPath, (unsigned char*)spectrum, spectrumSizeInBytes, delta ? &spectrumSnapshotDelta : nullptr);
+        });
+    std::thread universeWriter([&]()
+        {
+            universeSaved = saveNodeStateArray(universePath, (unsigned char*)assets, universeSizeInBytes, delta ? &universeSnapshotDelta : nullptr);
+        });
+#ifdef USE_SWAP
+    // Tick storage has already been saved by the node (see startNodeStateSnapshot())
+    bool saved = saveRemainingNodeStates(stagingDirectory, false, loggingStateSize, delta);
+#else
+    bool saved = saveRemainingNodeStates(stagingDirectory, true, loggingStateSize, delta);
+#endif
+    spectrumWriter.join();
+    universeWriter.join();
+    return saved && spectrumSaved && universeSaved;
+}
+
+// Start writing a snapshot of the node states in a child process. Can only be called from main thread while the
+// tick processor is waiting. Returns false if the snapshot could not be started (use saveAllNodeStates() instead).
+static bool startNodeStateSnapshot()
+{
+    CHAR16 directory[16], stagingDirectory[16];
+    getNodeStateSnapshotDirectories(directory, stagingDirectory);
+    const bool delta = canSaveNodeStateDelta(directory);
+    if (!prepareNodeStateDirectory(stagingDirectory, delta ? directory : NULL))
+    {
+        return false;
+    }
+
+#ifdef USE_SWAP
+    // Swapped tick data is stored in files that the node keeps changing after forking, so save it before.
+    logToConsole(L"Saving tick storage ");
+    if (ts.trySaveToFile(system.epoch, system.tick, stagingDirectory) != 0)
+    {
+        logToConsole(L"Failed to save tick storage");
+        return false;
+    }
+#endif
+    // Logging states are swapped as well, copy them to the scratchpad that the snapshot process inherits
+    const unsigned long long loggingStateSize = logger.dumpCurrentLoggingStates();
+
+    acquireNodeStateSnapshotLocks();
+    const unsigned long long beginningTick = __rdtsc();
+    const pid_t pid = fork();
+    releaseNodeStateSnapshotLocks();
+    if (pid == 0)
+    {
+        // Snapshot process: only this thread exists, so avoid anything that might wait for other processors
+        consoleLoggingLevel = 0;
+        _exit(writeNodeStateSnapshot(directory, stagingDirectory, [&](CHAR16* writeDirectory)
+            {
+                return writeNodeStateFiles(writeDirectory, loggingStateSize, delta);
+            }));
+    }
+    if (pid < 0)
+    {
+        logToConsole(L"Failed to fork snapshot process");
+        return false;
+    }
+
+    nodeStateSnapshotPid = pid;
+    nodeStateSnapshotStartTick = beginningTick;
+    nodeStateSnapshotIsBase = !delta;
+    if (!delta)
+    {
+        // Track changes relative to the new base. If the snapshot process fails, the next snapshot is a base again.
+        startNodeStateDeltaBase();
+    }
+    setText(message, delta ? L"Delta snapshot process started, node paused for " : L"Snapshot process started, node paused for ");
+    appendNumber(message, (__rdtsc() - beginningTick) * 1000000 / frequency, TRUE);
+    appendText(message, L" microseconds.");
+    logToConsole(message);
+    return true;
+}
+
+// Check if the snapshot process has finished. If wait is true, block until it has finished.
+// Returns true if no snapshot process is running anymore.
+static bool checkNodeStateSnapshot(bool wait)
+{
+    if (!nodeStateSnapshotPid)
+    {
+        return true;
+    }
+    int status = 0;
+    const pid_t pid = waitpid(nodeStateSnapshotPid, &status, wait ? 0 : WNOHANG);
+    if (pid == 0)
+    {
+        return false;
+    }
+    if (pid == nodeStateSnapshotPid && WIFEXITED(status) && WEXITSTATUS(status) == 0)
+    {
+        setText(message, L"Complete saving all node states in snapshot process (");
+        appendNumber(message, (__rdtsc() - nodeStateSnapshotStartTick) / frequency, TRUE);
+        appendText(message, L" seconds).");
+    }
+    else
+    {
+        setText(message, L"Snapshot process failed, status ");
+        appendNumber(message, status, FALSE);
+        appendText(message, L". The last complete snapshot is kept.");
+        if (nodeStateSnapshotIsBase)
+        {
+            nodeStateDeltaBase.tick = 0;
+        }
+    }
+    logToConsole(message);
+    nodeStateSnapshotPid = 0;
+
+    if (nodeStateSnapshotPending)
+    {
+        // Start the queued save, which is done by the main loop as soon as the tick processor is waiting
+        logToConsole(L"Saving node state requested while the snapshot process was running");
+        nodeStateSnapshotPending = false;
+        ATOMIC_STORE32(requestPersistingNodeState, 1);
+    }
+    return true;
+}
+#endif
+
+// Delta file of a large array of the node states, given by its full path
+struct NodeStateDeltaFile
+{
+    CHAR16 fileName[64];
+    unsigned char* data;
+    unsigned long long size;
+};
+
+static void addNodeStateDeltaFile(std::vector<NodeStateDeltaFile>& files, CHAR16* directory, const CHAR16* fileName, void* data, unsigned long long size)
+{
+    NodeStateDeltaFile& file = files.emplace_back();
+    setText(file.fileName, directory);
+    appendText(file.fileName, L"/");
+    appendText(file.fileName, fileName);
+    appendText(file.fileName, L".delta");
+    file.data = (unsigned char*)data;
+    file.size = size;
+}
+
+// Apply the delta files of a delta snapshot (see saveAllNodeStates()) to the node states loaded from the base files.
+// Has to be called after loading spectrum, universe, computer, and their digests. The deltas are applied in parallel.
+static bool loadNodeStateDeltas(CHAR16* directory)
+{
+    NodeStateDeltaBase base;
+    if (getFileSize(NODE_STATE_DELTA_BASE_FILE_NAME, directory) < 0)
+    {
+        // Saved without delta support
+        return true;
+    }
+    if (load(NODE_STATE_DELTA_BASE_FILE_NAME, sizeof(base), (unsigned char*)&base, directory) != sizeof(base))
     {
-        logToConsole(L"Failed to save universe");
         return false;
     }
 
-    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 4] = L'0';
-    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 3] = L'0';
-    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 2] = L'0';
-    setText(message, L"Saving computer files");
-    logToConsole(message);
-    if (!saveComputer(directory))
+    const unsigned long long beginningTick = __rdtsc();
+    std::vector<NodeStateDeltaFile> files;
+    addNodeStateDeltaFile(files, directory, SPECTRUM_FILE_NAME, spectrum, spectrumSizeInBytes);
+    addNodeStateDeltaFile(files, directory, UNIVERSE_FILE_NAME, assets, universeSizeInBytes);
+    addNodeStateDeltaFile(files, directory, L"snapshotSpectrumDigest", spectrumDigests, spectrumDigestsSizeInByte);
+    addNodeStateDeltaFile(files, directory, L"snapshotUniverseDigest", assetDigests, assetDigestsSizeInBytes);
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
     {
-        logToConsole(L"Failed to save computer");
-        return false;
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 9] = contractIndex / 1000 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 8] = (contractIndex % 1000) / 100 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 7] = (contractIndex % 100) / 10 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 6] = contractIndex % 10 + L'0';
+        addNodeStateDeltaFile(files, directory, CONTRACT_FILE_NAME, contractStates[contractIndex], contractDescriptions[contractIndex].stateSize);
     }
-    setText(message, L"Saving system to system.snp");
-    logToConsole(message);
 
-    static wchar_t SYSTEM_SNAPSHOT_FILE_NAME[] = L"system.snp";
-    long long savedSize = save(SYSTEM_SNAPSHOT_FILE_NAME, sizeof(system), (unsigned char*)&system, directory);
-    if (savedSize != sizeof(system))
+    volatile long nextFileIndex = -1;
+    volatile long numberOfAppliedFiles = 0;
+    volatile long numberOfFailedFiles = 0;
+    auto applyDeltas = [&]()
+        {
+            long fileIndex;
+            while ((fileIndex = _InterlockedIncrement(&nextFileIndex)) < (long)files.size())
+            {
+                NodeStateDeltaFile& file = files[fileIndex];
+                const int result = loadSnapshotDelta(file.fileName, file.data, file.size, base.epoch, base.tick);
+                if (result > 0)
+                {
+                    _InterlockedIncrement(&numberOfAppliedFiles);
+                }
+                else if (result < 0)
+                {
+                    _InterlockedIncrement(&numberOfFailedFiles);
+                }
+            }
+        };
+    std::vector<std::thread> threads;
+    const unsigned int numberOfThreads = std::min((unsigned int)files.size(), std::max(std::thread::hardware_concurrency(), 1u));
+    ACQUIRE(spectrumLock);
+    beginSpectrumLayoutChange();
+    for (unsigned int i = 0; i < numberOfThreads; i++)
+    {
+        threads.emplace_back(applyDeltas);
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    endSpectrumLayoutChange();
+    RELEASE(spectrumLock);
+    if (numberOfFailedFiles)
     {
-        logToConsole(L"Failed to save system");
         return false;
     }
-    
-    score->saveScoreCache(system.epoch, directory);
-    
-    copyMem(&nodeStateBuffer.etalonTick, &etalonTick, sizeof(etalonTick));
-    copyMem(nodeStateBuffer.minerPublicKeys, (void*)minerPublicKeys, sizeof(minerPublicKeys));
-    copyMem(nodeStateBuffer.minerScores, (void*)minerScores, sizeof(minerScores));
-    copyMem(nodeStateBuffer.competitorPublicKeys, (void*)competitorPublicKeys, sizeof(competitorPublicKeys));
-    copyMem(nodeStateBuffer.competitorScores, (void*)competitorScores, sizeof(competitorScores));
-    copyMem(nodeStateBuffer.competitorComputorStatuses, (void*)competitorComputorStatuses, sizeof(competitorComputorStatuses));
-    copyMem(nodeStateBuffer.solutionPublicationTicks, (void*)solutionPublicationTicks, sizeof(solutionPublicationTicks));
-    copyMem(nodeStateBuffer.faultyComputorFlags, (void*)faultyComputorFlags, sizeof(faultyComputorFlags));
-    copyMem(&nodeStateBuffer.broadcastedComputors, (void*)&broadcastedComputors, sizeof(broadcastedComputors));
-    copyMem(&nodeStateBuffer.resourceTestingDigest, &resourceTestingDigest, sizeof(resourceTestingDigest));
-    nodeStateBuffer.currentRandomSeed = score->currentRandomSeed;
-    nodeStateBuffer.numberOfMiners = numberOfMiners;
-    nodeStateBuffer.numberOfTransactions = numberOfTransactions;    
-    voteCounter.saveAllDataToArray(nodeStateBuffer.voteCounterData);
-    gCustomMiningSharesCounter.saveAllDataToArray(nodeStateBuffer.customMiningSharesCounterData);
+    updateSpectrumInfo();
+    as.indexLists.rebuild();
 
-    CHAR16 NODE_STATE_FILE_NAME[] = L"snapshotNodeMiningState";
-    savedSize = save(NODE_STATE_FILE_NAME, sizeof(nodeStateBuffer), (unsigned char*)&nodeStateBuffer, directory);
-    logToConsole(L"Saving mining states");
-    if (savedSize != sizeof(nodeStateBuffer))
+    setNumber(message, numberOfAppliedFiles, TRUE);
+    appendText(message, L" delta files of the snapshot of tick ");
+    appendNumber(message, base.tick, FALSE);
+    appendText(message, L" are applied (");
+    appendNumber(message, (__rdtsc() - beginningTick) * 1000000 / frequency, TRUE);
+    appendText(message, L" microseconds).");
+    logToConsole(message);
+    return true;
+}
+
+static bool readNodeStateFile(const std::filesystem::path& path, std::vector<unsigned char>& buffer)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
     {
-        logToConsole(L"Failed to save etalon tick and other states");
         return false;
     }
-    
-    CHAR16 SPECTRUM_DIGEST_FILE_NAME[] = L"snapshotSpectrumDigest";
-    savedSize = save(SPECTRUM_DIGEST_FILE_NAME, spectrumDigestsSizeInByte, (unsigned char*)spectrumDigests, directory);
-    logToConsole(L"Saving spectrum digests");
-    if (savedSize != spectrumDigestsSizeInByte)
+    buffer.resize(std::filesystem::file_size(path));
+    if (!file.read((char*)buffer.data(), buffer.size()))
     {
-        logToConsole(L"Failed to save spectrum digest");
         return false;
     }
+#ifdef __linux__
+    // Base files may be saved in the compressed format (see saveStateFile())
+    CompressedFileHeader header;
+    if (buffer.size() >= sizeof(header) && ((const CompressedFileHeader*)buffer.data())->magic == CompressedFileHeader::magicValue)
+    {
+        copyMem(&header, buffer.data(), sizeof(header));
+        buffer.resize(header.totalSize);
+        return readCompressedFile(path.string(), buffer.data(), header.totalSize) > 0;
+    }
+#endif
+    return true;
+}
 
-    CHAR16 UNIVERSE_DIGEST_FILE_NAME[] = L"snapshotUniverseDigest";
-    savedSize = save(UNIVERSE_DIGEST_FILE_NAME, assetDigestsSizeInBytes, (unsigned char*)assetDigests, directory);
-    logToConsole(L"Saving universe digests");
-    if (savedSize != assetDigestsSizeInBytes)
+static bool writeNodeStateFile(const std::filesystem::path& path, const std::vector<unsigned char>& buffer)
+{
+    // Write to a new file and replace the old one, so hard links of the old one (see prepareNodeStateDirectory()) stay unchanged
+    std::filesystem::path tmpPath = path;
+    tmpPath += ".tmp";
     {
-        logToConsole(L"Failed to save universe digest");
-        return false;
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file || !file.write((const char*)buffer.data(), buffer.size()) || !file.flush())
+        {
+            return false;
+        }
     }
+    std::error_code error;
+    std::filesystem::rename(tmpPath, path, error);
+    return !error;
+}
 
-    CHAR16 COMPUTER_DIGEST_FILE_NAME[] = L"snapshotComputerDigest";
-    savedSize = save(COMPUTER_DIGEST_FILE_NAME, contractStateDigestsSizeInBytes, (unsigned char*)contractStateDigests, directory);
-    logToConsole(L"Saving computer digests");
-    if (savedSize != contractStateDigestsSizeInBytes)
+// Fold the delta files of the snapshot of the given epoch into its base files (offline, while no node is saving to
+// the snapshot directory). Afterwards, the snapshot is the base of the next delta snapshots.
+static bool compactNodeStateSnapshot(unsigned int epoch)
+{
+    const std::filesystem::path directory = "ep" + std::to_string(epoch);
+    std::vector<unsigned char> base, delta;
+    NodeStateDeltaBase deltaBase;
+    if (!readNodeStateFile(directory / "snapshotDeltaBase", base) || base.size() != sizeof(deltaBase))
     {
-        logToConsole(L"Failed to save computer digest");
+        std::cerr << "No delta snapshot in " << directory << std::endl;
         return false;
     }
+    copyMem(&deltaBase, base.data(), sizeof(deltaBase));
 
-    CHAR16 MINER_SOL_FLAG_FILE_NAME[] = L"snapshotMinerSolutionFlag";
-    logToConsole(L"Saving miner solution flags");
-    savedSize = save(MINER_SOL_FLAG_FILE_NAME, NUMBER_OF_MINER_SOLUTION_FLAGS / 8, (unsigned char*)minerSolutionFlags, directory);
-    if (savedSize != NUMBER_OF_MINER_SOLUTION_FLAGS / 8)
+    // Check the snapshot is complete before changing it
+    std::vector<unsigned char> systemSnapshot;
+    if (!readNodeStateFile(directory / "system.snp", systemSnapshot) || systemSnapshot.size() != sizeof(System))
     {
-        logToConsole(L"Failed to save miner solution flag");
+        std::cerr << "Invalid system snapshot in " << directory << std::endl;
         return false;
     }
+    const NodeStateDeltaBase newDeltaBase = { deltaBase.epoch, ((const System*)systemSnapshot.data())->tick };
 
-    setText(message, L"Saving tick storage ");
-    logToConsole(message);
-    if (ts.trySaveToFile(system.epoch, system.tick, directory) != 0)
+    std::vector<std::filesystem::path> deltaPaths;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error))
     {
-        logToConsole(L"Failed to save tick storage");
-        return false;
+        if (entry.path().extension() == ".delta")
+        {
+            deltaPaths.push_back(entry.path());
+        }
+    }
+    for (const auto& deltaPath : deltaPaths)
+    {
+        std::filesystem::path basePath = deltaPath;
+        basePath.replace_extension();
+        if (!readNodeStateFile(basePath, base) || !readNodeStateFile(deltaPath, delta)
+            || !applySnapshotDelta(delta.data(), delta.size(), base.data(), base.size(), deltaBase.epoch, deltaBase.tick)
+            || !writeNodeStateFile(basePath, base))
+        {
+            std::cerr << "Failed to apply " << deltaPath << std::endl;
+            return false;
+        }
+        // Applying a delta twice has no effect, so the snapshot stays valid if the compaction is interrupted here
+        std::filesystem::remove(deltaPath, error);
     }
 
-#if ADDON_TX_STATUS_REQUEST
-    if (!saveStateTxStatus(numberOfTransactions, directory))
+    base.resize(sizeof(newDeltaBase));
+    copyMem(base.data(), &newDeltaBase, sizeof(newDeltaBase));
+    if (!writeNodeStateFile(directory / "snapshotDeltaBase", base))
     {
-        logToConsole(L"Failed to save tx status");
+        std::cerr << "Failed to save " << directory / "snapshotDeltaBase" << std::endl;
         return false;
     }
-#endif
-#if ENABLED_LOGGING
-    logger.saveCurrentLoggingStates(directory);
-#endif
+    std::cout << deltaPaths.size() << " delta files of " << directory << " are folded into the base of tick " << newDeltaBase.tick << std::endl;
     return true;
 }
 
@@ -4131,11 +4805,15 @@ static bool loadAllNodeStates()
         logToConsole(L"Found epoch snapshot directory. Using node states snapshot.");
     }
 
+    unsigned long long beginningTick = __rdtsc();
     if (ts.tryLoadFromFile(system.epoch, directory) != 0)
     {
         logToConsole(L"Failed to load tick storage");
         return false;
     }
+    logStartupPhase(L"load tick storage", beginningTick);
+
+    beginningTick = __rdtsc();
     SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 4] = L'0';
     SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 3] = L'0';
     SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 2] = L'0';
@@ -4144,7 +4822,9 @@ static bool loadAllNodeStates()
         logToConsole(L"Failed to load spectrum");
         return false;
     }
+    logStartupPhase(L"load spectrum", beginningTick);
 
+    beginningTick = __rdtsc();
     UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 4] = L'0';
     UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 3] = L'0';
     UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 2] = L'0';
@@ -4153,7 +4833,9 @@ static bool loadAllNodeStates()
         logToConsole(L"Failed to load universe");
         return false;
     }
+    logStartupPhase(L"load universe", beginningTick);
 
+    beginningTick = __rdtsc();
     CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 4] = L'0';
     CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 3] = L'0';
     CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 2] = L'0';
@@ -4163,6 +4845,7 @@ static bool loadAllNodeStates()
         logToConsole(L"Failed to load computer");
         return false;
     }
+    logStartupPhase(L"load computer", beginningTick);
 
     CHAR16 NODE_STATE_FILE_NAME[] = L"snapshotNodeMiningState";
     long long loadedSize = load(NODE_STATE_FILE_NAME, sizeof(nodeStateBuffer), (unsigned char*)&nodeStateBuffer, directory);
@@ -4180,6 +4863,7 @@ static bool loadAllNodeStates()
     copyMem((void*)solutionPublicationTicks, nodeStateBuffer.solutionPublicationTicks, sizeof(solutionPublicationTicks));
     copyMem((void*)faultyComputorFlags, nodeStateBuffer.faultyComputorFlags, sizeof(faultyComputorFlags));
     copyMem((void*)&broadcastedComputors, &nodeStateBuffer.broadcastedComputors, sizeof(broadcastedComputors));
+    updateComputorVerificationKeys();
     copyMem(&resourceTestingDigest, &nodeStateBuffer.resourceTestingDigest, sizeof(resourceTestingDigest));
     numberOfMiners = nodeStateBuffer.numberOfMiners;
     initialRandomSeedFromPersistingState = nodeStateBuffer.currentRandomSeed;
@@ -4213,10 +4897,13 @@ static bool loadAllNodeStates()
     }
     updateNumberOfTickTransactions();
 
-    setMem(assetChangeFlags, sizeof(assetChangeFlags), 0);
-    setMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
+    clearUniverseChanges();
+    ACQUIRE(spectrumLock);
+    clearSpectrumChanges();
+    RELEASE(spectrumLock);
+    beginningTick = __rdtsc();
     CHAR16 SPECTRUM_DIGEST_FILE_NAME[] = L"snapshotSpectrumDigest";
-    loadedSize = load(SPECTRUM_DIGEST_FILE_NAME, spectrumDigestsSizeInByte, (unsigned char*)spectrumDigests, directory);
+    loadedSize = loadParallel(SPECTRUM_DIGEST_FILE_NAME, spectrumDigestsSizeInByte, (unsigned char*)spectrumDigests, directory);
     logToConsole(L"Loading spectrum digests");
     if (loadedSize != spectrumDigestsSizeInByte)
     {
@@ -4225,7 +4912,7 @@ static bool loadAllNodeStates()
     }
 
     CHAR16 UNIVERSE_DIGEST_FILE_NAME[] = L"snapshotUniverseDigest";
-    loadedSize = load(UNIVERSE_DIGEST_FILE_NAME, assetDigestsSizeInBytes, (unsigned char*)assetDigests, directory);
+    loadedSize = loadParallel(UNIVERSE_DIGEST_FILE_NAME, assetDigestsSizeInBytes, (unsigned char*)assetDigests, directory);
     logToConsole(L"Loading universe digests");
     if (loadedSize != assetDigestsSizeInBytes)
     {
@@ -4242,6 +4929,17 @@ static bool loadAllNodeStates()
         return false;
     }
 
+    logStartupPhase(L"load digests", beginningTick);
+
+    logToConsole(L"Loading node state deltas");
+    beginningTick = __rdtsc();
+    if (!loadNodeStateDeltas(directory))
+    {
+        logToConsole(L"Failed to load node state deltas");
+        return false;
+    }
+    logStartupPhase(L"apply deltas", beginningTick);
+
     CHAR16 MINER_SOL_FLAG_FILE_NAME[] = L"snapshotMinerSolutionFlag";
     logToConsole(L"Loading miner solution flags");
     loadedSize = load(MINER_SOL_FLAG_FILE_NAME, NUMBER_OF_MINER_SOLUTION_FLAGS / 8, (unsigned char*)minerSolutionFlags, directory);
@@ -4273,7 +4971,7 @@ static void updateFutureTickCount()
 {
     const unsigned int nextTick = system.tick + 1;
     const unsigned int nextTickIndex = ts.tickToIndexCurrentEpoch(nextTick);
-    const Tick* tsCompTicks = ts.ticks.getByTickIndex(nextTickIndex);
+    const Tick* tsCompTicks = ts.ticks.pinByTickIndex(nextTickIndex);
     unsigned int futureTickTotalNumberOfComputors = 0;
     for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
     {
@@ -4282,6 +4980,7 @@ static void updateFutureTickCount()
             futureTickTotalNumberOfComputors++;
         }
     }
+    ts.ticks.unpinByTickIndex(nextTickIndex);
     gFutureTickTotalNumberOfComputors = futureTickTotalNumberOfComputors;
 }
 
@@ -4292,7 +4991,7 @@ static int findCurrentDigestsFromNextTickVotes(m256i &spectrumDigest, unsigned i
 {
     const unsigned int nextTick = system.tick + 1;
     const unsigned int nextTickIndex = ts.tickToIndexCurrentEpoch(nextTick);
-    const Tick* tsCompTicks = ts.ticks.getByTickIndex(nextTickIndex);
+    const Tick* tsCompTicks = ts.ticks.pinByTickIndex(nextTickIndex);
     unsigned int numberOfUniqueCurrentSpectrumDigests = 0;
     setMem(uniqueCurrentSpectrumDigests, sizeof(uniqueCurrentSpectrumDigests), 0);
     setMem(uniqueCurrentSpectrumDigestCounters, sizeof(uniqueCurrentSpectrumDigestCounters), 0);
@@ -4339,6 +5038,7 @@ static int findCurrentDigestsFromNextTickVotes(m256i &spectrumDigest, unsigned i
                 break;
             }
         }
+        ts.ticks.unpinByTickIndex(nextTickIndex);
         return 1;
     } else
     {
@@ -4353,9 +5053,11 @@ static int findCurrentDigestsFromNextTickVotes(m256i &spectrumDigest, unsigned i
                     break;
                 }
             }
+            ts.ticks.unpinByTickIndex(nextTickIndex);
             return 1;
         }
 
+        ts.ticks.unpinByTickIndex(nextTickIndex);
         if (totalUniqueCurrentSpectrumDigestCounter < NUMBER_OF_COMPUTORS)
         {
             setText(message, L"Not enough votes to decide current digests from next tick votes: ");
@@ -4379,7 +5081,7 @@ static void findNextTickDataDigestFromNextTickVotes()
 {
     const unsigned int nextTick = system.tick + 1;
     const unsigned int nextTickIndex = ts.tickToIndexCurrentEpoch(nextTick);
-    const Tick* tsCompTicks = ts.ticks.getByTickIndex(nextTickIndex);
+    const Tick* tsCompTicks = ts.ticks.pinByTickIndex(nextTickIndex);
     unsigned int numberOfEmptyNextTickTransactionDigest = 0;
     unsigned int numberOfUniqueNextTickTransactionDigests = 0;
     for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
@@ -4410,6 +5112,7 @@ static void findNextTickDataDigestFromNextTickVotes()
             }
         }
     }
+    ts.ticks.unpinByTickIndex(nextTickIndex);
     unsigned int mostPopularUniqueNextTickTransactionDigestIndex = 0, totalUniqueNextTickTransactionDigestCounter = uniqueNextTickTransactionDigestCounters[0];
     for (unsigned int i = 1; i < numberOfUniqueNextTickTransactionDigests; i++)
     {
@@ -4441,7 +5144,7 @@ static void findNextTickDataDigestFromNextTickVotes()
 static void findNextTickDataDigestFromCurrentTickVotes()
 {
     const unsigned int currentTickIndex = ts.tickToIndexCurrentEpoch(system.tick);
-    const Tick* tsCompTicks = ts.ticks.getByTickIndex(currentTickIndex);
+    const Tick* tsCompTicks = ts.ticks.pinByTickIndex(currentTickIndex);
     unsigned int numberOfEmptyNextTickTransactionDigest = 0;
     unsigned int numberOfUniqueNextTickTransactionDigests = 0;
     for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
@@ -4472,6 +5175,7 @@ static void findNextTickDataDigestFromCurrentTickVotes()
             }
         }
     }
+    ts.ticks.unpinByTickIndex(currentTickIndex);
     if (numberOfUniqueNextTickTransactionDigests)
     {
         unsigned int mostPopularUniqueNextTickTransactionDigestIndex = 0, totalUniqueNextTickTransactionDigestCounter = uniqueNextTickTransactionDigestCounters[0];
@@ -4505,7 +5209,7 @@ static unsigned int countCurrentTickVote()
 {
     const unsigned int currentTickIndex = ts.tickToIndexCurrentEpoch(system.tick);
     unsigned int tickTotalNumberOfComputors = 0;
-    const Tick* tsCompTicks = ts.ticks.getByTickIndex(currentTickIndex);
+    const Tick* tsCompTicks = ts.ticks.pinByTickIndex(currentTickIndex);
     for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
     {
         ts.ticks.acquireLock(i);
@@ -4517,6 +5221,7 @@ static unsigned int countCurrentTickVote()
 
         ts.ticks.releaseLock(i);
     }
+    ts.ticks.unpinByTickIndex(currentTickIndex);
     return tickTotalNumberOfComputors;
 }
 
@@ -4581,7 +5286,7 @@ static void prepareNextTickTransactions()
         // Checks if any of the missing transactions is available in the pending transaction pool and remove unknownTransaction flag if found
 
         unsigned int numPendingTickTxs = pendingTxsPool.getNumberOfPendingTickTxs(nextTick);
-        pendingTxsPool.acquireLock();
+        pendingTxsPool.acquireLock(nextTick);
         for (unsigned int i = 0; i < numPendingTickTxs; ++i)
         {
 #if !defined(NDEBUG) && !defined(NO_UEFI)
@@ -4627,7 +5332,7 @@ static void prepareNextTickTransactions()
                 }
             }
         }
-        pendingTxsPool.releaseLock();
+        pendingTxsPool.releaseLock(nextTick);
 
         // At this point unknownTransactions is set to 1 for all transactions that are unknown
         // Update requestedTickTransactions the list of txs that not exist in memory so the MAIN loop can try to fetch them from peers
@@ -4789,7 +5494,7 @@ static void broadcastTickVotes()
 static void updateVotesCount(unsigned int& tickNumberOfComputors, unsigned int& tickTotalNumberOfComputors, m256i &outComputerDigest)
 {
     const unsigned int currentTickIndex = ts.tickToIndexCurrentEpoch(system.tick);
-    const Tick* tsCompTicks = ts.ticks.getByTickIndex(currentTickIndex);
+    const Tick* tsCompTicks = ts.ticks.pinByTickIndex(currentTickIndex);
     for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
     {
         ts.ticks.acquireLock(i);
@@ -4859,6 +5564,7 @@ static void updateVotesCount(unsigned int& tickNumberOfComputors, unsigned int&
         }
         ts.ticks.releaseLock(i);
     }
+    ts.ticks.unpinByTickIndex(currentTickIndex);
 }
 
 // try to resend tick votes if local system.tick gets stuck for too long
@@ -5003,7 +5709,8 @@ void reprocessSolutionTransaction(unsigned long long processorNumber)
     solutionTotalExecutionTicks = __rdtsc() - solutionProcessStartTick; // for tracking the time processing solutions
 
     ts.tickData.acquireLock();
-    TickData *currentTickData = ts.tickData.getByTickIfNotEmpty(system.tick);
+    unsigned int currentTickDataIndex;
+    TickData *currentTickData = ts.tickData.pinByTickIfNotEmpty(system.tick, currentTickDataIndex);
     for (unsigned int transactionIndex = 0; transactionIndex < NUMBER_OF_TRANSACTIONS_PER_TICK; transactionIndex++)
     {
         if (!isZero(currentTickData->transactionDigests[transactionIndex]))
@@ -5026,6 +5733,7 @@ void reprocessSolutionTransaction(unsigned long long processorNumber)
                         spectrum[spectrumIndex].incomingAmount -= transaction->amount;
                         spectrum[spectrumIndex].numberOfIncomingTransfers--;
                         spectrum[spectrumIndex].latestIncomingTransferTick = spectrumDataRollback[transactionIndex].latestIncomingTransferTick;
+                        markSpectrumEntityChanged(spectrumIndex);
 
                         spectrumInfo.totalAmount -= transaction->amount;
                         RELEASE(spectrumLock);
@@ -5045,6 +5753,10 @@ void reprocessSolutionTransaction(unsigned long long processorNumber)
             }
         }
     }
+    if (currentTickData)
+    {
+        ts.tickData.unpinByIndex(currentTickDataIndex);
+    }
     ts.tickData.releaseLock();
 }
 
@@ -5076,6 +5788,12 @@ static void tickProcessor(void*, unsigned long long processorNumber)
 
         checkinTime(processorNumber);
 
+        if (computorVerificationKeysMustBeUpdated)
+        {
+            computorVerificationKeysMustBeUpdated = false;
+            updateComputorVerificationKeys();
+        }
+
         bool mustSkip = false;
         const unsigned long long curTimeTick = __rdtsc();
         const unsigned int nextTick = system.tick + 1;
@@ -5196,34 +5914,8 @@ static void tickProcessor(void*, unsigned long long processorNumber)
                             etalonTick.saltedResourceTestingDigest = resourceTestingDigest;
 
                             // Update etalonTick.saltedSpectrumDigest
-                            unsigned int digestIndex;
                             ACQUIRE(spectrumLock);
-                            for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
-                            {
-                                if (spectrum[digestIndex].latestIncomingTransferTick == system.tick || spectrum[digestIndex].latestOutgoingTransferTick == system.tick)
-                                {
-                                    KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-                                    spectrumChangeFlags[digestIndex >> 6] |= (1ULL << (digestIndex & 63));
-                                }
-                            }
-                            unsigned int previousLevelBeginning = 0;
-                            unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-                            while (numberOfLeafs > 1)
-                            {
-                                for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-                                {
-                                    if (spectrumChangeFlags[i >> 6] & (3ULL << (i & 63)))
-                                    {
-                                        KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex]);
-                                        spectrumChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
-                                        spectrumChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
-                                    }
-                                    digestIndex++;
-                                }
-                                previousLevelBeginning += numberOfLeafs;
-                                numberOfLeafs >>= 1;
-                            }
-                            spectrumChangeFlags[0] = 0;
+                            updateSpectrumDigests();
 
                             etalonTick.saltedSpectrumDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
                             RELEASE(spectrumLock);
@@ -5695,6 +6387,50 @@ static void contractProcessorShutdownCallback(EFI_EVENT Event, void* Context)
 static bool loadComputer(CHAR16* directory, bool forceLoadFromFile)
 {
     logToConsole(L"Loading contract files ...");
+
+    // Read the contract files in parallel first, then check and log the results in order (the readers do not log
+    // errors themselves, because logging is not thread-safe)
+    long long loadedSizes[contractCount];
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
+    {
+        loadedSizes[contractIndex] = -1;
+#if CONTRACT_STATE_DIGEST_VERSION >= 2
+        if (contractDescriptions[contractIndex].constructionEpoch != system.epoch || forceLoadFromFile)
+        {
+            // Writes by the file system do not cause write faults
+            contractStateChunkDigests[contractIndex].markAllChanged();
+        }
+#endif
+    }
+    volatile long nextContractIndex = -1;
+    auto readContractFiles = [&]()
+        {
+            CHAR16 fileName[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0])];
+            setText(fileName, CONTRACT_FILE_NAME);
+            long contractIndex;
+            while ((contractIndex = _InterlockedIncrement(&nextContractIndex)) < (long)contractCount)
+            {
+                if (contractDescriptions[contractIndex].constructionEpoch == system.epoch && !forceLoadFromFile)
+                {
+                    continue;
+                }
+                fileName[sizeof(fileName) / sizeof(fileName[0]) - 9] = contractIndex / 1000 + L'0';
+                fileName[sizeof(fileName) / sizeof(fileName[0]) - 8] = (contractIndex % 1000) / 100 + L'0';
+                fileName[sizeof(fileName) / sizeof(fileName[0]) - 7] = (contractIndex % 100) / 10 + L'0';
+                fileName[sizeof(fileName) / sizeof(fileName[0]) - 6] = contractIndex % 10 + L'0';
+                loadedSizes[contractIndex] = loadParallel(fileName, contractDescriptions[contractIndex].stateSize, contractStates[contractIndex], directory, 8, false);
+            }
+        };
+    std::vector<std::thread> readers;
+    for (unsigned int i = 0; i < STARTUP_LOADER_THREADS && i < contractCount; i++)
+    {
+        readers.emplace_back(readContractFiles);
+    }
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+
     for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
     {
         CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 9] = contractIndex / 1000 + L'0';
@@ -5711,8 +6447,8 @@ static bool loadComputer(CHAR16* directory, bool forceLoadFromFile)
         }
         else
         {
-            long long loadedSize = load(CONTRACT_FILE_NAME, contractDescriptions[contractIndex].stateSize, contractStates[contractIndex], directory);
-            setText(message, L" -> "); // set the message after loading otherwise `message` will contain potential messages from load()
+            long long loadedSize = loadedSizes[contractIndex];
+            setText(message, L" -> ");
             appendText(message, CONTRACT_FILE_NAME);
             if (loadedSize != contractDescriptions[contractIndex].stateSize)
             {
@@ -5774,6 +6510,67 @@ static bool saveComputer(CHAR16* directory)
     return false;
 }
 
+#if TICK_STORAGE_AUTOSAVE_MODE
+// Mark the contract state changes since the last getComputerDigest() in contractStateSnapshotDeltas. Aux nodes do not
+// compute the digest in each tick, so these changes are only flagged in contractStateChangeFlags (and in the chunk
+// change flags with CONTRACT_STATE_DIGEST_VERSION 2).
+static void markUndigestedContractStateChanges()
+{
+#if CONTRACT_STATE_DIGEST_VERSION >= 2
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
+    {
+        ChunkedStateDigest& stateDigest = contractStateChunkDigests[contractIndex];
+        if ((contractStateChangeFlags[contractIndex >> 6] & (1ULL << (contractIndex & 63))) && !stateDigest.isWriteTracking())
+        {
+            stateDigest.markAllChanged();
+        }
+        contractStateSnapshotDeltas[contractIndex].markChanged(stateDigest.getChangeFlags());
+    }
+#else
+    markFlaggedArraysChanged(contractStateSnapshotDeltas, contractCount, contractStateChangeFlags);
+#endif
+}
+
+// Save the changed chunks of the contract states since the last base snapshot as delta files (see saveAllNodeStates())
+static bool saveComputerDelta(CHAR16* directory)
+{
+    logToConsole(L"Saving contract delta files...");
+
+    const unsigned long long beginningTick = __rdtsc();
+
+    markUndigestedContractStateChanges();
+
+    unsigned long long totalSize = 0;
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
+    {
+        const unsigned int changedChunks = contractStateSnapshotDeltas[contractIndex].countChanged();
+        if (!changedChunks)
+        {
+            continue;
+        }
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 9] = contractIndex / 1000 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 8] = (contractIndex % 1000) / 100 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 7] = (contractIndex % 100) / 10 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 6] = contractIndex % 10 + L'0';
+        contractStateLock[contractIndex].acquireRead();
+        bool saved = saveNodeStateArray(CONTRACT_FILE_NAME, contractStates[contractIndex], contractDescriptions[contractIndex].stateSize, &contractStateSnapshotDeltas[contractIndex], directory);
+        contractStateLock[contractIndex].releaseRead();
+        if (!saved)
+        {
+            return false;
+        }
+        totalSize += contractStateSnapshotDeltas[contractIndex].getDeltaSize(changedChunks);
+    }
+
+    setNumber(message, totalSize, TRUE);
+    appendText(message, L" bytes of the computer delta are saved (");
+    appendNumber(message, (__rdtsc() - beginningTick) * 1000000 / frequency, TRUE);
+    appendText(message, L" microseconds).");
+    logToConsole(message);
+    return true;
+}
+#endif
+
 static bool saveSystem(CHAR16* directory)
 {
     logToConsole(L"Saving system file...");
@@ -5859,8 +6656,6 @@ static bool initialize()
         if (!pendingTxsPool.init())
             return false;
 
-        setMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
-
         if (!initSpectrum())
             return false;
 
@@ -5871,14 +6666,31 @@ static bool initialize()
             return false;
 
         initContractExec();
+        if (!contractFunctionResultCache.init())
+            return false;
         for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
         {
             unsigned long long size = contractDescriptions[contractIndex].stateSize;
+#if CONTRACT_STATE_DIGEST_VERSION >= 2
+            if (!allocPoolWithErrorLog(L"contractStates", contractStateAllocationSize(size), (void**)&contractStates[contractIndex], __LINE__, true, true)
+                || !contractStateChunkDigests[contractIndex].init(contractStates[contractIndex], size, CONTRACT_STATE_DIGEST_CHUNK_SIZE, qVirtualProtect))
+            {
+                return false;
+            }
+#else
             if (!allocPoolWithErrorLog(L"contractStates",  size, (void**)&contractStates[contractIndex], __LINE__))
             {
                 return false;
             }
+#endif
+            if (!contractStateSnapshotDeltas[contractIndex].init(size, CONTRACT_STATE_DIGEST_CHUNK_SIZE))
+            {
+                return false;
+            }
         }
+#if CONTRACT_STATE_DIGEST_VERSION >= 2
+        qSetWriteFaultHandler(onContractStateWriteFault);
+#endif
 
         if (!allocPoolWithErrorLog(L"score", sizeof(*score), (void**)&score, __LINE__))
         {
@@ -5962,7 +6774,9 @@ static bool initialize()
             etalonTick.month = system.initialMonth;
             etalonTick.year = system.initialYear;
 
+            unsigned long long beginningTick = __rdtsc();
             loadSpectrum();
+            logStartupPhase(L"load spectrum", beginningTick);
 
 #ifdef TESTNET
             // Give 676 computors money
@@ -5990,30 +6804,34 @@ static bool initialize()
             constexpr bool canObmitLoadNodeState = false;
 #endif
 
-            {
-                const unsigned long long beginningTick = __rdtsc();
-
-                unsigned int digestIndex;
-                for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
-                {
-                    KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-                }
-                unsigned int previousLevelBeginning = 0;
-                unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-                while (numberOfLeafs > 1)
+            // Hash the spectrum (with all idle processors) while reading the universe and contract files
+            StartupDigestHelpers digestHelpers;
+            beginningTick = __rdtsc();
+            unsigned long long spectrumHashingTicks = 0;
+            std::thread spectrumHasher([&spectrumHashingTicks]()
                 {
-                    for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-                    {
-                        KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex++]);
-                    }
+                    const unsigned long long beginningTick = __rdtsc();
+                    rebuildSpectrumDigests();
+                    spectrumHashingTicks = __rdtsc() - beginningTick;
+                });
 
-                    previousLevelBeginning += numberOfLeafs;
-                    numberOfLeafs >>= 1;
-                }
+            logToConsole(L"Loading universe file ...");
+            bool loaded = loadUniverse() || canObmitLoadNodeState;
+            logStartupPhase(L"load universe", beginningTick);
+            if (loaded)
+            {
+                beginningTick = __rdtsc();
+                loaded = loadComputer() || canObmitLoadNodeState;
+                logStartupPhase(L"load computer", beginningTick);
+            }
+            spectrumHasher.join();
+            if (!loaded)
+                return false;
 
+            {
                 setNumber(message, SPECTRUM_CAPACITY * sizeof(EntityRecord), TRUE);
                 appendText(message, L" bytes of the spectrum data are hashed (");
-                appendNumber(message, (__rdtsc() - beginningTick) * 1000000 / frequency, TRUE);
+                appendNumber(message, spectrumHashingTicks * 1000000 / frequency, TRUE);
                 appendText(message, L" microseconds).");
                 logToConsole(message);
 
@@ -6029,25 +6847,24 @@ static bool initialize()
                 appendText(message, L").");
                 logToConsole(message);
             }
-            logToConsole(L"Loading universe file ...");
-            if (!loadUniverse() && (!canObmitLoadNodeState))
-                return false;
             m256i universeDigest;
             {
-                setText(message, L"Universe digest = ");
+                beginningTick = __rdtsc();
                 getUniverseDigest(universeDigest);
+                logStartupPhase(L"hash universe", beginningTick);
+                setText(message, L"Universe digest = ");
                 CHAR16 digestChars[60 + 1];
                 getIdentity(universeDigest.m256i_u8, digestChars, true);
                 appendText(message, digestChars);
                 appendText(message, L".");
                 logToConsole(message);
             }
-            if (!loadComputer() && (!canObmitLoadNodeState))
-                return false;
             m256i computerDigest;
             {
-                setText(message, L"Computer digest = ");
+                beginningTick = __rdtsc();
                 getComputerDigest(computerDigest);
+                logStartupPhase(L"hash computer", beginningTick);
+                setText(message, L"Computer digest = ");
                 CHAR16 digestChars[60 + 1];
                 getIdentity(computerDigest.m256i_u8, digestChars, true);
                 appendText(message, digestChars);
@@ -6236,11 +7053,18 @@ static void deinitialize()
 #endif
 
     deinitContractExec();
+    contractFunctionResultCache.deinit();
     for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
     {
+        contractStateSnapshotDeltas[contractIndex].deinit();
         if (contractStates[contractIndex])
         {
+#if CONTRACT_STATE_DIGEST_VERSION >= 2
+            contractStateChunkDigests[contractIndex].deinit();
+            qVirtualFree(contractStates[contractIndex], contractStateAllocationSize(contractDescriptions[contractIndex].stateSize));
+#else
             freePool(contractStates[contractIndex]);
+#endif
         }
     }
 
@@ -6275,14 +7099,6 @@ static void deinitialize()
         freePool(responseQueueBuffer);
     }
 
-    for (unsigned int processorIndex = 0; processorIndex < MAX_NUMBER_OF_PROCESSORS; processorIndex++)
-    {
-        if (processors[processorIndex].buffer)
-        {
-            freePool(processors[processorIndex].buffer);
-        }
-    }
-
     for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
     {
         if (peers[i].receiveBuffer)
@@ -6389,6 +7205,10 @@ static void logInfo()
     appendText(message, L" | Miss ");
     appendNumber(message, score->scoreCache.missCount(), TRUE);
 #endif
+    appendText(message, L" Function cache: Hit ");
+    appendNumber(message, contractFunctionResultCache.getHits(), TRUE);
+    appendText(message, L" | Miss ");
+    appendNumber(message, contractFunctionResultCache.getMisses(), TRUE);
     logToConsole(message);
     prevNumberOfProcessedRequests = numberOfProcessedRequests;
     prevNumberOfDiscardedRequests = numberOfDiscardedRequests;
@@ -6631,6 +7451,11 @@ static void logHealthStatus()
         logToConsole(L"WARNING: Developers should increase stack size!");
     }
 
+#if defined(USE_SWAP) && !(defined(USE_SWAP_MMAP) && defined(__linux__))
+    ts.logSwapCacheStatistics();
+#endif
+    logger.logCacheStatistics();
+
     setText(message, L"Contract status: ");
     bool anyContractError = false;
     for (int i = 0; i < contractCount; i++)
@@ -7187,12 +8012,6 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
             mpServicesProtocol->GetProcessorInfo(mpServicesProtocol, i, &processorInformation);
             if (processorInformation.StatusFlag == (PROCESSOR_ENABLED_BIT | PROCESSOR_HEALTH_STATUS_BIT))
             {
-                if (!allocPoolWithErrorLog(L"processor[i]", BUFFER_SIZE, &processors[numberOfProcessors].buffer, __LINE__))
-                {
-                    numberOfProcessors = 0;
-
-                    break;
-                }
                 if (!processors[numberOfProcessors].alloc(STACK_SIZE))
                 {
                     logToConsole(L"Failed to allocate stack for processor!");
@@ -7479,7 +8298,8 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                         requestedQuorumTick.header.randomizeDejavu();
                         requestedQuorumTick.requestQuorumTick.quorumTick.tick = system.tick;
                         setMem(&requestedQuorumTick.requestQuorumTick.quorumTick.voteFlags, sizeof(requestedQuorumTick.requestQuorumTick.quorumTick.voteFlags), 0);
-                        const Tick* tsCompTicks = ts.ticks.getByTickInCurrentEpoch(system.tick);
+                        const unsigned int tickIndex = ts.tickToIndexCurrentEpoch(system.tick);
+                        const Tick* tsCompTicks = ts.ticks.pinByTickIndex(tickIndex);
                         for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
                         {
                             if (tsCompTicks[i].epoch == system.epoch)
@@ -7487,6 +8307,7 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                                 requestedQuorumTick.requestQuorumTick.quorumTick.voteFlags[i >> 3] |= (1 << (i & 7));
                             }
                         }
+                        ts.ticks.unpinByTickIndex(tickIndex);
                         pushToAny(&requestedQuorumTick.header);
                         pushToAnyFullNode(&requestedQuorumTick.header);
                     }
@@ -7497,7 +8318,8 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                         requestedQuorumTick.header.randomizeDejavu();
                         requestedQuorumTick.requestQuorumTick.quorumTick.tick = system.tick + 1;
                         setMem(&requestedQuorumTick.requestQuorumTick.quorumTick.voteFlags, sizeof(requestedQuorumTick.requestQuorumTick.quorumTick.voteFlags), 0);
-                        const Tick* tsCompTicks = ts.ticks.getByTickInCurrentEpoch(system.tick + 1);
+                        const unsigned int tickIndex = ts.tickToIndexCurrentEpoch(system.tick + 1);
+                        const Tick* tsCompTicks = ts.ticks.pinByTickIndex(tickIndex);
                         for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
                         {
                             if (tsCompTicks[i].epoch == system.epoch)
@@ -7505,6 +8327,7 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                                 requestedQuorumTick.requestQuorumTick.quorumTick.voteFlags[i >> 3] |= (1 << (i & 7));
                             }
                         }
+                        ts.ticks.unpinByTickIndex(tickIndex);
                         pushToAny(&requestedQuorumTick.header);
                         pushToAnyFullNode(&requestedQuorumTick.header);
                     }
@@ -7629,23 +8452,48 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                         }
                     }
                 }
+#endif
+#ifdef __linux__
+                checkNodeStateSnapshot(false);
 #endif
                 if (requestPersistingNodeState == 1 && persistingNodeStateTickProcWaiting == 1)
                 {
-                    // Saving node state takes a lot of time -> Close peer connections before to signal that
-                    // the peers should connect to another node.
-                    for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
+#ifdef __linux__
+                    if (nodeStateSnapshotPid)
                     {
-                        closePeer(&peers[i]);
+                        // Only one save is queued, later requests are covered by it
+                        if (!nodeStateSnapshotPending)
+                        {
+                            logToConsole(L"Previous snapshot is still being saved, saving node state again when it has finished");
+                            nodeStateSnapshotPending = true;
+                        }
+                        ATOMIC_STORE32(requestPersistingNodeState, 0);
+                    }
+                    else if (startNodeStateSnapshot())
+                    {
+#ifdef ENABLE_PROFILING
+                        gProfilingDataCollector.writeToFile();
+#endif
+                        ATOMIC_STORE32(requestPersistingNodeState, 0);
                     }
+                    else
+#endif
+                    {
+                        // Saving node state takes a lot of time -> Close peer connections before to signal that
+                        // the peers should connect to another node.
+                        for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
+                        {
+                            closePeer(&peers[i]);
+                        }
 
-                    logToConsole(L"Saving node state...");
-                    saveAllNodeStates();
+                        logToConsole(L"Saving node state...");
+                        saveAllNodeStates();
 #ifdef ENABLE_PROFILING
-                    gProfilingDataCollector.writeToFile();
+                        gProfilingDataCollector.writeToFile();
 #endif
-                    ATOMIC_STORE32(requestPersistingNodeState, 0);
-                    logToConsole(L"Complete saving all node states");
+                        ATOMIC_STORE32(requestPersistingNodeState, 0);
+                        logToConsole(L"Complete saving all node states");
+                    }
                 }
 #if TICK_STORAGE_AUTOSAVE_MODE == 1
                 if (nextAutoSaveTickUpdated)
@@ -7745,6 +8593,15 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                 while (remainedItem > 0 && ((__rdtsc() - curTimeTick) * 1000000 / frequency < TARGET_MAINTHREAD_LOOP_DURATION));
             }
 
+#if TICK_STORAGE_AUTOSAVE_MODE && defined(__linux__)
+            // Do not request a queued save on shutdown
+            nodeStateSnapshotPending = false;
+            if (!checkNodeStateSnapshot(false))
+            {
+                logToConsole(L"Waiting for snapshot process ...");
+                checkNodeStateSnapshot(true);
+            }
+#endif
             saveSystem();
             score->saveScoreCache(system.epoch);
             saveCustomMiningCache(system.epoch);
@@ -7829,7 +8686,7 @@ unsigned long long getTotalRam()
     }
 
     // processor buffers
-    totalRam += MAX_NUMBER_OF_PROCESSORS_DYNAMIC * (BUFFER_SIZE + STACK_SIZE);
+    totalRam += MAX_NUMBER_OF_PROCESSORS_DYNAMIC * STACK_SIZE;
 
     // CustomMiningStorageProcBuffer
     totalRam += CUSTOM_MINING_STORAGE_PROCESSOR_MAX_STORAGE * MAX_NUMBER_OF_PROCESSORS_DYNAMIC;
@@ -7886,9 +8743,19 @@ void processArgs(int argc, const char* argv[]) {
         ("seeds", "Set seeds (IDs) to run on this node (only apply for main node)", cxxopts::value<std::string>())
         ("rp, reader-passcode", "Passcode to access log reader", cxxopts::value<std::string>())
         ("hp, http-passcode", "Passcode to access http server", cxxopts::value<std::string>())
-        ("s,security-tick", "Core will verify state after x tick, to reduce computational to the node", cxxopts::value<int>()->default_value("1"));
+        ("s,security-tick", "Core will verify state after x tick, to reduce computational to the node", cxxopts::value<int>()->default_value("1"))
+        ("compact-snapshot", "Fold the delta files of the snapshot of the given epoch into its base files and exit", cxxopts::value<int>());
     auto result = options.parse(argc, argv);
 
+    if (result.count("compact-snapshot")) {
+#if TICK_STORAGE_AUTOSAVE_MODE
+        exit(compactNodeStateSnapshot(result["compact-snapshot"].as<int>()) ? 0 : 1);
+#else
+        logColorToScreen("ERROR", "Snapshots are disabled (TICK_STORAGE_AUTOSAVE_MODE 0)");
+        exit(1);
+#endif
+    }
+
     if (result.count("peers")) {
         std::string peersStr = result["peers"].as<std::string>();
         std::vector<std::string> peerList;
@@ -0,0 +1,291 @@
+#pragma once
+
+#include "platform/memory_util.h"
+#include "platform/file_io.h"
+#include "platform/assert.h"
+
+
+// Incremental node state snapshots: large arrays (spectrum, universe, contract states, digest trees) are saved as
+// a full base file once and afterwards only as delta files with the records changed since the base. Deltas are
+// cumulative, so a snapshot is always restored from the base and the latest delta file.
+//
+// A delta file starts with SnapshotDeltaHeader, followed by numberOfChangedRecords record indices (unsigned int,
+// ascending, padded with zeros to a multiple of 8 bytes) and the records (recordSize bytes each, the last record of
+// the array is padded with zeros if totalSize is not a multiple of recordSize).
+struct SnapshotDeltaHeader
+{
+    static constexpr unsigned long long magicValue = 0x3130415444534e51ULL; // "QNSDTA01"
+
+    unsigned long long magic;
+    unsigned int baseEpoch;
+    unsigned int baseTick;
+    unsigned long long totalSize;
+    unsigned long long recordSize;
+    unsigned long long numberOfChangedRecords;
+};
+
+// Records of an array changed since the last base snapshot, one flag bit per record. Not thread-safe, the caller
+// has to make sure that the tracker is not changed concurrently (usually by holding the lock of the array).
+class SnapshotDeltaTracker
+{
+public:
+    bool init(unsigned long long totalSize, unsigned long long recordSize)
+    {
+        ASSERT(recordSize);
+        this->totalSize = totalSize;
+        this->recordSize = recordSize;
+        numberOfRecords = (unsigned int)((totalSize + recordSize - 1) / recordSize);
+        numberOfWords = (numberOfRecords + 63) / 64;
+        if (!numberOfWords)
+        {
+            return true;
+        }
+        if (!allocPoolWithErrorLog(L"snapshotDeltaFlags", numberOfWords * 8ULL, (void**)&flags, __LINE__))
+        {
+            return false;
+        }
+        markAllChanged();
+        return true;
+    }
+
+    void deinit()
+    {
+        if (flags)
+        {
+            freePool(flags);
+            flags = nullptr;
+        }
+        numberOfRecords = 0;
+        numberOfWords = 0;
+    }
+
+    unsigned int getNumberOfRecords() const
+    {
+        return numberOfRecords;
+    }
+
+    unsigned long long getRecordSize() const
+    {
+        return recordSize;
+    }
+
+    void markChanged(unsigned int recordIndex)
+    {
+        ASSERT(recordIndex < numberOfRecords);
+        flags[recordIndex >> 6] |= (1ULL << (recordIndex & 63));
+    }
+
+    // Mark the records flagged in changeFlags (one bit per record, such as spectrumChangeFlags)
+    void markChanged(const unsigned long long* changeFlags)
+    {
+        for (unsigned int wordIndex = 0; wordIndex < numberOfWords; wordIndex++)
+        {
+            flags[wordIndex] |= changeFlags[wordIndex];
+        }
+    }
+
+    // Mark the records overlapping with size bytes starting at offset
+    void markChangedBytes(unsigned long long offset, unsigned long long size)
+    {
+        if (!size)
+        {
+            return;
+        }
+        const unsigned int end = (unsigned int)((offset + size - 1) / recordSize);
+        for (unsigned int recordIndex = (unsigned int)(offset / recordSize); recordIndex <= end && recordIndex < numberOfRecords; recordIndex++)
+        {
+            markChanged(recordIndex);
+        }
+    }
+
+    void markAllChanged()
+    {
+        if (!numberOfWords)
+        {
+            return;
+        }
+        setMem(flags, numberOfWords * 8ULL, 0xFF);
+        if (numberOfRecords & 63)
+        {
+            flags[numberOfWords - 1] = (1ULL << (numberOfRecords & 63)) - 1;
+        }
+    }
+
+    // Forget all changes, called when a base snapshot has been saved
+    void clear()
+    {
+        if (numberOfWords)
+        {
+            setMem(flags, numberOfWords * 8ULL, 0);
+        }
+    }
+
+    bool isChanged(unsigned int recordIndex) const
+    {
+        return (flags[recordIndex >> 6] >> (recordIndex & 63)) & 1;
+    }
+
+    unsigned int countChanged() const
+    {
+        unsigned long long count = 0;
+        for (unsigned int wordIndex = 0; wordIndex < numberOfWords; wordIndex++)
+        {
+            count += _mm_popcnt_u64(flags[wordIndex]);
+        }
+        return (unsigned int)count;
+    }
+
+    // Replace the flags of this tracker of a digest tree (see DigestTreeBuilder, one record per digest) by the
+    // flags of all nodes that have a changed leaf in leafs (the tracker of the array the tree is computed of).
+    void markTreeOfChangedLeafs(const SnapshotDeltaTracker& leafs)
+    {
+        ASSERT(numberOfRecords == leafs.numberOfRecords * 2 - 1);
+        clear();
+        copyMem(flags, leafs.flags, leafs.numberOfWords * 8ULL);
+        unsigned int levelBeginning = 0;
+        for (unsigned int levelSize = leafs.numberOfRecords; levelSize > 1; levelSize >>= 1)
+        {
+            for (unsigned int i = 0; i < levelSize; i += 2)
+            {
+                if (!((levelBeginning + i) & 63) && i + 64 <= levelSize && !flags[(levelBeginning + i) >> 6])
+                {
+                    // Skip 64 unchanged nodes at once
+                    i += 62;
+                    continue;
+                }
+                if (isChanged(levelBeginning + i) || isChanged(levelBeginning + i + 1))
+                {
+                    markChanged(levelBeginning + levelSize + (i >> 1));
+                }
+            }
+            levelBeginning += levelSize;
+        }
+    }
+
+    // Size of the delta file saved by saveDelta()
+    unsigned long long getDeltaSize(unsigned int numberOfChangedRecords) const
+    {
+        return sizeof(SnapshotDeltaHeader) + ((numberOfChangedRecords * 4ULL + 7) & ~7ULL) + numberOfChangedRecords * recordSize;
+    }
+
+    // Save the changed records of data (the tracked array) to a delta file relative to the base snapshot of the
+    // given epoch and tick. Returns false on error.
+    bool saveDelta(CHAR16* fileName, const unsigned char* data, unsigned int baseEpoch, unsigned int baseTick, CHAR16* directory = NULL) const
+    {
+        const unsigned int numberOfChangedRecords = countChanged();
+        const unsigned long long deltaSize = getDeltaSize(numberOfChangedRecords);
+        unsigned char* buffer = nullptr;
+        if (!allocPoolWithErrorLog(L"snapshotDeltaBuffer", deltaSize, (void**)&buffer, __LINE__))
+        {
+            return false;
+        }
+        SnapshotDeltaHeader* header = (SnapshotDeltaHeader*)buffer;
+        header->magic = SnapshotDeltaHeader::magicValue;
+        header->baseEpoch = baseEpoch;
+        header->baseTick = baseTick;
+        header->totalSize = totalSize;
+        header->recordSize = recordSize;
+        header->numberOfChangedRecords = numberOfChangedRecords;
+        unsigned int* indices = (unsigned int*)(buffer + sizeof(SnapshotDeltaHeader));
+        unsigned char* records = buffer + sizeof(SnapshotDeltaHeader) + ((numberOfChangedRecords * 4ULL + 7) & ~7ULL);
+        unsigned int count = 0;
+        for (unsigned int wordIndex = 0; wordIndex < numberOfWords; wordIndex++)
+        {
+            unsigned long long wordFlags = flags[wordIndex];
+            while (wordFlags)
+            {
+                const unsigned int recordIndex = (wordIndex << 6) + (unsigned int)_tzcnt_u64(wordFlags);
+                const unsigned long long offset = recordIndex * recordSize;
+                const unsigned long long size = (totalSize - offset < recordSize) ? totalSize - offset : recordSize;
+                indices[count] = recordIndex;
+                copyMem(records + count * recordSize, data + offset, size);
+                if (size < recordSize)
+                {
+                    setMem(records + count * recordSize + size, recordSize - size, 0);
+                }
+                count++;
+                wordFlags &= wordFlags - 1;
+            }
+        }
+        if (count & 1)
+        {
+            indices[count] = 0;
+        }
+        const bool saved = (save(fileName, deltaSize, buffer, directory) == (long long)deltaSize);
+        freePool(buffer);
+        return saved;
+    }
+
+private:
+    unsigned long long totalSize = 0;
+    unsigned long long recordSize = 0;
+    unsigned int numberOfRecords = 0;
+    unsigned int numberOfWords = 0;
+    unsigned long long* flags = nullptr;
+};
+
+// Mark all records of the arrays flagged in arrayChangeFlags (one bit per array, such as contractStateChangeFlags)
+// as changed in their trackers. For arrays whose changes are only known as a whole.
+static void markFlaggedArraysChanged(SnapshotDeltaTracker* trackers, unsigned int numberOfArrays, const unsigned long long* arrayChangeFlags)
+{
+    for (unsigned int arrayIndex = 0; arrayIndex < numberOfArrays; arrayIndex++)
+    {
+        if (arrayChangeFlags[arrayIndex >> 6] & (1ULL << (arrayIndex & 63)))
+        {
+            trackers[arrayIndex].markAllChanged();
+        }
+    }
+}
+
+// Apply the delta (the content of a delta file of deltaSize bytes) to data (the array of totalSize bytes, loaded from
+// the base snapshot of the given epoch and tick). Returns false if the delta is invalid or of another base.
+static bool applySnapshotDelta(const unsigned char* delta, unsigned long long deltaSize, unsigned char* data, unsigned long long totalSize, unsigned int baseEpoch, unsigned int baseTick)
+{
+    if (deltaSize < sizeof(SnapshotDeltaHeader))
+    {
+        return false;
+    }
+    const SnapshotDeltaHeader* header = (const SnapshotDeltaHeader*)delta;
+    if (header->magic != SnapshotDeltaHeader::magicValue
+        || header->baseEpoch != baseEpoch || header->baseTick != baseTick
+        || header->totalSize != totalSize || !header->recordSize
+        || header->numberOfChangedRecords > (totalSize + header->recordSize - 1) / header->recordSize
+        || sizeof(SnapshotDeltaHeader) + ((header->numberOfChangedRecords * 4ULL + 7) & ~7ULL) + header->numberOfChangedRecords * header->recordSize != deltaSize)
+    {
+        return false;
+    }
+    const unsigned long long recordSize = header->recordSize;
+    const unsigned int* indices = (const unsigned int*)(delta + sizeof(SnapshotDeltaHeader));
+    const unsigned char* records = delta + sizeof(SnapshotDeltaHeader) + ((header->numberOfChangedRecords * 4ULL + 7) & ~7ULL);
+    for (unsigned long long i = 0; i < header->numberOfChangedRecords; i++)
+    {
+        const unsigned long long offset = indices[i] * recordSize;
+        if (offset >= totalSize)
+        {
+            return false;
+        }
+        const unsigned long long size = (totalSize - offset < recordSize) ? totalSize - offset : recordSize;
+        copyMem(data + offset, records + i * recordSize, size);
+    }
+    return true;
+}
+
+// Apply the delta file to data (see applySnapshotDelta()). Returns 1 if the delta has been applied, 0 if there is no
+// delta file, and -1 on error (such as a delta of another base).
+static int loadSnapshotDelta(CHAR16* fileName, unsigned char* data, unsigned long long totalSize, unsigned int baseEpoch, unsigned int baseTick, CHAR16* directory = NULL)
+{
+    const long long fileSize = getFileSize(fileName, directory);
+    if (fileSize < 0)
+    {
+        return 0;
+    }
+    unsigned char* buffer = nullptr;
+    if (!allocPoolWithErrorLog(L"snapshotDeltaBuffer", fileSize ? fileSize : 1, (void**)&buffer, __LINE__))
+    {
+        return -1;
+    }
+    const bool applied = load(fileName, fileSize, buffer, directory) == fileSize
+        && applySnapshotDelta(buffer, fileSize, data, totalSize, baseEpoch, baseTick);
+    freePool(buffer);
+    return applied ? 1 : -1;
+}
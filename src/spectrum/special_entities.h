@@ -6,6 +6,7 @@
 #include "network_messages/computors.h"
 
 #include "four_q.h"
+#include "digest_tree.h"
 #include "private_settings.h"
 #include "public_settings.h"
 
@@ -21,6 +22,65 @@ GLOBAL_VAR_DECL m256i dispatcherPublicKey;
 
 GLOBAL_VAR_DECL BroadcastComputors broadcastedComputors;
 
+// Verification keys of the computors in broadcastedComputors, so verifying tick votes and tick data does not
+// decode the public key and compute its tables for each signature. An entry is only used if its public key
+// matches the current computor list. The sequence is odd while the entry is being written.
+struct ComputorVerificationKey
+{
+    volatile long long sequence;
+    bool valid;
+    VerificationKey key;
+};
+
+GLOBAL_VAR_DECL ComputorVerificationKey computorVerificationKeys[NUMBER_OF_COMPUTORS];
+
+// Prepare the verification keys of all computors in broadcastedComputors in parallel (see DigestTreeBuilder).
+// Call after changing the computor list.
+static void updateComputorVerificationKeys()
+{
+    constexpr unsigned int computorsPerTask = 26;
+    static_assert(NUMBER_OF_COMPUTORS % computorsPerTask == 0, "NUMBER_OF_COMPUTORS must be a multiple of computorsPerTask");
+    auto prepareKeys = [](unsigned int taskIndex)
+    {
+        for (unsigned int i = taskIndex * computorsPerTask; i < (taskIndex + 1) * computorsPerTask; i++)
+        {
+            ComputorVerificationKey& entry = computorVerificationKeys[i];
+            const long long sequence = entry.sequence;
+            if ((sequence & 1) || _InterlockedCompareExchange64(&entry.sequence, sequence + 1, sequence) != sequence)
+            {
+                // Another processor is writing this entry, verifyComputorSignature() falls back to verify() if it is outdated
+                continue;
+            }
+            entry.key.publicKey = broadcastedComputors.computors.publicKeys[i];
+            entry.valid = prepareVerificationKey(entry.key.publicKey.m256i_u8, entry.key);
+            COMPILER_BARRIER();
+            entry.sequence = sequence + 2;
+        }
+    };
+    digestTreeBuilder.run(NUMBER_OF_COMPUTORS / computorsPerTask, prepareKeys);
+}
+
+// Same result as verify() with the public key of the computor in broadcastedComputors
+static bool verifyComputorSignature(unsigned int computorIndex, const unsigned char* messageDigest, const unsigned char* signature)
+{
+    const ComputorVerificationKey& entry = computorVerificationKeys[computorIndex];
+    const m256i& publicKey = broadcastedComputors.computors.publicKeys[computorIndex];
+
+    const long long sequence = entry.sequence;
+    COMPILER_BARRIER();
+    if (!(sequence & 1) && entry.valid && entry.key.publicKey == publicKey)
+    {
+        const bool result = verifyWithKey(entry.key, messageDigest, signature);
+        COMPILER_BARRIER();
+        if (entry.sequence == sequence)
+        {
+            return result;
+        }
+    }
+
+    return verify(publicKey.m256i_u8, messageDigest, signature);
+}
+
 
 static bool initSpecialEntities()
 {
@@ -47,6 +107,7 @@ static bool initSpecialEntities()
     getPublicKeyFromIdentity((const unsigned char*)DISPATCHER, dispatcherPublicKey.m256i_u8);
 
     setMem(&broadcastedComputors, sizeof(broadcastedComputors), 0);
+    setMem(computorVerificationKeys, sizeof(computorVerificationKeys), 0);
 
     return true;
 }
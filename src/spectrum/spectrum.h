@@ -16,9 +16,15 @@
 #include "system.h"
 #include "kangaroo_twelve.h"
 #include "common_buffers.h"
+#include "digest_tree.h"
+#include "snapshot_delta.h"
 
 GLOBAL_VAR_DECL volatile char spectrumLock GLOBAL_VAR_INIT(0);
 GLOBAL_VAR_DECL EntityRecord* spectrum GLOBAL_VAR_INIT(nullptr);
+
+// Sequence counter of the hash map layout for lock-free lookups in spectrumIndex() (seqlock). It is odd while an entity
+// is inserted or entities are moved. Only writers holding spectrumLock change it.
+GLOBAL_VAR_DECL volatile long long spectrumLayoutSequence GLOBAL_VAR_INIT(0);
 GLOBAL_VAR_DECL struct SpectrumInfo {
     unsigned int numberOfEntities = 0;  // Number of entities in the spectrum hash map, may include entries with balance == 0
     unsigned long long totalAmount = 0; // Total amount of qubics in the spectrum
@@ -31,8 +37,37 @@ GLOBAL_VAR_DECL unsigned long long dustThresholdBurnAll GLOBAL_VAR_INIT(0), dust
 GLOBAL_VAR_DECL m256i* spectrumDigests GLOBAL_VAR_INIT(nullptr);
 static constexpr unsigned long long spectrumDigestsSizeInByte = (SPECTRUM_CAPACITY * 2 - 1) * 32ULL;
 
+// Sequence counter of spectrumDigests for lock-free reads in getSpectrumSiblings() (seqlock). It is odd while the digests
+// are updated. Only writers holding spectrumLock change it. Between two updates, spectrumDigests is an immutable snapshot.
+GLOBAL_VAR_DECL volatile long long spectrumDigestsSequence GLOBAL_VAR_INIT(0);
+
+// Direct-mapped cache of the siblings of recently requested entities (see getSpectrumSiblings()). Changing any entity
+// changes the siblings of all other entities, so an entry is only valid for the spectrumDigestsSequence it was read at.
+struct SpectrumSiblingsCacheEntry
+{
+    volatile long long sequence; // Odd while the entry is being written
+    long long digestsSequence;
+    int spectrumIndex;
+    m256i siblings[SPECTRUM_DEPTH];
+};
+static constexpr unsigned int SPECTRUM_SIBLINGS_CACHE_SIZE = 4096; // Must be 2^N
+GLOBAL_VAR_DECL SpectrumSiblingsCacheEntry* spectrumSiblingsCache GLOBAL_VAR_INIT(nullptr);
+
 GLOBAL_VAR_DECL unsigned long long spectrumReorgTotalExecutionTicks GLOBAL_VAR_INIT(0);
 
+// Change tracking for incremental update of spectrumDigests (see updateSpectrumDigests()), protected by spectrumLock.
+// One flag bit per entity that has been changed since the last digest update. During the update, the same bits are
+// used for flagging changed nodes of each level of the digest tree.
+GLOBAL_VAR_DECL unsigned long long spectrumChangeFlags[SPECTRUM_CAPACITY / (sizeof(unsigned long long) * 8)];
+// Indices of entities changed since last digest update (without duplicates). If more entities are changed than
+// fit into the list, spectrumChangeListOverflow is set and the update falls back to scanning spectrumChangeFlags.
+static constexpr unsigned int SPECTRUM_CHANGE_LIST_CAPACITY = 65536;
+GLOBAL_VAR_DECL unsigned int spectrumChangeList[SPECTRUM_CHANGE_LIST_CAPACITY];
+GLOBAL_VAR_DECL unsigned int spectrumChangeListSize GLOBAL_VAR_INIT(0);
+GLOBAL_VAR_DECL bool spectrumChangeListOverflow GLOBAL_VAR_INIT(false);
+// Entities changed since the last base snapshot of the node states, updated together with spectrumDigests
+GLOBAL_VAR_DECL SnapshotDeltaTracker spectrumSnapshotDelta;
+
 
 // Update SpectrumInfo data (exensive, because it iterates the whole spectrum), acquire no lock
 static void updateSpectrumInfo(SpectrumInfo& si = spectrumInfo)
@@ -109,6 +144,43 @@ static void logSpectrumStats()
     logger.logSpectrumStats(spectrumStats);
 }
 
+// Mark entity as changed, so its digest is updated by next call of updateSpectrumDigests(). Caller must hold spectrumLock.
+static void markSpectrumEntityChanged(unsigned int index)
+{
+    unsigned long long& flags = spectrumChangeFlags[index >> 6];
+    const unsigned long long flag = 1ULL << (index & 63);
+    if (!(flags & flag))
+    {
+        flags |= flag;
+        if (spectrumChangeListSize < SPECTRUM_CHANGE_LIST_CAPACITY)
+        {
+            spectrumChangeList[spectrumChangeListSize++] = index;
+        }
+        else
+        {
+            spectrumChangeListOverflow = true;
+        }
+    }
+}
+
+// Forget all tracked changes, for example because all digests have been recomputed. Caller must hold spectrumLock.
+static void clearSpectrumChanges()
+{
+    if (spectrumChangeListOverflow)
+    {
+        setMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
+    }
+    else
+    {
+        for (unsigned int i = 0; i < spectrumChangeListSize; i++)
+        {
+            spectrumChangeFlags[spectrumChangeList[i] >> 6] = 0;
+        }
+    }
+    spectrumChangeListSize = 0;
+    spectrumChangeListOverflow = false;
+}
+
 // Build and log variable-size DustBurning log message.
 // Assumes to be used tick processor or contract processor only, so can use reorgBuffer.
 struct DustBurnLogger
@@ -142,52 +214,280 @@ private:
     DustBurning* buf;
 };
 
-// Clean up spectrum hash map, removing all entities with balance 0. Updates spectrumInfo.
-static void reorganizeSpectrum()
+// Compute all spectrumDigests from scratch, using the idle processors helping digestTreeBuilder, and clear the
+// change tracking state.
+static void rebuildSpectrumDigests()
 {
     PROFILE_SCOPE();
 
-    unsigned long long spectrumReorgStartTick = __rdtsc();
+    auto hashEntities = [](unsigned int begin, unsigned int count)
+    {
+        KangarooTwelve64To32Batch(&spectrum[begin], &spectrumDigests[begin], count);
+    };
+    ATOMIC_INC64(spectrumDigestsSequence);
+    digestTreeBuilder.buildTree(spectrumDigests, SPECTRUM_CAPACITY, hashEntities);
+    ATOMIC_INC64(spectrumDigestsSequence);
+
+    // Entities may have been moved, so the next snapshot has to be a base snapshot
+    spectrumSnapshotDelta.markAllChanged();
+    clearSpectrumChanges();
+}
+
+// Update spectrumDigests of all entities changed since the last call and of their ancestors in the digest tree.
+// The cost depends on the number of changed entities, not on SPECTRUM_CAPACITY. Caller must hold spectrumLock.
+static void updateSpectrumDigests()
+{
+    PROFILE_SCOPE();
+
+    if (!spectrumChangeListSize && !spectrumChangeListOverflow)
+    {
+        // Nothing changed, keep spectrumDigestsSequence to keep the cached siblings valid
+        return;
+    }
+
+    ATOMIC_INC64(spectrumDigestsSequence);
+
+    if (!spectrumChangeListOverflow)
+    {
+        // Regular case: walk up the tree from the listed entities, only touching changed nodes
+        KangarooTwelve64To32Queue queue;
+        const unsigned int listSize = spectrumChangeListSize;
+        for (unsigned int i = 0; i < listSize; i++)
+        {
+            const unsigned int index = spectrumChangeList[i];
+            queue.push(&spectrum[index], &spectrumDigests[index]);
+            spectrumSnapshotDelta.markChanged(index);
+        }
+        queue.flush();
+        DigestTreeBuilder::updateAncestors(spectrumDigests, SPECTRUM_CAPACITY, spectrumChangeList, listSize, spectrumChangeFlags);
+    }
+    else
+    {
+        // Too many changes for the list: scan flags, skipping 64 unchanged nodes at once and distributing
+        // the hashing of larger levels to the processors helping digestTreeBuilder
+        auto hashEntity = [](unsigned int index)
+        {
+            KangarooTwelve64To32(&spectrum[index], &spectrumDigests[index]);
+        };
+        spectrumSnapshotDelta.markChanged(spectrumChangeFlags);
+        digestTreeBuilder.updateTree(spectrumDigests, SPECTRUM_CAPACITY, spectrumChangeFlags, hashEntity);
+    }
+
+    // Only the root flag is left
+    spectrumChangeFlags[0] = 0;
+    spectrumChangeListSize = 0;
+    spectrumChangeListOverflow = false;
+
+    ATOMIC_INC64(spectrumDigestsSequence);
+}
+
+// Get the siblings of the entity at spectrumIndex in the digest tree of the last digest update without acquiring
+// spectrumLock, so entity requests don't contend with the tick processor. Hot entities are served from
+// spectrumSiblingsCache.
+static void getSpectrumSiblings(int spectrumIndex, m256i siblings[SPECTRUM_DEPTH])
+{
+    SpectrumSiblingsCacheEntry& entry = spectrumSiblingsCache[spectrumIndex & (SPECTRUM_SIBLINGS_CACHE_SIZE - 1)];
+    while (true)
+    {
+        const long long digestsSequence = spectrumDigestsSequence;
+        if (digestsSequence & 1)
+        {
+            // Digests are being updated
+            _mm_pause();
+            continue;
+        }
+        COMPILER_BARRIER();
+
+        const long long entrySequence = entry.sequence;
+        COMPILER_BARRIER();
+        if (!(entrySequence & 1) && entry.spectrumIndex == spectrumIndex && entry.digestsSequence == digestsSequence)
+        {
+            copyMem(siblings, entry.siblings, sizeof(entry.siblings));
+            COMPILER_BARRIER();
+            if (entry.sequence == entrySequence)
+            {
+                return;
+            }
+        }
+
+        getSiblings<SPECTRUM_DEPTH>(spectrumIndex, spectrumDigests, siblings);
+        COMPILER_BARRIER();
+        if (spectrumDigestsSequence != digestsSequence)
+        {
+            continue;
+        }
+
+        // Cache siblings unless another processor is writing the entry
+        if (!(entrySequence & 1) && _InterlockedCompareExchange64(&entry.sequence, entrySequence + 1, entrySequence) == entrySequence)
+        {
+            entry.spectrumIndex = spectrumIndex;
+            entry.digestsSequence = digestsSequence;
+            copyMem(entry.siblings, siblings, sizeof(entry.siblings));
+            COMPILER_BARRIER();
+            entry.sequence = entrySequence + 2;
+        }
+        return;
+    }
+}
+
+// Start changing hash map layout, making concurrent spectrumIndex() calls wait or retry. Caller must hold spectrumLock.
+static void beginSpectrumLayoutChange()
+{
+    ATOMIC_INC64(spectrumLayoutSequence);
+}
+
+// Finish changing hash map layout. Caller must hold spectrumLock.
+static void endSpectrumLayoutChange()
+{
+    ATOMIC_INC64(spectrumLayoutSequence);
+}
+
+// Maximum number of entities that wrapped around the end of the hash map for compactSpectrumInPlace()
+static constexpr unsigned int SPECTRUM_COMPACTION_BUFFER_CAPACITY = 4096;
+
+// Remove all entities with balance 0 from the hash map in place, marking changed entries for updateSpectrumDigests().
+// The resulting layout is identical to reinserting all entities with balance != 0 into an empty hash map in the order
+// of their current indices. Thus, entities only move to lower indices, except for the ones at the beginning of the
+// hash map that had wrapped around the end. Entries at indices that have not been processed yet are kept in a small
+// buffer until the compaction reaches them. Returns false without changing anything if this buffer may be too small.
+// Caller must hold spectrumLock.
+static bool compactSpectrumInPlace()
+{
+    // Entities that wrapped around are in the run of occupied entries at the beginning. The number of buffered entries
+    // never exceeds their number, because only these and entities replaced by a buffered entry can move forward.
+    unsigned int wrappedCount = 0;
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY && !isZero(spectrum[i].publicKey); i++)
+    {
+        if ((spectrum[i].publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1)) > i)
+        {
+            wrappedCount++;
+        }
+    }
+    if (wrappedCount > SPECTRUM_COMPACTION_BUFFER_CAPACITY)
+    {
+        return false;
+    }
 
-    EntityRecord* reorgSpectrum = (EntityRecord*)reorgBuffer;
-    setMem(reorgSpectrum, SPECTRUM_CAPACITY * sizeof(EntityRecord), 0);
+    EntityRecord* aheadEntities = (EntityRecord*)reorgBuffer;
+    unsigned int* aheadIndices = (unsigned int*)(aheadEntities + SPECTRUM_COMPACTION_BUFFER_CAPACITY);
+    unsigned int aheadCount = 0;
+    auto findAhead = [&](unsigned int index) -> int
+    {
+        for (unsigned int j = 0; j < aheadCount; j++)
+        {
+            if (aheadIndices[j] == index)
+            {
+                return j;
+            }
+        }
+        return -1;
+    };
+
+    EntityRecord entity;
     for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
     {
-        if (spectrum[i].incomingAmount - spectrum[i].outgoingAmount)
+        const int aheadPos = aheadCount ? findAhead(i) : -1;
+
+        // Find new index of entity i (if kept), checking if entries of the compacted hash map are free. Entries
+        // before i are already final, entry i is only occupied by a buffered entity, later ones if buffered.
+        const bool keep = (spectrum[i].incomingAmount - spectrum[i].outgoingAmount) != 0;
+        unsigned int newIndex = 0;
+        if (keep)
+        {
+            newIndex = spectrum[i].publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
+            while ((newIndex < i) ? !isZero(spectrum[newIndex].publicKey) : (newIndex == i) ? aheadPos >= 0 : findAhead(newIndex) >= 0)
+            {
+                newIndex = (newIndex + 1) & (SPECTRUM_CAPACITY - 1);
+            }
+            if (newIndex == i)
+            {
+                continue;
+            }
+            copyMem(&entity, &spectrum[i], sizeof(EntityRecord));
+        }
+
+        // Set final entry i
+        if (aheadPos >= 0)
+        {
+            copyMem(&spectrum[i], &aheadEntities[aheadPos], sizeof(EntityRecord));
+            aheadCount--;
+            copyMem(&aheadEntities[aheadPos], &aheadEntities[aheadCount], sizeof(EntityRecord));
+            aheadIndices[aheadPos] = aheadIndices[aheadCount];
+            markSpectrumEntityChanged(i);
+        }
+        else if (!isZero(spectrum[i].publicKey))
         {
-            unsigned int index = spectrum[i].publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
+            setMem(&spectrum[i], sizeof(EntityRecord), 0);
+            markSpectrumEntityChanged(i);
+        }
 
-        iteration:
-            if (isZero(reorgSpectrum[index].publicKey))
+        // Move entity i
+        if (keep)
+        {
+            if (newIndex < i)
             {
-                copyMem(&reorgSpectrum[index], &spectrum[i], sizeof(EntityRecord));
+                copyMem(&spectrum[newIndex], &entity, sizeof(EntityRecord));
+                markSpectrumEntityChanged(newIndex);
             }
             else
             {
-                index = (index + 1) & (SPECTRUM_CAPACITY - 1);
-
-                goto iteration;
+                ASSERT(aheadCount < SPECTRUM_COMPACTION_BUFFER_CAPACITY);
+                copyMem(&aheadEntities[aheadCount], &entity, sizeof(EntityRecord));
+                aheadIndices[aheadCount] = newIndex;
+                aheadCount++;
             }
         }
     }
-    copyMem(spectrum, reorgSpectrum, SPECTRUM_CAPACITY * sizeof(EntityRecord));
+    ASSERT(aheadCount == 0);
+
+    return true;
+}
+
+// Clean up spectrum hash map, removing all entities with balance 0. Updates spectrumInfo and spectrumDigests.
+// Caller must hold spectrumLock.
+static void reorganizeSpectrum()
+{
+    PROFILE_SCOPE();
+
+    unsigned long long spectrumReorgStartTick = __rdtsc();
 
-    unsigned int digestIndex;
-    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
+    beginSpectrumLayoutChange();
+    if (compactSpectrumInPlace())
     {
-        KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
+        endSpectrumLayoutChange();
+
+        // Only rehash the entries that have changed
+        updateSpectrumDigests();
     }
-    unsigned int previousLevelBeginning = 0;
-    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-    while (numberOfLeafs > 1)
+    else
     {
-        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+        // Rare fallback: rebuild hash map in reorgBuffer
+        EntityRecord* reorgSpectrum = (EntityRecord*)reorgBuffer;
+        setMem(reorgSpectrum, SPECTRUM_CAPACITY * sizeof(EntityRecord), 0);
+        for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
         {
-            KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex++]);
+            if (spectrum[i].incomingAmount - spectrum[i].outgoingAmount)
+            {
+                unsigned int index = spectrum[i].publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
+
+            iteration:
+                if (isZero(reorgSpectrum[index].publicKey))
+                {
+                    copyMem(&reorgSpectrum[index], &spectrum[i], sizeof(EntityRecord));
+                }
+                else
+                {
+                    index = (index + 1) & (SPECTRUM_CAPACITY - 1);
+
+                    goto iteration;
+                }
+            }
         }
+        copyMem(spectrum, reorgSpectrum, SPECTRUM_CAPACITY * sizeof(EntityRecord));
+        endSpectrumLayoutChange();
 
-        previousLevelBeginning += numberOfLeafs;
-        numberOfLeafs >>= 1;
+        // Entities have moved, so all digests need to be recomputed
+        rebuildSpectrumDigests();
     }
 
     updateSpectrumInfo();
@@ -195,6 +495,8 @@ static void reorganizeSpectrum()
     spectrumReorgTotalExecutionTicks += __rdtsc() - spectrumReorgStartTick;
 }
 
+// Return index of entity in spectrum hash map or -1 if not found. The lookup is lock-free, so concurrent lookups
+// neither wait for each other nor for spectrumLock. It is retried if the layout changes meanwhile (seqlock).
 static int spectrumIndex(const m256i& publicKey)
 {
     if (isZero(publicKey))
@@ -202,30 +504,38 @@ static int spectrumIndex(const m256i& publicKey)
         return -1;
     }
 
-    unsigned int index = publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
-
-    ACQUIRE(spectrumLock);
-
-iteration:
-    if (spectrum[index].publicKey == publicKey)
+    while (true)
     {
-        RELEASE(spectrumLock);
-
-        return index;
-    }
-    else
-    {
-        if (isZero(spectrum[index].publicKey))
+        const long long sequence = spectrumLayoutSequence;
+        if (sequence & 1)
         {
-            RELEASE(spectrumLock);
-
-            return -1;
+            // Layout is being changed
+            _mm_pause();
+            continue;
         }
-        else
+        COMPILER_BARRIER();
+
+        // Probe at most SPECTRUM_CAPACITY entries, because the slots may be inconsistent if layout changes meanwhile
+        int result = -1;
+        unsigned int index = publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
+        for (unsigned int probes = 0; probes < SPECTRUM_CAPACITY; probes++)
         {
+            if (spectrum[index].publicKey == publicKey)
+            {
+                result = index;
+                break;
+            }
+            if (isZero(spectrum[index].publicKey))
+            {
+                break;
+            }
             index = (index + 1) & (SPECTRUM_CAPACITY - 1);
+        }
 
-            goto iteration;
+        COMPILER_BARRIER();
+        if (spectrumLayoutSequence == sequence)
+        {
+            return result;
         }
     }
 }
@@ -328,6 +638,7 @@ static void increaseEnergy(const m256i& publicKey, long long amount, bool isGene
             spectrum[index].incomingAmount += amount;
             spectrum[index].numberOfIncomingTransfers++;
             spectrum[index].latestIncomingTransferTick = system.tick;
+            markSpectrumEntityChanged(index);
 
             spectrumInfo.totalAmount += amount;
         }
@@ -335,10 +646,13 @@ static void increaseEnergy(const m256i& publicKey, long long amount, bool isGene
         {
             if (isZero(spectrum[index].publicKey))
             {
+                beginSpectrumLayoutChange();
                 spectrum[index].publicKey = publicKey;
                 spectrum[index].incomingAmount = amount;
                 spectrum[index].numberOfIncomingTransfers = 1;
                 spectrum[index].latestIncomingTransferTick = system.tick;
+                endSpectrumLayoutChange();
+                markSpectrumEntityChanged(index);
 
                 spectrumInfo.numberOfEntities++;
                 spectrumInfo.totalAmount += amount;
@@ -380,6 +694,7 @@ static bool decreaseEnergy(const int index, long long amount)
             spectrum[index].outgoingAmount += amount;
             spectrum[index].numberOfOutgoingTransfers++;
             spectrum[index].latestOutgoingTransferTick = system.tick;
+            markSpectrumEntityChanged(index);
 
             spectrumInfo.totalAmount -= amount;
 
@@ -394,11 +709,14 @@ static bool decreaseEnergy(const int index, long long amount)
     return false;
 }
 
-
 static bool loadSpectrum(const CHAR16* fileName = SPECTRUM_FILE_NAME, const CHAR16* directory = nullptr)
 {
     logToConsole(L"Loading spectrum file ...");
-    long long loadedSize = load(fileName, SPECTRUM_CAPACITY * sizeof(EntityRecord), (unsigned char*)spectrum, directory);
+    ACQUIRE(spectrumLock);
+    beginSpectrumLayoutChange();
+    long long loadedSize = loadParallel(fileName, SPECTRUM_CAPACITY * sizeof(EntityRecord), (unsigned char*)spectrum, directory);
+    endSpectrumLayoutChange();
+    RELEASE(spectrumLock);
     if (loadedSize != SPECTRUM_CAPACITY * sizeof(EntityRecord))
     {
         logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() reads invalid number of bytes", loadedSize, __LINE__);
@@ -416,7 +734,7 @@ static bool saveSpectrum(const CHAR16* fileName = SPECTRUM_FILE_NAME, const CHAR
     const unsigned long long beginningTick = __rdtsc();
 
     ACQUIRE(spectrumLock);
-    long long savedSize = save(fileName, SPECTRUM_CAPACITY * sizeof(EntityRecord), (unsigned char*)spectrum, directory);
+    long long savedSize = saveStateFile(fileName, SPECTRUM_CAPACITY * sizeof(EntityRecord), (unsigned char*)spectrum, directory);
     RELEASE(spectrumLock);
 
     if (savedSize == SPECTRUM_CAPACITY * sizeof(EntityRecord))
@@ -434,17 +752,33 @@ static bool saveSpectrum(const CHAR16* fileName = SPECTRUM_FILE_NAME, const CHAR
 static bool initSpectrum()
 {
     if (!allocPoolWithErrorLog(L"spectrum", spectrumSizeInBytes, (void**)&spectrum, __LINE__)
-        || !allocPoolWithErrorLog(L"spectrumDigests", spectrumDigestsSizeInByte, (void**)&spectrumDigests, __LINE__))
+        || !allocPoolWithErrorLog(L"spectrumDigests", spectrumDigestsSizeInByte, (void**)&spectrumDigests, __LINE__)
+        || !allocPoolWithErrorLog(L"spectrumSiblingsCache", SPECTRUM_SIBLINGS_CACHE_SIZE * sizeof(SpectrumSiblingsCacheEntry), (void**)&spectrumSiblingsCache, __LINE__))
     {
         return false;
     }
     spectrumLock = 0;
+    spectrumLayoutSequence = 0;
+    spectrumDigestsSequence = 0;
+    for (unsigned int i = 0; i < SPECTRUM_SIBLINGS_CACHE_SIZE; i++)
+    {
+        spectrumSiblingsCache[i].spectrumIndex = -1;
+    }
+    setMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
+    spectrumChangeListSize = 0;
+    spectrumChangeListOverflow = false;
 
-    return true;
+    return spectrumSnapshotDelta.init(spectrumSizeInBytes, sizeof(EntityRecord));
 }
 
 static void deinitSpectrum()
 {
+    spectrumSnapshotDelta.deinit();
+    if (spectrumSiblingsCache)
+    {
+        freePool(spectrumSiblingsCache);
+        spectrumSiblingsCache = nullptr;
+    }
     if (spectrumDigests)
     {
         freePool(spectrumDigests);
@@ -4,6 +4,7 @@
 
 #include "platform/memory_util.h"
 #include "platform/concurrency.h"
+#include "platform/read_write_lock.h"
 #include "platform/console_logging.h"
 #include "platform/debugging.h"
 
@@ -32,8 +33,14 @@ protected:
     static constexpr unsigned long long tickTransactionsSize =  maxNumTxsTotal * MAX_TRANSACTION_SIZE;
     static constexpr unsigned long long txsDigestsSize = maxNumTxsTotal * sizeof(m256i);
 
-    // `maxNumTxsTotal` priorities have to be saved at a time. Collection capacity has to be 2^N so find the next bigger power of 2.
-    static constexpr unsigned long long txsPrioritiesCapacity = math_lib::findNextPowerOf2(maxNumTxsTotal);
+    // `maxNumTxsPerTick` priorities have to be saved per tick. Collection capacity has to be 2^N so find the next bigger power of 2.
+    static constexpr unsigned long long txsPrioritiesCapacity = math_lib::findNextPowerOf2(maxNumTxsPerTick);
+    static constexpr unsigned long long txsPrioritiesSize = PENDING_TXS_POOL_NUM_TICKS * sizeof(Collection<unsigned int, txsPrioritiesCapacity>);
+
+    // Capacity of the digest hash set of each tick (load factor <= 50% with linear probing)
+    static constexpr unsigned int txsDigestSetCapacity = 2 * txsPrioritiesCapacity;
+    static constexpr unsigned long long txsDigestSetsSize = PENDING_TXS_POOL_NUM_TICKS * txsDigestSetCapacity * sizeof(unsigned short);
+    static_assert(maxNumTxsPerTick < 0xffff, "Transaction index + 1 has to fit into unsigned short");
 
     // The pool stores the tick range [firstStoredTick, firstStoredTick + PENDING_TXS_POOL_NUM_TICKS[
     inline static unsigned int firstStoredTick = 0;
@@ -44,6 +51,11 @@ protected:
     // Allocated txsDigests buffer with maxNumTxs elements
     inline static m256i* txsDigestsBuffer = nullptr;
 
+    // Allocated buffer of the per-tick digest hash sets with txsDigestSetsSize bytes.
+    // Each slot contains transactionIndex + 1 or 0 if empty. The slot is found by linear probing, starting from the
+    // digest bits modulo capacity.
+    inline static unsigned short* txsDigestSetsBuffer = nullptr;
+
     // Records the number of saved transactions for each tick
     inline static unsigned int numSavedTxsPerTick[PENDING_TXS_POOL_NUM_TICKS];
 
@@ -51,25 +63,68 @@ protected:
     // buffersBeginIndex corresponds to firstStoredTick
     inline static unsigned int buffersBeginIndex = 0;
 
-    // Lock for securing the data in the PendingTxsPool
-    inline static volatile char lock = 0;
+    // Lock for securing the tick window (firstStoredTick and buffersBeginIndex). Adding transactions and reading the
+    // transactions of a tick requires a read lock, moving the window requires the write lock.
+    inline static ReadWriteLock windowLock;
+
+    // Locks for securing the data of each tick (transactions, digests, digest set, priorities, number of saved
+    // transactions), indexed like numSavedTxsPerTick. Only acquire while holding the windowLock for reading.
+    inline static volatile char tickLocks[PENDING_TXS_POOL_NUM_TICKS];
 
-    // Priority queues for transactions in each saved tick
+    // Priority queues for transactions, one per saved tick (indexed like numSavedTxsPerTick)
     inline static Collection<unsigned int, txsPrioritiesCapacity>* txsPriorities;
 
-    static void cleanupTxsPriorities(unsigned int tickIndex)
+    // Reset priorities and digest set of a tick index that is discarded
+    static void cleanupTickIndex(unsigned int tickIndex)
     {
-        sint64 elementIndex = txsPriorities->headIndex(m256i{ tickIndex, 0, 0, 0 });
-        // use a `for` instead of a `while` loop to make sure it cannot run forever 
-        // there can be at most `maxNumTxsPerTick` elements in one pov
-        for (unsigned int t = 0; t < maxNumTxsPerTick; ++t)
+        txsPriorities[tickIndex].reset();
+        setMem(getDigestSetPtr(tickIndex), txsDigestSetCapacity * sizeof(unsigned short), 0);
+    }
+
+    // Return pointer to the digest set of the tick index
+    inline static unsigned short* getDigestSetPtr(unsigned int tickIndex)
+    {
+        ASSERT(tickIndex < PENDING_TXS_POOL_NUM_TICKS);
+        return txsDigestSetsBuffer + (unsigned long long)tickIndex * txsDigestSetCapacity;
+    }
+
+    // Return slot of digest in the digest set of the tick index, or the empty slot where it can be inserted
+    static unsigned int findDigestSlot(unsigned int tickIndex, const m256i& digest)
+    {
+        const unsigned short* digestSet = getDigestSetPtr(tickIndex);
+        unsigned int slot = digest.m256i_u32[0] & (txsDigestSetCapacity - 1);
+        while (digestSet[slot] && *getDigestPtr(tickIndex, digestSet[slot] - 1) != digest)
         {
-            if (elementIndex != NULL_INDEX)
-                elementIndex = txsPriorities->remove(elementIndex);
-            else
+            slot = (slot + 1) & (txsDigestSetCapacity - 1);
+        }
+        return slot;
+    }
+
+    // Remove transaction from the digest set of the tick index (digest has to be contained)
+    static void removeDigest(unsigned int tickIndex, const m256i& digest)
+    {
+        unsigned short* digestSet = getDigestSetPtr(tickIndex);
+        unsigned int emptySlot = findDigestSlot(tickIndex, digest);
+        ASSERT(digestSet[emptySlot] != 0);
+
+        // Backward shift deletion: move following entries of the probe sequence into the gap if this does not
+        // put them before their home slot
+        unsigned int slot = emptySlot;
+        while (true)
+        {
+            slot = (slot + 1) & (txsDigestSetCapacity - 1);
+            if (!digestSet[slot])
+            {
                 break;
+            }
+            const unsigned int homeSlot = getDigestPtr(tickIndex, digestSet[slot] - 1)->m256i_u32[0] & (txsDigestSetCapacity - 1);
+            if (((slot - homeSlot) & (txsDigestSetCapacity - 1)) >= ((slot - emptySlot) & (txsDigestSetCapacity - 1)))
+            {
+                digestSet[emptySlot] = digestSet[slot];
+                emptySlot = slot;
+            }
         }
-        txsPriorities->cleanupIfNeeded();
+        digestSet[emptySlot] = 0;
     }
 
     static sint64 calculateTxPriority(const Transaction* tx)
@@ -132,7 +187,7 @@ public:
 
     static unsigned long long getSize()
     {
-        return tickTransactionsSize + txsDigestsSize + sizeof(numSavedTxsPerTick) + sizeof(Collection<unsigned int, txsPrioritiesCapacity>);
+        return tickTransactionsSize + txsDigestsSize + txsDigestSetsSize + sizeof(numSavedTxsPerTick) + txsPrioritiesSize;
     }
 
     // Init at node startup.
@@ -140,18 +195,20 @@ public:
     {
         if (!allocPoolWithErrorLog(L"PendingTxsPool::tickTransactionsPtr ", tickTransactionsSize, (void**)&tickTransactionsBuffer, __LINE__)
             || !allocPoolWithErrorLog(L"PendingTxsPool::txsDigestsPtr ", txsDigestsSize, (void**)&txsDigestsBuffer, __LINE__)
-            || !allocPoolWithErrorLog(L"PendingTxsPool::txsPriorities", sizeof(Collection<unsigned int, txsPrioritiesCapacity>), (void**)&txsPriorities, __LINE__))
+            || !allocPoolWithErrorLog(L"PendingTxsPool::txsDigestSetsPtr ", txsDigestSetsSize, (void**)&txsDigestSetsBuffer, __LINE__)
+            || !allocPoolWithErrorLog(L"PendingTxsPool::txsPriorities", txsPrioritiesSize, (void**)&txsPriorities, __LINE__))
         {
             return false;
         }
 
-        ASSERT(lock == 0);
+        windowLock.reset();
+        setMem((void*)tickLocks, sizeof(tickLocks), 0);
 
         setMem(tickTransactionsBuffer, tickTransactionsSize, 0);
         setMem(txsDigestsBuffer, txsDigestsSize, 0);
+        setMem(txsDigestSetsBuffer, txsDigestSetsSize, 0);
         setMem(numSavedTxsPerTick, sizeof(numSavedTxsPerTick), 0);
-
-        txsPriorities->reset();
+        setMem(txsPriorities, txsPrioritiesSize, 0);
 
         firstStoredTick = 0;
         buffersBeginIndex = 0;
@@ -170,22 +227,35 @@ public:
         {
             freePool(txsDigestsBuffer);
         }
+        if (txsDigestSetsBuffer)
+        {
+            freePool(txsDigestSetsBuffer);
+        }
         if (txsPriorities)
         {
             freePool(txsPriorities);
         }
     }
 
-    // Acquire lock for returned pointers to transactions or digests.
-    inline static void acquireLock()
+    // Acquire lock for returned pointers to transactions or digests of the specified tick.
+    // Transactions of other ticks can be added concurrently, but the stored tick range cannot change.
+    inline static void acquireLock(unsigned int tick)
     {
-        ACQUIRE(lock);
+        windowLock.acquireRead();
+        if (tickInStorage(tick))
+        {
+            ACQUIRE(tickLocks[tickToIndex(tick)]);
+        }
     }
 
-    // Release lock for returned pointers to transactions or digests.
-    inline static void releaseLock()
+    // Release lock for returned pointers to transactions or digests of the specified tick.
+    inline static void releaseLock(unsigned int tick)
     {
-        RELEASE(lock);
+        if (tickInStorage(tick))
+        {
+            RELEASE(tickLocks[tickToIndex(tick)]);
+        }
+        windowLock.releaseRead();
     }
 
     // Return number of transactions scheduled for the specified tick.
@@ -195,12 +265,12 @@ public:
         addDebugMessage(L"Begin pendingTxsPool.getNumberOfPendingTickTxs()");
 #endif
         unsigned int res = 0;
-        ACQUIRE(lock);
+        windowLock.acquireRead();
         if (tickInStorage(tick))
         {
             res = numSavedTxsPerTick[tickToIndex(tick)];
         }
-        RELEASE(lock);
+        windowLock.releaseRead();
 
 #if !defined(NDEBUG) && !defined(NO_UEFI)
         CHAR16 dbgMsgBuf[200];
@@ -220,7 +290,7 @@ public:
         addDebugMessage(L"Begin pendingTxsPool.getTotalNumberOfPendingTxs()");
 #endif
         unsigned int res = 0;
-        ACQUIRE(lock);
+        windowLock.acquireRead();
         if (tickInStorage(tick + 1))
         {
             unsigned int startIndex = tickToIndex(tick + 1);
@@ -238,7 +308,7 @@ public:
                     res += numSavedTxsPerTick[t];
             }
         }
-        RELEASE(lock);
+        windowLock.releaseRead();
 
 #if !defined(NDEBUG) && !defined(NO_UEFI)
         CHAR16 dbgMsgBuf[200];
@@ -252,96 +322,109 @@ public:
     }
 
     // Check validity of transaction and add to the pool. Return boolean indicating whether transaction was added.
+    // Validity, digest, and priority are computed without locking. Afterwards, only the lock of the scheduled tick is
+    // acquired (in addition to a read lock of the tick window), so transactions of different ticks are added in parallel.
     static bool add(const Transaction* tx)
     {
 #if !defined(NDEBUG) && !defined(NO_UEFI)
         addDebugMessage(L"Begin pendingTxsPool.add()");
 #endif
         bool txAdded = false;
-        ACQUIRE(lock);
-        if (tx->checkValidity() && tickInStorage(tx->tick))
+        if (tx->checkValidity())
         {
-            unsigned int tickIndex = tickToIndex(tx->tick);
             const unsigned int transactionSize = tx->totalSize();
-
-            // check if tx with same digest already exists
             m256i digest;
             KangarooTwelve(tx, transactionSize, &digest, sizeof(m256i));
-            for (unsigned int txIndex = 0; txIndex < numSavedTxsPerTick[tickIndex]; ++txIndex)
-            {
-                if (*getDigestPtr(tickIndex, txIndex) == digest)
-                {
-#if !defined(NDEBUG) && !defined(NO_UEFI)
-                    CHAR16 dbgMsgBuf[100];
-                    setText(dbgMsgBuf, L"tx with the same digest already exists for tick ");
-                    appendNumber(dbgMsgBuf, tx->tick, FALSE);
-                    addDebugMessage(dbgMsgBuf);
-#endif
-                    goto end_add_function;
-                }
-            }
 
             sint64 priority = calculateTxPriority(tx);
             if (priority > 0)
             {
-                m256i povIndex{ tickIndex, 0, 0, 0 };
-
-                if (numSavedTxsPerTick[tickIndex] < maxNumTxsPerTick)
+                windowLock.acquireRead();
+                if (tickInStorage(tx->tick))
                 {
-                    copyMem(getDigestPtr(tickIndex, numSavedTxsPerTick[tickIndex]), &digest, sizeof(m256i));
-                    copyMem(getTxPtr(tickIndex, numSavedTxsPerTick[tickIndex]), tx, transactionSize);
-                    txsPriorities->add(povIndex, numSavedTxsPerTick[tickIndex], priority);
+                    unsigned int tickIndex = tickToIndex(tx->tick);
+                    ACQUIRE(tickLocks[tickIndex]);
 
-                    numSavedTxsPerTick[tickIndex]++;
-                    txAdded = true;
-                }
-                else
-                {
-                    // check if priority is higher than lowest priority tx in this tick and replace in this case
-                    sint64 lowestElementIndex = txsPriorities->tailIndex(povIndex);
-                    if (lowestElementIndex != NULL_INDEX)
+                    // check if tx with same digest already exists
+                    unsigned int digestSlot = findDigestSlot(tickIndex, digest);
+                    if (getDigestSetPtr(tickIndex)[digestSlot])
                     {
-                        if (txsPriorities->priority(lowestElementIndex) < priority)
-                        {
-                            unsigned int replacedTxIndex = txsPriorities->element(lowestElementIndex);
-                            txsPriorities->remove(lowestElementIndex);
-                            txsPriorities->add(povIndex, replacedTxIndex, priority);
+#if !defined(NDEBUG) && !defined(NO_UEFI)
+                        CHAR16 dbgMsgBuf[100];
+                        setText(dbgMsgBuf, L"tx with the same digest already exists for tick ");
+                        appendNumber(dbgMsgBuf, tx->tick, FALSE);
+                        addDebugMessage(dbgMsgBuf);
+#endif
+                    }
+                    else
+                    {
+                        Collection<unsigned int, txsPrioritiesCapacity>& tickTxsPriorities = txsPriorities[tickIndex];
+                        const m256i povIndex = m256i::zero();
 
-                            copyMem(getDigestPtr(tickIndex, replacedTxIndex), &digest, sizeof(m256i));
-                            copyMem(getTxPtr(tickIndex, replacedTxIndex), tx, transactionSize);
+                        if (numSavedTxsPerTick[tickIndex] < maxNumTxsPerTick)
+                        {
+                            copyMem(getDigestPtr(tickIndex, numSavedTxsPerTick[tickIndex]), &digest, sizeof(m256i));
+                            copyMem(getTxPtr(tickIndex, numSavedTxsPerTick[tickIndex]), tx, transactionSize);
+                            tickTxsPriorities.add(povIndex, numSavedTxsPerTick[tickIndex], priority);
 
+                            numSavedTxsPerTick[tickIndex]++;
+                            getDigestSetPtr(tickIndex)[digestSlot] = numSavedTxsPerTick[tickIndex];
                             txAdded = true;
                         }
-#if !defined(NDEBUG) && !defined(NO_UEFI)
                         else
                         {
-                            CHAR16 dbgMsgBuf[300];
-                            setText(dbgMsgBuf, L"tx could not be added, already saved ");
-                            appendNumber(dbgMsgBuf, numSavedTxsPerTick[tickIndex], FALSE);
-                            appendText(dbgMsgBuf, L" txs for tick ");
-                            appendNumber(dbgMsgBuf, tx->tick, FALSE);
-                            appendText(dbgMsgBuf, L" and priority ");
-                            appendNumber(dbgMsgBuf, priority, FALSE);
-                            appendText(dbgMsgBuf, L" is lower than lowest saved priority ");
-                            appendNumber(dbgMsgBuf, txsPriorities->priority(lowestElementIndex), FALSE);
-                            addDebugMessage(dbgMsgBuf);
-                        }
+                            // check if priority is higher than lowest priority tx in this tick and replace in this case
+                            sint64 lowestElementIndex = tickTxsPriorities.tailIndex(povIndex);
+                            if (lowestElementIndex != NULL_INDEX)
+                            {
+                                if (tickTxsPriorities.priority(lowestElementIndex) < priority)
+                                {
+                                    unsigned int replacedTxIndex = tickTxsPriorities.element(lowestElementIndex);
+                                    tickTxsPriorities.remove(lowestElementIndex);
+                                    tickTxsPriorities.add(povIndex, replacedTxIndex, priority);
+
+                                    removeDigest(tickIndex, *getDigestPtr(tickIndex, replacedTxIndex));
+                                    copyMem(getDigestPtr(tickIndex, replacedTxIndex), &digest, sizeof(m256i));
+                                    copyMem(getTxPtr(tickIndex, replacedTxIndex), tx, transactionSize);
+                                    getDigestSetPtr(tickIndex)[findDigestSlot(tickIndex, digest)] = replacedTxIndex + 1;
+
+                                    txAdded = true;
+                                }
+#if !defined(NDEBUG) && !defined(NO_UEFI)
+                                else
+                                {
+                                    CHAR16 dbgMsgBuf[300];
+                                    setText(dbgMsgBuf, L"tx could not be added, already saved ");
+                                    appendNumber(dbgMsgBuf, numSavedTxsPerTick[tickIndex], FALSE);
+                                    appendText(dbgMsgBuf, L" txs for tick ");
+                                    appendNumber(dbgMsgBuf, tx->tick, FALSE);
+                                    appendText(dbgMsgBuf, L" and priority ");
+                                    appendNumber(dbgMsgBuf, priority, FALSE);
+                                    appendText(dbgMsgBuf, L" is lower than lowest saved priority ");
+                                    appendNumber(dbgMsgBuf, tickTxsPriorities.priority(lowestElementIndex), FALSE);
+                                    addDebugMessage(dbgMsgBuf);
+                                }
 #endif      
-                    }
+                            }
 #if !defined(NDEBUG) && !defined(NO_UEFI)
-                    else
-                    {
-                        // debug log, this should never happen
-                        CHAR16 dbgMsgBuf[300];
-                        setText(dbgMsgBuf, L"maximum number of txs ");
-                        appendNumber(dbgMsgBuf, numSavedTxsPerTick[tickIndex], FALSE);
-                        appendText(dbgMsgBuf, L" saved for tick ");
-                        appendNumber(dbgMsgBuf, tx->tick, FALSE);
-                        appendText(dbgMsgBuf, L" but povIndex is unknown. This should never happen.");
-                        addDebugMessage(dbgMsgBuf);
-                    }
+                            else
+                            {
+                                // debug log, this should never happen
+                                CHAR16 dbgMsgBuf[300];
+                                setText(dbgMsgBuf, L"maximum number of txs ");
+                                appendNumber(dbgMsgBuf, numSavedTxsPerTick[tickIndex], FALSE);
+                                appendText(dbgMsgBuf, L" saved for tick ");
+                                appendNumber(dbgMsgBuf, tx->tick, FALSE);
+                                appendText(dbgMsgBuf, L" but povIndex is unknown. This should never happen.");
+                                addDebugMessage(dbgMsgBuf);
+                            }
 #endif
+                        }
+                    }
+
+                    RELEASE(tickLocks[tickIndex]);
                 }
+                windowLock.releaseRead();
             }
 #if !defined(NDEBUG) && !defined(NO_UEFI)
             else
@@ -354,9 +437,6 @@ public:
 #endif
         }
 
-    end_add_function:
-        RELEASE(lock);
-
 #if !defined(NDEBUG) && !defined(NO_UEFI)
         if (txAdded)
             addDebugMessage(L"End pendingTxsPool.add(), txAdded true");
@@ -367,7 +447,7 @@ public:
     }
 
     // Get a transaction for the specified tick. If no more transactions for this tick, return nullptr.
-    // ATTENTION: when running multiple threads, you need to have acquired the lock via acquireLock() before calling this function.
+    // ATTENTION: when running multiple threads, you need to have acquired the lock via acquireLock(tick) before calling this function.
     static Transaction* getTx(unsigned int tick, unsigned int index)
     {
         unsigned int tickIndex;
@@ -386,7 +466,7 @@ public:
     }
 
     // Get a transaction digest for the specified tick. If no more transactions for this tick, return nullptr.
-    // ATTENTION: when running multiple threads, you need to have acquired the lock via acquireLock() before calling this function.
+    // ATTENTION: when running multiple threads, you need to have acquired the lock via acquireLock(tick) before calling this function.
     static m256i* getDigest(unsigned int tick, unsigned int index)
     {
         unsigned int tickIndex;
@@ -406,7 +486,7 @@ public:
 
     static void incrementFirstStoredTick()
     {
-        ACQUIRE(lock);
+        windowLock.acquireWrite();
 
         // set memory at buffersBeginIndex to 0 
         unsigned long long numTxsBeforeBegin = buffersBeginIndex * maxNumTxsPerTick;
@@ -414,14 +494,14 @@ public:
         setMem(txsDigestsBuffer + numTxsBeforeBegin, maxNumTxsPerTick * sizeof(m256i), 0);
         numSavedTxsPerTick[buffersBeginIndex] = 0;
 
-        // remove txs priorities stored for firstStoredTick
-        cleanupTxsPriorities(tickToIndex(firstStoredTick));
+        // remove txs priorities and digest set stored for firstStoredTick
+        cleanupTickIndex(tickToIndex(firstStoredTick));
 
         // increment buffersBeginIndex and firstStoredTick
         firstStoredTick++;
         buffersBeginIndex = (buffersBeginIndex + 1) % PENDING_TXS_POOL_NUM_TICKS;
 
-        RELEASE(lock);
+        windowLock.releaseWrite();
     }
 
     static void beginEpoch(unsigned int newInitialTick)
@@ -429,7 +509,7 @@ public:
 #if !defined(NDEBUG) && !defined(NO_UEFI)
         addDebugMessage(L"Begin pendingTxsPool.beginEpoch()");
 #endif
-        ACQUIRE(lock);
+        windowLock.acquireWrite();
         if (tickInStorage(newInitialTick))
         {
             unsigned int newInitialIndex = tickToIndex(newInitialTick);
@@ -443,7 +523,7 @@ public:
                 setMem(numSavedTxsPerTick, newInitialIndex * sizeof(unsigned int), 0);
 
                 for (unsigned int tickIndex = 0; tickIndex < newInitialIndex; ++tickIndex)
-                    cleanupTxsPriorities(tickIndex);
+                    cleanupTickIndex(tickIndex);
 
                 unsigned long long numTxsBeforeBegin = buffersBeginIndex * maxNumTxsPerTick;
                 unsigned long long numTxsStartingAtBegin = (PENDING_TXS_POOL_NUM_TICKS - buffersBeginIndex) * maxNumTxsPerTick;
@@ -452,7 +532,7 @@ public:
                 setMem(numSavedTxsPerTick + buffersBeginIndex, (PENDING_TXS_POOL_NUM_TICKS - buffersBeginIndex) * sizeof(unsigned int), 0);
 
                 for (unsigned int tickIndex = buffersBeginIndex; tickIndex < PENDING_TXS_POOL_NUM_TICKS; ++tickIndex)
-                    cleanupTxsPriorities(tickIndex);
+                    cleanupTickIndex(tickIndex);
             }
             else
             {
@@ -463,7 +543,7 @@ public:
                 setMem(numSavedTxsPerTick + buffersBeginIndex, (newInitialIndex - buffersBeginIndex) * sizeof(unsigned int), 0);
 
                 for (unsigned int tickIndex = buffersBeginIndex; tickIndex < newInitialIndex; ++tickIndex)
-                    cleanupTxsPriorities(tickIndex);
+                    cleanupTickIndex(tickIndex);
             }
 
             buffersBeginIndex = newInitialIndex;
@@ -472,16 +552,16 @@ public:
         {
             setMem(tickTransactionsBuffer, tickTransactionsSize, 0);
             setMem(txsDigestsBuffer, txsDigestsSize, 0);
+            setMem(txsDigestSetsBuffer, txsDigestSetsSize, 0);
             setMem(numSavedTxsPerTick, sizeof(numSavedTxsPerTick), 0);
-
-            txsPriorities->reset();
+            setMem(txsPriorities, txsPrioritiesSize, 0);
 
             buffersBeginIndex = 0;
         }
 
         firstStoredTick = newInitialTick;
 
-        RELEASE(lock);
+        windowLock.releaseWrite();
 
 #if !defined(NDEBUG) && !defined(NO_UEFI)
         addDebugMessage(L"End pendingTxsPool.beginEpoch()");
@@ -491,7 +571,7 @@ public:
     // Useful for debugging, but expensive: check that everything is as expected.
     static void checkStateConsistencyWithAssert()
     {
-        ACQUIRE(lock);
+        windowLock.acquireWrite();
 
 #if !defined(NDEBUG) && !defined(NO_UEFI)
         addDebugMessage(L"Begin tsxPool.checkStateConsistencyWithAssert()");
@@ -508,6 +588,8 @@ public:
 
         ASSERT(tickTransactionsBuffer != nullptr);
         ASSERT(txsDigestsBuffer != nullptr);
+        ASSERT(txsDigestSetsBuffer != nullptr);
+        ASSERT(txsPriorities != nullptr);
 
         for (unsigned int tick = firstStoredTick; tick < firstStoredTick + PENDING_TXS_POOL_NUM_TICKS; ++tick)
         {
@@ -517,11 +599,22 @@ public:
                 unsigned int tickIndex = tickToIndex(tick);
                 unsigned int numSavedForTick = numSavedTxsPerTick[tickIndex];
                 ASSERT(numSavedForTick <= maxNumTxsPerTick);
+                ASSERT(txsPriorities[tickIndex].population() == numSavedForTick);
+
+                // each saved transaction has to be found in the digest set and the set must not have other entries
+                unsigned int numDigestSetEntries = 0;
+                for (unsigned int slot = 0; slot < txsDigestSetCapacity; ++slot)
+                {
+                    if (getDigestSetPtr(tickIndex)[slot])
+                        numDigestSetEntries++;
+                }
+                ASSERT(numDigestSetEntries == numSavedForTick);
                 for (unsigned int txIndex = 0; txIndex < numSavedForTick; ++txIndex)
                 {
                     Transaction* transaction = (Transaction*)(tickTransactionsBuffer + (tickIndex * maxNumTxsPerTick + txIndex) * MAX_TRANSACTION_SIZE);
                     ASSERT(transaction->checkValidity());
                     ASSERT(transaction->tick == tick);
+                    ASSERT(getDigestSetPtr(tickIndex)[findDigestSlot(tickIndex, *getDigestPtr(tickIndex, txIndex))] == txIndex + 1);
 #if !defined(NDEBUG) && !defined(NO_UEFI)
                     if (!transaction->checkValidity() || transaction->tick != tick)
                     {
@@ -546,7 +639,7 @@ public:
             }
         }
 
-        RELEASE(lock);
+        windowLock.releaseWrite();
 
 #if !defined(NDEBUG) && !defined(NO_UEFI)
         addDebugMessage(L"End pendingTxsPool.checkStateConsistencyWithAssert()");
@@ -19,11 +19,21 @@
 #define DATA_AS_NUMBER 27303570963497060ULL
 
 #define CACHE_PAGE 32
+#define SWAP_IO_WORKERS 2 // threads writing evicted pages and prefetching pages in background
 #define TICK_DATA_PAGE_CAPACITY 128 // one page can hold data for 128 ticks
 #define TICKS_PAGE_CAPACITY (64 * NUMBER_OF_COMPUTORS) // one page can hold data for 64 ticks
 #define TRANSACTION_PAGE_CAPACITY (NUMBER_OF_TRANSACTIONS_PER_TICK * 16) // one page can hold data for AT LEAST 16 ticks
 #define TRANSACTION_DIGEST_HASHMAP_PAGE_CAPACITY (NUMBER_OF_TRANSACTIONS_PER_TICK * 64)
 
+// Swap storage type of tick data, ticks, transactions, and transaction digests (if USE_SWAP is enabled)
+#if defined(USE_SWAP_MMAP) && defined(__linux__)
+template <typename T, unsigned long long prefixName, unsigned long long pageDirectory, unsigned long long pageCapacity, unsigned long long numCachePage, SwapMode mode, long long extraBytesPerElement>
+using TickStorageSwapVM = MappedSwapVirtualMemory<T, prefixName, pageDirectory, pageCapacity, numCachePage, mode, extraBytesPerElement>;
+#else
+template <typename T, unsigned long long prefixName, unsigned long long pageDirectory, unsigned long long pageCapacity, unsigned long long numCachePage, SwapMode mode, long long extraBytesPerElement>
+using TickStorageSwapVM = SwapVirtualMemory<T, prefixName, pageDirectory, pageCapacity, numCachePage, mode, extraBytesPerElement>;
+#endif
+
 #if TICK_STORAGE_AUTOSAVE_MODE
 static wchar_t SNAPSHOT_METADATA_FILE_NAME[] = L"snapshotMetadata.???";
 static wchar_t SNAPSHOT_TICK_DATA_FILE_NAME[] = L"snapshotTickdata.???";
@@ -79,16 +89,16 @@ private:
     // Allocated tick data buffer with tickDataLength elements (includes current and previous epoch data)
     inline static TickData* tickDataPtr = nullptr;
     // SWAP: should reserve another tickData SwapVm instance for requestProcessor to avoid affect ticking process
-    inline static SwapVirtualMemory<TickData, TD00_AS_NUMBER, DATA_AS_NUMBER, TICK_DATA_PAGE_CAPACITY, CACHE_PAGE, SwapMode::INDEX_MODE, 0> tickDataSwapVM;
+    inline static TickStorageSwapVM<TickData, TD00_AS_NUMBER, DATA_AS_NUMBER, TICK_DATA_PAGE_CAPACITY, CACHE_PAGE, SwapMode::INDEX_MODE, 0> tickDataSwapVM;
 
     // Allocated ticks buffer with ticksLength elements (includes current and previous epoch data)
     inline static Tick* ticksPtr = nullptr;
     // SWAP: should reserve another ticks SwapVm instance for requestProcessor to avoid affect ticking process
-    inline static SwapVirtualMemory<Tick, TICK_AS_NUMBER, DATA_AS_NUMBER, TICKS_PAGE_CAPACITY, CACHE_PAGE, SwapMode::INDEX_MODE, 0> ticksSwapVM;
+    inline static TickStorageSwapVM<Tick, TICK_AS_NUMBER, DATA_AS_NUMBER, TICKS_PAGE_CAPACITY, CACHE_PAGE, SwapMode::INDEX_MODE, 0> ticksSwapVM;
 
     // Allocated tickTransactions buffer with tickTransactionsSize bytes (includes current and previous epoch data)
     inline static unsigned char* tickTransactionsPtr = nullptr;
-    inline static SwapVirtualMemory<Transaction, TX00_AS_NUMBER, DATA_AS_NUMBER, TRANSACTION_PAGE_CAPACITY, CACHE_PAGE, SwapMode::OFFSET_MODE, MAX_INPUT_SIZE + SIGNATURE_SIZE> tickTransactionsSwapVM;
+    inline static TickStorageSwapVM<Transaction, TX00_AS_NUMBER, DATA_AS_NUMBER, TRANSACTION_PAGE_CAPACITY, CACHE_PAGE, SwapMode::OFFSET_MODE, MAX_INPUT_SIZE + SIGNATURE_SIZE> tickTransactionsSwapVM;
 
     // Allocated tickTransactionOffsets buffer with tickTransactionOffsetsLength elements (includes current and previous epoch data)
     inline static unsigned long long* tickTransactionOffsetsPtr = nullptr;
@@ -111,7 +121,7 @@ private:
         unsigned long long offset;
     };
     inline static unsigned char* tickTransactionsDigestPtr = nullptr;
-    inline static SwapVirtualMemory<TxHashMapEntry, TXDI_AS_NUMBER, DATA_AS_NUMBER, TRANSACTION_DIGEST_HASHMAP_PAGE_CAPACITY, CACHE_PAGE, SwapMode::INDEX_MODE, 0> tickTransactionsDigestSwapVM;
+    inline static TickStorageSwapVM<TxHashMapEntry, TXDI_AS_NUMBER, DATA_AS_NUMBER, TRANSACTION_DIGEST_HASHMAP_PAGE_CAPACITY, CACHE_PAGE, SwapMode::INDEX_MODE, 0> tickTransactionsDigestSwapVM;
 
     // Lock for securing tickData
     inline static volatile char tickDataLock = 0;
@@ -332,6 +342,7 @@ private:
     }
     bool loadTickData(unsigned long long nTick, CHAR16* directory = NULL)
     {
+        tickDataDigestIndex.reset();
 #ifdef USE_SWAP
         unsigned long long totalLoadSize = tickDataSwapVM.getVmStateSize();
         void *buffer = nullptr;
@@ -694,10 +705,21 @@ public:
         }
 
 #ifdef USE_SWAP
+#if defined(USE_SWAP_MMAP) && defined(__linux__)
+        if (!tickDataSwapVM.init(tickDataSize)
+            || !ticksSwapVM.init(ticksSize)
+            || !tickTransactionsSwapVM.init(tickTransactionsSizeCurrentEpoch)
+            || !tickTransactionsDigestSwapVM.init(tickTransactionOffsetsLengthCurrentEpoch * sizeof(TxHashMapEntry), /*randomAccess=*/true))
+        {
+            return false;
+        }
+#else
+        SwapIOWorkers::start(SWAP_IO_WORKERS);
         tickDataSwapVM.init();
         ticksSwapVM.init();
         tickTransactionsSwapVM.init();
         tickTransactionsDigestSwapVM.init();
+#endif
 #endif
 
         ASSERT(tickDataLock == 0);
@@ -747,8 +769,30 @@ public:
         {
             freePool(tickTransactionsDigestPtr);
         }
+
+#if defined(USE_SWAP) && defined(USE_SWAP_MMAP) && defined(__linux__)
+        tickDataSwapVM.deinit();
+        ticksSwapVM.deinit();
+        tickTransactionsSwapVM.deinit();
+        tickTransactionsDigestSwapVM.deinit();
+#elif defined(USE_SWAP)
+        SwapIOWorkers::stop();
+#endif
     }
 
+#if defined(USE_SWAP) && !(defined(USE_SWAP_MMAP) && defined(__linux__))
+    // Log page cache counters of the swap storages, which help to choose CACHE_PAGE
+    static void logSwapCacheStatistics()
+    {
+        setText(message, L"Swap cache hits/misses/prefetch hits: ");
+        appendCacheStatistics(message, L"tick data ", tickDataSwapVM.getCacheStatistics());
+        appendCacheStatistics(message, L" | ticks ", ticksSwapVM.getCacheStatistics());
+        appendCacheStatistics(message, L" | transactions ", tickTransactionsSwapVM.getCacheStatistics());
+        appendCacheStatistics(message, L" | digests ", tickTransactionsDigestSwapVM.getCacheStatistics());
+        logToConsole(message);
+    }
+#endif
+
     // Begin new epoch. If not called the first time (seamless transition), assume that the ticks to keep
     // are ticks in [newInitialTick-TICKS_TO_KEEP_FROM_PRIOR_EPOCH, newInitialTick-1].
     static void beginEpoch(unsigned int newInitialTick)
@@ -946,6 +990,7 @@ public:
         tickEnd = newInitialTick + MAX_NUMBER_OF_TICKS_PER_EPOCH;
 
         nextTickTransactionOffset = FIRST_TICK_TRANSACTION_OFFSET;
+        tickDataDigestIndex.reset();
 #if !defined(NDEBUG)
         addDebugMessage(L"End ts.beginEpoch()");
 #endif
@@ -1178,6 +1223,39 @@ public:
             return td;
         }
 
+        // Like getByTickIfNotEmpty(), but with USE_SWAP the page of the tick data is pinned in the swap cache, so the
+        // pointer stays valid while other threads access the tick storage. If the result is not nullptr, it has to be
+        // released with unpinByIndex(index).
+        inline static TickData* pinByTickIfNotEmpty(unsigned int tick, unsigned int& index)
+        {
+#ifdef USE_SWAP
+            if (tickInCurrentEpochStorage(tick))
+                index = tickToIndexCurrentEpoch(tick);
+            else if (tickInPreviousEpochStorage(tick))
+                index = tickToIndexPreviousEpoch(tick);
+            else
+                return nullptr;
+
+            TickData* td = tickDataSwapVM.pin(index);
+            if (td->epoch == 0 || td->epoch == INVALIDATED_TICK_DATA)
+            {
+                tickDataSwapVM.unpin(index);
+                return nullptr;
+            }
+            return td;
+#else
+            index = 0;
+            return getByTickIfNotEmpty(tick);
+#endif
+        }
+
+        inline static void unpinByIndex(unsigned int index)
+        {
+#ifdef USE_SWAP
+            tickDataSwapVM.unpin(index);
+#endif
+        }
+
         // Get tick data by tick in current epoch (checking tick with ASSERT)
         inline static TickData& getByTickInCurrentEpoch(unsigned int tick)
         {
@@ -1227,6 +1305,79 @@ public:
         }
     } tickData;
 
+    // Index from transaction digest to slot in TickData::transactionDigests for the tick data of the next ticks,
+    // replacing the linear search when a transaction of the next tick is received. One open-addressing table is
+    // kept per tick modulo numberOfTables. Tables are built by build() when tick data is stored, or on first use
+    // by findSlot(). All functions require tickDataLock.
+    inline static struct TickDataDigestIndexAccess
+    {
+        static constexpr unsigned int numberOfTables = 4;
+        static constexpr unsigned int tableSize = 2 * NUMBER_OF_TRANSACTIONS_PER_TICK;
+
+        static_assert((numberOfTables & (numberOfTables - 1)) == 0, "numberOfTables must be power of 2");
+        static_assert((tableSize & (tableSize - 1)) == 0, "tableSize must be power of 2");
+        static_assert(NUMBER_OF_TRANSACTIONS_PER_TICK < 0xFFFF, "slot + 1 must fit into unsigned short");
+
+        struct Table
+        {
+            unsigned int tick; // 0 if table is unused
+            unsigned short entries[tableSize]; // transaction slot + 1, 0 if entry is empty
+        };
+        inline static Table tables[numberOfTables];
+
+        // Invalidate all tables
+        inline static void reset()
+        {
+            for (unsigned int i = 0; i < numberOfTables; ++i)
+            {
+                tables[i].tick = 0;
+            }
+        }
+
+        // (Re)build table of tick data, has to be called each time after the tick data of a tick is changed
+        inline static void build(const TickData& td)
+        {
+            Table& table = tables[td.tick & (numberOfTables - 1)];
+            setMem(table.entries, sizeof(table.entries), 0);
+            for (unsigned int slot = 0; slot < NUMBER_OF_TRANSACTIONS_PER_TICK; ++slot)
+            {
+                const m256i& digest = td.transactionDigests[slot];
+                if (isZero(digest))
+                {
+                    continue;
+                }
+                unsigned int index = digest.m256i_u32[0] & (tableSize - 1);
+                while (table.entries[index])
+                {
+                    index = (index + 1) & (tableSize - 1);
+                }
+                table.entries[index] = (unsigned short)(slot + 1);
+            }
+            table.tick = td.tick;
+        }
+
+        // Return slot of digest in td.transactionDigests, or -1 if td does not contain digest
+        inline static int findSlot(const TickData& td, const m256i& digest)
+        {
+            Table& table = tables[td.tick & (numberOfTables - 1)];
+            if (table.tick != td.tick)
+            {
+                build(td);
+            }
+            unsigned int index = digest.m256i_u32[0] & (tableSize - 1);
+            while (table.entries[index])
+            {
+                const unsigned int slot = table.entries[index] - 1;
+                if (td.transactionDigests[slot] == digest)
+                {
+                    return slot;
+                }
+                index = (index + 1) & (tableSize - 1);
+            }
+            return -1;
+        }
+    } tickDataDigestIndex;
+
     // Struct for structured, convenient access via ".ticks"
    inline static  struct TicksAccess
     {
@@ -1254,6 +1405,26 @@ public:
 #endif
         }
 
+        // Like getByTickIndex(), but with USE_SWAP the page of the ticks is pinned in the swap cache, so the pointer
+        // stays valid while other threads access the tick storage. Has to be released with unpinByTickIndex(tickIndex).
+        inline static Tick* pinByTickIndex(unsigned int tickIndex)
+        {
+            ASSERT(tickIndex < tickDataLength);
+#ifdef USE_SWAP
+            static_assert(TICKS_PAGE_CAPACITY % NUMBER_OF_COMPUTORS == 0, "Ticks of one tick must not cross a page boundary");
+            return ticksSwapVM.pin(tickIndex * NUMBER_OF_COMPUTORS);
+#else
+            return getByTickIndex(tickIndex);
+#endif
+        }
+
+        inline static void unpinByTickIndex(unsigned int tickIndex)
+        {
+#ifdef USE_SWAP
+            ticksSwapVM.unpin(tickIndex * NUMBER_OF_COMPUTORS);
+#endif
+        }
+
         // Return pointer to array of one Tick per computor in current epoch by tick (checking tick with ASSERT)
         inline static Tick* getByTickInCurrentEpoch(unsigned int tick)
         {
@@ -15,6 +15,9 @@
 #include "contract_core/contract_exec.h"
 #include "contract_core/qpi_asset_impl.h"
 
+#include <random>
+#include <vector>
+
 
 
 
@@ -105,9 +108,11 @@ public:
                 break;
             case OWNERSHIP:
                 ++arrayElementCount[assets[index].varStruct.ownership.issuanceIndex];
+                EXPECT_EQ(indexLists.findOwnership(assets[index].varStruct.ownership.issuanceIndex, assets[index].varStruct.ownership.publicKey, assets[index].varStruct.ownership.managingContractIndex), index);
                 break;
             case POSSESSION:
                 ++arrayElementCount[assets[index].varStruct.possession.ownershipIndex];
+                EXPECT_EQ(indexLists.findPossession(assets[index].varStruct.possession.ownershipIndex, assets[index].varStruct.possession.publicKey, assets[index].varStruct.possession.managingContractIndex), index);
                 break;
             }
         }
@@ -758,3 +763,130 @@ TEST(TestCoreAssets, AssetTransferShareManagementRights)
 
 
 
+
+// Reference of ownershipSlot(): probe from start index of owner until finding matching or empty slot
+static unsigned int probeOwnershipSlot(unsigned int issuanceIdx, const m256i& owner, unsigned short managingContractIndex)
+{
+    unsigned int idx = owner.m256i_u32[0] & (ASSETS_CAPACITY - 1);
+    while (assets[idx].varStruct.ownership.type != EMPTY
+        && !(assets[idx].varStruct.ownership.type == OWNERSHIP
+            && assets[idx].varStruct.ownership.issuanceIndex == issuanceIdx
+            && assets[idx].varStruct.ownership.managingContractIndex == managingContractIndex
+            && assets[idx].varStruct.ownership.publicKey == owner))
+    {
+        idx = (idx + 1) & (ASSETS_CAPACITY - 1);
+    }
+    return idx;
+}
+
+// Reference of possessionSlot(), treating occupiedIdx as non-empty (new ownership record is inserted before)
+static unsigned int probePossessionSlot(unsigned int ownershipIdx, const m256i& possessor, unsigned short managingContractIndex, unsigned int occupiedIdx)
+{
+    unsigned int idx = possessor.m256i_u32[0] & (ASSETS_CAPACITY - 1);
+    while ((assets[idx].varStruct.possession.type != EMPTY || idx == occupiedIdx)
+        && !(assets[idx].varStruct.possession.type == POSSESSION
+            && assets[idx].varStruct.possession.ownershipIndex == ownershipIdx
+            && assets[idx].varStruct.possession.managingContractIndex == managingContractIndex
+            && assets[idx].varStruct.possession.publicKey == possessor))
+    {
+        idx = (idx + 1) & (ASSETS_CAPACITY - 1);
+    }
+    return idx;
+}
+
+TEST(TestCoreAssets, HashIndexMatchesProbing)
+{
+    AssetsTest test;
+    test.clearUniverse();
+    std::mt19937_64 gen64(42);
+
+    // Few different start indices lead to long probe sequences like in a crowded universe
+    std::vector<m256i> publicKeys(300);
+    for (auto& publicKey : publicKeys)
+    {
+        publicKey = m256i(gen64(), gen64(), gen64(), gen64());
+        publicKey.m256i_u32[0] = (unsigned int)(gen64() % 64);
+    }
+
+    std::vector<std::pair<int, int>> records;
+    for (int i = 0; i < 5; i++)
+    {
+        int issuanceIdx, ownershipIdx, possessionIdx;
+        EXPECT_EQ(issueAsset(publicKeys[i], assetNameFromInt64(assetNameFromString("ASSET") + i).c_str(), 0, CONTRACT_ASSET_UNIT_OF_MEASUREMENT,
+            1000000, 1, &issuanceIdx, &ownershipIdx, &possessionIdx), 1000000);
+        records.push_back({ ownershipIdx, possessionIdx });
+    }
+
+    for (int i = 0; i < 5000; i++)
+    {
+        const auto record = records[gen64() % records.size()];
+        const auto& ownership = assets[record.first].varStruct.ownership;
+        const auto& possession = assets[record.second].varStruct.possession;
+        if (possession.numberOfShares <= 0)
+            continue;
+        const long long numberOfShares = 1 + gen64() % possession.numberOfShares;
+
+        int destinationOwnershipIdx = -1, destinationPossessionIdx = -1;
+        unsigned int expectedOwnershipIdx, expectedPossessionIdx;
+        if (gen64() % 4)
+        {
+            const m256i& destination = publicKeys[gen64() % publicKeys.size()];
+            expectedOwnershipIdx = probeOwnershipSlot(ownership.issuanceIndex, destination, ownership.managingContractIndex);
+            expectedPossessionIdx = probePossessionSlot(expectedOwnershipIdx, destination, possession.managingContractIndex, expectedOwnershipIdx);
+            EXPECT_TRUE(transferShareOwnershipAndPossession(record.first, record.second, destination, numberOfShares, &destinationOwnershipIdx, &destinationPossessionIdx, false));
+        }
+        else
+        {
+            const unsigned short managingContractIndex = (unsigned short)(1 + gen64() % 4);
+            expectedOwnershipIdx = probeOwnershipSlot(ownership.issuanceIndex, ownership.publicKey, managingContractIndex);
+            expectedPossessionIdx = probePossessionSlot(expectedOwnershipIdx, possession.publicKey, managingContractIndex, expectedOwnershipIdx);
+            EXPECT_TRUE(transferShareManagementRights(record.first, record.second, managingContractIndex, managingContractIndex, numberOfShares, &destinationOwnershipIdx, &destinationPossessionIdx, false));
+        }
+        EXPECT_EQ(destinationOwnershipIdx, expectedOwnershipIdx);
+        EXPECT_EQ(destinationPossessionIdx, expectedPossessionIdx);
+        records.push_back({ destinationOwnershipIdx, destinationPossessionIdx });
+    }
+
+    test.checkAssetsConsistency();
+
+    // Index is rebuilt with the lists
+    as.indexLists.rebuild();
+    test.checkAssetsConsistency();
+}
+
+TEST(TestCoreAssets, UniverseDigestIncrementalMatchesFull)
+{
+    AssetsTest test;
+    test.clearUniverse();
+    markAllUniverseRecordsChanged();
+    m256i digest;
+    getUniverseDigest(digest);
+
+    // Nothing changed
+    m256i digestQuiet;
+    getUniverseDigest(digestQuiet);
+    EXPECT_EQ(digest, digestQuiet);
+
+    std::mt19937_64 gen64(123);
+    m256i issuer(gen64(), gen64(), gen64(), gen64());
+    int issuanceIdx, ownershipIdx, possessionIdx;
+    EXPECT_EQ(issueAsset(issuer, "DIGEST", 0, CONTRACT_ASSET_UNIT_OF_MEASUREMENT, 1000, 1, &issuanceIdx, &ownershipIdx, &possessionIdx), 1000);
+    for (int i = 0; i < 10; i++)
+    {
+        int destinationOwnershipIdx, destinationPossessionIdx;
+        EXPECT_TRUE(transferShareOwnershipAndPossession(ownershipIdx, possessionIdx, m256i(gen64(), gen64(), gen64(), gen64()), 10,
+            &destinationOwnershipIdx, &destinationPossessionIdx, false));
+    }
+    EXPECT_EQ(assetChangeListSize, 23);
+    EXPECT_FALSE(assetChangeListOverflow);
+
+    m256i digestIncremental;
+    getUniverseDigest(digestIncremental);
+    EXPECT_NE(digest, digestIncremental);
+    EXPECT_EQ(assetChangeListSize, 0);
+
+    markAllUniverseRecordsChanged();
+    m256i digestFull;
+    getUniverseDigest(digestFull);
+    EXPECT_EQ(digestIncremental, digestFull);
+}
@@ -0,0 +1,170 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "contract_core/chunked_state_digest.h"
+
+#include <random>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <Windows.h>
+#else
+#include <signal.h>
+#include <sys/mman.h>
+#endif
+
+
+static constexpr unsigned long long testChunkSize = 4096;
+
+// Reference implementation: hash all chunks and compute the tree level by level
+static m256i referenceDigest(const unsigned char* state, unsigned long long stateSize)
+{
+    if (!stateSize)
+        return m256i::zero();
+    const unsigned int numberOfChunks = (unsigned int)((stateSize + testChunkSize - 1) / testChunkSize);
+    unsigned int numberOfLeafs = 1;
+    while (numberOfLeafs < numberOfChunks)
+        numberOfLeafs <<= 1;
+    std::vector<m256i> level(numberOfLeafs, m256i::zero());
+    for (unsigned int i = 0; i < numberOfChunks; i++)
+    {
+        const unsigned long long offset = i * testChunkSize;
+        const unsigned long long size = std::min(testChunkSize, stateSize - offset);
+        KangarooTwelve(state + offset, (unsigned int)size, &level[i], 32);
+    }
+    while (level.size() > 1)
+    {
+        std::vector<m256i> parents(level.size() / 2);
+        for (size_t i = 0; i < parents.size(); i++)
+            KangarooTwelve64To32(&level[2 * i], &parents[i]);
+        level.swap(parents);
+    }
+    return level[0];
+}
+
+static m256i updateDigest(ChunkedStateDigest& stateDigest)
+{
+    const unsigned int changedChunks = stateDigest.collectChangedChunks();
+    for (unsigned int i = 0; i < changedChunks; i += 3)
+        stateDigest.hashChangedChunks(i, 3);
+    return stateDigest.updateRoot();
+}
+
+TEST(TestCoreChunkedStateDigest, MatchesReference)
+{
+    std::mt19937_64 gen64(42);
+    for (unsigned long long stateSize : { 0ull, 100ull, testChunkSize, testChunkSize * 3 + 5, testChunkSize * 17 })
+    {
+        std::vector<unsigned char> state(stateSize);
+        for (auto& byte : state)
+            byte = (unsigned char)gen64();
+
+        ChunkedStateDigest stateDigest;
+        EXPECT_TRUE(stateDigest.init(state.data(), stateSize, testChunkSize));
+        EXPECT_EQ(updateDigest(stateDigest), referenceDigest(state.data(), stateSize));
+        if (stateSize && stateSize <= testChunkSize)
+        {
+            // Same as K12 of the whole state (CONTRACT_STATE_DIGEST_VERSION 1)
+            m256i digest;
+            KangarooTwelve(state.data(), (unsigned int)stateSize, &digest, 32);
+            EXPECT_EQ(updateDigest(stateDigest), digest);
+        }
+
+        for (int i = 0; stateSize && i < 3; i++)
+        {
+            state[gen64() % stateSize]++;
+            stateDigest.markAllChanged();
+            EXPECT_EQ(updateDigest(stateDigest), referenceDigest(state.data(), stateSize));
+        }
+        stateDigest.deinit();
+    }
+}
+
+// Write tracking with page protection, like in the node
+static ChunkedStateDigest* trackedStateDigest = nullptr;
+
+static bool protectMemory(void* address, unsigned long long size, bool writable)
+{
+#ifdef _MSC_VER
+    DWORD oldProtect;
+    return VirtualProtect(address, size, writable ? PAGE_READWRITE : PAGE_READONLY, &oldProtect) != 0;
+#else
+    return mprotect(address, size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ) == 0;
+#endif
+}
+
+#ifdef _MSC_VER
+static LONG CALLBACK writeFaultHandler(PEXCEPTION_POINTERS exceptionInfo)
+{
+    const EXCEPTION_RECORD* record = exceptionInfo->ExceptionRecord;
+    if (record->ExceptionCode == EXCEPTION_ACCESS_VIOLATION && record->ExceptionInformation[0] == 1
+        && trackedStateDigest->onWriteFault((void*)record->ExceptionInformation[1]))
+        return EXCEPTION_CONTINUE_EXECUTION;
+    return EXCEPTION_CONTINUE_SEARCH;
+}
+#else
+static void writeFaultHandler(int, siginfo_t* info, void*)
+{
+    if (!trackedStateDigest->onWriteFault(info->si_addr))
+        signal(SIGSEGV, SIG_DFL);
+}
+#endif
+
+TEST(TestCoreChunkedStateDigest, WriteTracking)
+{
+    const unsigned long long numberOfChunks = 37;
+    const unsigned long long stateSize = numberOfChunks * testChunkSize - 10;
+#ifdef _MSC_VER
+    unsigned char* state = (unsigned char*)VirtualAlloc(NULL, numberOfChunks * testChunkSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    void* handler = AddVectoredExceptionHandler(1, writeFaultHandler);
+#else
+    unsigned char* state = (unsigned char*)mmap(nullptr, numberOfChunks * testChunkSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    struct sigaction action = {}, previousAction;
+    action.sa_sigaction = writeFaultHandler;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigaction(SIGSEGV, &action, &previousAction);
+#endif
+
+    std::mt19937_64 gen64(37);
+    for (unsigned long long i = 0; i < stateSize; i++)
+        state[i] = (unsigned char)gen64();
+
+    ChunkedStateDigest stateDigest;
+    trackedStateDigest = &stateDigest;
+    EXPECT_TRUE(stateDigest.init(state, stateSize, testChunkSize, protectMemory));
+    EXPECT_TRUE(stateDigest.isWriteTracking());
+    EXPECT_EQ(updateDigest(stateDigest), referenceDigest(state, stateSize));
+
+    // Without writes, nothing has to be hashed
+    EXPECT_EQ(stateDigest.collectChangedChunks(), 0u);
+    EXPECT_EQ(stateDigest.updateRoot(), referenceDigest(state, stateSize));
+
+    for (unsigned int writes : { 1u, 2u, 10u, 100u })
+    {
+        std::vector<bool> chunkWritten(numberOfChunks, false);
+        for (unsigned int i = 0; i < writes; i++)
+        {
+            const unsigned long long offset = gen64() % stateSize;
+            state[offset] ^= 0x5A;
+            chunkWritten[offset / testChunkSize] = true;
+        }
+        unsigned int writtenChunks = 0;
+        for (bool written : chunkWritten)
+            writtenChunks += written;
+
+        EXPECT_EQ(stateDigest.collectChangedChunks(), writtenChunks);
+        EXPECT_EQ(updateDigest(stateDigest), referenceDigest(state, stateSize));
+    }
+
+    stateDigest.markAllChanged();
+    stateDigest.deinit();
+    trackedStateDigest = nullptr;
+#ifdef _MSC_VER
+    RemoveVectoredExceptionHandler(handler);
+    VirtualFree(state, 0, MEM_RELEASE);
+#else
+    sigaction(SIGSEGV, &previousAction, nullptr);
+    munmap(state, numberOfChunks * testChunkSize);
+#endif
+}
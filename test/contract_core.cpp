@@ -5,6 +5,7 @@
 #define TRACK_MAX_STACK_BUFFER_SIZE
 #include "../src/contract_core/stack_buffer.h"
 #include "../src/contract_core/contract_action_tracker.h"
+#include "../src/contract_core/contract_function_cache.h"
 
 TEST(TestCoreContractCore, StackBuffer)
 {
@@ -165,3 +166,61 @@ TEST(TestCoreContractCore, ContractActionTracker)
 
     at.freeBuffer();
 }
+
+TEST(TestCoreContractCore, ContractFunctionResultCache)
+{
+    ContractFunctionResultCache cache;
+    EXPECT_TRUE(cache.init());
+
+    unsigned char input[100], output[200];
+    for (unsigned int i = 0; i < sizeof(input); ++i)
+        input[i] = i;
+    for (unsigned int i = 0; i < sizeof(output); ++i)
+        output[i] = 3 * i;
+    const m256i digest = ContractFunctionResultCache::computeInputDigest(input, sizeof(input));
+    const m256i otherDigest = ContractFunctionResultCache::computeInputDigest(input, sizeof(input) - 1);
+    EXPECT_NE(digest, otherDigest);
+
+    unsigned int outputSize = 0;
+    EXPECT_EQ(cache.tryGet(0, 1, 2, digest, 100, 5, outputSize), nullptr);
+    cache.put(1, 2, digest, 100, 5, output, sizeof(output));
+
+    // Hit for the same key, tick, and state version
+    const void* cached = cache.tryGet(1, 1, 2, digest, 100, 5, outputSize);
+    ASSERT_NE(cached, nullptr);
+    EXPECT_EQ(outputSize, sizeof(output));
+    EXPECT_EQ(memcmp(cached, output, sizeof(output)), 0);
+
+    // Miss if key differs
+    EXPECT_EQ(cache.tryGet(0, 3, 2, digest, 100, 5, outputSize), nullptr);
+    EXPECT_EQ(cache.tryGet(0, 1, 3, digest, 100, 5, outputSize), nullptr);
+    EXPECT_EQ(cache.tryGet(0, 1, 2, otherDigest, 100, 5, outputSize), nullptr);
+
+    // Miss if contract state or tick changed
+    EXPECT_EQ(cache.tryGet(0, 1, 2, digest, 100, 6, outputSize), nullptr);
+    EXPECT_EQ(cache.tryGet(0, 1, 2, digest, 101, 5, outputSize), nullptr);
+
+    // Updating the entry with the new version makes it valid again, but not for the old version
+    output[0] = 42;
+    cache.put(1, 2, digest, 100, 6, output, 1);
+    cached = cache.tryGet(0, 1, 2, digest, 100, 6, outputSize);
+    ASSERT_NE(cached, nullptr);
+    EXPECT_EQ(outputSize, 1);
+    EXPECT_EQ(*(const unsigned char*)cached, 42);
+    EXPECT_EQ(cache.tryGet(0, 1, 2, digest, 100, 5, outputSize), nullptr);
+
+    // Empty output can be cached
+    cache.put(1, 2, digest, 100, 7, output, 0);
+    EXPECT_NE(cache.tryGet(0, 1, 2, digest, 100, 7, outputSize), nullptr);
+    EXPECT_EQ(outputSize, 0);
+
+    // Output too large for caching
+    std::vector<unsigned char> largeOutput(ContractFunctionResultCache::maxOutputSize + 1, 1);
+    cache.put(1, 2, otherDigest, 100, 5, largeOutput.data(), (unsigned int)largeOutput.size());
+    EXPECT_EQ(cache.tryGet(0, 1, 2, otherDigest, 100, 5, outputSize), nullptr);
+
+    EXPECT_EQ(cache.getHits(), 3);
+    EXPECT_EQ(cache.getMisses(), 8);
+
+    cache.deinit();
+}
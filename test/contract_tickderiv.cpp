@@ -0,0 +1,325 @@
+#define NO_UEFI
+
+#include "contract_testing.h"
+
+constexpr uint16 PROCEDURE_INDEX_PLACE_BET = 1;
+constexpr uint16 PROCEDURE_INDEX_CLAIM_WINNINGS = 4;
+constexpr uint16 PROCEDURE_INDEX_SET_AUTO_PAYOUT = 5;
+constexpr uint16 FUNCTION_INDEX_GET_CURRENT_ROUND = 1;
+constexpr uint16 FUNCTION_INDEX_GET_CONTRACT_STATS = 4;
+constexpr uint16 FUNCTION_INDEX_GET_USER_CLAIMABLE = 5;
+
+static const id TICKDERIV_OWNER = id(100, 200, 300, 400);
+
+// Price of the round start or end at the given tick, as computed by the contract
+static sint64 roundPrice(uint32 tick)
+{
+    uint64 seed = tick;
+    seed = seed * 1103515245ULL + 12345ULL;
+    seed = (seed / 65536ULL) % 32768ULL;
+    return (2500 + (sint64)(seed % 1000) - 500) * 100000;
+}
+
+class ContractTestingTickDeriv : protected ContractTesting
+{
+public:
+    ContractTestingTickDeriv()
+    {
+        initEmptySpectrum();
+        initEmptyUniverse();
+        INIT_CONTRACT(TickDeriv);
+        system.epoch = contractDescriptions[TickDeriv_CONTRACT_INDEX].constructionEpoch;
+        system.tick = 1000;
+        callSystemProcedure(TickDeriv_CONTRACT_INDEX, INITIALIZE);
+        state()->owner = TICKDERIV_OWNER;
+        increaseEnergy(TICKDERIV_OWNER, 1);
+    }
+
+    TickDerivState* state()
+    {
+        return (TickDerivState*)contractStates[TickDeriv_CONTRACT_INDEX];
+    }
+
+    void placeBet(const id& user, uint8 direction, uint64 amount)
+    {
+        TickDeriv::PlaceBet_input input{ direction };
+        TickDeriv::PlaceBet_output output;
+        EXPECT_TRUE(invokeUserProcedure(TickDeriv_CONTRACT_INDEX, PROCEDURE_INDEX_PLACE_BET, input, output, user, amount));
+    }
+
+    TickDeriv::ClaimWinnings_output claimWinnings(const id& user)
+    {
+        TickDeriv::ClaimWinnings_input input;
+        TickDeriv::ClaimWinnings_output output;
+        EXPECT_TRUE(invokeUserProcedure(TickDeriv_CONTRACT_INDEX, PROCEDURE_INDEX_CLAIM_WINNINGS, input, output, user, 0));
+        return output;
+    }
+
+    bool setAutoPayout(const id& user, bool enabled)
+    {
+        TickDeriv::SetAutoPayout_input input{ enabled };
+        TickDeriv::SetAutoPayout_output output;
+        EXPECT_TRUE(invokeUserProcedure(TickDeriv_CONTRACT_INDEX, PROCEDURE_INDEX_SET_AUTO_PAYOUT, input, output, user, 0));
+        return output.success;
+    }
+
+    TickDeriv::GetCurrentRound_output getCurrentRound()
+    {
+        TickDeriv::GetCurrentRound_input input;
+        TickDeriv::GetCurrentRound_output output;
+        callFunction(TickDeriv_CONTRACT_INDEX, FUNCTION_INDEX_GET_CURRENT_ROUND, input, output);
+        return output;
+    }
+
+    TickDeriv::GetContractStats_output getContractStats()
+    {
+        TickDeriv::GetContractStats_input input;
+        TickDeriv::GetContractStats_output output;
+        callFunction(TickDeriv_CONTRACT_INDEX, FUNCTION_INDEX_GET_CONTRACT_STATS, input, output);
+        return output;
+    }
+
+    TickDeriv::GetUserClaimable_output getUserClaimable(const id& user)
+    {
+        TickDeriv::GetUserClaimable_input input{ user };
+        TickDeriv::GetUserClaimable_output output;
+        callFunction(TickDeriv_CONTRACT_INDEX, FUNCTION_INDEX_GET_USER_CLAIMABLE, input, output);
+        return output;
+    }
+
+    void beginTick(uint32 tick)
+    {
+        system.tick = tick;
+        callSystemProcedure(TickDeriv_CONTRACT_INDEX, BEGIN_TICK);
+    }
+
+    void endEpoch()
+    {
+        callSystemProcedure(TickDeriv_CONTRACT_INDEX, END_EPOCH);
+    }
+
+    // Lock and resolve the current round in BEGIN_TICK at a tick whose price results in the winning direction
+    // (2 = draw), return the resolution tick
+    uint32 resolveRound(uint8 winningDirection)
+    {
+        const sint64 startPrice = state()->currentRound.startPrice;
+        uint32 tick = state()->currentRound.endTick + 5;
+        while (true)
+        {
+            const sint64 endPrice = roundPrice(tick);
+            const uint8 direction = (endPrice > startPrice) ? Direction::UP : ((endPrice < startPrice) ? Direction::DOWN : 2);
+            if (direction == winningDirection)
+                break;
+            ++tick;
+        }
+        const uint32 roundsBefore = state()->totalRoundsCount;
+        beginTick(tick);
+        EXPECT_EQ(state()->totalRoundsCount, roundsBefore + 1);
+        const Round resolved = state()->history.get((state()->historyWriteIndex - 1) & (HISTORY_SIZE - 1));
+        EXPECT_EQ(resolved.winningDirection, winningDirection);
+        EXPECT_EQ(state()->currentRound.state, RoundState::ACTIVE);
+        return tick;
+    }
+};
+
+TEST(ContractTickDeriv, RoundSettlementAndClaimWinnings)
+{
+    ContractTestingTickDeriv tickDeriv;
+    const id userA(1, 0, 0, 0), userB(2, 0, 0, 0), userC(3, 0, 0, 0);
+    for (const id& user : { userA, userB, userC })
+        increaseEnergy(user, 100000000);
+
+    // Only the owner can switch automatic payout
+    EXPECT_FALSE(tickDeriv.setAutoPayout(userA, false));
+    EXPECT_TRUE(tickDeriv.state()->autoPayoutEnabled);
+    EXPECT_TRUE(tickDeriv.setAutoPayout(TICKDERIV_OWNER, false));
+
+    tickDeriv.placeBet(userA, Direction::UP, 10000000);
+    tickDeriv.placeBet(userB, Direction::UP, 30000000);
+    tickDeriv.placeBet(userC, Direction::DOWN, 40000000);
+    EXPECT_EQ(tickDeriv.getCurrentRound().betCount, 3u);
+
+    // Invalid direction and too small bets are refunded
+    tickDeriv.placeBet(userC, 5, 10000000);
+    tickDeriv.placeBet(userC, Direction::DOWN, MIN_BET - 1);
+    EXPECT_EQ(getBalance(userC), 60000000);
+    EXPECT_EQ(tickDeriv.getCurrentRound().betCount, 3u);
+
+    // Pool of 80M minus 2% fee is shared by the UP bets
+    const uint32 resolutionTick = tickDeriv.resolveRound(Direction::UP);
+    EXPECT_EQ(tickDeriv.getContractStats().collectedFees, 1600000u);
+    EXPECT_EQ(tickDeriv.getContractStats().totalPayouts, 78400000u);
+
+    // Without automatic payout, winnings stay claimable
+    tickDeriv.beginTick(resolutionTick + 1);
+    EXPECT_EQ(getBalance(userA), 90000000);
+    EXPECT_EQ(tickDeriv.getUserClaimable(userA).totalClaimable, 19600000u);
+    EXPECT_EQ(tickDeriv.getUserClaimable(userA).unclaimedBets, 1u);
+    EXPECT_EQ(tickDeriv.getUserClaimable(userB).totalClaimable, 58800000u);
+    EXPECT_EQ(tickDeriv.getUserClaimable(userC).totalClaimable, 0u);
+
+    auto claimed = tickDeriv.claimWinnings(userA);
+    EXPECT_TRUE(claimed.success);
+    EXPECT_EQ(claimed.totalClaimed, 19600000u);
+    EXPECT_EQ(claimed.betsClaimed, 1u);
+    EXPECT_EQ(getBalance(userA), 109600000);
+    EXPECT_EQ(tickDeriv.getUserClaimable(userA).totalClaimable, 0u);
+
+    // Nothing to claim twice or for losing bets
+    EXPECT_FALSE(tickDeriv.claimWinnings(userA).success);
+    EXPECT_EQ(getBalance(userA), 109600000);
+    claimed = tickDeriv.claimWinnings(userC);
+    EXPECT_FALSE(claimed.success);
+    EXPECT_EQ(claimed.totalClaimed, 0u);
+    EXPECT_EQ(getBalance(userC), 60000000);
+
+    EXPECT_TRUE(tickDeriv.claimWinnings(userB).success);
+    EXPECT_EQ(getBalance(userB), 128800000);
+}
+
+TEST(ContractTickDeriv, DrawRefundsBets)
+{
+    ContractTestingTickDeriv tickDeriv;
+    EXPECT_TRUE(tickDeriv.setAutoPayout(TICKDERIV_OWNER, false));
+
+    const id userA(1, 0, 0, 0), userC(3, 0, 0, 0);
+    increaseEnergy(userA, 100000000);
+    increaseEnergy(userC, 100000000);
+    tickDeriv.placeBet(userA, Direction::UP, 10000000);
+    tickDeriv.placeBet(userC, Direction::DOWN, 20000000);
+
+    tickDeriv.resolveRound(2);
+    EXPECT_EQ(tickDeriv.getContractStats().collectedFees, 0u);
+    EXPECT_EQ(tickDeriv.getUserClaimable(userA).totalClaimable, 10000000u);
+    EXPECT_EQ(tickDeriv.getUserClaimable(userC).totalClaimable, 20000000u);
+
+    EXPECT_EQ(tickDeriv.claimWinnings(userA).totalClaimed, 10000000u);
+    EXPECT_EQ(tickDeriv.claimWinnings(userC).totalClaimed, 20000000u);
+    EXPECT_EQ(getBalance(userA), 100000000);
+    EXPECT_EQ(getBalance(userC), 100000000);
+}
+
+TEST(ContractTickDeriv, AutoPayoutInBeginTick)
+{
+    ContractTestingTickDeriv tickDeriv;
+    EXPECT_TRUE(tickDeriv.state()->autoPayoutEnabled);
+
+    // 100 winning bets of 1M share 196M (pool of 200M minus 2% fee)
+    const id userA(1, 0, 0, 0), userC(3, 0, 0, 0);
+    increaseEnergy(userA, 100000000);
+    increaseEnergy(userC, 110000000);
+    for (int i = 0; i < 100; ++i)
+        tickDeriv.placeBet(userA, Direction::UP, 1000000);
+    tickDeriv.placeBet(userC, Direction::DOWN, 100000000);
+
+    const uint32 resolutionTick = tickDeriv.resolveRound(Direction::UP);
+    EXPECT_EQ(getBalance(userA), 0);
+
+    // At most AUTO_PAYOUT_BETS_PER_TICK bets are paid out per tick
+    tickDeriv.beginTick(resolutionTick + 1);
+    EXPECT_EQ(getBalance(userA), AUTO_PAYOUT_BETS_PER_TICK * 1960000LL);
+    tickDeriv.beginTick(resolutionTick + 2);
+    EXPECT_EQ(getBalance(userA), 196000000);
+    EXPECT_EQ(getBalance(userC), 10000000);
+
+    EXPECT_EQ(tickDeriv.getUserClaimable(userA).totalClaimable, 0u);
+    EXPECT_FALSE(tickDeriv.claimWinnings(userA).success);
+    EXPECT_EQ(getBalance(userA), 196000000);
+
+    // Disabled automatic payout leaves the winnings claimable
+    EXPECT_TRUE(tickDeriv.setAutoPayout(TICKDERIV_OWNER, false));
+    tickDeriv.placeBet(userA, Direction::UP, 10000000);
+    tickDeriv.placeBet(userC, Direction::DOWN, 10000000);
+    const uint32 secondResolutionTick = tickDeriv.resolveRound(Direction::UP);
+    tickDeriv.beginTick(secondResolutionTick + 1);
+    EXPECT_EQ(getBalance(userA), 186000000);
+    EXPECT_EQ(tickDeriv.getUserClaimable(userA).totalClaimable, 19600000u);
+    EXPECT_EQ(tickDeriv.claimWinnings(userA).totalClaimed, 19600000u);
+    EXPECT_EQ(getBalance(userA), 205600000);
+}
+
+TEST(ContractTickDeriv, EvictedWinningsStayClaimable)
+{
+    ContractTestingTickDeriv tickDeriv;
+    EXPECT_TRUE(tickDeriv.setAutoPayout(TICKDERIV_OWNER, false));
+
+    const id winner1(1, 0, 0, 0), winner2(2, 0, 0, 0), loser(3, 0, 0, 0), filler(4, 0, 0, 0);
+    for (const id& user : { winner1, winner2, loser })
+        increaseEnergy(user, 10000000);
+    increaseEnergy(filler, (2 * MAX_BETS_PER_ROUND + 2) * 1000000LL);
+
+    // Pool of 5M minus 2% fee is shared by the two winners
+    tickDeriv.placeBet(winner1, Direction::UP, 1000000);
+    tickDeriv.placeBet(winner2, Direction::UP, 1000000);
+    tickDeriv.placeBet(loser, Direction::DOWN, 1000000);
+    tickDeriv.placeBet(filler, Direction::DOWN, 2000000);
+    tickDeriv.resolveRound(Direction::UP);
+
+    // The entry of winner2 is missing when its bet leaves the bet history
+    tickDeriv.state()->bettors.removeByKey(winner2);
+
+    // Fill the bet history, so that the bets of the first round are evicted
+    for (int round = 0; round < 2; ++round)
+    {
+        for (unsigned int i = 0; i < MAX_BETS_PER_ROUND; ++i)
+            tickDeriv.placeBet(filler, Direction::DOWN, 1000000);
+        if (round == 0)
+            tickDeriv.resolveRound(Direction::UP);
+    }
+    EXPECT_EQ(tickDeriv.state()->betHistoryCount, BET_HISTORY_SIZE + 4ULL);
+
+    for (const id& winner : { winner1, winner2 })
+    {
+        BettorInfo bettorInfo;
+        EXPECT_TRUE(tickDeriv.state()->bettors.get(winner, bettorInfo));
+        EXPECT_EQ(bettorInfo.claimable, 2450000u);
+        EXPECT_EQ(bettorInfo.unclaimedBets, 1u);
+        EXPECT_EQ(tickDeriv.getUserClaimable(winner).totalClaimable, 2450000u);
+    }
+
+    // Claimed bettors without bets in the history are removed
+    auto claimed = tickDeriv.claimWinnings(winner2);
+    EXPECT_EQ(claimed.totalClaimed, 2450000u);
+    EXPECT_EQ(claimed.betsClaimed, 1u);
+    EXPECT_EQ(getBalance(winner2), 11450000);
+    EXPECT_FALSE(tickDeriv.state()->bettors.contains(winner2));
+
+    // END_EPOCH removes bettors without claimable winnings and bets in the history
+    EXPECT_TRUE(tickDeriv.state()->bettors.contains(loser));
+    tickDeriv.endEpoch();
+    EXPECT_FALSE(tickDeriv.state()->bettors.contains(loser));
+    EXPECT_TRUE(tickDeriv.state()->bettors.contains(winner1));
+    EXPECT_TRUE(tickDeriv.state()->bettors.contains(filler));
+    EXPECT_EQ(tickDeriv.state()->bettors.population(), 2u);
+
+    EXPECT_EQ(tickDeriv.claimWinnings(winner1).totalClaimed, 2450000u);
+    EXPECT_EQ(getBalance(winner1), 11450000);
+}
+
+TEST(ContractTickDeriv, FullBettorsMapRemovesInactiveBettors)
+{
+    ContractTestingTickDeriv tickDeriv;
+    const id userA(1, 0, 0, 0), userB(2, 0, 0, 0);
+    increaseEnergy(userA, 10000000);
+    increaseEnergy(userB, 10000000);
+
+    // Bettors without bets and winnings are removed to make space for a new bettor
+    BettorInfo inactive{ 0, 0, 0 };
+    for (uint64 i = 0; i < MAX_BETTORS; ++i)
+        EXPECT_NE(tickDeriv.state()->bettors.set(id(i, 7, 0, 0), inactive), NULL_INDEX);
+    tickDeriv.placeBet(userA, Direction::UP, 1000000);
+    EXPECT_EQ(tickDeriv.getCurrentRound().betCount, 1u);
+    EXPECT_EQ(tickDeriv.state()->bettors.population(), 1u);
+
+    // Bettors with unclaimed winnings are kept, so the bet of a new bettor is refunded
+    BettorInfo active{ 0, 1, 1 };
+    for (uint64 i = 1; i < MAX_BETTORS; ++i)
+        EXPECT_NE(tickDeriv.state()->bettors.set(id(i, 8, 0, 0), active), NULL_INDEX);
+    tickDeriv.placeBet(userB, Direction::UP, 1000000);
+    EXPECT_EQ(tickDeriv.getCurrentRound().betCount, 1u);
+    EXPECT_EQ(getBalance(userB), 10000000);
+
+    // Known bettors can still bet
+    tickDeriv.placeBet(userA, Direction::DOWN, 1000000);
+    EXPECT_EQ(tickDeriv.getCurrentRound().betCount, 2u);
+}
@@ -0,0 +1,188 @@
+#define NO_UEFI
+#define SINGLE_COMPILE_UNIT
+
+#include "gtest/gtest.h"
+
+#include "digest_tree.h"
+
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+// Threads calling tryHelp() while idle, like the request processors in the node
+class DigestTreeHelpers
+{
+public:
+    DigestTreeHelpers(DigestTreeBuilder& builder, unsigned int count) : stop(false)
+    {
+        for (unsigned int i = 0; i < count; i++)
+        {
+            threads.emplace_back([this, &builder]()
+                {
+                    while (!stop)
+                    {
+                        builder.tryHelp();
+                        std::this_thread::yield();
+                    }
+                });
+        }
+    }
+
+    ~DigestTreeHelpers()
+    {
+        stop = true;
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+private:
+    std::atomic<bool> stop;
+    std::vector<std::thread> threads;
+};
+
+// Sequential reference implementation: compute all digests level by level
+static std::vector<m256i> referenceTree(const std::vector<m256i>& leafData)
+{
+    const unsigned int numberOfLeafs = (unsigned int)leafData.size();
+    std::vector<m256i> digests(numberOfLeafs * 2 - 1);
+    for (unsigned int i = 0; i < numberOfLeafs; i++)
+        KangarooTwelve(&leafData[i], sizeof(m256i), &digests[i], 32);
+    unsigned int levelBeginning = 0;
+    for (unsigned int levelSize = numberOfLeafs; levelSize > 1; levelSize >>= 1)
+    {
+        for (unsigned int i = 0; i < levelSize; i += 2)
+            KangarooTwelve64To32(&digests[levelBeginning + i], &digests[levelBeginning + levelSize + (i >> 1)]);
+        levelBeginning += levelSize;
+    }
+    return digests;
+}
+
+static void expectEqualTrees(const std::vector<m256i>& expected, const m256i* digests)
+{
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        EXPECT_EQ(expected[i], digests[i]) << "digest index " << i;
+        if (expected[i] != digests[i])
+            break;
+    }
+}
+
+static void testBuildAndUpdate(unsigned int numberOfLeafs, unsigned int numberOfHelpers, unsigned int leafsPerTask)
+{
+    DigestTreeBuilder builder;
+    DigestTreeHelpers helpers(builder, numberOfHelpers);
+
+    std::mt19937_64 gen64(numberOfLeafs + numberOfHelpers);
+    std::vector<m256i> leafData(numberOfLeafs);
+    for (auto& leaf : leafData)
+        leaf = m256i(gen64(), gen64(), gen64(), gen64());
+
+    std::vector<m256i> digests(numberOfLeafs * 2 - 1, m256i::zero());
+    auto hashLeaf = [&](unsigned int index)
+    {
+        KangarooTwelve(&leafData[index], sizeof(m256i), &digests[index], 32);
+    };
+
+    auto hashLeafs = [&](unsigned int begin, unsigned int count)
+    {
+        for (unsigned int i = begin; i < begin + count; i++)
+            hashLeaf(i);
+    };
+    builder.buildTree(digests.data(), numberOfLeafs, hashLeafs);
+    expectEqualTrees(referenceTree(leafData), digests.data());
+
+    std::vector<unsigned long long> changeFlags((numberOfLeafs + 63) / 64, 0);
+    for (unsigned int changes : { 1u, 10u, numberOfLeafs / 3, numberOfLeafs })
+    {
+        for (unsigned int i = 0; i < changes; i++)
+        {
+            const unsigned int index = gen64() % numberOfLeafs;
+            leafData[index].m256i_u64[gen64() % 4] = gen64();
+            changeFlags[index >> 6] |= 1ULL << (index & 63);
+        }
+
+        builder.updateTree(digests.data(), numberOfLeafs, changeFlags.data(), hashLeaf, leafsPerTask);
+        expectEqualTrees(referenceTree(leafData), digests.data());
+        for (const auto flags : changeFlags)
+            EXPECT_EQ(flags, 0);
+    }
+}
+
+TEST(TestCoreDigestTree, RunProcessesEachTaskOnce)
+{
+    DigestTreeBuilder builder;
+    DigestTreeHelpers helpers(builder, 3);
+
+    for (unsigned int numberOfTasks : { 0u, 1u, 2u, 17u, 1000u })
+    {
+        std::vector<std::atomic<int>> counters(numberOfTasks);
+        auto task = [&](unsigned int taskIndex)
+        {
+            counters[taskIndex]++;
+        };
+        builder.run(numberOfTasks, task);
+        for (unsigned int i = 0; i < numberOfTasks; i++)
+            EXPECT_EQ(counters[i].load(), 1);
+    }
+}
+
+TEST(TestCoreDigestTree, SingleThreadMatchesReference)
+{
+    testBuildAndUpdate(64, 0, DigestTreeBuilder::nodesPerUpdateTask);
+    testBuildAndUpdate(1 << 16, 0, DigestTreeBuilder::nodesPerUpdateTask);
+    testBuildAndUpdate(1024, 0, 1);
+}
+
+TEST(TestCoreDigestTree, MultiThreadMatchesReference)
+{
+    testBuildAndUpdate(1 << 16, 3, DigestTreeBuilder::nodesPerUpdateTask);
+    testBuildAndUpdate(1 << 15, 7, 64);
+    testBuildAndUpdate(1024, 3, 1);
+}
+
+TEST(TestCoreDigestTree, UpdateAncestorsMatchesReference)
+{
+    for (unsigned int numberOfLeafs : { 1u, 2u, 64u, 1u << 12 })
+    {
+        DigestTreeBuilder builder;
+        std::mt19937_64 gen64(numberOfLeafs);
+        std::vector<m256i> leafData(numberOfLeafs);
+        for (auto& leaf : leafData)
+            leaf = m256i(gen64(), gen64(), gen64(), gen64());
+
+        std::vector<m256i> digests(numberOfLeafs * 2 - 1, m256i::zero());
+        auto hashLeafs = [&](unsigned int begin, unsigned int count)
+        {
+            for (unsigned int i = begin; i < begin + count; i++)
+                KangarooTwelve(&leafData[i], sizeof(m256i), &digests[i], 32);
+        };
+        builder.buildTree(digests.data(), numberOfLeafs, hashLeafs);
+
+        std::vector<unsigned long long> changeFlags((numberOfLeafs + 63) / 64, 0);
+        std::vector<unsigned int> changeList;
+        for (unsigned int changes : { 0u, 1u, 3u, numberOfLeafs / 2 + 1 })
+        {
+            // Build list without duplicates, like markSpectrumEntityChanged()
+            changeList.clear();
+            for (unsigned int i = 0; i < changes; i++)
+            {
+                const unsigned int index = gen64() % numberOfLeafs;
+                leafData[index].m256i_u64[gen64() % 4] = gen64();
+                if (!(changeFlags[index >> 6] & (1ULL << (index & 63))))
+                {
+                    changeFlags[index >> 6] |= 1ULL << (index & 63);
+                    changeList.push_back(index);
+                }
+            }
+            for (const auto index : changeList)
+                KangarooTwelve(&leafData[index], sizeof(m256i), &digests[index], 32);
+
+            DigestTreeBuilder::updateAncestors(digests.data(), numberOfLeafs, changeList.data(), (unsigned int)changeList.size(), changeFlags.data());
+            expectEqualTrees(referenceTree(leafData), digests.data());
+            for (const auto flags : changeFlags)
+                EXPECT_EQ(flags, 0);
+        }
+    }
+}
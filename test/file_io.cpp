@@ -682,3 +682,67 @@ TEST(TestAsyncFileIO, FindKLargestKDuplicated)
     }
 }
 
+
+TEST(TestAsyncFileIO, LoadParallel)
+{
+    // Larger than PARALLEL_LOAD_MIN_PART_SIZE, so it is read by 3 threads
+    const unsigned long long size = PARALLEL_LOAD_MIN_PART_SIZE * 2 + 12345;
+    std::vector<unsigned char> data(size), loaded(size + 1, 0);
+    unsigned long long i = 0;
+    for (; i + 8 <= size; i += 8)
+        *(unsigned long long*)&data[i] = random64(0xFFFFFFFFFFFFFFFFULL) ^ i;
+    for (; i < size; i++)
+        data[i] = (unsigned char)random64(0xFF);
+
+    CHAR16 fileName[] = L"load_parallel_test.bin";
+    EXPECT_EQ(save(fileName, size, data.data()), (long long)size);
+    EXPECT_EQ(loadParallel(fileName, size, loaded.data()), (long long)size);
+    EXPECT_TRUE(memcmp(data.data(), loaded.data(), size) == 0);
+    EXPECT_EQ(loaded[size], 0);
+
+    // Small files are read by one thread, but otherwise the same
+    setMem(loaded.data(), 1000, 0);
+    EXPECT_EQ(loadParallel(fileName, 1000, loaded.data()), 1000);
+    EXPECT_TRUE(memcmp(data.data(), loaded.data(), 1000) == 0);
+
+    // Reading beyond the end of the file fails
+    EXPECT_EQ(loadParallel(fileName, size + 1, loaded.data()), -1);
+    CHAR16 missingFileName[] = L"load_parallel_missing.bin";
+    EXPECT_EQ(loadParallel(missingFileName, 1000, loaded.data()), -1);
+    std::filesystem::remove("load_parallel_test.bin");
+}
+
+#ifdef __linux__
+TEST(TestAsyncFileIO, LoadParallelCompressed)
+{
+    // Partial last chunk, more chunks than threads
+    const unsigned long long chunkSize = 64 * 1024;
+    const unsigned long long size = chunkSize * 10 + 4321;
+    std::vector<unsigned char> data(size, 0), loaded(size + 1, 0);
+    for (unsigned long long i = 0; i < size; i += 3)
+        data[i] = (unsigned char)random(16);
+
+    CHAR16 fileName[] = L"load_parallel_compressed_test.bin";
+    EXPECT_TRUE(writeCompressedFile("load_parallel_compressed_test.bin", data.data(), size, 3, chunkSize));
+    EXPECT_LT(std::filesystem::file_size("load_parallel_compressed_test.bin"), size);
+    EXPECT_EQ(loadParallel(fileName, size, loaded.data()), (long long)size);
+    EXPECT_TRUE(memcmp(data.data(), loaded.data(), size) == 0);
+    EXPECT_EQ(loaded[size], 0);
+
+    // The size must match the size of the data
+    EXPECT_EQ(loadParallel(fileName, size - 1, loaded.data(), NULL, 8, false), -1);
+
+    // A corrupted chunk is detected
+    {
+        std::fstream file("load_parallel_compressed_test.bin", std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(std::filesystem::file_size("load_parallel_compressed_test.bin") / 2);
+        file.put(0x55);
+    }
+    EXPECT_EQ(loadParallel(fileName, size, loaded.data(), NULL, 8, false), -1);
+
+    // Empty data
+    EXPECT_TRUE(writeCompressedFile("load_parallel_compressed_test.bin", data.data(), 0));
+    EXPECT_EQ(loadParallel(fileName, 0, loaded.data()), 0);
+    std::filesystem::remove("load_parallel_compressed_test.bin");
+}
+#endif
@@ -7,8 +7,11 @@
 #include <lib/platform_common/qintrin.h>
 #include "gtest/gtest.h"
 
+#include <array>
 #include <chrono>
 #include <iostream>
+#include <random>
+#include <vector>
 
 static constexpr int ID_SIZE = 61;
 static inline void getIDChar(const unsigned char* key, char* identity, bool isLowerCase)
@@ -262,3 +265,123 @@ TEST(TestFourQ, TestSign)
         }
     }
 }
+
+// Signatures of numberOfKeys keys, each key signing signaturesPerKey different message digests
+struct SignatureTestSet
+{
+    std::vector<m256i> publicKeys, messageDigests;
+    std::vector<std::array<unsigned char, 64>> signatures;
+
+    SignatureTestSet(unsigned int numberOfKeys, unsigned int signaturesPerKey, unsigned long long seed)
+    {
+        std::mt19937_64 gen64(seed);
+        for (unsigned int i = 0; i < numberOfKeys; i++)
+        {
+            m256i subseed(gen64(), gen64(), gen64(), gen64());
+            m256i privateKey, publicKey;
+            getPrivateKey(subseed.m256i_u8, privateKey.m256i_u8);
+            getPublicKey(privateKey.m256i_u8, publicKey.m256i_u8);
+            for (unsigned int j = 0; j < signaturesPerKey; j++)
+            {
+                m256i messageDigest(gen64(), gen64(), gen64(), gen64());
+                std::array<unsigned char, 64> signature;
+                sign(subseed.m256i_u8, publicKey.m256i_u8, messageDigest.m256i_u8, signature.data());
+                publicKeys.push_back(publicKey);
+                messageDigests.push_back(messageDigest);
+                signatures.push_back(signature);
+            }
+        }
+    }
+
+    unsigned int size() const
+    {
+        return (unsigned int)signatures.size();
+    }
+
+    // Verify signature i with a key prepared like in computorVerificationKeys
+    bool verifyWithPreparedKey(unsigned int i) const
+    {
+        VerificationKey key;
+        return prepareVerificationKey(publicKeys[i].m256i_u8, key) && verifyWithKey(key, messageDigests[i].m256i_u8, signatures[i].data());
+    }
+};
+
+TEST(TestFourQ, TestVerifyWithKeyMatchesVerify)
+{
+#ifdef __AVX512F__
+    initAVX512FourQConstants();
+#endif
+
+    SignatureTestSet set(16, 4, 42);
+    for (unsigned int i = 0; i < set.size(); i++)
+    {
+        EXPECT_TRUE(verify(set.publicKeys[i].m256i_u8, set.messageDigests[i].m256i_u8, set.signatures[i].data()));
+        EXPECT_TRUE(set.verifyWithPreparedKey(i));
+    }
+
+    // Tamper with message digests, signatures, and public keys
+    set.messageDigests[0].m256i_u8[7] ^= 1;
+    set.signatures[5][3] ^= 0x10;
+    set.signatures[6][40] ^= 0x01;
+    set.signatures[7][63] = 1;
+    set.signatures[8][15] |= 0x80;
+    set.publicKeys[11].m256i_u8[0] ^= 1;
+    set.publicKeys[20].m256i_u8[15] |= 0x80;
+    for (unsigned int i = 0; i < 32; i++)
+        set.publicKeys[63].m256i_u8[i] = 0xff;
+
+    for (unsigned int i = 0; i < set.size(); i++)
+        EXPECT_EQ(set.verifyWithPreparedKey(i), verify(set.publicKeys[i].m256i_u8, set.messageDigests[i].m256i_u8, set.signatures[i].data())) << " at " << i;
+    for (unsigned int i : { 0, 5, 6, 7, 8, 11, 20, 63 })
+        EXPECT_FALSE(set.verifyWithPreparedKey(i)) << " at " << i;
+    EXPECT_TRUE(set.verifyWithPreparedKey(9));
+    EXPECT_TRUE(set.verifyWithPreparedKey(10));
+    EXPECT_TRUE(set.verifyWithPreparedKey(62));
+}
+
+TEST(TestFourQ, TestVerifyWithPreparedKey)
+{
+#ifdef __AVX512F__
+    initAVX512FourQConstants();
+#endif
+
+    SignatureTestSet set(2, 8, 7);
+    VerificationKey key;
+    EXPECT_TRUE(prepareVerificationKey(set.publicKeys[0].m256i_u8, key));
+    for (unsigned int i = 0; i < set.size(); i++)
+    {
+        // Only signatures of the first key are valid for the prepared key
+        EXPECT_EQ(verifyWithKey(key, set.messageDigests[i].m256i_u8, set.signatures[i].data()), i < 8) << " at " << i;
+    }
+
+    m256i invalidKey = set.publicKeys[0];
+    invalidKey.m256i_u8[15] |= 0x80;
+    EXPECT_FALSE(prepareVerificationKey(invalidKey.m256i_u8, key));
+}
+
+// Throughput of verify() and of verifyWithKey() with keys prepared in advance (see computorVerificationKeys) in
+// verifications per second on one core
+TEST(TestFourQ, BenchmarkVerify)
+{
+#ifdef __AVX512F__
+    initAVX512FourQConstants();
+#endif
+
+    SignatureTestSet set(1024, 1, 1);
+    std::vector<VerificationKey> keys(set.size());
+    for (unsigned int i = 0; i < set.size(); i++)
+        EXPECT_TRUE(prepareVerificationKey(set.publicKeys[i].m256i_u8, keys[i]));
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (unsigned int i = 0; i < set.size(); i++)
+        EXPECT_TRUE(verify(set.publicKeys[i].m256i_u8, set.messageDigests[i].m256i_u8, set.signatures[i].data()));
+    auto verifyMicroSec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    startTime = std::chrono::high_resolution_clock::now();
+    for (unsigned int i = 0; i < set.size(); i++)
+        EXPECT_TRUE(verifyWithKey(keys[i], set.messageDigests[i].m256i_u8, set.signatures[i].data()));
+    auto preparedMicroSec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    std::cout << "verify() " << set.size() * 1e6 / (verifyMicroSec + 1) << " / sec, verifyWithKey() "
+        << set.size() * 1e6 / (preparedMicroSec + 1) << " / sec per core" << std::endl;
+}
@@ -12,6 +12,8 @@
 
 #include <chrono>
 #include <iostream>
+#include <random>
+#include <vector>
 
 
 TEST(TestCoreK12, PerformanceDigest32Of1GB)
@@ -94,3 +96,61 @@ TEST(TestCoreK12, CompareK12Implementations)
     ASSERT_EQ(memcmp(outputArrayXKCP, outputArray, outputN), 0);
     delete [] inputPtr;
 }
+
+TEST(TestCoreK12, BatchDigest64To32MatchesScalar)
+{
+    std::mt19937_64 gen64(42);
+    constexpr unsigned int maxCount = 4 * K12_64TO32_LANES + 3;
+    std::vector<unsigned long long> input(maxCount * 8);
+    for (auto& word : input)
+        word = gen64();
+
+    std::vector<m256i> expected(maxCount);
+    for (unsigned int i = 0; i < maxCount; ++i)
+        KangarooTwelve64To32(&input[i * 8], &expected[i]);
+
+    // Consecutive inputs, including counts that are no multiple of the lane count
+    for (unsigned int count = 0; count <= maxCount; ++count)
+    {
+        std::vector<m256i> output(maxCount, m256i::zero());
+        KangarooTwelve64To32Batch(input.data(), output.data(), count);
+        for (unsigned int i = 0; i < maxCount; ++i)
+            EXPECT_EQ(output[i], (i < count) ? expected[i] : m256i::zero()) << "count " << count << ", index " << i;
+    }
+
+    // Scattered inputs and outputs
+    const void* inputs[K12_64TO32_LANES];
+    void* outputs[K12_64TO32_LANES];
+    std::vector<m256i> output(maxCount, m256i::zero());
+    for (unsigned int n = 0; n < K12_64TO32_LANES; ++n)
+    {
+        inputs[n] = &input[(maxCount - 1 - 3 * n) * 8];
+        outputs[n] = &output[n];
+    }
+    KangarooTwelve64To32Lanes(inputs, outputs);
+    for (unsigned int n = 0; n < K12_64TO32_LANES; ++n)
+        EXPECT_EQ(output[n], expected[maxCount - 1 - 3 * n]);
+}
+
+TEST(TestCoreK12, PerformanceBatchDigest64To32)
+{
+    constexpr unsigned int count = 1 << 20;
+    std::vector<m256i> data(count * 2);
+    std::mt19937_64 gen64(42);
+    for (auto& value : data)
+        value = m256i(gen64(), gen64(), gen64(), gen64());
+    std::vector<m256i> outputScalar(count), outputBatch(count);
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (unsigned int i = 0; i < count; ++i)
+        KangarooTwelve64To32(&data[i * 2], &outputScalar[i]);
+    auto durationScalar = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime);
+
+    startTime = std::chrono::high_resolution_clock::now();
+    KangarooTwelve64To32Batch(data.data(), outputBatch.data(), count);
+    auto durationBatch = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime);
+
+    std::cout << std::dec << "K12 64 to 32 bytes, " << count << " digests: scalar " << durationScalar.count() << " us, "
+        << K12_64TO32_LANES << " lanes " << durationBatch.count() << " us" << std::endl;
+    EXPECT_EQ(memcmp(outputScalar.data(), outputBatch.data(), count * sizeof(m256i)), 0);
+}
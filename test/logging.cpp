@@ -0,0 +1,104 @@
+#define NO_UEFI
+#define SINGLE_COMPILE_UNIT
+
+#include "gtest/gtest.h"
+
+#include "logging_test.h"
+
+
+static void logTransfer(long long amount)
+{
+    QuTransfer transfer;
+    transfer.sourcePublicKey = m256i(1, 2, 3, 4);
+    transfer.destinationPublicKey = m256i(5, 6, 7, 8);
+    transfer.amount = amount;
+    logger.logQuTransfer(transfer);
+}
+
+static long long getTransferAmount(unsigned long long logId)
+{
+    qLogger::BlobInfo bi = logger.logBuf.getBlobInfo(logId);
+    EXPECT_EQ(bi.length, LOG_HEADER_SIZE + offsetof(QuTransfer, _terminator));
+    if (bi.length != LOG_HEADER_SIZE + offsetof(QuTransfer, _terminator))
+        return -1;
+    QuTransfer transfer;
+    logger.logBuf.getMany((char*)&transfer, bi.startIndex + LOG_HEADER_SIZE, offsetof(QuTransfer, _terminator));
+    return transfer.amount;
+}
+
+static void expectTxLogIds(unsigned int tick, unsigned int txId, long long fromLogId, long long length)
+{
+    qLogger::BlobInfo info = logger.tx.getLogIdInfo(0, tick, txId);
+    EXPECT_EQ(info.startIndex, fromLogId) << "tick " << tick << ", tx " << txId;
+    EXPECT_EQ(info.length, length) << "tick " << tick << ", tx " << txId;
+}
+
+TEST(TestCoreLogging, CommitRemovesReturnDepositLogOfSolutionTransactions)
+{
+    LoggingTest test;
+    constexpr unsigned int firstTick = 1000;
+    constexpr unsigned int numTicks = 3;
+    system.epoch = 123;
+    system.tick = firstTick;
+    logger.reset(firstTick);
+
+    for (unsigned int tick = firstTick; tick < firstTick + numTicks; tick++)
+    {
+        system.tick = tick;
+        logger.registerNewTx(tick, logger.SC_BEGIN_TICK_TX);
+        logTransfer(tick * 10 + 0);
+
+        // invalid solution transaction: return deposit log is removed
+        logger.registerNewTx(tick, 0);
+        logTransfer(tick * 10 + 1);
+        logTransfer(tick * 10 + 2);
+        logger.tx.removeReturnDepositLogOfSolutionTransaction(0);
+
+        logger.registerNewTx(tick, 1);
+        logTransfer(tick * 10 + 3);
+        logTransfer(tick * 10 + 4);
+
+        logger.registerNewTx(tick, logger.SC_END_TICK_TX);
+        logTransfer(tick * 10 + 5);
+
+        logger.updateTick(tick);
+    }
+
+    // 5 logs are committed per tick and log IDs are contiguous
+    for (unsigned int tick = firstTick; tick < firstTick + numTicks; tick++)
+    {
+        const long long firstLogId = (tick - firstTick) * 5;
+        expectTxLogIds(tick, logger.SC_BEGIN_TICK_TX, firstLogId, 1);
+        expectTxLogIds(tick, 0, firstLogId + 1, 1);
+        expectTxLogIds(tick, 1, firstLogId + 2, 2);
+        expectTxLogIds(tick, logger.SC_END_TICK_TX, firstLogId + 4, 1);
+        expectTxLogIds(tick, 2, -1, -1);
+
+        const long long expectedAmounts[5] = { 0, 1, 3, 4, 5 };
+        for (int i = 0; i < 5; i++)
+            EXPECT_EQ(getTransferAmount(firstLogId + i), tick * 10 + expectedAmounts[i]);
+    }
+}
+
+TEST(TestCoreLogging, CommitManyLogsPerTick)
+{
+    LoggingTest test;
+    constexpr unsigned int firstTick = 2000;
+    constexpr unsigned int numTransactions = 1000;
+    constexpr unsigned int logsPerTransaction = 100;
+    system.tick = firstTick;
+    logger.reset(firstTick);
+
+    for (unsigned int txId = 0; txId < numTransactions; txId++)
+    {
+        logger.registerNewTx(firstTick, txId);
+        for (unsigned int i = 0; i < logsPerTransaction; i++)
+            logTransfer(txId * logsPerTransaction + i);
+    }
+    logger.updateTick(firstTick);
+
+    for (unsigned int txId = 0; txId < numTransactions; txId++)
+        expectTxLogIds(firstTick, txId, txId * logsPerTransaction, logsPerTransaction);
+    for (unsigned long long logId = 0; logId < numTransactions * logsPerTransaction; logId += 997)
+        EXPECT_EQ(getTransferAmount(logId), logId);
+}
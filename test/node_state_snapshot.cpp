@@ -0,0 +1,75 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "node_state_snapshot.h"
+
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#ifdef __linux__
+
+static std::vector<CHAR16> toChar16(const std::filesystem::path& path)
+{
+    const std::string pathString = path.string();
+    std::vector<CHAR16> result(pathString.begin(), pathString.end());
+    result.push_back(0);
+    return result;
+}
+
+TEST(TestCoreNodeStateSnapshot, WriteAndReload)
+{
+    const std::filesystem::path tempDirectory = std::filesystem::temp_directory_path() / "qubic_node_state_snapshot_test";
+    std::filesystem::remove_all(tempDirectory);
+    std::filesystem::create_directories(tempDirectory);
+    std::vector<CHAR16> directory = toChar16(tempDirectory / "ep123");
+    std::vector<CHAR16> stagingDirectory = toChar16(tempDirectory / "ep123.new");
+    CHAR16 spectrumFileName[] = L"spectrum.123";
+    CHAR16 systemFileName[] = L"system.snp";
+
+    std::mt19937_64 gen64(42);
+    constexpr unsigned long long spectrumSize = 3 * 1024 * 1024 + 5;
+    std::vector<unsigned char> spectrum(spectrumSize), loadedSpectrum(spectrumSize);
+    unsigned long long systemTick = 0, loadedSystemTick = 0;
+    auto writeStates = [&](CHAR16* writeDirectory)
+        {
+            return saveStateFile(spectrumFileName, spectrumSize, spectrum.data(), writeDirectory) == (long long)spectrumSize
+                && save(systemFileName, sizeof(systemTick), (unsigned char*)&systemTick, writeDirectory) == sizeof(systemTick);
+        };
+    auto reload = [&]()
+        {
+            return loadParallel(spectrumFileName, spectrumSize, loadedSpectrum.data(), directory.data()) == (long long)spectrumSize
+                && load(systemFileName, sizeof(loadedSystemTick), (unsigned char*)&loadedSystemTick, directory.data()) == sizeof(loadedSystemTick);
+        };
+
+    // First snapshot creates the directory, the following ones replace it
+    for (int i = 0; i < 3; i++)
+    {
+        for (unsigned long long j = 0; j < spectrumSize; j += 7)
+            spectrum[j] = (unsigned char)gen64();
+        systemTick = 1000 + i;
+        EXPECT_EQ(writeNodeStateSnapshot(directory.data(), stagingDirectory.data(), writeStates), 0);
+        EXPECT_FALSE(std::filesystem::exists(tempDirectory / "ep123.new"));
+
+        ASSERT_TRUE(reload());
+        EXPECT_EQ(loadedSystemTick, systemTick);
+        EXPECT_TRUE(loadedSpectrum == spectrum);
+    }
+
+    // A failed snapshot keeps the last complete one
+    const std::vector<unsigned char> lastSpectrum = spectrum;
+    spectrum[0] ^= 0xff;
+    systemTick = 2000;
+    EXPECT_EQ(writeNodeStateSnapshot(directory.data(), stagingDirectory.data(), [&](CHAR16* writeDirectory)
+        {
+            return writeStates(writeDirectory) && false;
+        }), 1);
+    ASSERT_TRUE(reload());
+    EXPECT_EQ(loadedSystemTick, 1002);
+    EXPECT_TRUE(loadedSpectrum == lastSpectrum);
+
+    std::filesystem::remove_all(tempDirectory);
+}
+
+#endif
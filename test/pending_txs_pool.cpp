@@ -19,7 +19,11 @@
 #define NUMBER_OF_TRANSACTIONS_PER_TICK 128ULL
 #include "../src/ticking/pending_txs_pool.h"
 
+#include <atomic>
+#include <chrono>
+#include <iostream>
 #include <random>
+#include <thread>
 #include <vector>
 
 static constexpr unsigned int NUM_INITIALIZED_ENTITIES = 200U;
@@ -542,4 +546,161 @@ TEST(TestPendingTxsPool, TxsWithSrcBalance0AreRejected)
 
         pendingTxsPool.deinit();
     }
-}
\ No newline at end of file
+}
+
+// Transaction with zero input, distinct for each (threadIndex, transactionIndex), source with balance > 0.
+// The buffer also covers the (zeroed) signature, which is part of the digest.
+struct ConcurrentTestTx
+{
+    unsigned char buffer[MAX_TRANSACTION_SIZE];
+
+    ConcurrentTestTx(unsigned int tick, unsigned int threadIndex, unsigned int transactionIndex)
+    {
+        memset(buffer, 0, sizeof(buffer));
+        Transaction* tx = (Transaction*)buffer;
+        tx->sourcePublicKey = m256i{ 0, 0, 0, (transactionIndex % NUM_INITIALIZED_ENTITIES) + 1 };
+        tx->destinationPublicKey = m256i{ threadIndex + 1, transactionIndex + 1, 0, 0 };
+        tx->amount = transactionIndex + 1;
+        tx->tick = tick;
+    }
+
+    const Transaction* get() const
+    {
+        return (const Transaction*)buffer;
+    }
+};
+
+// Run addFunc(threadIndex) in numThreads threads, return number of transactions added
+template <typename AddFunc>
+static unsigned int runConcurrentAdds(unsigned int numThreads, AddFunc addFunc)
+{
+    std::atomic<unsigned int> numAdded = 0;
+    std::vector<std::thread> threads;
+    for (unsigned int threadIndex = 0; threadIndex < numThreads; ++threadIndex)
+    {
+        threads.emplace_back([&, threadIndex]()
+            {
+                numAdded += addFunc(threadIndex);
+            });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    return numAdded;
+}
+
+TEST(TestPendingTxsPool, ConcurrentAddRejectsDuplicates)
+{
+    TestPendingTxsPool pendingTxsPool;
+
+    pendingTxsPool.init();
+    const unsigned int firstEpochTick0 = 4321;
+    pendingTxsPool.beginEpoch(firstEpochTick0);
+
+    // all threads try to add the same transactions, each has to be stored exactly once
+    constexpr unsigned int numTicks = 8;
+    constexpr unsigned int numTxsPerTick = pendingTxsPool.getMaxNumTxsPerTick() / 2;
+    unsigned int numAdded = runConcurrentAdds(8, [&](unsigned int threadIndex)
+        {
+            unsigned int added = 0;
+            for (unsigned int t = 0; t < numTicks * numTxsPerTick; ++t)
+            {
+                // different threads process the ticks in different order
+                unsigned int position = (t + threadIndex * numTxsPerTick) % (numTicks * numTxsPerTick);
+                ConcurrentTestTx tx(firstEpochTick0 + position / numTxsPerTick, 0, position % numTxsPerTick);
+                if (pendingTxsPool.add(tx.get()))
+                    ++added;
+            }
+            return added;
+        });
+
+    EXPECT_EQ(numAdded, numTicks * numTxsPerTick);
+    for (unsigned int i = 0; i < numTicks; ++i)
+        EXPECT_EQ(pendingTxsPool.getNumberOfPendingTickTxs(firstEpochTick0 + i), numTxsPerTick);
+    pendingTxsPool.checkStateConsistencyWithAssert();
+
+    // after filling ticks concurrently, replaced transactions have to be removed from the digest set
+    runConcurrentAdds(8, [&](unsigned int threadIndex)
+        {
+            unsigned int added = 0;
+            for (unsigned int t = 0; t < 2 * pendingTxsPool.getMaxNumTxsPerTick(); ++t)
+            {
+                ConcurrentTestTx tx(firstEpochTick0 + t % numTicks, threadIndex + 1, t);
+                if (pendingTxsPool.add(tx.get()))
+                    ++added;
+            }
+            return added;
+        });
+    for (unsigned int i = 0; i < numTicks; ++i)
+        EXPECT_EQ(pendingTxsPool.getNumberOfPendingTickTxs(firstEpochTick0 + i), pendingTxsPool.getMaxNumTxsPerTick());
+    pendingTxsPool.checkStateConsistencyWithAssert();
+
+    pendingTxsPool.deinit();
+}
+
+TEST(TestPendingTxsPool, ConcurrentAddFillsAllTicks)
+{
+    TestPendingTxsPool pendingTxsPool;
+
+    constexpr unsigned int numTxsPerThread = 20000;
+    for (unsigned int numThreads : { 1u, 2u, 4u, 8u })
+    {
+        pendingTxsPool.init();
+        const unsigned int firstEpochTick0 = 1000;
+        pendingTxsPool.beginEpoch(firstEpochTick0);
+
+        unsigned int numAdded = runConcurrentAdds(numThreads, [&](unsigned int threadIndex)
+            {
+                unsigned int added = 0;
+                for (unsigned int t = 0; t < numTxsPerThread; ++t)
+                {
+                    ConcurrentTestTx tx(firstEpochTick0 + (t + threadIndex) % PENDING_TXS_POOL_NUM_TICKS, threadIndex, t);
+                    if (pendingTxsPool.add(tx.get()))
+                        ++added;
+                }
+                return added;
+            });
+        EXPECT_GE(numAdded, (unsigned int)(PENDING_TXS_POOL_NUM_TICKS * pendingTxsPool.getMaxNumTxsPerTick()));
+        pendingTxsPool.checkStateConsistencyWithAssert();
+
+        pendingTxsPool.deinit();
+    }
+}
+
+TEST(TestPendingTxsPool, PerformanceConcurrentAdd)
+{
+    TestPendingTxsPool pendingTxsPool;
+
+    // Distinct transactions spread over all ticks, so most adds replace a transaction with lower priority
+    constexpr unsigned int numTxsPerThread = 20000;
+    const unsigned int maxNumThreads = std::min(std::max(std::thread::hardware_concurrency(), 1u), 16u);
+    for (unsigned int numThreads = 1; numThreads <= maxNumThreads; numThreads *= 2)
+    {
+        pendingTxsPool.init();
+        const unsigned int firstEpochTick0 = 1000;
+        pendingTxsPool.beginEpoch(firstEpochTick0);
+
+        std::vector<std::vector<ConcurrentTestTx>> txs(numThreads);
+        for (unsigned int threadIndex = 0; threadIndex < numThreads; ++threadIndex)
+        {
+            txs[threadIndex].reserve(numTxsPerThread);
+            for (unsigned int t = 0; t < numTxsPerThread; ++t)
+                txs[threadIndex].emplace_back(firstEpochTick0 + (t + threadIndex) % PENDING_TXS_POOL_NUM_TICKS, threadIndex, t);
+        }
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        runConcurrentAdds(numThreads, [&](unsigned int threadIndex)
+            {
+                unsigned int added = 0;
+                for (const auto& tx : txs[threadIndex])
+                    added += pendingTxsPool.add(tx.get());
+                return added;
+            });
+        auto durationMicroSec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+        pendingTxsPool.checkStateConsistencyWithAssert();
+        std::cout << "PendingTxsPool::add() with " << numThreads << " thread(s): "
+            << numThreads * numTxsPerThread * 1000000.0 / (durationMicroSec + 1) << " inserts/sec" << std::endl;
+
+        pendingTxsPool.deinit();
+    }
+}
@@ -0,0 +1,228 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "snapshot_delta.h"
+#include "contract_core/chunked_state_digest.h"
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+
+
+// Reference: flags of all digest tree nodes (see DigestTreeBuilder) that depend on a changed leaf
+static std::vector<bool> referenceTreeFlags(const std::vector<bool>& leafFlags)
+{
+    std::vector<bool> flags(leafFlags);
+    unsigned int levelBeginning = 0;
+    for (unsigned int levelSize = (unsigned int)leafFlags.size(); levelSize > 1; levelSize >>= 1)
+    {
+        for (unsigned int i = 0; i < levelSize; i += 2)
+            flags.push_back(flags[levelBeginning + i] || flags[levelBeginning + i + 1]);
+        levelBeginning += levelSize;
+    }
+    return flags;
+}
+
+TEST(TestCoreSnapshotDelta, MarkAndCount)
+{
+    SnapshotDeltaTracker tracker;
+    EXPECT_TRUE(tracker.init(1000, 10));
+    EXPECT_EQ(tracker.getNumberOfRecords(), 100u);
+    EXPECT_EQ(tracker.countChanged(), 100u);
+
+    tracker.clear();
+    EXPECT_EQ(tracker.countChanged(), 0u);
+    tracker.markChanged(0u);
+    tracker.markChanged(63u);
+    tracker.markChanged(64u);
+    tracker.markChanged(99u);
+    tracker.markChanged(99u);
+    EXPECT_EQ(tracker.countChanged(), 4u);
+    EXPECT_TRUE(tracker.isChanged(63));
+    EXPECT_FALSE(tracker.isChanged(62));
+
+    // Bytes 25 to 54 are in records 2 to 5
+    tracker.clear();
+    tracker.markChangedBytes(25, 30);
+    EXPECT_EQ(tracker.countChanged(), 4u);
+    EXPECT_TRUE(tracker.isChanged(2));
+    EXPECT_TRUE(tracker.isChanged(5));
+
+    const unsigned long long changeFlags[2] = { 1ULL << 7, 1ULL << 3 };
+    tracker.markChanged(changeFlags);
+    EXPECT_EQ(tracker.countChanged(), 6u);
+    EXPECT_TRUE(tracker.isChanged(7));
+    EXPECT_TRUE(tracker.isChanged(67));
+    tracker.deinit();
+}
+
+TEST(TestCoreSnapshotDelta, TreeOfChangedLeafsMatchesReference)
+{
+    std::mt19937_64 gen64(23);
+    for (unsigned int numberOfLeafs : { 1u, 2u, 64u, 256u, 1u << 12 })
+    {
+        SnapshotDeltaTracker leafs, tree;
+        EXPECT_TRUE(leafs.init(numberOfLeafs * 32ULL, 32));
+        EXPECT_TRUE(tree.init((numberOfLeafs * 2ULL - 1) * 32, 32));
+        for (unsigned int changes : { 0u, 1u, 5u, numberOfLeafs / 2 + 1 })
+        {
+            leafs.clear();
+            std::vector<bool> leafFlags(numberOfLeafs, false);
+            for (unsigned int i = 0; i < changes; i++)
+            {
+                const unsigned int index = gen64() % numberOfLeafs;
+                leafs.markChanged(index);
+                leafFlags[index] = true;
+            }
+            tree.markTreeOfChangedLeafs(leafs);
+            const std::vector<bool> expected = referenceTreeFlags(leafFlags);
+            for (unsigned int i = 0; i < expected.size(); i++)
+                EXPECT_EQ(tree.isChanged(i), expected[i]) << "node " << i << " of " << numberOfLeafs << " leafs";
+        }
+        leafs.deinit();
+        tree.deinit();
+    }
+}
+
+TEST(TestCoreSnapshotDelta, SaveAndApply)
+{
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "qubic_snapshot_delta_test";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    const std::filesystem::path filePath = directory / "array.delta";
+    const std::string filePathString = filePath.string();
+    std::vector<CHAR16> fileName(filePathString.begin(), filePathString.end());
+    fileName.push_back(0);
+
+    // The last record is shorter than the others
+    constexpr unsigned long long recordSize = 48, totalSize = recordSize * 1000 + 17;
+    std::mt19937_64 gen64(42);
+    std::vector<unsigned char> base(totalSize), data(totalSize);
+    for (auto& byte : base)
+        byte = (unsigned char)gen64();
+    data = base;
+
+    SnapshotDeltaTracker tracker;
+    EXPECT_TRUE(tracker.init(totalSize, recordSize));
+    tracker.clear();
+
+    // Without a delta file, nothing is applied
+    EXPECT_EQ(loadSnapshotDelta(fileName.data(), base.data(), totalSize, 7, 100), 0);
+
+    // Changes are cumulative, the second delta contains all changes since the base
+    for (unsigned int changes : { 0u, 3u, 50u })
+    {
+        for (unsigned int i = 0; i < changes; i++)
+        {
+            const unsigned long long offset = gen64() % totalSize;
+            const unsigned long long size = std::min<unsigned long long>(totalSize - offset, gen64() % 100 + 1);
+            for (unsigned long long j = offset; j < offset + size; j++)
+                data[j] ^= 0xA5;
+            tracker.markChangedBytes(offset, size);
+        }
+        if (changes)
+            tracker.markChanged(tracker.getNumberOfRecords() - 1);
+
+        EXPECT_TRUE(tracker.saveDelta(fileName.data(), data.data(), 7, 100));
+        EXPECT_EQ(std::filesystem::file_size(filePath), tracker.getDeltaSize(tracker.countChanged()));
+
+        std::vector<unsigned char> restored(base);
+        EXPECT_EQ(loadSnapshotDelta(fileName.data(), restored.data(), totalSize, 7, 100), 1);
+        EXPECT_EQ(restored, data);
+    }
+
+    // Deltas of another base or array size are rejected
+    std::vector<unsigned char> restored(base);
+    EXPECT_EQ(loadSnapshotDelta(fileName.data(), restored.data(), totalSize, 7, 101), -1);
+    EXPECT_EQ(loadSnapshotDelta(fileName.data(), restored.data(), totalSize, 8, 100), -1);
+    EXPECT_EQ(loadSnapshotDelta(fileName.data(), restored.data(), totalSize - 1, 7, 100), -1);
+
+    // Truncated delta
+    std::vector<unsigned char> delta(std::filesystem::file_size(filePath));
+    std::ifstream(filePath, std::ios::binary).read((char*)delta.data(), delta.size());
+    EXPECT_TRUE(applySnapshotDelta(delta.data(), delta.size(), restored.data(), totalSize, 7, 100));
+    EXPECT_FALSE(applySnapshotDelta(delta.data(), delta.size() - 1, restored.data(), totalSize, 7, 100));
+    EXPECT_FALSE(applySnapshotDelta(delta.data(), sizeof(SnapshotDeltaHeader) - 1, restored.data(), totalSize, 7, 100));
+
+    tracker.deinit();
+    std::filesystem::remove_all(directory);
+}
+
+// Contract states changed after the last digest are only flagged in contractStateChangeFlags (one bit per state) and
+// in the chunk change flags of ChunkedStateDigest, but the delta has to contain them
+TEST(TestCoreSnapshotDelta, ChangesWithoutDigest)
+{
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "qubic_snapshot_delta_test";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    const std::string filePathString = (directory / "contract.delta").string();
+    std::vector<CHAR16> fileName(filePathString.begin(), filePathString.end());
+    fileName.push_back(0);
+
+    constexpr unsigned long long chunkSize = 4096;
+    constexpr unsigned int numberOfStates = 3;
+    const unsigned long long stateSizes[numberOfStates] = { 100, chunkSize * 5 + 17, chunkSize * 2 };
+    std::mt19937_64 gen64(11);
+    std::vector<unsigned char> bases[numberOfStates], states[numberOfStates];
+    SnapshotDeltaTracker trackers[numberOfStates];
+    ChunkedStateDigest stateDigests[numberOfStates];
+    for (unsigned int i = 0; i < numberOfStates; i++)
+    {
+        bases[i].resize(stateSizes[i]);
+        for (auto& byte : bases[i])
+            byte = (unsigned char)gen64();
+        states[i] = bases[i];
+        EXPECT_TRUE(trackers[i].init(stateSizes[i], chunkSize));
+        EXPECT_TRUE(stateDigests[i].init(states[i].data(), stateSizes[i], chunkSize));
+
+        // Base snapshot after a digest
+        stateDigests[i].collectChangedChunks();
+        stateDigests[i].hashChangedChunks(0, (unsigned int)((stateSizes[i] + chunkSize - 1) / chunkSize));
+        stateDigests[i].updateRoot();
+        trackers[i].clear();
+    }
+
+    // Change states 1 and 2 without computing the digest
+    unsigned long long stateChangeFlags[1] = { (1ULL << 1) | (1ULL << 2) };
+    states[1][chunkSize * 5 + 3] ^= 0x11;
+    states[2][7] ^= 0x22;
+    for (unsigned int i = 0; i < numberOfStates; i++)
+        EXPECT_EQ(trackers[i].countChanged(), 0u);
+
+    // Whole states (CONTRACT_STATE_DIGEST_VERSION 1)
+    markFlaggedArraysChanged(trackers, numberOfStates, stateChangeFlags);
+    EXPECT_EQ(trackers[0].countChanged(), 0u);
+    EXPECT_EQ(trackers[1].countChanged(), 6u);
+    EXPECT_EQ(trackers[2].countChanged(), 2u);
+    for (unsigned int i = 1; i < numberOfStates; i++)
+    {
+        EXPECT_TRUE(trackers[i].saveDelta(fileName.data(), states[i].data(), 7, 100));
+        std::vector<unsigned char> restored(bases[i]);
+        EXPECT_EQ(loadSnapshotDelta(fileName.data(), restored.data(), stateSizes[i], 7, 100), 1);
+        EXPECT_EQ(restored, states[i]);
+        trackers[i].clear();
+    }
+
+    // Changed chunks (CONTRACT_STATE_DIGEST_VERSION 2 without write tracking flags all chunks of changed states)
+    for (unsigned int i = 0; i < numberOfStates; i++)
+    {
+        if (stateChangeFlags[0] & (1ULL << i))
+            stateDigests[i].markAllChanged();
+        trackers[i].markChanged(stateDigests[i].getChangeFlags());
+    }
+    EXPECT_EQ(trackers[0].countChanged(), 0u);
+    EXPECT_EQ(trackers[1].countChanged(), 6u);
+    EXPECT_TRUE(trackers[1].saveDelta(fileName.data(), states[1].data(), 7, 100));
+    std::vector<unsigned char> restored(bases[1]);
+    EXPECT_EQ(loadSnapshotDelta(fileName.data(), restored.data(), stateSizes[1], 7, 100), 1);
+    EXPECT_EQ(restored, states[1]);
+
+    for (unsigned int i = 0; i < numberOfStates; i++)
+    {
+        trackers[i].deinit();
+        stateDigests[i].deinit();
+    }
+    std::filesystem::remove_all(directory);
+}
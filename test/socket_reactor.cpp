@@ -0,0 +1,292 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#ifdef __linux__
+
+#include "extensions/socket_reactor.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+// The I/O threads of the reactor run until the process exits, so the reactor is never destroyed
+static SocketReactor& reactor = []() -> SocketReactor&
+{
+    SocketReactor* r = new SocketReactor();
+    r->start(2, [](EFI_TCP4_LISTEN_TOKEN* token, int socket) { token->NewChildHandle = (EFI_HANDLE)(unsigned long long)socket; });
+    return *r;
+}();
+
+static constexpr EFI_STATUS pendingStatus = (EFI_STATUS)-1;
+
+// Wait for the I/O threads to complete the token, like the main loop polls it
+static EFI_STATUS waitForCompletion(const EFI_TCP4_COMPLETION_TOKEN& token, long long timeoutMilliseconds = 5000)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMilliseconds);
+    while (*(volatile EFI_STATUS*)&token.Status == pendingStatus && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::yield();
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return token.Status;
+}
+
+static int createSocket()
+{
+    return socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+}
+
+// Receive/transmit data with up to 2 * maxNumberOfFragments fragments (FragmentTable has only 1 entry)
+template <typename T>
+struct IoData
+{
+    T data;
+    EFI_TCP4_FRAGMENT_DATA moreFragments[2 * SocketReactor::maxNumberOfFragments];
+
+    IoData(unsigned char* buffer, unsigned int size, unsigned int fragmentCount = 1)
+    {
+        memset(this, 0, sizeof(*this));
+        data.DataLength = size;
+        data.FragmentCount = fragmentCount;
+        // Split the buffer into fragmentCount fragments of about the same size. The table is addressed through a
+        // pointer, because indexing FragmentTable[1] directly would be out of bounds.
+        EFI_TCP4_FRAGMENT_DATA* fragmentTable = (EFI_TCP4_FRAGMENT_DATA*)((unsigned char*)this + offsetof(T, FragmentTable));
+        for (unsigned int i = 0; i < fragmentCount; i++)
+        {
+            const unsigned int begin = size * i / fragmentCount, end = size * (i + 1) / fragmentCount;
+            fragmentTable[i].FragmentBuffer = buffer + begin;
+            fragmentTable[i].FragmentLength = end - begin;
+        }
+    }
+};
+
+// A connection of two sockets registered in the reactor, set up with connect() and accept() on loopback
+struct LoopbackConnection
+{
+    unsigned long long listenId = 0, clientId = 0, serverId = 0;
+
+    void open()
+    {
+        const int listenSocket = createSocket();
+        ASSERT_GE(listenSocket, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addressSize = sizeof(address);
+        ASSERT_EQ(bind(listenSocket, (sockaddr*)&address, sizeof(address)), 0);
+        ASSERT_EQ(listen(listenSocket, 4), 0);
+        ASSERT_EQ(getsockname(listenSocket, (sockaddr*)&address, &addressSize), 0);
+        listenId = reactor.add(listenSocket, true);
+        ASSERT_NE(listenId, 0u);
+
+        EFI_TCP4_LISTEN_TOKEN acceptToken{};
+        acceptToken.CompletionToken.Status = pendingStatus;
+        EXPECT_EQ(reactor.accept(listenId, &acceptToken), EFI_SUCCESS);
+
+        clientId = reactor.add(createSocket(), false);
+        ASSERT_NE(clientId, 0u);
+        EFI_TCP4_CONNECTION_TOKEN connectToken{};
+        connectToken.CompletionToken.Status = pendingStatus;
+        EXPECT_EQ(reactor.connect(clientId, address, &connectToken, 0), EFI_SUCCESS);
+
+        ASSERT_EQ(waitForCompletion(connectToken.CompletionToken), EFI_SUCCESS);
+        ASSERT_EQ(waitForCompletion(acceptToken.CompletionToken), EFI_SUCCESS);
+        serverId = reactor.add((int)(unsigned long long)acceptToken.NewChildHandle, false);
+        ASSERT_NE(serverId, 0u);
+    }
+
+    void close()
+    {
+        reactor.remove(clientId);
+        reactor.remove(serverId);
+        reactor.remove(listenId);
+    }
+};
+
+static EFI_STATUS transmit(unsigned long long id, unsigned char* buffer, unsigned int size, unsigned int fragmentCount = 1)
+{
+    IoData<EFI_TCP4_TRANSMIT_DATA> txData(buffer, size, fragmentCount);
+    EFI_TCP4_IO_TOKEN token{};
+    token.CompletionToken.Status = pendingStatus;
+    token.Packet.TxData = &txData.data;
+    reactor.transmit(id, &token);
+    return waitForCompletion(token.CompletionToken);
+}
+
+// Receive exactly size bytes, which may need several receive operations
+static EFI_STATUS receive(unsigned long long id, unsigned char* buffer, unsigned int size, unsigned int fragmentCount = 1)
+{
+    unsigned int received = 0;
+    while (received < size)
+    {
+        IoData<EFI_TCP4_RECEIVE_DATA> rxData(buffer + received, size - received, fragmentCount);
+        EFI_TCP4_IO_TOKEN token{};
+        token.CompletionToken.Status = pendingStatus;
+        token.Packet.RxData = &rxData.data;
+        reactor.receive(id, &token);
+        const EFI_STATUS status = waitForCompletion(token.CompletionToken);
+        if (status != EFI_SUCCESS)
+        {
+            return status;
+        }
+        received += rxData.data.DataLength;
+    }
+    return EFI_SUCCESS;
+}
+
+TEST(TestSocketReactor, TransmitAndReceive)
+{
+    LoopbackConnection connection;
+    connection.open();
+    if (HasFatalFailure())
+        return;
+
+    // Larger than the socket buffers, so the transmission has to wait for EPOLLOUT
+    const unsigned int size = 8 * 1024 * 1024;
+    std::vector<unsigned char> sent(size), received(size);
+    for (unsigned int i = 0; i < size; i++)
+        sent[i] = (unsigned char)(i * 7 + (i >> 12));
+
+    EFI_STATUS transmitStatus = pendingStatus;
+    std::thread transmitter([&]() { transmitStatus = transmit(connection.clientId, sent.data(), size, 5); });
+    EXPECT_EQ(receive(connection.serverId, received.data(), size, 3), EFI_SUCCESS);
+    transmitter.join();
+    EXPECT_EQ(transmitStatus, EFI_SUCCESS);
+    EXPECT_EQ(sent, received);
+
+    // Other direction, with the receive operation pending before the data arrives
+    EFI_STATUS receiveStatus = pendingStatus;
+    std::thread receiver([&]() { receiveStatus = receive(connection.clientId, received.data(), 1000); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(transmit(connection.serverId, sent.data() + 1, 1000), EFI_SUCCESS);
+    receiver.join();
+    EXPECT_EQ(receiveStatus, EFI_SUCCESS);
+    EXPECT_EQ(memcmp(received.data(), sent.data() + 1, 1000), 0);
+
+    connection.close();
+}
+
+TEST(TestSocketReactor, InvalidFragments)
+{
+    LoopbackConnection connection;
+    connection.open();
+    if (HasFatalFailure())
+        return;
+
+    // Too many fragments fail instead of transmitting or receiving only a part of the data
+    unsigned char buffer[1000] = { 1 };
+    EXPECT_EQ(transmit(connection.clientId, buffer, sizeof(buffer), SocketReactor::maxNumberOfFragments + 1), EFI_INVALID_PARAMETER);
+    EXPECT_EQ(receive(connection.serverId, buffer, sizeof(buffer), SocketReactor::maxNumberOfFragments + 1), EFI_INVALID_PARAMETER);
+
+    // An empty buffer is not taken for a closed connection
+    IoData<EFI_TCP4_RECEIVE_DATA> rxData(buffer, 0, 2);
+    EFI_TCP4_IO_TOKEN token{};
+    token.CompletionToken.Status = pendingStatus;
+    token.Packet.RxData = &rxData.data;
+    reactor.receive(connection.serverId, &token);
+    EXPECT_EQ(waitForCompletion(token.CompletionToken), EFI_INVALID_PARAMETER);
+
+    // The connection still works
+    EXPECT_EQ(transmit(connection.clientId, buffer, sizeof(buffer), SocketReactor::maxNumberOfFragments), EFI_SUCCESS);
+    EXPECT_EQ(receive(connection.serverId, buffer, sizeof(buffer), SocketReactor::maxNumberOfFragments), EFI_SUCCESS);
+
+    connection.close();
+}
+
+TEST(TestSocketReactor, CloseAndAbort)
+{
+    LoopbackConnection connection;
+    connection.open();
+    if (HasFatalFailure())
+        return;
+
+    // A pending receive fails when the remote socket is closed
+    unsigned char buffer[100];
+    IoData<EFI_TCP4_RECEIVE_DATA> rxData(buffer, sizeof(buffer));
+    EFI_TCP4_IO_TOKEN token{};
+    token.CompletionToken.Status = pendingStatus;
+    token.Packet.RxData = &rxData.data;
+    EXPECT_EQ(reactor.receive(connection.serverId, &token), EFI_SUCCESS);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(token.CompletionToken.Status, pendingStatus);
+    reactor.remove(connection.clientId);
+    EXPECT_EQ(waitForCompletion(token.CompletionToken), EFI_ABORTED);
+
+    // Unknown IDs
+    token.CompletionToken.Status = pendingStatus;
+    EXPECT_EQ(reactor.receive(connection.clientId, &token), EFI_ABORTED);
+    EXPECT_EQ(token.CompletionToken.Status, EFI_ABORTED);
+
+    // abort() completes pending tokens right away and further operations fail
+    connection.close();
+    connection.open();
+    if (HasFatalFailure())
+        return;
+    token.CompletionToken.Status = pendingStatus;
+    EXPECT_EQ(reactor.receive(connection.serverId, &token), EFI_SUCCESS);
+    reactor.abort(connection.serverId);
+    EXPECT_EQ(token.CompletionToken.Status, EFI_ABORTED);
+    token.CompletionToken.Status = pendingStatus;
+    EXPECT_EQ(reactor.receive(connection.serverId, &token), EFI_ABORTED);
+    EXPECT_EQ(transmit(connection.serverId, buffer, sizeof(buffer)), EFI_ABORTED);
+    EFI_TCP4_LISTEN_TOKEN acceptToken{};
+    acceptToken.CompletionToken.Status = pendingStatus;
+    reactor.abort(connection.listenId);
+    EXPECT_EQ(reactor.accept(connection.listenId, &acceptToken), EFI_ACCESS_DENIED);
+
+    // The remote side sees the shutdown
+    EXPECT_EQ(receive(connection.clientId, buffer, sizeof(buffer)), EFI_ABORTED);
+
+    connection.close();
+}
+
+TEST(TestSocketReactor, BenchmarkRoundTripLatency)
+{
+    LoopbackConnection connection;
+    connection.open();
+    if (HasFatalFailure())
+        return;
+
+    // Request and response of the size of small messages such as tick votes, echoed by a server thread that polls
+    // its tokens like the main loop
+    const unsigned int numberOfRoundTrips = 10000, messageSize = 64;
+    std::thread server([&]()
+        {
+            unsigned char message[messageSize];
+            for (unsigned int i = 0; i < numberOfRoundTrips; i++)
+            {
+                if (receive(connection.serverId, message, messageSize) != EFI_SUCCESS
+                    || transmit(connection.serverId, message, messageSize) != EFI_SUCCESS)
+                    break;
+            }
+        });
+
+    unsigned char request[messageSize], response[messageSize];
+    memset(request, 0x5A, messageSize);
+    unsigned int completed = 0;
+    const auto startTime = std::chrono::high_resolution_clock::now();
+    for (; completed < numberOfRoundTrips; completed++)
+    {
+        request[0] = (unsigned char)completed;
+        if (transmit(connection.clientId, request, messageSize) != EFI_SUCCESS
+            || receive(connection.clientId, response, messageSize) != EFI_SUCCESS
+            || response[0] != request[0])
+            break;
+    }
+    const auto durationMicroSec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+    server.join();
+    EXPECT_EQ(completed, numberOfRoundTrips);
+
+    std::cout << "SocketReactor round trip of " << messageSize << " bytes on loopback: "
+        << (double)durationMicroSec / numberOfRoundTrips << " us" << std::endl;
+
+    connection.close();
+}
+
+#endif
@@ -5,8 +5,11 @@
 
 #include "gtest/gtest.h"
 
+#include <atomic>
 #include <chrono>
 #include <random>
+#include <thread>
+#include <vector>
 
 #include "logging_test.h"
 #include "spectrum/spectrum.h"
@@ -408,3 +411,326 @@ TEST(TestCoreSpectrum, AntiDustEdgeCaseHugeBinZeroBalance)
     test.afterAntiDust();
 }
 
+// Recompute all digests from scratch level by level and check that spectrumDigests matches
+static void checkSpectrumDigests()
+{
+    std::vector<m256i> levelDigests(SPECTRUM_CAPACITY);
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+    {
+        KangarooTwelve64To32(&spectrum[i], &levelDigests[i]);
+    }
+    unsigned long long levelBeginning = 0;
+    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
+    while (true)
+    {
+        EXPECT_EQ(memcmp(levelDigests.data(), spectrumDigests + levelBeginning, numberOfLeafs * sizeof(m256i)), 0) << "numberOfLeafs = " << numberOfLeafs;
+        if (numberOfLeafs == 1)
+            break;
+        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+        {
+            KangarooTwelve64To32(&levelDigests[i], &levelDigests[i >> 1]);
+        }
+        levelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+    }
+}
+
+TEST(TestCoreSpectrum, IncrementalDigestUpdate)
+{
+    SpectrumTest test;
+    for (int i = 0; i < 1000; i++)
+    {
+        increaseEnergy(m256i(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64()), 1000000);
+    }
+
+    // Rebuild all digests, which also resets change tracking
+    rebuildSpectrumDigests();
+    EXPECT_EQ(spectrumChangeListSize, 0);
+
+    // Few changes per tick -> use change list
+    for (int tick = 0; tick < 3; tick++)
+    {
+        ++system.tick;
+        for (int i = 0; i < 100; i++)
+        {
+            m256i src = getAnyEntity();
+            transfer(src, m256i(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64()), 10 + tick);
+            transfer(src, src, 1);
+        }
+        EXPECT_FALSE(spectrumChangeListOverflow);
+        EXPECT_GT(spectrumChangeListSize, 0);
+        EXPECT_LE(spectrumChangeListSize, 300);
+        updateSpectrumDigests();
+        EXPECT_EQ(spectrumChangeListSize, 0);
+    }
+    checkSpectrumDigests();
+
+    // Quiet tick doesn't change anything
+    ++system.tick;
+    const m256i rootDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
+    updateSpectrumDigests();
+    EXPECT_EQ(spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1], rootDigest);
+
+    // More changes than fit into change list -> fall back to scanning change flags
+    ++system.tick;
+    for (unsigned int i = 0; i < SPECTRUM_CHANGE_LIST_CAPACITY + 1000; i++)
+    {
+        increaseEnergy(m256i(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64()), 1);
+    }
+    EXPECT_TRUE(spectrumChangeListOverflow);
+    updateSpectrumDigests();
+    EXPECT_FALSE(spectrumChangeListOverflow);
+
+    // Change tracking works as usual afterwards
+    ++system.tick;
+    transfer(getAnyEntity(), m256i(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64()), 5);
+    updateSpectrumDigests();
+    checkSpectrumDigests();
+}
+
+// Reference of reorganizeSpectrum(): reinsert entities with balance != 0 into empty hash map in order of current index
+static std::vector<EntityRecord> getReorganizedSpectrumReference()
+{
+    std::vector<EntityRecord> reorganized(SPECTRUM_CAPACITY);
+    memset(reorganized.data(), 0, SPECTRUM_CAPACITY * sizeof(EntityRecord));
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+    {
+        if (spectrum[i].incomingAmount - spectrum[i].outgoingAmount)
+        {
+            unsigned int index = spectrum[i].publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
+            while (!isZero(reorganized[index].publicKey))
+                index = (index + 1) & (SPECTRUM_CAPACITY - 1);
+            reorganized[index] = spectrum[i];
+        }
+    }
+    return reorganized;
+}
+
+static void testReorganizeSpectrum(SpectrumTest& test, unsigned int wrappedEntities)
+{
+    test.clearSpectrum();
+    for (int i = 0; i < 200000; i++)
+    {
+        m256i publicKey(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64());
+        if (i % 4 == 0)
+        {
+            // Create clusters to have entities that are moved during compaction
+            publicKey.m256i_u32[0] = (publicKey.m256i_u32[0] & ~(SPECTRUM_CAPACITY - 1)) | (publicKey.m256i_u32[0] & 0xfff);
+        }
+        increaseEnergy(publicKey, 1 + test.rnd64() % 1000);
+    }
+    for (unsigned int i = 0; i < wrappedEntities; i++)
+    {
+        // Cluster wrapping around the end of the hash map
+        m256i publicKey(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64());
+        publicKey.m256i_u32[0] = SPECTRUM_CAPACITY - 1 - (i % 16);
+        increaseEnergy(publicKey, 1 + test.rnd64() % 1000);
+    }
+    rebuildSpectrumDigests();
+
+    // Burn some balances like the anti-dust feature (without marking entities as changed)
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+    {
+        if (!isZero(spectrum[i].publicKey) && test.rnd64() % 3 == 0)
+            spectrum[i].outgoingAmount = spectrum[i].incomingAmount;
+    }
+    // Also change some entities in the regular way
+    for (int i = 0; i < 1000; i++)
+        increaseEnergy(getAnyEntity(), 1);
+
+    const std::vector<EntityRecord> expected = getReorganizedSpectrumReference();
+    reorganizeSpectrum();
+    EXPECT_EQ(memcmp(expected.data(), spectrum, SPECTRUM_CAPACITY * sizeof(EntityRecord)), 0);
+    checkSpectrumDigests();
+    EXPECT_EQ(spectrumChangeListSize, 0);
+    for (const m256i& publicKey : { expected[0].publicKey, expected[SPECTRUM_CAPACITY - 1].publicKey })
+    {
+        if (!isZero(publicKey))
+            EXPECT_GE(spectrumIndex(publicKey), 0);
+    }
+}
+
+TEST(TestCoreSpectrum, ReorganizeInPlace)
+{
+    SpectrumTest test;
+
+    // In-place compaction
+    testReorganizeSpectrum(test, 100);
+
+    // Fallback to rebuilding in reorgBuffer, because too many entities wrapped around
+    testReorganizeSpectrum(test, SPECTRUM_COMPACTION_BUFFER_CAPACITY + 100);
+}
+
+TEST(TestCoreSpectrum, ConcurrentSpectrumIndex)
+{
+    SpectrumTest test;
+    constexpr unsigned int entityCount = 100000;
+    std::vector<m256i> publicKeys(entityCount);
+    for (auto& publicKey : publicKeys)
+    {
+        publicKey = m256i(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64());
+        increaseEnergy(publicKey, 1000);
+    }
+
+    // Lock-free readers always find existing entities while entities are inserted and moved
+    {
+        std::atomic<bool> stop(false);
+        std::atomic<unsigned long long> notFound(0);
+        std::vector<std::thread> readers;
+        for (unsigned int t = 0; t < 3; t++)
+        {
+            readers.emplace_back([&, t]()
+                {
+                    for (unsigned int i = t; !stop; i += 7)
+                    {
+                        const m256i& publicKey = publicKeys[i % entityCount];
+                        const int index = spectrumIndex(publicKey);
+                        if (index < 0)
+                            notFound++;
+                    }
+                });
+        }
+        for (int round = 0; round < 2; round++)
+        {
+            for (int i = 0; i < 10000; i++)
+                increaseEnergy(m256i(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64()), 1);
+            ACQUIRE(spectrumLock);
+            reorganizeSpectrum();
+            RELEASE(spectrumLock);
+        }
+        stop = true;
+        for (auto& reader : readers)
+            reader.join();
+        EXPECT_EQ(notFound, 0);
+    }
+
+    // Contention benchmark: lookup throughput with increasing number of readers, while balances are changed
+    for (unsigned int readerCount : { 1u, 2u, 4u, 8u })
+    {
+        std::atomic<bool> stop(false);
+        std::atomic<unsigned long long> lookups(0);
+        std::vector<std::thread> threads;
+        threads.emplace_back([&]()
+            {
+                for (unsigned int i = 0; !stop; i += 13)
+                    increaseEnergy(publicKeys[i % entityCount], 1);
+            });
+        for (unsigned int t = 0; t < readerCount; t++)
+        {
+            threads.emplace_back([&, t]()
+                {
+                    unsigned long long count = 0;
+                    for (unsigned int i = t; !stop; i += 7, count++)
+                        EXPECT_GE(spectrumIndex(publicKeys[i % entityCount]), 0);
+                    lookups += count;
+                });
+        }
+        auto startTime = std::chrono::high_resolution_clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        stop = true;
+        for (auto& thread : threads)
+            thread.join();
+        auto durationMicroSec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime);
+        std::cout << "spectrumIndex() with " << readerCount << " reader threads: "
+            << lookups * 1000000 / durationMicroSec.count() << " lookups/sec" << std::endl;
+    }
+}
+
+// Compute root digest from leaf digest and siblings
+static m256i getRootFromSiblings(int index, m256i digest, const m256i* siblings)
+{
+    for (unsigned int level = 0; level < SPECTRUM_DEPTH; level++, index >>= 1)
+    {
+        m256i pair[2];
+        pair[index & 1] = digest;
+        pair[(index & 1) ^ 1] = siblings[level];
+        KangarooTwelve64To32(pair, &digest);
+    }
+    return digest;
+}
+
+TEST(TestCoreSpectrum, LockFreeSiblings)
+{
+    SpectrumTest test;
+    constexpr unsigned int entityCount = 1000;
+    std::vector<m256i> publicKeys(entityCount);
+    for (auto& publicKey : publicKeys)
+    {
+        publicKey = m256i(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64());
+        increaseEnergy(publicKey, 1000);
+    }
+    rebuildSpectrumDigests();
+
+    auto checkSiblings = [&]()
+    {
+        // Second round is served from cache
+        for (int round = 0; round < 2; round++)
+        {
+            for (unsigned int i = 0; i < 100; i++)
+            {
+                const int index = spectrumIndex(publicKeys[i]);
+                m256i siblings[SPECTRUM_DEPTH], expectedSiblings[SPECTRUM_DEPTH];
+                getSpectrumSiblings(index, siblings);
+                getSiblings<SPECTRUM_DEPTH>(index, spectrumDigests, expectedSiblings);
+                EXPECT_EQ(memcmp(siblings, expectedSiblings, sizeof(siblings)), 0) << "entity " << i;
+            }
+        }
+    };
+    checkSiblings();
+
+    // Digest update without changes keeps cached siblings valid, changes invalidate them
+    long long digestsSequence = spectrumDigestsSequence;
+    updateSpectrumDigests();
+    EXPECT_EQ(spectrumDigestsSequence, digestsSequence);
+    increaseEnergy(publicKeys[500], 1);
+    updateSpectrumDigests();
+    EXPECT_NE(spectrumDigestsSequence, digestsSequence);
+    checkSiblings();
+
+    // Readers get consistent siblings while the digests are updated: the siblings of an unchanged entity always
+    // lead to one of the published root digests
+    const int fixedIndex = spectrumIndex(publicKeys[0]);
+    m256i fixedLeafDigest;
+    KangarooTwelve64To32(&spectrum[fixedIndex], &fixedLeafDigest);
+    std::vector<m256i> publishedRoots(1, spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1]);
+    std::atomic<bool> stop(false);
+    std::vector<std::vector<m256i>> readRoots(3);
+    std::vector<std::thread> readers;
+    for (unsigned int t = 0; t < readRoots.size(); t++)
+    {
+        readers.emplace_back([&, t]()
+            {
+                while (!stop && readRoots[t].size() < 100000)
+                {
+                    m256i siblings[SPECTRUM_DEPTH];
+                    getSpectrumSiblings(fixedIndex, siblings);
+                    readRoots[t].push_back(getRootFromSiblings(fixedIndex, fixedLeafDigest, siblings));
+                }
+            });
+    }
+    for (int round = 0; round < 50; round++)
+    {
+        for (int i = 0; i < 100; i++)
+            increaseEnergy(publicKeys[1 + test.rnd64() % (entityCount - 1)], 1);
+        ACQUIRE(spectrumLock);
+        updateSpectrumDigests();
+        publishedRoots.push_back(spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1]);
+        RELEASE(spectrumLock);
+    }
+    stop = true;
+    for (auto& reader : readers)
+        reader.join();
+    for (const auto& roots : readRoots)
+    {
+        EXPECT_FALSE(roots.empty());
+        for (const m256i& root : roots)
+        {
+            bool found = false;
+            for (const m256i& publishedRoot : publishedRoots)
+                found = found || (root == publishedRoot);
+            EXPECT_TRUE(found);
+            if (!found)
+                break;
+        }
+    }
+}
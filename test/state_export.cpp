@@ -0,0 +1,303 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#ifdef __linux__
+
+#include "extensions/state_export.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <random>
+
+
+static const std::filesystem::path testDirectory = std::filesystem::temp_directory_path() / "qubic_state_export_test";
+
+// Spectrum-like content: 64-byte entries, most of them empty
+static std::vector<unsigned char> createStateFile(const std::filesystem::path& path, unsigned long long size, unsigned long long seed)
+{
+    std::mt19937_64 gen64(seed);
+    std::vector<unsigned char> data(size, 0);
+    for (unsigned long long offset = 0; offset + 64 <= size; offset += 64)
+    {
+        if (gen64() % 4 == 0)
+        {
+            for (unsigned long long i = offset; i < offset + 32; i++)
+                data[i] = (unsigned char)gen64();
+            data[offset + 32] = (unsigned char)gen64();
+        }
+    }
+    std::ofstream(path, std::ios::binary).write((const char*)data.data(), data.size());
+    return data;
+}
+
+static unsigned int readZip16(const std::vector<unsigned char>& buffer, size_t offset)
+{
+    return buffer[offset] | (buffer[offset + 1] << 8);
+}
+
+static unsigned int readZip32(const std::vector<unsigned char>& buffer, size_t offset)
+{
+    return readZip16(buffer, offset) | (readZip16(buffer, offset + 2) << 16);
+}
+
+// Check the archive structure and return the decompressed content of its only entry
+static std::vector<unsigned char> extractZipArchive(const std::filesystem::path& path, const std::string& entryName)
+{
+    std::vector<unsigned char> archive(std::filesystem::file_size(path));
+    std::ifstream(path, std::ios::binary).read((char*)archive.data(), archive.size());
+
+    EXPECT_GE(archive.size(), 22u);
+    const size_t end = archive.size() - 22;
+    EXPECT_EQ(readZip32(archive, end), 0x06054b50u);
+    EXPECT_EQ(readZip16(archive, end + 10), 1u);
+    const size_t central = readZip32(archive, end + 16);
+    EXPECT_EQ(readZip32(archive, central), 0x02014b50u);
+    EXPECT_EQ(central + readZip32(archive, end + 12), end);
+
+    EXPECT_EQ(readZip32(archive, 0), 0x04034b50u);
+    EXPECT_EQ(readZip16(archive, 8), 8u);
+    EXPECT_EQ(std::string(archive.begin() + 30, archive.begin() + 30 + readZip16(archive, 26)), entryName);
+    const unsigned int crc = readZip32(archive, 14);
+    const unsigned int compressedSize = readZip32(archive, 18), uncompressedSize = readZip32(archive, 22);
+    EXPECT_EQ(readZip32(archive, central + 16), crc);
+    EXPECT_EQ(30 + entryName.size() + compressedSize, central);
+
+    std::vector<unsigned char> data(uncompressedSize + 1);
+    z_stream stream = {};
+    EXPECT_EQ(inflateInit2(&stream, -MAX_WBITS), Z_OK);
+    stream.next_in = archive.data() + 30 + entryName.size();
+    stream.avail_in = compressedSize;
+    stream.next_out = data.data();
+    stream.avail_out = (uInt)data.size();
+    EXPECT_EQ(inflate(&stream, Z_FINISH), Z_STREAM_END);
+    EXPECT_EQ(stream.avail_in, 0u);
+    data.resize(stream.total_out);
+    inflateEnd(&stream);
+    EXPECT_EQ(crc32(0, data.data(), (uInt)data.size()), crc);
+    return data;
+}
+
+TEST(TestStateExport, WriteZipArchive)
+{
+    std::filesystem::remove_all(testDirectory);
+    std::filesystem::create_directories(testDirectory);
+    const std::filesystem::path source = testDirectory / "spectrum.123";
+    const std::filesystem::path archive = testDirectory / "spectrum.zip";
+
+    // Empty file, single block, several rounds of blocks with a partial last block
+    for (unsigned long long size : { 0ull, 1000ull, 4096ull * 10 + 64 * 3 })
+    {
+        const std::vector<unsigned char> data = createStateFile(source, size, size);
+        for (unsigned int threads : { 1u, 3u })
+        {
+            unsigned int crc = 0;
+            std::string error;
+            EXPECT_TRUE(writeZipArchive(source.string(), "spectrum.123", archive.string(), crc, error, threads, 4096));
+            EXPECT_EQ(crc, crc32(0, data.data(), (uInt)data.size()));
+            EXPECT_EQ(extractZipArchive(archive, "spectrum.123"), data);
+        }
+    }
+
+    unsigned int crc = 0;
+    std::string error;
+    EXPECT_FALSE(writeZipArchive((testDirectory / "missing.123").string(), "missing.123", archive.string(), crc, error));
+    EXPECT_FALSE(error.empty());
+    std::filesystem::remove_all(testDirectory);
+}
+
+TEST(TestStateExport, WriteZipArchiveOfCompressedFile)
+{
+    std::filesystem::remove_all(testDirectory);
+    std::filesystem::create_directories(testDirectory);
+    const std::filesystem::path source = testDirectory / "spectrum.123";
+    const std::filesystem::path archive = testDirectory / "spectrum.zip";
+
+    // The chunks are copied, so the archive contains the original data (empty, single chunk, several chunks)
+    for (unsigned long long size : { 0ull, 1000ull, 4096ull * 10 + 64 * 3 })
+    {
+        const std::vector<unsigned char> data = createStateFile(source, size, size);
+        EXPECT_TRUE(writeCompressedFile(source.string(), data.data(), size, 3, 4096));
+        unsigned int crc = 0;
+        std::string error;
+        EXPECT_TRUE(writeZipArchive(source.string(), "spectrum.123", archive.string(), crc, error));
+        EXPECT_EQ(crc, crc32(0, data.data(), (uInt)data.size()));
+        EXPECT_EQ(extractZipArchive(archive, "spectrum.123"), data);
+    }
+    std::filesystem::remove_all(testDirectory);
+}
+
+static StateExport getStateExport(StateExportCache& cache, const std::string& sourcePath)
+{
+    std::mutex mutex;
+    std::condition_variable done;
+    bool finished = false;
+    StateExport result;
+    cache.get(sourcePath, [&](const StateExport& stateExport)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            result = stateExport;
+            finished = true;
+            done.notify_one();
+        });
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return finished; });
+    return result;
+}
+
+TEST(TestStateExport, CacheByEpochAndContent)
+{
+    std::filesystem::remove_all(testDirectory);
+    std::filesystem::create_directories(testDirectory);
+    const std::string exportDirectory = (testDirectory / "exports").string();
+    const std::filesystem::path source123 = testDirectory / "universe.123", source124 = testDirectory / "universe.124";
+    std::vector<unsigned char> data = createStateFile(source123, 100000, 1);
+    createStateFile(source124, 50000, 2);
+
+    // Outdated archives are deleted immediately
+    StateExportCache cache(exportDirectory, 2, 0);
+    const StateExport first = getStateExport(cache, source123.string());
+    ASSERT_FALSE(first.path.empty()) << first.error;
+    EXPECT_EQ(first.size, std::filesystem::file_size(first.path));
+    EXPECT_EQ(first.crc32, crc32(0, data.data(), (uInt)data.size()));
+    EXPECT_EQ(extractZipArchive(first.path, "universe.123"), data);
+
+    // Cached archive is reused
+    const auto firstWriteTime = std::filesystem::last_write_time(first.path);
+    EXPECT_EQ(getStateExport(cache, source123.string()).path, first.path);
+    EXPECT_EQ(std::filesystem::last_write_time(first.path), firstWriteTime);
+
+    // Changed content is exported again
+    data[0] ^= 1;
+    std::ofstream(source123, std::ios::binary).write((const char*)data.data(), data.size());
+    std::filesystem::last_write_time(source123, std::filesystem::last_write_time(source123) + std::chrono::seconds(1));
+    const StateExport changed = getStateExport(cache, source123.string());
+    ASSERT_FALSE(changed.path.empty()) << changed.error;
+    EXPECT_NE(changed.path, first.path);
+    EXPECT_FALSE(std::filesystem::exists(first.path));
+    EXPECT_EQ(extractZipArchive(changed.path, "universe.123"), data);
+
+    // Archive of the next epoch replaces the previous one
+    const StateExport next = getStateExport(cache, source124.string());
+    ASSERT_FALSE(next.path.empty()) << next.error;
+    EXPECT_FALSE(std::filesystem::exists(changed.path));
+    EXPECT_EQ(std::distance(std::filesystem::directory_iterator(exportDirectory), std::filesystem::directory_iterator()), 1);
+
+    // Concurrent requests share one build
+    std::vector<StateExport> results(8);
+    std::vector<std::thread> requests;
+    for (auto& result : results)
+        requests.emplace_back([&] { result = getStateExport(cache, source123.string()); });
+    for (auto& request : requests)
+        request.join();
+    for (auto& result : results)
+        EXPECT_EQ(result.path, results[0].path);
+
+    EXPECT_FALSE(getStateExport(cache, (testDirectory / "universe.125").string()).error.empty());
+    std::filesystem::remove_all(testDirectory);
+}
+
+TEST(TestStateExport, DelayedRemovalOfOutdatedArchives)
+{
+    std::filesystem::remove_all(testDirectory);
+    std::filesystem::create_directories(testDirectory);
+    const std::string exportDirectory = (testDirectory / "exports").string();
+    const std::filesystem::path source123 = testDirectory / "spectrum.123", source124 = testDirectory / "spectrum.124";
+    createStateFile(source123, 100000, 1);
+    const std::vector<unsigned char> data124 = createStateFile(source124, 50000, 2);
+
+    StateExportCache cache(exportDirectory, 2, 1);
+    const StateExport first = getStateExport(cache, source123.string());
+    ASSERT_FALSE(first.path.empty()) << first.error;
+
+    // The archive of the previous epoch can still be sent by responses that have been created before
+    const StateExport next = getStateExport(cache, source124.string());
+    ASSERT_FALSE(next.path.empty()) << next.error;
+    EXPECT_TRUE(std::filesystem::exists(first.path));
+    EXPECT_EQ(getStateExport(cache, source124.string()).path, next.path);
+    EXPECT_TRUE(std::filesystem::exists(first.path));
+
+    // It is deleted by the first request after the delay
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    EXPECT_EQ(getStateExport(cache, source124.string()).path, next.path);
+    EXPECT_FALSE(std::filesystem::exists(first.path));
+    EXPECT_EQ(extractZipArchive(next.path, "spectrum.124"), data124);
+    std::filesystem::remove_all(testDirectory);
+}
+
+TEST(TestStateExport, ParseByteRange)
+{
+    unsigned long long offset, length;
+    EXPECT_EQ(parseByteRange("", 1000, offset, length), ByteRangeFull);
+    EXPECT_EQ(length, 1000u);
+    EXPECT_EQ(parseByteRange("bytes=0-99,200-299", 1000, offset, length), ByteRangeFull);
+    EXPECT_EQ(parseByteRange("items=0-99", 1000, offset, length), ByteRangeFull);
+    EXPECT_EQ(parseByteRange("bytes=a-b", 1000, offset, length), ByteRangeFull);
+
+    EXPECT_EQ(parseByteRange("bytes=100-199", 1000, offset, length), ByteRangePartial);
+    EXPECT_EQ(offset, 100u);
+    EXPECT_EQ(length, 100u);
+    EXPECT_EQ(parseByteRange("bytes=900-", 1000, offset, length), ByteRangePartial);
+    EXPECT_EQ(offset, 900u);
+    EXPECT_EQ(length, 100u);
+    EXPECT_EQ(parseByteRange("bytes=900-5000", 1000, offset, length), ByteRangePartial);
+    EXPECT_EQ(length, 100u);
+    EXPECT_EQ(parseByteRange("bytes=-10", 1000, offset, length), ByteRangePartial);
+    EXPECT_EQ(offset, 990u);
+    EXPECT_EQ(length, 10u);
+    EXPECT_EQ(parseByteRange("bytes=-5000", 1000, offset, length), ByteRangePartial);
+    EXPECT_EQ(offset, 0u);
+    EXPECT_EQ(length, 1000u);
+
+    // Values beyond the size of any file are clamped like other values beyond the end of the file
+    EXPECT_EQ(parseByteRange("bytes=100-99999999999999999999999", 1000, offset, length), ByteRangePartial);
+    EXPECT_EQ(offset, 100u);
+    EXPECT_EQ(length, 900u);
+    EXPECT_EQ(parseByteRange("bytes=-99999999999999999999999", 1000, offset, length), ByteRangePartial);
+    EXPECT_EQ(offset, 0u);
+    EXPECT_EQ(length, 1000u);
+    EXPECT_EQ(parseByteRange("bytes=00000000000000000000100-00000000000000000000199", 1000, offset, length), ByteRangePartial);
+    EXPECT_EQ(offset, 100u);
+    EXPECT_EQ(length, 100u);
+
+    EXPECT_EQ(parseByteRange("bytes=1000-", 1000, offset, length), ByteRangeUnsatisfiable);
+    EXPECT_EQ(parseByteRange("bytes=200-100", 1000, offset, length), ByteRangeUnsatisfiable);
+    EXPECT_EQ(parseByteRange("bytes=-0", 1000, offset, length), ByteRangeUnsatisfiable);
+    EXPECT_EQ(parseByteRange("bytes=99999999999999999999999-", 1000, offset, length), ByteRangeUnsatisfiable);
+}
+
+// Compare with the previous implementation of the HTTP export, which ran "zip -j" for each request
+TEST(TestStateExport, BenchmarkAgainstZipCommand)
+{
+    if (system("zip -v > /dev/null 2>&1") != 0)
+        GTEST_SKIP() << "zip is not installed";
+
+    std::filesystem::remove_all(testDirectory);
+    std::filesystem::create_directories(testDirectory);
+    const std::filesystem::path source = testDirectory / "spectrum.123";
+    const unsigned long long size = 256ULL * 1024 * 1024;
+    createStateFile(source, size, 3);
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    const std::string command = "zip -q -j " + (testDirectory / "command.zip").string() + " " + source.string();
+    EXPECT_EQ(system(command.c_str()), 0);
+    auto zipCommandMicroSec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    StateExportCache cache((testDirectory / "exports").string());
+    startTime = std::chrono::high_resolution_clock::now();
+    const StateExport stateExport = getStateExport(cache, source.string());
+    auto exportMicroSec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+    ASSERT_FALSE(stateExport.path.empty()) << stateExport.error;
+
+    startTime = std::chrono::high_resolution_clock::now();
+    EXPECT_EQ(getStateExport(cache, source.string()).path, stateExport.path);
+    auto cachedMicroSec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    std::cout << "zip -j: " << size / (zipCommandMicroSec + 1.0) << " MB/s, " << std::filesystem::file_size(testDirectory / "command.zip") << " bytes" << std::endl;
+    std::cout << "StateExportCache: " << size / (exportMicroSec + 1.0) << " MB/s, " << stateExport.size << " bytes, "
+        << cachedMicroSec << " us when cached" << std::endl;
+    std::filesystem::remove_all(testDirectory);
+}
+
+#endif
@@ -0,0 +1,53 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/ticking/tick_storage.h"
+
+#include <memory>
+#include <random>
+
+
+TEST(TestCoreTickDataDigestIndex, FindSlot)
+{
+    std::mt19937_64 gen64(42);
+    auto randomDigest = [&gen64]()
+    {
+        return m256i(gen64(), gen64(), gen64(), gen64());
+    };
+
+    std::unique_ptr<TickData> tickData(new TickData);
+    TickData& td = *tickData;
+    TickStorage::tickDataDigestIndex.reset();
+
+    for (unsigned int numberOfTransactions : { 0u, 1u, 100u, (unsigned int)NUMBER_OF_TRANSACTIONS_PER_TICK })
+    {
+        setMem(&td, sizeof(td), 0);
+        td.tick = 1000 + numberOfTransactions;
+        for (unsigned int i = 0; i < numberOfTransactions; ++i)
+        {
+            td.transactionDigests[gen64() % NUMBER_OF_TRANSACTIONS_PER_TICK] = randomDigest();
+        }
+
+        // table is built on first use
+        for (unsigned int slot = 0; slot < NUMBER_OF_TRANSACTIONS_PER_TICK; ++slot)
+        {
+            if (!isZero(td.transactionDigests[slot]))
+            {
+                EXPECT_EQ(TickStorage::tickDataDigestIndex.findSlot(td, td.transactionDigests[slot]), (int)slot);
+            }
+        }
+        EXPECT_EQ(TickStorage::tickDataDigestIndex.findSlot(td, randomDigest()), -1);
+
+        // changed tick data is found after calling build()
+        const unsigned int changedSlot = (unsigned int)(gen64() % NUMBER_OF_TRANSACTIONS_PER_TICK);
+        const m256i oldDigest = td.transactionDigests[changedSlot];
+        td.transactionDigests[changedSlot] = randomDigest();
+        TickStorage::tickDataDigestIndex.build(td);
+        EXPECT_EQ(TickStorage::tickDataDigestIndex.findSlot(td, td.transactionDigests[changedSlot]), (int)changedSlot);
+        if (!isZero(oldDigest))
+        {
+            EXPECT_EQ(TickStorage::tickDataDigestIndex.findSlot(td, oldDigest), -1);
+        }
+    }
+}
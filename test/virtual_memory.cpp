@@ -7,6 +7,7 @@
 
 #include <cstring>
 #include <random>
+#include <thread>
 
 #include "network_messages/transactions.h"
 
@@ -452,4 +453,223 @@ TEST(TestSwapVirtualMemory, TestSwapVirtualMemory_TestCacheBuffer)
             EXPECT_TRUE((uint64_t)tx == (uint64_t)test_vm.getCacheBuffer(0) + i * test_vm.getPageSize());
         }
     }
-}
\ No newline at end of file
+}
+TEST(TestSwapVirtualMemory, TestSwapVirtualMemory_PinnedPagesAreNotEvicted)
+{
+    initFilesystem();
+    registerAsynFileIO(NULL);
+
+    constexpr unsigned long long pageCapacity = 16;
+    constexpr unsigned long long numCachePage = 4;
+    SwapVirtualMemory<unsigned long long, wcharToNumber(L"pinp"), wcharToNumber(L"data"), pageCapacity, numCachePage, INDEX_MODE, 0> test_vm;
+    test_vm.init();
+
+    // pin elements of two pages
+    unsigned long long* pinned0 = test_vm.pin(5);
+    unsigned long long* pinned1 = test_vm.pin(3 * pageCapacity + 1);
+    *pinned0 = 1234;
+    *pinned1 = 5678;
+
+    // access many other pages from another thread, which evicts all unpinned pages several times
+    std::thread other([&test_vm]()
+        {
+            for (unsigned long long i = 4 * pageCapacity; i < 200 * pageCapacity; i++)
+                test_vm(i) = i;
+        });
+    other.join();
+
+    // pointers to pinned elements still point to the cached pages
+    EXPECT_EQ(test_vm.getPtr(5), pinned0);
+    EXPECT_EQ(test_vm.getPtr(3 * pageCapacity + 1), pinned1);
+    EXPECT_EQ(*pinned0, 1234);
+    EXPECT_EQ(*pinned1, 5678);
+
+    // after unpinning, pages can be evicted and reloaded
+    test_vm.unpin(5);
+    test_vm.unpin(3 * pageCapacity + 1);
+    for (unsigned long long i = 200 * pageCapacity; i < 300 * pageCapacity; i++)
+        test_vm(i) = i;
+    EXPECT_EQ(test_vm(5), 1234);
+    EXPECT_EQ(test_vm(3 * pageCapacity + 1), 5678);
+    for (unsigned long long i = 4 * pageCapacity; i < 300 * pageCapacity; i += 7)
+        EXPECT_EQ(test_vm(i), i);
+}
+
+TEST(TestSwapVirtualMemory, TestSwapVirtualMemory_BackgroundWriteAndPrefetch)
+{
+    initFilesystem();
+    registerAsynFileIO(NULL);
+    EXPECT_TRUE(SwapIOWorkers::start(2));
+
+    {
+        constexpr unsigned long long pageCapacity = 64;
+        constexpr unsigned long long numCachePage = 4;
+        constexpr unsigned long long numPages = 100;
+        SwapVirtualMemory<unsigned long long, wcharToNumber(L"pref"), wcharToNumber(L"data"), pageCapacity, numCachePage, INDEX_MODE, 0> test_vm;
+        test_vm.init();
+
+        // sequential writes evict pages to background writes
+        for (unsigned long long i = 0; i < numPages * pageCapacity; i++)
+            test_vm(i) = i * 3 + 1;
+        VirtualMemoryCacheStatistics stats = test_vm.getCacheStatistics();
+        EXPECT_EQ(stats.misses, numPages - 1); // page 0 is in cache after init
+        EXPECT_EQ(stats.hits + stats.misses, numPages * pageCapacity);
+
+        // sequential reads are served by prefetching
+        for (unsigned long long i = 0; i < numPages * pageCapacity; i++)
+            EXPECT_EQ(*test_vm[i], i * 3 + 1);
+        stats = test_vm.getCacheStatistics();
+        EXPECT_GT(stats.prefetchHits, 0);
+        EXPECT_LE(stats.prefetchHits, stats.misses);
+
+        // random access and modification while pages are written and prefetched in background
+        std::mt19937_64 gen64(42);
+        for (int i = 0; i < 20000; i++)
+        {
+            unsigned long long index = gen64() % (numPages * pageCapacity);
+            if (i % 3 == 0)
+                test_vm(index) = index * 3 + 1;
+            else
+                EXPECT_EQ(test_vm(index), index * 3 + 1);
+        }
+        for (unsigned long long i = 0; i < numPages * pageCapacity; i++)
+            EXPECT_EQ(test_vm(i), i * 3 + 1);
+    }
+
+    SwapIOWorkers::stop();
+    EXPECT_FALSE(SwapIOWorkers::isRunning());
+}
+
+#ifdef __linux__
+TEST(TestMappedSwapVirtualMemory, IndexModeRandomAccessAndPersistence)
+{
+    struct TxHashMapEntry {
+        m256i digest;
+        unsigned long long offset;
+    };
+    constexpr unsigned long long numEntries = 1024 * 128;
+    std::mt19937_64 gen64(42);
+    std::vector<unsigned long long> expected(numEntries, 0);
+    std::vector<unsigned char> state;
+
+    {
+        MappedSwapVirtualMemory<TxHashMapEntry, wcharToNumber(L"mtxd"), wcharToNumber(L"data"), 64, 64, INDEX_MODE, 0> test_vm;
+        ASSERT_TRUE(test_vm.init(numEntries * sizeof(TxHashMapEntry), /*randomAccess=*/true));
+        test_vm.reset();
+
+        // pages that haven't been written read as zeros
+        EXPECT_EQ(test_vm.getRef(numEntries - 1).offset, 0);
+
+        for (int i = 0; i < numEntries; i++)
+        {
+            unsigned long long index = gen64() % numEntries;
+            expected[index] = gen64() | 1;
+            TxHashMapEntry& entry = test_vm.getRef(index);
+            entry.digest = m256i(expected[index], 0, 0, 0);
+            entry.offset = expected[index];
+        }
+
+        for (unsigned long long i = 0; i < numEntries; i++)
+        {
+            EXPECT_EQ(test_vm.getPtr(i)->offset, expected[i]);
+            EXPECT_EQ(test_vm(i).digest.m256i_u64[0], expected[i]);
+        }
+
+        state.resize(test_vm.getVmStateSize());
+        EXPECT_EQ(test_vm.dumpVMState(state.data()), state.size());
+        test_vm.deinit();
+    }
+
+    {
+        // data in file is only used after loading the VM state
+        MappedSwapVirtualMemory<TxHashMapEntry, wcharToNumber(L"mtxd"), wcharToNumber(L"data"), 64, 64, INDEX_MODE, 0> test_vm;
+        ASSERT_TRUE(test_vm.init(numEntries * sizeof(TxHashMapEntry)));
+        EXPECT_EQ(test_vm.loadVMState(state.data()), state.size());
+        for (unsigned long long i = 0; i < numEntries; i++)
+            EXPECT_EQ(test_vm.getRef(i).offset, expected[i]);
+        test_vm.deinit();
+    }
+
+    {
+        MappedSwapVirtualMemory<TxHashMapEntry, wcharToNumber(L"mtxd"), wcharToNumber(L"data"), 64, 64, INDEX_MODE, 0> test_vm;
+        ASSERT_TRUE(test_vm.init(numEntries * sizeof(TxHashMapEntry)));
+        for (unsigned long long i = 0; i < numEntries; i++)
+            EXPECT_EQ(test_vm.getRef(i).offset, 0);
+        test_vm.deinit();
+    }
+}
+
+TEST(TestMappedSwapVirtualMemory, LoadStateOfDumpTime)
+{
+    constexpr unsigned long long numEntries = 64 * 1024;
+    std::vector<unsigned char> state;
+
+    {
+        MappedSwapVirtualMemory<unsigned long long, wcharToNumber(L"msnp"), wcharToNumber(L"data"), 1024, 64, INDEX_MODE, 0> test_vm;
+        ASSERT_TRUE(test_vm.init(numEntries * sizeof(unsigned long long)));
+        test_vm.reset();
+        for (unsigned long long i = 0; i < numEntries / 2; i++)
+            test_vm(i) = i + 1;
+
+        state.resize(test_vm.getVmStateSize());
+        EXPECT_EQ(test_vm.dumpVMState(state.data()), state.size());
+
+        // changes after the dump are not part of the saved state
+        for (unsigned long long i = 0; i < numEntries; i++)
+            test_vm(i) = 0xffffffff;
+        test_vm.deinit();
+    }
+
+    {
+        MappedSwapVirtualMemory<unsigned long long, wcharToNumber(L"msnp"), wcharToNumber(L"data"), 1024, 64, INDEX_MODE, 0> test_vm;
+        ASSERT_TRUE(test_vm.init(numEntries * sizeof(unsigned long long)));
+        EXPECT_EQ(test_vm.loadVMState(state.data()), state.size());
+        for (unsigned long long i = 0; i < numEntries; i++)
+            EXPECT_EQ(test_vm(i), (i < numEntries / 2) ? i + 1 : 0);
+
+        // the state can be loaded again after changing data
+        test_vm(0) = 0xffffffff;
+        EXPECT_EQ(test_vm.loadVMState(state.data()), state.size());
+        EXPECT_EQ(test_vm(0), 1);
+        test_vm.deinit();
+    }
+}
+
+TEST(TestMappedSwapVirtualMemory, OffsetModeLinearAccess)
+{
+    MappedSwapVirtualMemory<Transaction, wcharToNumber(L"moff"), wcharToNumber(L"data"), 2, 64, OFFSET_MODE, SIGNATURE_SIZE + MAX_INPUT_SIZE> test_vm;
+    constexpr unsigned long long size = 64 * 1024 * 1024;
+    ASSERT_TRUE(test_vm.init(size));
+
+    // write transactions of random size back to back, crossing page boundaries
+    std::mt19937_64 gen64(1234);
+    std::vector<unsigned long long> offsets;
+    unsigned long long offset = 0;
+    while (offset + MAX_TRANSACTION_SIZE < size)
+    {
+        Transaction* tx = test_vm[offset];
+        tx->amount = offset;
+        tx->inputSize = gen64() % MAX_INPUT_SIZE;
+        tx->tick = (unsigned int)offsets.size();
+        unsigned char* input = (unsigned char*)(tx + 1);
+        for (unsigned int i = 0; i < tx->inputSize; i++)
+            input[i] = (unsigned char)(offset + i);
+        offsets.push_back(offset);
+        offset += tx->totalSize();
+    }
+
+    for (size_t i = 0; i < offsets.size(); i++)
+    {
+        const Transaction* tx = test_vm[offsets[i]];
+        EXPECT_EQ(tx->amount, offsets[i]);
+        EXPECT_EQ(tx->tick, i);
+        const unsigned char* input = (const unsigned char*)(tx + 1);
+        for (unsigned int j = 0; j < tx->inputSize; j++)
+            EXPECT_EQ(input[j], (unsigned char)(offsets[i] + j));
+    }
+
+    test_vm.reset();
+    EXPECT_EQ(test_vm[offsets.back()]->amount, 0);
+    test_vm.deinit();
+}
+#endif